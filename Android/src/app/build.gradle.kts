@@ -72,6 +72,14 @@ android {
   // NDK configuration for optimal LLM performance
   ndkVersion = "27.2.12479018"
 
+  // Native CPU inference engine (libmlc_llm_jni)
+  externalNativeBuild {
+    cmake {
+      path = file("src/main/cpp/CMakeLists.txt")
+      version = "3.22.1"
+    }
+  }
+
   compileOptions {
     sourceCompatibility = JavaVersion.VERSION_11
     targetCompatibility = JavaVersion.VERSION_11
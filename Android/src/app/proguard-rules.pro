@@ -32,6 +32,13 @@
     native <methods>;
 }
 
+# Native CPU engine calls NativeTokenCallback methods by name from C++
+-keep interface com.google.ai.edge.gallery.llm.engine.NativeTokenCallback { *; }
+-keepclassmembers class * implements com.google.ai.edge.gallery.llm.engine.NativeTokenCallback {
+    public void onTokensAvailable();
+    public void onComplete(int, int, double, double, int, double);
+}
+
 # ============================================================================
 # Kotlin Serialization
 # ============================================================================
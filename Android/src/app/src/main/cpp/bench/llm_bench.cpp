@@ -0,0 +1,281 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Host benchmark for the CPU engine.
+ *
+ *   llm_bench <model_dir> [-p prompt] [-n max_tokens] [-c context]
+ *             [-b batch] [-k f32|f16|q8_0|q4_0] [-t threads] [-s seed]
+ *             [--temp t] [--raw] [--turns n] [--eager] [--repack dir]
+ *             [--kernels name] [--f32-activations] [--unfused-attention]
+ *             [--spin us] [--no-pin] [--tokenize file]
+ *             [--grammar file | --json-schema file]
+ *
+ * The prompt is wrapped in the qwen2 chat template unless --raw is
+ * given. Prints the generated text followed by prefill and decode
+ * throughput. --turns asks the prompt n times as one chat, resending
+ * the whole transcript each turn as the app does, and reports each
+ * turn's prefill time and cached-prefix reuse. --eager waits for every
+ * layer to be resident (and verified) before the first prompt instead of
+ * warming them behind it. --repack keeps kernel-layout weights in dir,
+ * building them on the first run. --kernels runs the q4 kernel variant
+ * name (see q4KernelVariants()), and the KV cache kernels of its level,
+ * instead of the best one for this CPU.
+ * --f32-activations keeps repacked matmuls on float activations where
+ * the int8 kernels would otherwise be used. --unfused-attention turns
+ * off EngineOptions::useFlashAttention. --spin sets how long idle pool
+ * threads spin before sleeping and --no-pin leaves them unpinned (see
+ * ThreadPoolOptions). --tokenize encodes the contents of file (say a long
+ * paste of code) over and over and reports tokenizer throughput instead
+ * of running the model. --grammar (GBNF) and --json-schema constrain
+ * the reply to the grammar in file and report what building and
+ * applying its token masks cost.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include "cpu_features.h"
+#include "engine.h"
+#include "grammar.h"
+#include "kernels.h"
+#include "kv_quant.h"
+
+namespace {
+
+void usage() {
+    std::fprintf(stderr,
+                 "usage: llm_bench <model_dir> [-p prompt] [-n max_tokens] [-c context]\n"
+                 "                 [-b batch] [-k f32|f16|q8_0|q4_0] [-t threads] [-s seed]\n"
+                 "                 [--temp t] [--raw] [--turns n] [--eager]\n"
+                 "                 [--repack dir] [--kernels name] [--f32-activations]\n"
+                 "                 [--unfused-attention] [--spin us] [--no-pin]\n"
+                 "                 [--tokenize file] [--grammar file | --json-schema file]\n");
+}
+
+bool parseKvCacheType(const char* name, nimittam::KvCacheType* out) {
+    static const struct {
+        const char* name;
+        nimittam::KvCacheType type;
+    } kTypes[] = {{"f32", nimittam::KvCacheType::F32},
+                  {"f16", nimittam::KvCacheType::F16},
+                  {"q8_0", nimittam::KvCacheType::Q8_0},
+                  {"q4_0", nimittam::KvCacheType::Q4_0}};
+    for (const auto& entry : kTypes) {
+        if (!std::strcmp(name, entry.name)) {
+            *out = entry.type;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool readFile(const std::string& path, std::string* out) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::fprintf(stderr, "cannot read %s\n", path.c_str());
+        return false;
+    }
+    std::stringstream contents;
+    contents << file.rdbuf();
+    *out = contents.str();
+    return true;
+}
+
+/** Encode [path] repeatedly for about a second and print MB/s. */
+int benchTokenizer(const nimittam::Tokenizer& tokenizer, const std::string& path) {
+    std::string text;
+    if (!readFile(path, &text)) return 1;
+
+    size_t tokens = tokenizer.encode(text).size();  // warm-up
+    int runs = 0;
+    const auto start = std::chrono::steady_clock::now();
+    double seconds = 0.0;
+    while (seconds < 1.0) {
+        tokens = tokenizer.encode(text).size();
+        ++runs;
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    std::printf("tokenize:         %zu bytes -> %zu tokens (%.2f bytes/token)\n", text.size(),
+                tokens, tokens > 0 ? static_cast<double>(text.size()) / tokens : 0.0);
+    std::printf("tokenize:         %.3f ms per run, %.1f MB/s\n", seconds * 1000.0 / runs,
+                text.size() * runs / seconds / (1 << 20));
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        usage();
+        return 2;
+    }
+
+    std::string modelDir = argv[1];
+    std::string prompt = "Explain in two sentences why the sky is blue.";
+    int maxTokens = 64;
+    bool raw = false;
+    int turns = 1;
+    std::string tokenizeFile;
+    std::string grammarFile;
+    bool grammarIsSchema = false;
+    nimittam::EngineOptions options;
+    options.contextSize = 2048;
+    nimittam::SamplingParams sampling;
+    sampling.temperature = 0.0f;
+
+    for (int i = 2; i < argc; ++i) {
+        auto next = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                usage();
+                std::exit(2);
+            }
+            return argv[++i];
+        };
+        if (!std::strcmp(argv[i], "-p")) prompt = next();
+        else if (!std::strcmp(argv[i], "-n")) maxTokens = std::atoi(next());
+        else if (!std::strcmp(argv[i], "-c")) options.contextSize = std::atoi(next());
+        else if (!std::strcmp(argv[i], "-b")) options.batchSize = std::atoi(next());
+        else if (!std::strcmp(argv[i], "-k")) {
+            if (!parseKvCacheType(next(), &options.kvCacheType)) {
+                usage();
+                return 2;
+            }
+        }
+        else if (!std::strcmp(argv[i], "-t")) options.threads = std::atoi(next());
+        else if (!std::strcmp(argv[i], "-s")) sampling.seed = std::atoll(next());
+        else if (!std::strcmp(argv[i], "--temp")) sampling.temperature = std::strtof(next(), nullptr);
+        else if (!std::strcmp(argv[i], "--raw")) raw = true;
+        else if (!std::strcmp(argv[i], "--turns")) turns = std::atoi(next());
+        else if (!std::strcmp(argv[i], "--eager")) options.lazyWeights = false;
+        else if (!std::strcmp(argv[i], "--repack")) options.repackDir = next();
+        else if (!std::strcmp(argv[i], "--f32-activations")) options.int8Activations = false;
+        else if (!std::strcmp(argv[i], "--unfused-attention")) options.useFlashAttention = false;
+        else if (!std::strcmp(argv[i], "--spin")) options.spinMicros = std::atoi(next());
+        else if (!std::strcmp(argv[i], "--no-pin")) options.pinThreads = false;
+        else if (!std::strcmp(argv[i], "--tokenize")) tokenizeFile = next();
+        else if (!std::strcmp(argv[i], "--grammar")) grammarFile = next();
+        else if (!std::strcmp(argv[i], "--json-schema")) {
+            grammarFile = next();
+            grammarIsSchema = true;
+        }
+        else if (!std::strcmp(argv[i], "--kernels")) {
+            const char* name = next();
+            if (!nimittam::useQ4Kernels(name)) {
+                std::fprintf(stderr, "q4 kernels '%s' not available on this CPU\n", name);
+                return 2;
+            }
+        }
+        else {
+            usage();
+            return 2;
+        }
+    }
+
+    std::string error;
+    const auto loadStart = std::chrono::steady_clock::now();
+    auto engine = nimittam::Engine::create(modelDir, options, &error);
+    if (!engine) {
+        std::fprintf(stderr, "failed to load model: %s\n", error.c_str());
+        return 1;
+    }
+    std::printf("load:             %.1f ms (%.0f%% of weights resident)\n",
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+                                                          loadStart).count(),
+                engine->warmUpProgress() * 100.0f);
+    std::printf("cpu:              %s (q4 kernels %s, KV kernels %s, %s activations)\n",
+                nimittam::cpuFeatureList().c_str(), nimittam::q4KernelName(),
+                nimittam::kvQuantKernelName(), engine->int8Activations() ? "int8" : "f32");
+    if (!tokenizeFile.empty()) return benchTokenizer(engine->tokenizer(), tokenizeFile);
+
+    std::unique_ptr<nimittam::GrammarMatcher> grammar;
+    if (!grammarFile.empty()) {
+        std::string source;
+        if (!readFile(grammarFile, &source)) return 1;
+        const auto grammarStart = std::chrono::steady_clock::now();
+        auto compiled = std::make_shared<nimittam::Grammar>();
+        const bool ok = grammarIsSchema
+                            ? nimittam::Grammar::fromJsonSchema(source, compiled.get(), &error)
+                            : nimittam::Grammar::parse(source, compiled.get(), &error);
+        if (!ok) {
+            std::fprintf(stderr, "%s: %s\n", grammarFile.c_str(), error.c_str());
+            return 1;
+        }
+        const nimittam::ModelConfig& config = engine->modelConfig();
+        grammar = std::make_unique<nimittam::GrammarMatcher>(
+            std::move(compiled), engine->tokenizer(), config.vocabSize, config.stopTokenIds);
+        std::printf("grammar:          %.1f ms to compile\n",
+                    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+                                                              grammarStart).count());
+        engine->setGrammar(grammar.get());
+    }
+
+    if (turns > 1) {
+        std::string transcript = "<|im_start|>system\nYou are a helpful assistant.<|im_end|>\n";
+        for (int turn = 1; turn <= turns; ++turn) {
+            transcript += "<|im_start|>user\n" + prompt + "<|im_end|>\n<|im_start|>assistant\n";
+            if (engine->prefillTranscript(transcript) < 0) {
+                std::fprintf(stderr, "turn %d does not fit in the context\n", turn);
+                return 1;
+            }
+            const nimittam::EngineStats prefillStats = engine->stats();
+            std::string reply;
+            std::string piece;
+            if (grammar) grammar->reset();
+            while (engine->generate(maxTokens, sampling, &piece)) reply += piece;
+            transcript += reply + "<|im_end|>\n";
+            std::printf("turn %2d: %4d cached + %3d prefilled tokens in %7.1f ms, %3d generated\n",
+                        turn, prefillStats.reusedTokens, prefillStats.promptTokens,
+                        prefillStats.prefillMs, engine->stats().generatedTokens);
+        }
+        return 0;
+    }
+
+    if (!raw) {
+        prompt = "<|im_start|>system\nYou are a helpful assistant.<|im_end|>\n"
+                 "<|im_start|>user\n" + prompt + "<|im_end|>\n<|im_start|>assistant\n";
+    }
+
+    if (engine->prefill(prompt) < 0) {
+        std::fprintf(stderr, "prompt does not fit in the context\n");
+        return 1;
+    }
+
+    std::string piece;
+    while (engine->generate(maxTokens, sampling, &piece)) {
+        std::fwrite(piece.data(), 1, piece.size(), stdout);
+        std::fflush(stdout);
+    }
+    std::printf("\n\n");
+
+    const nimittam::EngineStats& stats = engine->stats();
+    std::printf("prompt tokens:    %d\n", stats.promptTokens);
+    std::printf("prefill chunks:   %d (slowest %.1f ms)\n", stats.prefillChunks, stats.maxChunkMs);
+    std::printf("prefill:          %.1f ms (%.2f tok/s)\n", stats.prefillMs,
+                stats.prefillTokensPerSecond());
+    std::printf("generated tokens: %d\n", stats.generatedTokens);
+    std::printf("decode:           %.1f ms (%.2f tok/s)\n", stats.decodeMs,
+                stats.decodeTokensPerSecond());
+    std::printf("sampling:         %.1f ms (%.1f%% of decode)\n", stats.sampleMs,
+                stats.decodeMs > 0.0 ? stats.sampleMs * 100.0 / stats.decodeMs : 0.0);
+    if (grammar) {
+        std::printf("grammar:          %s, %zu states, %zu masks cached\n",
+                    grammar->isComplete() ? "complete" : "incomplete", grammar->cachedStates(),
+                    grammar->cachedMasks());
+    }
+    std::printf("kv cache in use:  %zu KB\n", engine->kvCacheBytesInUse() >> 10);
+    std::printf("activations:      %zu KB peak of %zu KB reserved\n",
+                engine->activationHighWater() >> 10, engine->activationBytes() >> 10);
+    return 0;
+}
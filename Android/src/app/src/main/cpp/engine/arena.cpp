@@ -0,0 +1,53 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "arena.h"
+
+#include <sys/mman.h>
+
+#include <algorithm>
+
+namespace nimittam {
+
+Arena::~Arena() {
+    release();
+}
+
+void Arena::release() {
+    if (base_) munmap(base_, capacity_);
+    base_ = nullptr;
+    capacity_ = used_ = highWater_ = 0;
+}
+
+bool Arena::reserve(size_t bytes, std::string* error) {
+    release();
+    capacity_ = alignedSize(bytes);
+    if (capacity_ == 0) return true;
+    // A page-aligned mapping, so every slice is line-aligned too.
+    void* base = mmap(nullptr, capacity_, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        *error = "failed to reserve " + std::to_string(capacity_ >> 10) +
+                 " KB for the activation arena";
+        capacity_ = 0;
+        return false;
+    }
+    base_ = static_cast<uint8_t*>(base);
+    return true;
+}
+
+void* Arena::allocateBytes(size_t bytes) {
+    const size_t size = alignedSize(bytes);
+    if (size > capacity_ - used_) return nullptr;
+    void* slice = base_ + used_;
+    used_ += size;
+    highWater_ = std::max(highWater_, used_);
+    return slice;
+}
+
+} // namespace nimittam
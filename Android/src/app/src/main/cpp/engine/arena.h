@@ -0,0 +1,72 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Bump allocator for one forward pass's activations.
+ *
+ * The arena reserves one block up front and hands out consecutive
+ * slices of it, each starting on a 64-byte cache line. reset() takes
+ * them all back at once, so a step does no heap work and two buffers
+ * never share a line. The owner plans the capacity from the model shape
+ * before anything runs; highWater() records the most any step has used.
+ * Pages are only backed once written, so a session that never prefills
+ * a full chunk never pays for one.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace nimittam {
+
+class Arena {
+public:
+    static constexpr size_t kAlignment = 64;
+
+    /** [bytes] rounded up to a whole number of kAlignment slices. */
+    static constexpr size_t alignedSize(size_t bytes) {
+        return (bytes + kAlignment - 1) & ~(kAlignment - 1);
+    }
+
+    Arena() = default;
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    /** Reserve [bytes], dropping any earlier reservation and everything allocated from it. */
+    bool reserve(size_t bytes, std::string* error);
+
+    /** Uninitialized room for [count] Ts; nullptr once the capacity is used up. */
+    template <typename T>
+    T* allocate(size_t count) {
+        return static_cast<T*>(allocateBytes(count * sizeof(T)));
+    }
+
+    void* allocateBytes(size_t bytes);
+
+    /** Hand back every allocation; the memory stays reserved. */
+    void reset() { used_ = 0; }
+
+    size_t capacity() const { return capacity_; }
+    size_t used() const { return used_; }
+    /** Most bytes allocated between two resets since reserve(). */
+    size_t highWater() const { return highWater_; }
+
+private:
+    void release();
+
+    uint8_t* base_ = nullptr;
+    size_t capacity_ = 0;
+    size_t used_ = 0;
+    size_t highWater_ = 0;
+};
+
+} // namespace nimittam
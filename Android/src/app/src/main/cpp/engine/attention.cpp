@@ -0,0 +1,184 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "attention.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "kernels.h"
+#include "kv_quant.h"
+
+namespace nimittam {
+
+namespace {
+
+// q . K[offset, offset + headDim) for a cached key row of [type].
+inline float kvDot(KvCacheType type, const float* q, const void* row, int offset, int headDim) {
+    switch (type) {
+        case KvCacheType::F32:
+            return dot(q, static_cast<const float*>(row) + offset, headDim);
+        case KvCacheType::F16:
+            return dotHalf(q, static_cast<const uint16_t*>(row) + offset, headDim);
+        case KvCacheType::Q8_0:
+            return dotQ8_0(q, static_cast<const BlockQ8_0*>(row) + offset / kKvQuantBlock,
+                           headDim);
+        case KvCacheType::Q4_0:
+            return dotQ4_0(q, static_cast<const BlockQ4_0*>(row) + offset / kKvQuantBlock,
+                           headDim);
+    }
+    return 0.0f;
+}
+
+// out += s * V[offset, offset + headDim) for a cached value row of [type].
+inline void kvAxpy(KvCacheType type, float s, const void* row, int offset, float* out,
+                   int headDim) {
+    switch (type) {
+        case KvCacheType::F32:
+            axpy(s, static_cast<const float*>(row) + offset, out, headDim);
+            break;
+        case KvCacheType::F16:
+            axpyHalf(s, static_cast<const uint16_t*>(row) + offset, out, headDim);
+            break;
+        case KvCacheType::Q8_0:
+            axpyQ8_0(s, static_cast<const BlockQ8_0*>(row) + offset / kKvQuantBlock, out, headDim);
+            break;
+        case KvCacheType::Q4_0:
+            axpyQ4_0(s, static_cast<const BlockQ4_0*>(row) + offset / kKvQuantBlock, out, headDim);
+            break;
+    }
+}
+
+} // namespace
+
+void flashAttention(const AttentionArgs& args, int head, int queryBegin, int queryEnd) {
+    const KvCache& cache = *args.cache;
+    const KvCacheType type = cache.type();
+    const int headDim = args.headDim;
+    const int kvOffset = (head / args.groupSize) * headDim;
+    // Not -infinity: -ffast-math assumes there are none.
+    const float lowest = std::numeric_limits<float>::lowest();
+    // This head's slice of a key and value tile, converted to float once
+    // per query tile. Float rows are read in place.
+    thread_local std::vector<float> tile;
+    tile.resize(2 * static_cast<size_t>(kAttentionKvTile) * headDim);
+    float* keys = tile.data();
+    float* values = keys + static_cast<size_t>(kAttentionKvTile) * headDim;
+
+    for (int q0 = queryBegin; q0 < queryEnd; q0 += kAttentionQueryTile) {
+        const int q1 = std::min(queryEnd, q0 + kAttentionQueryTile);
+        // A lone query (decode) reads each row once anyway.
+        const bool convert = type != KvCacheType::F32 && q1 - q0 > 1;
+        float maxScore[kAttentionQueryTile];
+        float sum[kAttentionQueryTile];
+        float scores[kAttentionKvTile];
+        for (int b = q0; b < q1; ++b) {
+            maxScore[b - q0] = lowest;
+            sum[b - q0] = 0.0f;
+            float* out = args.out + static_cast<size_t>(b) * args.outStride + head * headDim;
+            std::fill(out, out + headDim, 0.0f);
+        }
+
+        // The last query of the tile sees the most positions.
+        const int length = args.pos + q1;
+        for (int t0 = 0; t0 < length; t0 += kAttentionKvTile) {
+            const int t1 = std::min(length, t0 + kAttentionKvTile);
+            if (convert) {
+                const size_t rows = static_cast<size_t>(t1 - t0) * headDim;
+                std::fill(keys, keys + rows, 0.0f);
+                std::fill(values, values + rows, 0.0f);
+                for (int t = t0; t < t1; ++t) {
+                    const size_t row = static_cast<size_t>(t - t0) * headDim;
+                    kvAxpy(type, 1.0f, cache.keyRow(args.layer, t), kvOffset, keys + row,
+                           headDim);
+                    kvAxpy(type, 1.0f, cache.valueRow(args.layer, t), kvOffset, values + row,
+                           headDim);
+                }
+            }
+            auto key = [&](int t) {
+                return convert ? keys + static_cast<size_t>(t - t0) * headDim
+                               : static_cast<const float*>(cache.keyRow(args.layer, t)) + kvOffset;
+            };
+            auto value = [&](int t) {
+                return convert ? values + static_cast<size_t>(t - t0) * headDim
+                               : static_cast<const float*>(cache.valueRow(args.layer, t)) +
+                                         kvOffset;
+            };
+            const bool floatRows = convert || type == KvCacheType::F32;
+
+            for (int b = q0; b < q1; ++b) {
+                const int end = std::min(t1, args.pos + b + 1);
+                if (end <= t0) continue;
+                const float* q = args.q + static_cast<size_t>(b) * args.qStride + head * headDim;
+                float* out = args.out + static_cast<size_t>(b) * args.outStride + head * headDim;
+
+                float tileMax = lowest;
+                for (int t = t0; t < end; ++t) {
+                    const float s = floatRows ? dot(q, key(t), headDim)
+                                              : kvDot(type, q, cache.keyRow(args.layer, t),
+                                                      kvOffset, headDim);
+                    scores[t - t0] = args.scale * s;
+                    tileMax = std::max(tileMax, scores[t - t0]);
+                }
+                // Rescale what has been summed so far to the new maximum.
+                const float previous = maxScore[b - q0];
+                if (tileMax > previous) {
+                    const float correction = std::exp(previous - tileMax);
+                    sum[b - q0] *= correction;
+                    for (int i = 0; i < headDim; ++i) out[i] *= correction;
+                    maxScore[b - q0] = tileMax;
+                }
+                const float max = maxScore[b - q0];
+                float tileSum = 0.0f;
+                for (int j = 0; j < end - t0; ++j) {
+                    scores[j] = std::exp(scores[j] - max);
+                    tileSum += scores[j];
+                }
+                sum[b - q0] += tileSum;
+                for (int t = t0; t < end; ++t) {
+                    if (floatRows) {
+                        axpy(scores[t - t0], value(t), out, headDim);
+                    } else {
+                        kvAxpy(type, scores[t - t0], cache.valueRow(args.layer, t), kvOffset, out,
+                               headDim);
+                    }
+                }
+            }
+        }
+
+        for (int b = q0; b < q1; ++b) {
+            float* out = args.out + static_cast<size_t>(b) * args.outStride + head * headDim;
+            const float inverse = 1.0f / sum[b - q0];
+            for (int i = 0; i < headDim; ++i) out[i] *= inverse;
+        }
+    }
+}
+
+void naiveAttention(const AttentionArgs& args, int head, float* scores) {
+    const KvCache& cache = *args.cache;
+    const KvCacheType type = cache.type();
+    const int headDim = args.headDim;
+    const int kvOffset = (head / args.groupSize) * headDim;
+    for (int b = 0; b < args.n; ++b) {
+        const int length = args.pos + b + 1;
+        const float* q = args.q + static_cast<size_t>(b) * args.qStride + head * headDim;
+        for (int t = 0; t < length; ++t) {
+            scores[t] = args.scale * kvDot(type, q, cache.keyRow(args.layer, t), kvOffset, headDim);
+        }
+        softmax(scores, length);
+        float* out = args.out + static_cast<size_t>(b) * args.outStride + head * headDim;
+        std::fill(out, out + headDim, 0.0f);
+        for (int t = 0; t < length; ++t) {
+            kvAxpy(type, scores[t], cache.valueRow(args.layer, t), kvOffset, out, headDim);
+        }
+    }
+}
+
+} // namespace nimittam
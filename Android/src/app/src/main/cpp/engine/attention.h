@@ -0,0 +1,53 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Causal attention of a batch of queries over the paged KV cache.
+ *
+ * flashAttention() walks the cache in tiles of kAttentionKvTile
+ * positions for a tile of kAttentionQueryTile queries at a time, keeping
+ * a running maximum and sum per query (online softmax) and rescaling its
+ * output as the maximum grows. No score row longer than a tile exists,
+ * and each key/value tile is read once per query tile rather than once
+ * per query, so it is served from L1. naiveAttention() is the reference:
+ * a full softmax over one score row per query.
+ */
+
+#pragma once
+
+#include "kv_cache.h"
+
+namespace nimittam {
+
+constexpr int kAttentionQueryTile = 16;
+constexpr int kAttentionKvTile = 64;
+
+struct AttentionArgs {
+    const KvCache* cache = nullptr;
+    int layer = 0;
+    // Query i sits at position pos + i and sees positions [0, pos + i].
+    int pos = 0;
+    int n = 0;
+    int headDim = 0;
+    // Query heads per KV head.
+    int groupSize = 1;
+    float scale = 1.0f;
+    // [n, qStride] and [n, outStride]; head h at h * headDim in both.
+    const float* q = nullptr;
+    int qStride = 0;
+    float* out = nullptr;
+    int outStride = 0;
+};
+
+/** Head [head], queries [queryBegin, queryEnd); scratch stays within the tile sizes. */
+void flashAttention(const AttentionArgs& args, int head, int queryBegin, int queryEnd);
+
+/** Head [head], every query; [scores] holds pos + n floats. */
+void naiveAttention(const AttentionArgs& args, int head, float* scores);
+
+} // namespace nimittam
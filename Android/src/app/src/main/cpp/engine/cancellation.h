@@ -0,0 +1,57 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Per-request cancellation flag.
+ *
+ * One token is created for each prompt/generation request and shared
+ * between the JNI caller and the thread doing the work. Cancelling only
+ * affects that request, so a stop never leaks into the next one. The
+ * model polls it between layers and at the start of every parallel
+ * chunk, which bounds stop latency by one chunk of work rather than a
+ * whole decode step.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace nimittam {
+
+class CancellationToken {
+public:
+    /** Request cancellation; the first call's timestamp is kept. */
+    void cancel() {
+        int64_t expected = 0;
+        requestedAtNs_.compare_exchange_strong(expected, nowNs(), std::memory_order_relaxed);
+        cancelled_.store(true, std::memory_order_release);
+    }
+
+    /** Cheap enough to poll from inner loops. */
+    bool cancelled() const { return cancelled_.load(std::memory_order_relaxed); }
+
+    /** Milliseconds since cancel() was first called, or 0 if it was not. */
+    double msSinceCancel() const {
+        const int64_t requested = requestedAtNs_.load(std::memory_order_relaxed);
+        return requested ? (nowNs() - requested) / 1e6 : 0.0;
+    }
+
+private:
+    static int64_t nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now().time_since_epoch())
+                .count();
+    }
+
+    std::atomic<bool> cancelled_{false};
+    std::atomic<int64_t> requestedAtNs_{0};
+};
+
+} // namespace nimittam
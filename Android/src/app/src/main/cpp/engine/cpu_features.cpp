@@ -0,0 +1,127 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "cpu_features.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <numeric>
+#include <utility>
+
+#if defined(__aarch64__) && defined(__linux__)
+#define NIMITTAM_CPU_HWCAPS 1
+#include <sys/auxv.h>
+#elif defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define NIMITTAM_CPU_CPUID 1
+#endif
+
+namespace nimittam {
+
+namespace {
+
+#if NIMITTAM_CPU_HWCAPS
+// Bits from the kernel's arm64 <asm/hwcap.h>, spelled out because older
+// NDK sysroots lack the newer ones.
+#ifndef AT_HWCAP2
+#define AT_HWCAP2 26
+#endif
+constexpr unsigned long kHwcapAsimd = 1ul << 1;
+constexpr unsigned long kHwcapAsimdHp = 1ul << 10;
+constexpr unsigned long kHwcapAsimdDp = 1ul << 20;
+constexpr unsigned long kHwcapSve = 1ul << 22;
+constexpr unsigned long kHwcap2I8mm = 1ul << 13;
+#endif
+
+CpuFeatures detect() {
+    CpuFeatures cpu;
+#if NIMITTAM_CPU_HWCAPS
+    const unsigned long hwcap = getauxval(AT_HWCAP);
+    const unsigned long hwcap2 = getauxval(AT_HWCAP2);
+    cpu.asimd = (hwcap & kHwcapAsimd) != 0;
+    cpu.asimdHp = (hwcap & kHwcapAsimdHp) != 0;
+    cpu.dotProd = (hwcap & kHwcapAsimdDp) != 0;
+    cpu.sve = (hwcap & kHwcapSve) != 0;
+    cpu.i8mm = (hwcap2 & kHwcap2I8mm) != 0;
+#elif NIMITTAM_CPU_CPUID
+    __builtin_cpu_init();
+    cpu.sse41 = __builtin_cpu_supports("sse4.1");
+    cpu.avx2 = __builtin_cpu_supports("avx2");
+    cpu.fma = __builtin_cpu_supports("fma");
+    cpu.f16c = __builtin_cpu_supports("f16c");
+    cpu.avx512f = __builtin_cpu_supports("avx512f");
+    cpu.avx512bw = __builtin_cpu_supports("avx512bw");
+    cpu.avx512vl = __builtin_cpu_supports("avx512vl");
+    cpu.avx512vnni = __builtin_cpu_supports("avx512vnni");
+#endif
+    return cpu;
+}
+
+} // namespace
+
+const CpuFeatures& cpuFeatures() {
+    static const CpuFeatures features = detect();
+    return features;
+}
+
+std::string cpuFeatureList() {
+    const CpuFeatures& cpu = cpuFeatures();
+    const std::pair<bool, const char*> named[] = {
+            {cpu.asimd, "asimd"},       {cpu.asimdHp, "asimdhp"},   {cpu.dotProd, "asimddp"},
+            {cpu.i8mm, "i8mm"},         {cpu.sve, "sve"},           {cpu.sse41, "sse4.1"},
+            {cpu.avx2, "avx2"},         {cpu.fma, "fma"},           {cpu.f16c, "f16c"},
+            {cpu.avx512f, "avx512f"},   {cpu.avx512bw, "avx512bw"}, {cpu.avx512vl, "avx512vl"},
+            {cpu.avx512vnni, "avx512vnni"},
+    };
+    std::string list;
+    for (const auto& feature : named) {
+        if (!feature.first) continue;
+        if (!list.empty()) list += ',';
+        list += feature.second;
+    }
+    return list;
+}
+
+std::vector<int> cpuCapacities() {
+    const long count = sysconf(_SC_NPROCESSORS_CONF);
+    std::vector<int> capacities;
+    bool known = false;
+    for (long cpu = 0; cpu < count; ++cpu) {
+        char path[64];
+        std::snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%ld/cpu_capacity", cpu);
+        int capacity = 0;
+        if (FILE* file = std::fopen(path, "r")) {
+            if (std::fscanf(file, "%d", &capacity) != 1) capacity = 0;
+            std::fclose(file);
+        }
+        known = known || capacity > 0;
+        capacities.push_back(capacity);
+    }
+    if (!known) capacities.clear();
+    return capacities;
+}
+
+std::vector<int> fastestCpus(int count) {
+    const std::vector<int> capacities = cpuCapacities();
+    if (capacities.empty() || count <= 0) return {};
+    std::vector<int> byCapacity(capacities.size());
+    std::iota(byCapacity.begin(), byCapacity.end(), 0);
+    std::stable_sort(byCapacity.begin(), byCapacity.end(),
+                     [&](int a, int b) { return capacities[a] > capacities[b]; });
+    // Equal cores are never split, so the scheduler can still balance among them.
+    const int nth = byCapacity[std::min<size_t>(count, byCapacity.size()) - 1];
+    std::vector<int> cpus;
+    for (size_t cpu = 0; cpu < capacities.size(); ++cpu) {
+        if (capacities[cpu] >= capacities[nth]) cpus.push_back(static_cast<int>(cpu));
+    }
+    if (cpus.size() == capacities.size()) cpus.clear();
+    return cpus;
+}
+
+} // namespace nimittam
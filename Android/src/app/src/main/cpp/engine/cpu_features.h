@@ -0,0 +1,66 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Instruction set extensions of the CPU we are running on.
+ *
+ * The library is compiled for the ABI baseline (armv8-a with NEON on
+ * arm64, SSE2 on x86_64); kernels built for newer levels sit next to the
+ * baseline ones and are picked from these flags at runtime. On arm64 they
+ * come from the kernel's hwcaps (getauxval(AT_HWCAP / AT_HWCAP2)), on
+ * x86_64 from cpuid, which also checks that the OS saves the registers.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace nimittam {
+
+struct CpuFeatures {
+    // arm64
+    bool asimd = false;    // NEON
+    bool asimdHp = false;  // FP16 arithmetic (armv8.2-a)
+    bool dotProd = false;  // SDOT / UDOT (armv8.2-a, optional before armv8.4-a)
+    bool i8mm = false;     // SMMLA / UMMLA (armv8.6-a)
+    bool sve = false;
+
+    // x86_64
+    bool sse41 = false;
+    bool avx2 = false;
+    bool fma = false;
+    bool f16c = false;
+    bool avx512f = false;
+    bool avx512bw = false;
+    bool avx512vl = false;
+    bool avx512vnni = false;  // VPDPBUSD
+};
+
+/** Features of this CPU, detected on first use. */
+const CpuFeatures& cpuFeatures();
+
+/** The detected features as a comma-separated list, e.g. "asimd,asimdhp,asimddp", for logs. */
+std::string cpuFeatureList();
+
+/**
+ * Relative speed of each CPU, indexed by CPU number, from
+ * /sys/devices/system/cpu/cpuN/cpu_capacity (the fastest core is 1024 on
+ * arm64). Empty where the kernel does not report it, which includes most
+ * x86_64 machines; 0 for a CPU whose entry is missing.
+ */
+std::vector<int> cpuCapacities();
+
+/**
+ * CPUs to keep [count] busy threads on: every core at least as fast as
+ * the [count]th fastest, in CPU order. Empty when the cores are all
+ * alike, capacities are unknown or every core would be included.
+ */
+std::vector<int> fastestCpus(int count);
+
+} // namespace nimittam
@@ -0,0 +1,93 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "detokenizer.h"
+
+namespace nimittam {
+
+namespace {
+
+constexpr char kReplacement[] = "\xEF\xBF\xBD";  // U+FFFD
+
+/**
+ * Length of the sequence [lead] starts, or 0 if it starts none, with the
+ * range allowed for the second byte (Unicode table 3-7). The narrower
+ * ranges rule out overlong forms, surrogates and values past U+10FFFF.
+ */
+size_t sequenceLength(uint8_t lead, uint8_t* low, uint8_t* high) {
+    *low = 0x80;
+    *high = 0xBF;
+    if (lead >= 0xC2 && lead <= 0xDF) return 2;
+    if (lead >= 0xE0 && lead <= 0xEF) {
+        if (lead == 0xE0) *low = 0xA0;
+        if (lead == 0xED) *high = 0x9F;
+        return 3;
+    }
+    if (lead >= 0xF0 && lead <= 0xF4) {
+        if (lead == 0xF0) *low = 0x90;
+        if (lead == 0xF4) *high = 0x8F;
+        return 4;
+    }
+    return 0;
+}
+
+} // namespace
+
+const std::string& Detokenizer::push(const char* bytes, size_t size) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(bytes);
+    text_.clear();
+    size_t i = 0;
+    while (i < size) {
+        uint8_t low;
+        uint8_t high;
+        if (pendingSize_ == 0) {
+            size_t ascii = i;
+            while (ascii < size && p[ascii] < 0x80) ++ascii;
+            text_.append(bytes + i, ascii - i);
+            i = ascii;
+            if (i == size) break;
+            if (sequenceLength(p[i], &low, &high) == 0) {
+                text_ += kReplacement;
+            } else {
+                pending_[pendingSize_++] = p[i];
+            }
+            ++i;
+            continue;
+        }
+
+        const size_t length = sequenceLength(pending_[0], &low, &high);
+        if (pendingSize_ > 1) {
+            low = 0x80;
+            high = 0xBF;
+        }
+        if (p[i] < low || p[i] > high) {
+            // What is held back can no longer complete; p[i] is looked
+            // at again as the start of something new.
+            text_ += kReplacement;
+            pendingSize_ = 0;
+            continue;
+        }
+        pending_[pendingSize_++] = p[i++];
+        if (pendingSize_ == length) {
+            text_.append(reinterpret_cast<const char*>(pending_), length);
+            pendingSize_ = 0;
+        }
+    }
+    return text_;
+}
+
+const std::string& Detokenizer::finish() {
+    text_.clear();
+    if (pendingSize_ > 0) {
+        text_ += kReplacement;
+        pendingSize_ = 0;
+    }
+    return text_;
+}
+
+} // namespace nimittam
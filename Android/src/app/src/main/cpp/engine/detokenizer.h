@@ -0,0 +1,60 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Turns a stream of token bytes into well-formed UTF-8 text.
+ *
+ * Byte-level BPE tokens often end partway through a code point (CJK
+ * characters and emoji are split across two or three tokens), so a
+ * token's bytes cannot be handed to Java on their own. push() emits
+ * every code point the new bytes complete and holds back an unfinished
+ * one, at most three bytes, until the token that finishes it arrives.
+ * Bytes that can never be part of well-formed UTF-8 (stray continuation
+ * bytes, overlong forms, surrogates, values past U+10FFFF) come out as
+ * U+FFFD, one per maximal ill-formed subpart as Unicode recommends.
+ *
+ * The returned text lives in a buffer owned by the detokenizer and
+ * reused from call to call, so streaming does not allocate per token.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace nimittam {
+
+class Detokenizer {
+public:
+    /** Drop any held-back bytes, e.g. at the start of a new reply. */
+    void reset() { pendingSize_ = 0; }
+
+    /**
+     * Append one token's bytes and return the text they complete (may be
+     * empty). The reference stays valid until the next call.
+     */
+    const std::string& push(const std::string& bytes) { return push(bytes.data(), bytes.size()); }
+    const std::string& push(const char* bytes, size_t size);
+
+    /**
+     * End of the stream: a held-back partial code point comes out as
+     * U+FFFD. Leaves the detokenizer ready for a new stream.
+     */
+    const std::string& finish();
+
+    /** Bytes of an unfinished code point waiting for the next token. */
+    size_t pendingBytes() const { return pendingSize_; }
+
+private:
+    std::string text_;
+    uint8_t pending_[4] = {};
+    size_t pendingSize_ = 0;
+};
+
+} // namespace nimittam
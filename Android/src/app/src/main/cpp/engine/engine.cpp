@@ -0,0 +1,502 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "engine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include "cpu_features.h"
+#include "grammar.h"
+#include "kv_quant.h"
+#include "kv_snapshot.h"
+#include "log.h"
+#include "model_source.h"
+
+namespace nimittam {
+
+namespace {
+
+double elapsedMs(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since)
+            .count();
+}
+
+/** FNV-1a over the model file [name], continuing from [hash]; unreadable files add nothing. */
+uint64_t hashModelFile(const ModelSource& source, const std::string& name, uint64_t hash) {
+    MappedFile file;
+    std::string ignored;
+    if (!source.map(name, &file, &ignored)) return hash;
+    for (size_t i = 0; i < file.size(); ++i) {
+        hash = (hash ^ file.data()[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/** Hash of one KV block's tokens chained onto the hash of everything before it. */
+uint64_t hashBlock(uint64_t previous, const int32_t* tokens) {
+    uint64_t h = previous ^ 0x9e3779b97f4a7c15ULL;
+    for (int i = 0; i < KvCache::kBlockTokens; ++i) {
+        // splitmix64 finalizer per token
+        h += static_cast<uint32_t>(tokens[i]) + 0x9e3779b97f4a7c15ULL;
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+        h ^= h >> 31;
+    }
+    return h;
+}
+
+/** Context and prefill chunk sizes [options] come to for [config]. */
+void resolveSizes(const EngineOptions& options, const ModelConfig& config, int* contextSize,
+                  int* chunk) {
+    *contextSize = options.contextSize > 0 ? options.contextSize : config.contextWindowSize;
+    *contextSize = std::min(*contextSize, config.contextWindowSize);
+    *chunk = options.batchSize > 0 ? options.batchSize : config.prefillChunkSize;
+    if (config.prefillChunkSize > 0) *chunk = std::min(*chunk, config.prefillChunkSize);
+    *chunk = std::max(1, std::min(*chunk, *contextSize));
+}
+
+/**
+ * Map [model]'s repacked weights from [dir], building them on first use.
+ * The weights are verified before a build unless the load already did.
+ * Returns false, with [error] left empty, when the model should run on
+ * its weights as stored; fills [error] only if they fail verification.
+ */
+bool openRepacked(LoadedModel& model, const std::string& dir, bool unverified,
+                  std::string* error) {
+    const std::string path = dir + "/" + RepackedWeights::fileName(model.modelHash);
+    std::string why;
+    if (model.repacked.open(path, model.modelHash, &why)) {
+        LOGI("Mapped %zu repacked matrices from %s", model.repacked.size(), path.c_str());
+        return true;
+    }
+    LOGI("Repacking weights: %s", why.c_str());
+    for (size_t i = 0; unverified && i < model.weights.shardCount(); ++i) {
+        if (!model.weights.verifyShard(i, error)) return false;
+    }
+    if (!RepackedWeights::build(path, model.modelHash, model.weights, &why) ||
+        !model.repacked.open(path, model.modelHash, &why)) {
+        LOGE("Running without repacked weights: %s", why.c_str());
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+std::shared_ptr<const LoadedModel> LoadedModel::acquire(const std::string& modelDir,
+                                                        const ModelLoadOptions& options,
+                                                        std::string* error) {
+    // One slot per key: its mutex makes concurrent inits of one model
+    // load it once without holding up loads of any other.
+    struct Slot {
+        std::mutex loading;
+        std::weak_ptr<const LoadedModel> model;
+    };
+    static std::mutex mutex;
+    static std::unordered_map<std::string, std::shared_ptr<Slot>> slots;
+
+    ModelSource source;
+    if (!source.open(modelDir, error)) return nullptr;
+    const std::string& location = source.location();
+    // Only engines asking for the same repacking and verification share a
+    // load; another engine gets its own rather than silently missing
+    // repacked weights or running on unverified ones. The shards are
+    // mapped read-only either way, so their pages are still shared.
+    const std::string key = location + '\n' + options.repackDir +
+                            (options.weights.verifyChecksums ? "\nverified" : "\nunverified");
+    std::shared_ptr<Slot> slot;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // Drop slots of models nobody holds; a slot held only by the map
+        // is not being loaded or read by anyone.
+        for (auto it = slots.begin(); it != slots.end();) {
+            if (it->second.use_count() == 1 && it->second->model.expired()) {
+                it = slots.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        std::shared_ptr<Slot>& entry = slots[key];
+        if (!entry) entry = std::make_shared<Slot>();
+        slot = entry;
+    }
+    // Held across the load so a second init of this key waits for it.
+    std::lock_guard<std::mutex> lock(slot->loading);
+    if (auto existing = slot->model.lock()) {
+        LOGI("Sharing loaded weights for %s", location.c_str());
+        return existing;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto model = std::make_shared<LoadedModel>();
+    model->modelDir = location;
+    if (!ModelConfig::load(source, &model->config, error)) return nullptr;
+    // The tokenizer is parsed while the shard threads wait on I/O.
+    std::string tokenizerError;
+    bool tokenizerLoaded = false;
+    std::thread tokenizerThread([&]() {
+        tokenizerLoaded = model->tokenizer.load(source, &tokenizerError);
+    });
+    const bool deferVerification = options.weights.verifyChecksums && options.deferVerification;
+    WeightLoadOptions loadOptions = options.weights;
+    loadOptions.verifyChecksums = options.weights.verifyChecksums && !deferVerification;
+    const bool weightsLoaded = model->weights.load(source, loadOptions, error);
+    tokenizerThread.join();
+    if (!weightsLoaded) return nullptr;
+    if (!tokenizerLoaded) {
+        *error = tokenizerError;
+        return nullptr;
+    }
+    if (model->tokenizer.vocabSize() > model->config.vocabSize) {
+        *error = "tokenizer vocabulary exceeds model vocab_size";
+        return nullptr;
+    }
+    // ndarray-cache.json carries every shard's checksum.
+    model->modelHash = hashModelFile(
+            source, "ndarray-cache.json",
+            hashModelFile(source, "mlc-chat-config.json", 0xcbf29ce484222325ULL));
+    std::string verifyError;
+    const bool repacked = !options.repackDir.empty() &&
+                          openRepacked(*model, options.repackDir, deferVerification, &verifyError);
+    if (!verifyError.empty()) {
+        *error = verifyError;
+        return nullptr;
+    }
+    model->prefetcher = std::make_unique<WeightPrefetcher>(
+            model->weights, repacked ? &model->repacked : nullptr, model->config.numLayers);
+    model->prefetcher->start(deferVerification);
+
+    LOGI("Loaded %s: %d layers, hidden %d, %zu MB weights in %.0f ms",
+         model->config.modelType.c_str(), model->config.numLayers, model->config.hiddenSize,
+         model->weights.totalBytes() >> 20, elapsedMs(start));
+    slot->model = model;
+    return model;
+}
+
+float LoadedModel::warmUpProgress() const {
+    return prefetcher->failed() ? -1.0f : prefetcher->progress();
+}
+
+std::unique_ptr<Engine> Engine::create(const std::string& modelDir,
+                                       const EngineOptions& options,
+                                       std::string* error) {
+    std::unique_ptr<Engine> engine(new Engine());
+    engine->options_ = options;
+
+    if (options.backend != Backend::CPU) {
+        LOGI("Backend %d not available natively, using CPU", static_cast<int>(options.backend));
+    }
+    LOGI("CPU features: %s; q4 kernels: %s; KV kernels: %s", cpuFeatureList().c_str(),
+         q4KernelName(), kvQuantKernelName());
+    ModelLoadOptions loadOptions;
+    loadOptions.weights.verifyChecksums = options.verifyWeights;
+    loadOptions.weights.ioThreads = std::max(1, options.threads);
+    loadOptions.deferVerification = options.lazyWeights;
+    loadOptions.repackDir = options.repackDir;
+    engine->shared_ = LoadedModel::acquire(modelDir, loadOptions, error);
+    if (!engine->shared_) {
+        return nullptr;
+    }
+
+    const ModelConfig& config = engine->shared_->config;
+    WeightPrefetcher* prefetcher = engine->shared_->prefetcher.get();
+    auto warmStart = std::chrono::steady_clock::now();
+    const bool warm = options.lazyWeights ? prefetcher->waitForLayers(kReadyLayers)
+                                          : prefetcher->finish();
+    if (!warm) {
+        *error = prefetcher->error();
+        return nullptr;
+    }
+    LOGI("Weights %.0f%% resident after %.0f ms warm-up wait", prefetcher->progress() * 100.0f,
+         elapsedMs(warmStart));
+    int contextSize;
+    int chunk;
+    resolveSizes(options, config, &contextSize, &chunk);
+    ThreadPoolOptions poolOptions;
+    poolOptions.pinToFastCores = options.pinThreads;
+    poolOptions.spinMicros = options.spinMicros;
+    engine->pool_ = std::make_unique<ThreadPool>(options.threads, poolOptions);
+    if (!engine->pool_->pinnedCpus().empty()) {
+        std::string cpus;
+        for (int cpu : engine->pool_->pinnedCpus()) {
+            cpus += (cpus.empty() ? "" : ",") + std::to_string(cpu);
+        }
+        LOGI("Pool workers pinned to CPUs %s", cpus.c_str());
+    }
+    const RepackedWeights* repacked =
+            engine->shared_->repacked.size() > 0 ? &engine->shared_->repacked : nullptr;
+    engine->model_.setFlashAttention(options.useFlashAttention);
+    if (!engine->model_.init(config, engine->shared_->weights, repacked, contextSize,
+                             options.kvCacheType, chunk, engine->pool_.get(), error)) {
+        return nullptr;
+    }
+    engine->model_.setPrefetcher(prefetcher);
+    const bool int8 = options.int8Activations && repacked && q4HasInt8Kernels();
+    engine->model_.setInt8Activations(int8);
+    engine->logits_.resize(config.vocabSize);
+
+    LOGI("Engine ready: context %d, %d threads, %zu MB KV cache reserved (%d-token blocks), "
+         "prefill chunk %d (%zu MB activations, %s, %s attention)",
+         contextSize, engine->pool_->size(), engine->model_.kvCache().bytes() >> 20,
+         KvCache::kBlockTokens, chunk, engine->model_.activationBytes() >> 20,
+         int8 ? "int8" : "f32", options.useFlashAttention ? "fused" : "unfused");
+    return engine;
+}
+
+bool Engine::estimateMemory(const std::string& modelDir, const EngineOptions& options,
+                            MemoryEstimate* out, std::string* error) {
+    ModelSource source;
+    ModelConfig config;
+    JsonValue manifest;
+    if (!source.open(modelDir, error) || !ModelConfig::load(source, &config, error) ||
+        !source.parseJson("ndarray-cache.json", &manifest, error)) {
+        return false;
+    }
+    *out = MemoryEstimate();
+    for (const JsonValue& shard : manifest["records"].items()) {
+        out->weightBytes += static_cast<size_t>(shard["nbytes"].asInt());
+    }
+    resolveSizes(options, config, &out->contextSize, &out->prefillChunk);
+    const Qwen2Model::MemoryPlan plan =
+            Qwen2Model::planMemory(config, out->contextSize, options.kvCacheType,
+                                   out->prefillChunk, options.useFlashAttention);
+    out->kvCacheBytes = plan.kvCacheBytes;
+    out->activationBytes = plan.activationBytes();
+    return true;
+}
+
+int Engine::prefill(const std::string& text, const CancellationToken* cancel) {
+    if (!weightsUsable()) return -1;
+    // The pending token leads the prompt but stays pending until the
+    // model has run it, so an overflow or an early cancel keeps it.
+    std::vector<int32_t> tokens;
+    if (pendingToken_ >= 0) tokens.push_back(pendingToken_);
+    std::vector<int32_t> encoded = shared_->tokenizer.encode(text);
+    tokens.insert(tokens.end(), encoded.begin(), encoded.end());
+    if (tokens.empty()) return 0;
+
+    if (position_ + static_cast<int>(tokens.size()) > model_.contextSize()) {
+        LOGE("Prompt of %zu tokens exceeds context (%d/%d used)", tokens.size(), position_,
+             model_.contextSize());
+        return -1;
+    }
+
+    beginPrompt(static_cast<int>(encoded.size()));
+    const int start = position_;
+    const bool completed = runPrefill(tokens.data(), static_cast<int>(tokens.size()), cancel);
+    if (position_ > start) pendingToken_ = -1;
+    return completed ? stats_.promptTokens : kPrefillCancelled;
+}
+
+int Engine::prefillTranscript(const std::string& transcript, const CancellationToken* cancel) {
+    if (!weightsUsable()) return -1;
+    std::vector<int32_t> tokens = shared_->tokenizer.encode(transcript);
+    const int total = static_cast<int>(tokens.size());
+    if (total > model_.contextSize()) {
+        LOGE("Transcript of %d tokens exceeds context %d", total, model_.contextSize());
+        return -1;
+    }
+    if (total == 0) {
+        resetContext();
+        return 0;
+    }
+
+    const int reused = std::min(cachedPrefixLength(tokens), total - 1);
+    if (reused < position_) {
+        model_.truncateCache(reused);
+        history_.resize(reused);
+        blockHashes_.resize(reused / KvCache::kBlockTokens);
+        position_ = reused;
+    }
+    // A pending stop token is part of the transcript if the caller kept it.
+    pendingToken_ = -1;
+
+    beginPrompt(total - reused);
+    stats_.reusedTokens = reused;
+    LOGI("Transcript of %d tokens: %d cached, %d to prefill", total, reused, total - reused);
+    if (!runPrefill(tokens.data() + reused, total - reused, cancel)) return kPrefillCancelled;
+    return stats_.promptTokens;
+}
+
+void Engine::beginPrompt(int tokens) {
+    stats_ = EngineStats();
+    samplerSeeded_ = false;
+    finishReason_ = FinishReason::None;
+    stats_.promptTokens = tokens;
+}
+
+bool Engine::runPrefill(const int32_t* tokens, int total, const CancellationToken* cancel) {
+    const int chunkSize = model_.maxBatch();
+    for (int begin = 0; begin < total; begin += chunkSize) {
+        const int n = std::min(chunkSize, total - begin);
+        const bool last = begin + n == total;
+        auto start = std::chrono::steady_clock::now();
+        if (!model_.forwardBatch(tokens + begin, n, position_,
+                                 last ? logits_.data() : nullptr, cancel)) {
+            markCancelled(cancel);
+            return false;
+        }
+        const double ms = elapsedMs(start);
+        position_ += n;
+        history_.insert(history_.end(), tokens + begin, tokens + begin + n);
+        stats_.prefillMs += ms;
+        stats_.maxChunkMs = std::max(stats_.maxChunkMs, ms);
+        ++stats_.prefillChunks;
+        LOGD("Prefill chunk %d: %d tokens in %.1f ms (%.1f tok/s)", stats_.prefillChunks, n, ms,
+             ms > 0.0 ? n * 1000.0 / ms : 0.0);
+    }
+    return true;
+}
+
+int Engine::cachedPrefixLength(const std::vector<int32_t>& tokens) {
+    constexpr int kBlock = KvCache::kBlockTokens;
+    // Hash the blocks generation has filled since the last call.
+    for (size_t b = blockHashes_.size(); (b + 1) * kBlock <= history_.size(); ++b) {
+        blockHashes_.push_back(hashBlock(b ? blockHashes_[b - 1] : 0, &history_[b * kBlock]));
+    }
+
+    // Whole blocks by chained hash: equal hashes mean equal prefixes.
+    size_t blocks = 0;
+    uint64_t hash = 0;
+    while (blocks < blockHashes_.size() && (blocks + 1) * kBlock <= tokens.size()) {
+        hash = hashBlock(hash, &tokens[blocks * kBlock]);
+        if (hash != blockHashes_[blocks]) break;
+        ++blocks;
+    }
+    // Then token by token into the first block that differs.
+    size_t matched = blocks * kBlock;
+    const size_t limit = std::min(history_.size(), tokens.size());
+    while (matched < limit && history_[matched] == tokens[matched]) ++matched;
+    return static_cast<int>(matched);
+}
+
+bool Engine::generate(int maxTokens, const SamplingParams& params, std::string* piece,
+                      int32_t* tokenId, const CancellationToken* cancel) {
+    if (history_.empty() && pendingToken_ < 0) return false;
+    if (finishReason_ != FinishReason::None) return false;
+    if (cancel && cancel->cancelled()) {
+        markCancelled(cancel);
+        return false;
+    }
+    if (maxTokens > 0 && stats_.generatedTokens >= maxTokens) {
+        finishReason_ = FinishReason::Length;
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    if (pendingToken_ >= 0) {
+        if (position_ >= model_.contextSize()) {
+            LOGI("Context full at %d tokens", position_);
+            finishReason_ = FinishReason::ContextFull;
+            return false;
+        }
+        if (!model_.forward(pendingToken_, position_, logits_.data(), cancel)) {
+            // The token stays pending and leads the next prefill.
+            stats_.decodeMs += elapsedMs(start);
+            markCancelled(cancel);
+            return false;
+        }
+        ++position_;
+        history_.push_back(pendingToken_);
+        pendingToken_ = -1;
+    }
+    if (!samplerSeeded_) {
+        sampler_.reset(params.seed);
+        samplerSeeded_ = true;
+    }
+
+    auto sampleStart = std::chrono::steady_clock::now();
+    if (grammar_ && !grammar_->applyMask(logits_.data())) {
+        LOGE("Grammar allows no token at position %d", position_);
+        stats_.sampleMs += elapsedMs(sampleStart);
+        stats_.decodeMs += elapsedMs(start);
+        finishReason_ = FinishReason::Stop;
+        return false;
+    }
+    int32_t token = sampler_.sample(logits_.data(), shared_->config.vocabSize, params, history_);
+    if (grammar_ && !isStopToken(token)) grammar_->accept(token);
+    stats_.sampleMs += elapsedMs(sampleStart);
+    // The stop token stays pending so the next prefill records it in the
+    // transcript, matching the chat template.
+    pendingToken_ = token;
+    stats_.decodeMs += elapsedMs(start);
+    if (isStopToken(token)) {
+        finishReason_ = FinishReason::Stop;
+        return false;
+    }
+
+    ++stats_.generatedTokens;
+    *piece = shared_->tokenizer.tokenBytes(token);
+    if (tokenId) *tokenId = token;
+    return true;
+}
+
+void Engine::resetContext() {
+    model_.resetCache();
+    history_.clear();
+    blockHashes_.clear();
+    position_ = 0;
+    pendingToken_ = -1;
+    samplerSeeded_ = false;
+    finishReason_ = FinishReason::None;
+    stats_ = EngineStats();
+}
+
+bool Engine::saveContext(const std::string& path, std::string* error) const {
+    KvSnapshotContext context;
+    context.tokens = history_;
+    context.pendingToken = pendingToken_;
+    return saveKvSnapshot(path, shared_->modelHash, model_.kvCache(), context, error);
+}
+
+bool Engine::loadContext(const std::string& path, std::string* error) {
+    auto start = std::chrono::steady_clock::now();
+    KvSnapshotContext context;
+    if (!loadKvSnapshot(path, shared_->modelHash, shared_->config.vocabSize,
+                        &model_.kvCache(), &context, error)) {
+        return false;
+    }
+    // There are no logits for the last cached token, so rerun it as the
+    // pending token; its KV rows are simply rewritten.
+    if (context.pendingToken < 0 && !context.tokens.empty()) {
+        context.pendingToken = context.tokens.back();
+        context.tokens.pop_back();
+    }
+    history_ = std::move(context.tokens);
+    blockHashes_.clear();
+    position_ = static_cast<int>(history_.size());
+    pendingToken_ = context.pendingToken;
+    samplerSeeded_ = false;
+    finishReason_ = FinishReason::None;
+    stats_ = EngineStats();
+    LOGI("Restored %d tokens from %s in %.1f ms", position_, path.c_str(), elapsedMs(start));
+    return true;
+}
+
+bool Engine::weightsUsable() const {
+    if (!shared_->prefetcher->failed()) return true;
+    LOGE("Refusing prompt: %s", shared_->prefetcher->error().c_str());
+    return false;
+}
+
+void Engine::markCancelled(const CancellationToken* cancel) {
+    finishReason_ = FinishReason::Cancelled;
+    stats_.stopLatencyMs = cancel->msSinceCancel();
+    LOGI("Cancelled at position %d, %.2f ms after stop request", position_, stats_.stopLatencyMs);
+}
+
+bool Engine::isStopToken(int32_t token) const {
+    const auto& stops = shared_->config.stopTokenIds;
+    return std::find(stops.begin(), stops.end(), token) != stops.end();
+}
+
+} // namespace nimittam
@@ -0,0 +1,327 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * CPU reference inference engine behind the JNI bridge.
+ *
+ * Each Engine is one session: its own paged KV cache, sampler and
+ * thread pool. Weights and tokenizer are immutable and shared by every engine
+ * opened on the same model directory, so a second session costs a KV
+ * cache rather than a reload. The prompt/generate cycle used by
+ * MlcLlmEngine:
+ * prefill() appends text to the context, generate() yields one decoded
+ * token at a time until a stop token, the token budget or the context
+ * limit is reached. prefillTranscript() instead takes the whole
+ * conversation each turn and only runs the part the cache does not
+ * already hold.
+ *
+ * Prefill runs in chunks of at most EngineOptions::batchSize tokens
+ * (also capped by the model's prefill_chunk_size). Each chunk is one
+ * batched forward pass, so activation memory is bounded by the chunk,
+ * not the prompt, and chunk boundaries are where cancellation and other
+ * work get a chance to run.
+ *
+ * With EngineOptions::lazyWeights, create() returns once the embedding
+ * and the first kReadyLayers layers are resident. The remaining layers
+ * fault in behind the first prompts (see WeightPrefetcher), and the
+ * shard checksums are verified in the background. If verification
+ * fails, every later prefill is refused.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cancellation.h"
+#include "model_config.h"
+#include "qwen2_model.h"
+#include "repacked_weights.h"
+#include "sampler.h"
+#include "thread_pool.h"
+#include "tokenizer.h"
+#include "weight_prefetcher.h"
+#include "weights.h"
+
+namespace nimittam {
+
+class GrammarMatcher;
+
+// Backend types matching Kotlin HardwareBackend enum
+enum class Backend {
+    CPU = 0,
+    VULKAN_GPU = 1,
+    OPENCL_GPU = 2,
+    NPU_HEXAGON = 3,
+    NPU_MEDIATEK = 4,
+    METAL_GPU = 5
+};
+
+struct EngineOptions {
+    Backend backend = Backend::CPU;
+    int gpuLayers = 0;
+    int contextSize = 4096;
+    int batchSize = 512;
+    // Compute threads, the calling one included (ThreadPool).
+    int threads = 4;
+    // Keep pool workers on the [threads] fastest cores of a big.LITTLE SoC.
+    bool pinThreads = true;
+    // How long idle pool threads spin for the next job before sleeping, in
+    // microseconds. Spinning shortens the gaps between a decode step's
+    // many small jobs at the cost of some power; 0 always sleeps.
+    int spinMicros = 200;
+    // Tiled online-softmax attention (attention.h); off keeps a score row
+    // of the whole context per head.
+    bool useFlashAttention = true;
+    KvCacheType kvCacheType = KvCacheType::F16;
+    // Check weight shards against the manifest checksums on first load.
+    bool verifyWeights = true;
+    // Return from create() before every layer is resident (see Engine).
+    bool lazyWeights = true;
+    // Writable directory for the repacked-weight cache (RepackedWeights);
+    // empty runs the kernels on the weights as stored.
+    std::string repackDir;
+    // Quantize matmul activations to int8 when the CPU has int8 dot products
+    // (q4HasInt8Kernels); applies to repacked weights only.
+    bool int8Activations = true;
+};
+
+/** Why the last generate() call returned false. */
+enum class FinishReason {
+    None = 0,
+    Stop = 1,         // stop / EOS token
+    Length = 2,       // maxTokens reached
+    ContextFull = 3,  // no room left in the KV cache
+    Cancelled = 4,    // stopped by the caller
+    StopSequence = 5  // a stop sequence appeared in the text (GenerationLoop)
+};
+
+/**
+ * Memory an engine will need, worked out from the model's config and
+ * manifest before loading it (Engine::estimateMemory).
+ */
+struct MemoryEstimate {
+    // Weight shards as stored; repacked weights are a second copy that
+    // replaces them in the working set.
+    size_t weightBytes = 0;
+    // KV cache for the full context; it is committed as the conversation grows.
+    size_t kvCacheBytes = 0;
+    // Activation arena and int8 scratch for one full prefill chunk.
+    size_t activationBytes = 0;
+    // The sizes the options resolve to for this model.
+    int contextSize = 0;
+    int prefillChunk = 0;
+
+    size_t totalBytes() const { return weightBytes + kvCacheBytes + activationBytes; }
+};
+
+/** Timing for the most recent prompt/generation cycle. */
+struct EngineStats {
+    // Tokens run through the model; cached ones are counted in reusedTokens.
+    int promptTokens = 0;
+    int reusedTokens = 0;
+    // Model time over all prefill chunks; tokenization is excluded.
+    double prefillMs = 0.0;
+    int prefillChunks = 0;
+    // Slowest chunk, which bounds how long a decode step can be delayed.
+    double maxChunkMs = 0.0;
+    int generatedTokens = 0;
+    double decodeMs = 0.0;
+    // Part of decodeMs spent picking tokens from the logits, grammar masks included.
+    double sampleMs = 0.0;
+    // From CancellationToken::cancel() to the engine going idle; 0 unless cancelled.
+    double stopLatencyMs = 0.0;
+
+    double prefillTokensPerSecond() const {
+        return prefillMs > 0.0 ? promptTokens * 1000.0 / prefillMs : 0.0;
+    }
+    double decodeTokensPerSecond() const {
+        return decodeMs > 0.0 ? generatedTokens * 1000.0 / decodeMs : 0.0;
+    }
+};
+
+/** How LoadedModel::acquire() loads a model that is not already loaded. */
+struct ModelLoadOptions {
+    WeightLoadOptions weights;
+    // Leave weights.verifyChecksums to the prefetcher instead of the load.
+    bool deferVerification = false;
+    // See EngineOptions::repackDir.
+    std::string repackDir;
+};
+
+/** Read-only model data shared between engines. */
+struct LoadedModel {
+    // Canonical ModelSource location: a directory or "<archive>!/<dir>".
+    std::string modelDir;
+    // Identifies the weights (config and shard checksums) for KV snapshots.
+    uint64_t modelHash = 0;
+    ModelConfig config;
+    WeightStore weights;
+    // Empty unless a repack directory was given.
+    RepackedWeights repacked;
+    Tokenizer tokenizer;
+    // Warms [weights] from the first load on; declared after them so it stops first.
+    std::unique_ptr<WeightPrefetcher> prefetcher;
+
+    /**
+     * Fraction of the weights resident and verified so far, 0 to 1, or
+     * -1 once background verification has found them corrupt.
+     */
+    float warmUpProgress() const;
+
+    /**
+     * Return the already-loaded model at [modelDir] (a ModelSource
+     * location) if any engine still holds it loaded with the same
+     * repackDir and checksum verification, otherwise load it, map or
+     * build its repacked weights and start warming it.
+     */
+    static std::shared_ptr<const LoadedModel> acquire(const std::string& modelDir,
+                                                      const ModelLoadOptions& options,
+                                                      std::string* error);
+};
+
+class Engine {
+public:
+    /** prefill() result when the request was cancelled. */
+    static constexpr int kPrefillCancelled = -2;
+    /** Decoder layers resident before a lazily loaded engine is returned. */
+    static constexpr int kReadyLayers = 2;
+
+    /**
+     * Load the model at [modelDir], a directory or an "<apk>!/<dir>"
+     * ModelSource location; returns nullptr and fills [error] on failure.
+     */
+    static std::unique_ptr<Engine> create(const std::string& modelDir,
+                                          const EngineOptions& options,
+                                          std::string* error);
+
+    /**
+     * Peak memory create() with the same arguments would lead to, read
+     * from the model's config and manifest without loading the weights.
+     * Returns false and fills [error] if they cannot be read.
+     */
+    static bool estimateMemory(const std::string& modelDir, const EngineOptions& options,
+                               MemoryEstimate* out, std::string* error);
+
+    /**
+     * Tokenize [text] and run it through the model after the existing
+     * context, led by the token sampled last if it is still pending.
+     * Returns the number of prompt tokens, -1 if the context would
+     * overflow (the context, pending token included, is left untouched),
+     * or kPrefillCancelled if [cancel] fired; the tokens processed
+     * before that stay in the context.
+     */
+    int prefill(const std::string& text, const CancellationToken* cancel = nullptr);
+
+    /**
+     * Make [transcript] the whole context. The longest prefix of its
+     * tokens already in the KV cache is kept (matched a block at a time
+     * by prefix hash, then token by token) and only the remainder is
+     * prefilled; cached positions past the divergence are dropped. At
+     * least the last token is always run so there are logits to sample.
+     * Returns the number of tokens prefilled, -1 if the transcript does
+     * not fit the context (the cache is left untouched) or
+     * kPrefillCancelled.
+     */
+    int prefillTranscript(const std::string& transcript,
+                          const CancellationToken* cancel = nullptr);
+
+    /**
+     * Sample and return the next token's bytes in [piece] (and its id in
+     * [tokenId] when non-null). Returns false once a stop token is
+     * produced, [maxTokens] tokens have been generated since the last
+     * prefill, the context is full or [cancel] fired; finishReason()
+     * says which.
+     */
+    bool generate(int maxTokens, const SamplingParams& params, std::string* piece,
+                  int32_t* tokenId = nullptr, const CancellationToken* cancel = nullptr);
+
+    FinishReason finishReason() const { return finishReason_; }
+
+    /**
+     * Keep generate() inside [grammar]'s language from the next token on,
+     * or lift the constraint with nullptr. The matcher is not owned and
+     * must outlive its use; its state is advanced but never reset here.
+     */
+    void setGrammar(GrammarMatcher* grammar) { grammar_ = grammar; }
+
+    /** Drop the conversation; the next prefill starts at position 0. */
+    void resetContext();
+
+    /**
+     * Write the conversation (tokens and KV cache) to [path] as a
+     * kv_snapshot.h file. Call between requests, not during generation.
+     */
+    bool saveContext(const std::string& path, std::string* error) const;
+
+    /**
+     * Replace the conversation with the snapshot at [path], written by an
+     * engine on the same model and KV cache type. On failure the current
+     * conversation is kept.
+     */
+    bool loadContext(const std::string& path, std::string* error);
+
+    const EngineOptions& options() const { return options_; }
+    const ModelConfig& modelConfig() const { return shared_->config; }
+    const Tokenizer& tokenizer() const { return shared_->tokenizer; }
+    const EngineStats& stats() const { return stats_; }
+    /** LoadedModel::warmUpProgress() of the shared weights. */
+    float warmUpProgress() const { return shared_->warmUpProgress(); }
+    /** How the shared weights were loaded (by whichever engine loaded them). */
+    const std::vector<ShardLoadTiming>& loadTimeline() const {
+        return shared_->weights.loadTimeline();
+    }
+    /** The shared model data, for callers that must outlive this engine. */
+    const std::shared_ptr<const LoadedModel>& loadedModel() const { return shared_; }
+    int position() const { return position_; }
+    int prefillChunkSize() const { return model_.maxBatch(); }
+    /** Whether matmuls run on int8 activations (EngineOptions::int8Activations). */
+    bool int8Activations() const { return model_.int8Activations(); }
+    /** KV memory held by the current conversation. */
+    size_t kvCacheBytesInUse() const { return model_.kvCache().committedBytes(); }
+    /** Activation memory reserved at create(); MemoryEstimate::activationBytes. */
+    size_t activationBytes() const { return model_.activationBytes(); }
+    /** Most of the activation arena a forward pass has used so far. */
+    size_t activationHighWater() const { return model_.activationHighWater(); }
+
+private:
+    Engine() = default;
+
+    bool isStopToken(int32_t token) const;
+    /** False, with a log line, if the weights failed background verification. */
+    bool weightsUsable() const;
+    /** Start a new prompt's stats; [tokens] will be prefilled. */
+    void beginPrompt(int tokens);
+    /** Run [n] tokens at position_ in maxBatch() chunks; false if cancelled. */
+    bool runPrefill(const int32_t* tokens, int n, const CancellationToken* cancel);
+    /** Length of the longest prefix of [tokens] held by the KV cache. */
+    int cachedPrefixLength(const std::vector<int32_t>& tokens);
+    void markCancelled(const CancellationToken* cancel);
+
+    EngineOptions options_;
+    std::shared_ptr<const LoadedModel> shared_;
+    std::unique_ptr<ThreadPool> pool_;
+    Qwen2Model model_;
+    Sampler sampler_;
+    GrammarMatcher* grammar_ = nullptr;
+
+    std::vector<int32_t> history_;
+    // Chained hash of history_ up to the end of each full KV block.
+    std::vector<uint64_t> blockHashes_;
+    std::vector<float> logits_;
+    int position_ = 0;
+    // Sampled but not yet fed to the model; it leads the next step.
+    int32_t pendingToken_ = -1;
+    bool samplerSeeded_ = false;
+    FinishReason finishReason_ = FinishReason::None;
+    EngineStats stats_;
+};
+
+} // namespace nimittam
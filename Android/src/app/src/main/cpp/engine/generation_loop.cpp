@@ -0,0 +1,151 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "generation_loop.h"
+
+#include <chrono>
+#include <deque>
+#include <utility>
+
+#include "grammar.h"
+#include "log.h"
+
+namespace nimittam {
+
+GenerationLoop::~GenerationLoop() {
+    requestStop();
+    join();
+}
+
+void GenerationLoop::start(int maxTokens, const SamplingParams& params,
+                           std::unique_ptr<TokenSink> sink,
+                           std::shared_ptr<CancellationToken> cancel,
+                           const std::vector<std::string>& stopSequences,
+                           GrammarMatcher* grammar) {
+    join();
+    stops_.build(stopSequences);
+    if (grammar) grammar->reset();
+    engine_->setGrammar(grammar);
+    cancel_ = cancel;
+    running_.store(true);
+    thread_ = std::thread(&GenerationLoop::run, this, maxTokens, params, std::move(sink),
+                          std::move(cancel));
+}
+
+void GenerationLoop::requestStop() {
+    if (cancel_) cancel_->cancel();
+}
+
+void GenerationLoop::join() {
+    if (thread_.joinable()) thread_.join();
+}
+
+void GenerationLoop::run(int maxTokens, SamplingParams params, std::unique_ptr<TokenSink> sink,
+                         std::shared_ptr<CancellationToken> cancel) {
+    using Clock = std::chrono::steady_clock;
+
+    std::deque<std::pair<int32_t, std::string>> backlog;
+    size_t backlogBytes = 0;
+    uint64_t dropped = 0;
+    int unannounced = 0;
+    std::string piece;
+    auto lastAnnounce = Clock::now();
+
+    // Move as much of the backlog into the ring as fits, oldest first.
+    auto drainBacklog = [&]() {
+        while (!backlog.empty()) {
+            const auto& front = backlog.front();
+            if (!ring_->tryPush(front.first, front.second.data(),
+                                static_cast<uint32_t>(front.second.size()))) {
+                return;
+            }
+            backlogBytes -= front.second.size();
+            backlog.pop_front();
+            ++unannounced;
+        }
+    };
+
+    auto publish = [&](int32_t id, const std::string& bytes) {
+        drainBacklog();
+        if (backlog.empty() &&
+            ring_->tryPush(id, bytes.data(), static_cast<uint32_t>(bytes.size()))) {
+            ++unannounced;
+            return;
+        }
+        if (bytes.size() > ring_->maxPayload() || backlogBytes + bytes.size() > kMaxBacklogBytes) {
+            ring_->addDropped(1);
+            ++dropped;
+            return;
+        }
+        ring_->addBackpressure();
+        backlog.emplace_back(id, bytes);
+        backlogBytes += bytes.size();
+    };
+
+    auto announce = [&]() {
+        if (unannounced > 0) {
+            sink->onTokensAvailable();
+            unannounced = 0;
+        }
+        lastAnnounce = Clock::now();
+    };
+
+    FinishReason reason = FinishReason::None;
+    while (true) {
+        int32_t id;
+        if (!engine_->generate(maxTokens, params, &piece, &id, cancel.get())) {
+            reason = engine_->finishReason();
+            break;
+        }
+        if (stops_.feed(detokenizer_.push(piece), &text_)) {
+            publish(id, text_);
+            reason = FinishReason::StopSequence;
+            break;
+        }
+        publish(id, text_);
+        if (unannounced >= kMaxBatchTokens ||
+            Clock::now() - lastAnnounce >= std::chrono::milliseconds(kFlushIntervalMs)) {
+            announce();
+        }
+    }
+
+    // Text held back for an unfinished character or stop sequence
+    // belongs to the reply after all, unless a stop sequence ended it.
+    text_.clear();
+    if (reason != FinishReason::StopSequence && !stops_.feed(detokenizer_.finish(), &text_)) {
+        stops_.finish(&text_);
+    }
+    detokenizer_.reset();
+    engine_->setGrammar(nullptr);
+    if (!text_.empty()) publish(TokenRing::kNoToken, text_);
+
+    // Decoding is over, so waiting here no longer stalls the model; give
+    // the consumer a bounded window to make room for the backlog.
+    const auto deadline = Clock::now() + std::chrono::milliseconds(kFinalDrainTimeoutMs);
+    drainBacklog();
+    while (!backlog.empty() && Clock::now() < deadline) {
+        announce();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        drainBacklog();
+    }
+    if (!backlog.empty()) {
+        ring_->addDropped(backlog.size());
+        dropped += backlog.size();
+        backlog.clear();
+    }
+    announce();
+    if (dropped > 0) {
+        LOGI("Token ring overflow: %llu tokens dropped", static_cast<unsigned long long>(dropped));
+    }
+
+    sink->onComplete(engine_->stats(), reason);
+    sink.reset();
+    running_.store(false);
+}
+
+} // namespace nimittam
@@ -0,0 +1,112 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Background decode loop with batched token delivery.
+ *
+ * Replaces one JNI round trip per token: the loop runs on its own
+ * thread and writes every token into a TokenRing as soon as it is
+ * sampled. The TokenSink is only a doorbell: it is rung when
+ * kMaxBatchTokens tokens are waiting or kFlushIntervalMs has passed
+ * since the previous ring, so slow decoders still stream token by
+ * token while fast ones cost one callback per UI frame.
+ *
+ * Records carry text rather than raw token bytes: a Detokenizer holds
+ * back a character split across tokens until it is complete, so every
+ * record is well-formed UTF-8 on its own (and may be empty). The text
+ * then passes through a StopMatcher: the run ends with
+ * FinishReason::StopSequence on the token that completes a stop
+ * sequence, and neither the sequence nor a trailing partial one is
+ * published.
+ *
+ * The loop never waits for the consumer. When the ring is full, tokens
+ * are parked in a local backlog (counted as backpressure) and retried
+ * on the next step; once the backlog exceeds kMaxBacklogBytes further
+ * tokens are dropped and counted.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "detokenizer.h"
+#include "engine.h"
+#include "stop_matcher.h"
+#include "token_ring.h"
+
+namespace nimittam {
+
+class TokenSink {
+public:
+    virtual ~TokenSink() = default;
+
+    /** New records were published to the ring. */
+    virtual void onTokensAvailable() = 0;
+
+    /** Called once, after the last token has been published or dropped. */
+    virtual void onComplete(const EngineStats& stats, FinishReason reason) = 0;
+};
+
+class GenerationLoop {
+public:
+    static constexpr int kMaxBatchTokens = 32;
+    static constexpr int kFlushIntervalMs = 16;
+    static constexpr size_t kMaxBacklogBytes = 256 * 1024;
+    /** How long a finished run waits for the consumer to drain the backlog. */
+    static constexpr int kFinalDrainTimeoutMs = 500;
+
+    /** [ring] must outlive the loop; this loop is its only producer. */
+    GenerationLoop(Engine* engine, TokenRing* ring) : engine_(engine), ring_(ring) {}
+    ~GenerationLoop();
+
+    GenerationLoop(const GenerationLoop&) = delete;
+    GenerationLoop& operator=(const GenerationLoop&) = delete;
+
+    /**
+     * Start decoding on a new thread, joining any previous run first.
+     * The run ends with FinishReason::Cancelled once [cancel] fires and
+     * with FinishReason::StopSequence once the text contains one of
+     * [stopSequences]. A non-null [grammar] is reset and constrains every
+     * token of the run (Engine::setGrammar()); it must stay alive until
+     * the run is over. The sink is destroyed on the loop thread when it
+     * finishes.
+     */
+    void start(int maxTokens, const SamplingParams& params, std::unique_ptr<TokenSink> sink,
+               std::shared_ptr<CancellationToken> cancel,
+               const std::vector<std::string>& stopSequences = {},
+               GrammarMatcher* grammar = nullptr);
+
+    /** Cancel the current run, if any. */
+    void requestStop();
+
+    /** Wait for the loop thread, if any. */
+    void join();
+
+    bool running() const { return running_.load(); }
+
+private:
+    void run(int maxTokens, SamplingParams params, std::unique_ptr<TokenSink> sink,
+             std::shared_ptr<CancellationToken> cancel);
+
+    Engine* engine_;
+    TokenRing* ring_;
+    // Used by the loop thread only, once start() has built them.
+    Detokenizer detokenizer_;
+    StopMatcher stops_;
+    std::string text_;
+    std::thread thread_;
+    std::shared_ptr<CancellationToken> cancel_;
+    std::atomic<bool> running_{false};
+};
+
+} // namespace nimittam
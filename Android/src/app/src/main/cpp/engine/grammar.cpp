@@ -0,0 +1,915 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "grammar.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <utility>
+
+#include "json.h"
+#include "json_schema.h"
+#include "sampler.h"
+#include "tokenizer.h"
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define NIMITTAM_GRAMMAR_NEON 1
+#include <arm_neon.h>
+#elif defined(__x86_64__)
+#define NIMITTAM_GRAMMAR_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace nimittam {
+
+namespace {
+
+// Largest {m,n} bound; every repetition is a copy of the repeated item.
+constexpr uint32_t kMaxRepeat = 1000;
+
+using ByteSet = std::array<uint64_t, 4>;
+// One run of UTF-8 sequences: a byte range for each position.
+using ByteRanges = std::vector<std::pair<uint8_t, uint8_t>>;
+
+size_t encodeUtf8(uint32_t cp, uint8_t* out) {
+    if (cp < 0x80) {
+        out[0] = static_cast<uint8_t>(cp);
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = static_cast<uint8_t>(0xC0 | (cp >> 6));
+        out[1] = static_cast<uint8_t>(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = static_cast<uint8_t>(0xE0 | (cp >> 12));
+        out[1] = static_cast<uint8_t>(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = static_cast<uint8_t>(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = static_cast<uint8_t>(0xF0 | (cp >> 18));
+    out[1] = static_cast<uint8_t>(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = static_cast<uint8_t>(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = static_cast<uint8_t>(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+/**
+ * Split the code points [lo, hi] into runs whose UTF-8 encodings are
+ * exactly the products of per-byte ranges: first by encoded length,
+ * then wherever a continuation byte would not cover its full range.
+ */
+void addUtf8Range(uint32_t lo, uint32_t hi, std::vector<ByteRanges>* out) {
+    if (lo > hi) return;
+    for (uint32_t limit : {0x7Fu, 0x7FFu, 0xFFFFu}) {
+        if (lo <= limit && hi > limit) {
+            addUtf8Range(lo, limit, out);
+            addUtf8Range(limit + 1, hi, out);
+            return;
+        }
+    }
+    for (int i = 1; i < 4; ++i) {
+        const uint32_t m = (1u << (6 * i)) - 1;
+        if ((lo & ~m) == (hi & ~m)) continue;
+        if ((lo & m) != 0) {
+            addUtf8Range(lo, lo | m, out);
+            addUtf8Range((lo | m) + 1, hi, out);
+            return;
+        }
+        if ((hi & m) != m) {
+            addUtf8Range(lo, (hi & ~m) - 1, out);
+            addUtf8Range(hi & ~m, hi, out);
+            return;
+        }
+    }
+    uint8_t first[4];
+    uint8_t last[4];
+    const size_t length = encodeUtf8(lo, first);
+    encodeUtf8(hi, last);
+    ByteRanges ranges;
+    for (size_t i = 0; i < length; ++i) ranges.emplace_back(first[i], last[i]);
+    out->push_back(std::move(ranges));
+}
+
+/** Disallowed logits to kMaskedLogit: bit i of [mask] keeps logit i. */
+void maskLogits(const uint64_t* mask, float* logits, int n) {
+    for (int base = 0; base < n; base += 64) {
+        const uint64_t bits = mask[base >> 6];
+        float* x = logits + base;
+        if (bits == ~0ULL) continue;
+        if (n - base < 64) {
+            for (int k = 0; k < n - base; ++k) {
+                if (!((bits >> k) & 1)) x[k] = kMaskedLogit;
+            }
+            continue;
+        }
+        if (bits == 0) {
+            std::fill(x, x + 64, kMaskedLogit);
+            continue;
+        }
+#if defined(NIMITTAM_GRAMMAR_NEON)
+        static const uint32_t kLaneBits[4] = {1, 2, 4, 8};
+        const uint32x4_t laneBits = vld1q_u32(kLaneBits);
+        const float32x4_t blocked = vdupq_n_f32(kMaskedLogit);
+        for (int k = 0; k < 64; k += 4) {
+            const uint32x4_t nibble = vdupq_n_u32(static_cast<uint32_t>(bits >> k));
+            const uint32x4_t allowed = vtstq_u32(nibble, laneBits);
+            vst1q_f32(x + k, vbslq_f32(allowed, vld1q_f32(x + k), blocked));
+        }
+#elif defined(NIMITTAM_GRAMMAR_SSE2)
+        const __m128i laneBits = _mm_setr_epi32(1, 2, 4, 8);
+        const __m128 blocked = _mm_set1_ps(kMaskedLogit);
+        for (int k = 0; k < 64; k += 4) {
+            const __m128i nibble = _mm_set1_epi32(static_cast<int32_t>(bits >> k));
+            const __m128 allowed =
+                _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(nibble, laneBits), laneBits));
+            const __m128 kept = _mm_and_ps(allowed, _mm_loadu_ps(x + k));
+            _mm_storeu_ps(x + k, _mm_or_ps(kept, _mm_andnot_ps(allowed, blocked)));
+        }
+#else
+        for (int k = 0; k < 64; ++k) {
+            if (!((bits >> k) & 1)) x[k] = kMaskedLogit;
+        }
+#endif
+    }
+}
+
+std::vector<std::string> vocabularyOf(const Tokenizer& tokenizer) {
+    std::vector<std::string> tokens(tokenizer.vocabSize());
+    for (int id = 0; id < tokenizer.vocabSize(); ++id) tokens[id] = tokenizer.tokenBytes(id);
+    for (const auto& added : tokenizer.addedTokens()) tokens[added.second].clear();
+    return tokens;
+}
+
+} // namespace
+
+/**
+ * GBNF source to a Grammar. Rules are first built as alternatives of
+ * symbol sequences, with groups, repetitions and multi-byte character
+ * classes turned into rules of their own, then checked and laid out.
+ */
+class GbnfParser {
+public:
+    GbnfParser(const std::string& source, Grammar* out)
+        : begin_(source.data()), p_(source.data()), end_(source.data() + source.size()),
+          out_(out) {}
+
+    bool run(std::string* error) {
+        if (!parseRules() || !check()) {
+            *error = error_;
+            return false;
+        }
+        layOut();
+        return true;
+    }
+
+private:
+    struct Symbol {
+        bool rule;
+        uint32_t value;  // rule or byte set index
+    };
+    using Sequence = std::vector<Symbol>;
+
+    bool fail(const std::string& message) {
+        const int line = 1 + static_cast<int>(std::count(begin_, p_, '\n'));
+        error_ = "line " + std::to_string(line) + ": " + message;
+        return false;
+    }
+
+    static bool isNameChar(char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+               c == '-' || c == '_';
+    }
+
+    void skipSpace(bool newlines) {
+        while (p_ < end_) {
+            if (*p_ == ' ' || *p_ == '\t' || (newlines && (*p_ == '\n' || *p_ == '\r'))) {
+                ++p_;
+            } else if (*p_ == '#') {
+                while (p_ < end_ && *p_ != '\n') ++p_;
+            } else {
+                break;
+            }
+        }
+    }
+
+    uint32_t ruleIndex(const std::string& name) {
+        auto it = ids_.find(name);
+        if (it != ids_.end()) return it->second;
+        const auto index = static_cast<uint32_t>(names_.size());
+        ids_.emplace(name, index);
+        names_.push_back(name);
+        rules_.emplace_back();
+        defined_.push_back(false);
+        referencedAt_.push_back(p_);
+        return index;
+    }
+
+    /** A rule for a group, repetition or character class of the current rule. */
+    uint32_t newRule(std::vector<Sequence> alternatives) {
+        const uint32_t index = ruleIndex(current_ + "#" + std::to_string(++generated_));
+        defined_[index] = true;
+        rules_[index] = std::move(alternatives);
+        return index;
+    }
+
+    Symbol byteSet(const ByteSet& set) {
+        auto it = setIds_.find(set);
+        if (it == setIds_.end()) {
+            it = setIds_.emplace(set, static_cast<uint32_t>(setIds_.size())).first;
+        }
+        return {false, it->second};
+    }
+
+    Symbol byteRange(uint8_t lo, uint8_t hi) {
+        ByteSet set = {};
+        for (unsigned b = lo; b <= hi; ++b) set[b >> 6] |= 1ULL << (b & 63);
+        return byteSet(set);
+    }
+
+    bool parseRules() {
+        while (true) {
+            skipSpace(true);
+            if (p_ == end_) return true;
+            const char* start = p_;
+            while (p_ < end_ && isNameChar(*p_)) ++p_;
+            if (p_ == start) return fail("expected a rule name");
+            current_.assign(start, p_);
+            generated_ = 0;
+            skipSpace(false);
+            if (end_ - p_ < 3 || std::strncmp(p_, "::=", 3) != 0) {
+                return fail("expected ::= after '" + current_ + "'");
+            }
+            p_ += 3;
+            const uint32_t rule = ruleIndex(current_);
+            if (defined_[rule]) return fail("rule '" + current_ + "' is defined twice");
+            defined_[rule] = true;
+            skipSpace(true);
+            std::vector<Sequence> alternatives;
+            if (!parseAlternatives(false, &alternatives)) return false;
+            rules_[rule] = std::move(alternatives);
+            skipSpace(false);
+            if (p_ < end_ && *p_ != '\n' && *p_ != '\r') {
+                return fail(std::string("unexpected '") + *p_ + "'");
+            }
+        }
+    }
+
+    bool parseAlternatives(bool nested, std::vector<Sequence>* out) {
+        out->emplace_back();
+        if (!parseSequence(nested, &out->back())) return false;
+        while (p_ < end_ && *p_ == '|') {
+            ++p_;
+            skipSpace(true);
+            out->emplace_back();
+            if (!parseSequence(nested, &out->back())) return false;
+        }
+        return true;
+    }
+
+    bool parseSequence(bool nested, Sequence* out) {
+        while (true) {
+            skipSpace(nested);
+            if (p_ == end_) return true;
+            const char c = *p_;
+            if (c == '|' || c == ')' || c == '\n' || c == '\r') return true;
+            Sequence item;
+            if (c == '"') {
+                if (!parseLiteral(&item)) return false;
+            } else if (c == '[') {
+                if (!parseClass(&item)) return false;
+            } else if (c == '.') {
+                ++p_;
+                addClass({{0, 0x10FFFF}}, &item);
+            } else if (c == '(') {
+                ++p_;
+                skipSpace(true);
+                std::vector<Sequence> alternatives;
+                if (!parseAlternatives(true, &alternatives)) return false;
+                if (p_ == end_ || *p_ != ')') return fail("expected )");
+                ++p_;
+                item.push_back({true, newRule(std::move(alternatives))});
+            } else if (isNameChar(c)) {
+                const char* start = p_;
+                while (p_ < end_ && isNameChar(*p_)) ++p_;
+                item.push_back({true, ruleIndex(std::string(start, p_))});
+            } else {
+                return fail(std::string("unexpected '") + c + "'");
+            }
+            if (!parseRepetition(std::move(item), out)) return false;
+        }
+    }
+
+    bool parseRepetition(Sequence item, Sequence* out) {
+        uint32_t min = 1;
+        uint32_t max = 1;
+        const uint32_t kUnbounded = ~0u;
+        if (p_ < end_ && (*p_ == '*' || *p_ == '+' || *p_ == '?')) {
+            min = *p_ == '+' ? 1 : 0;
+            max = *p_ == '?' ? 1 : kUnbounded;
+            ++p_;
+        } else if (p_ < end_ && *p_ == '{') {
+            ++p_;
+            if (!parseCount(&min)) return false;
+            max = min;
+            if (p_ < end_ && *p_ == ',') {
+                ++p_;
+                max = kUnbounded;
+                if (p_ < end_ && *p_ != '}' && !parseCount(&max)) return false;
+            }
+            if (p_ == end_ || *p_ != '}') return fail("expected }");
+            ++p_;
+            if (max < min) return fail("repetition bounds out of order");
+        }
+        for (uint32_t i = 0; i < min; ++i) out->insert(out->end(), item.begin(), item.end());
+        if (max == kUnbounded) {
+            // item* as a right-recursive rule: R ::= item R |
+            const uint32_t rule = newRule({});
+            Sequence again = item;
+            again.push_back({true, rule});
+            rules_[rule] = {again, {}};
+            out->push_back({true, rule});
+        } else if (max > min) {
+            // Nested optionals, so at most max - min more.
+            Sequence tail;
+            for (uint32_t i = min; i < max; ++i) {
+                Sequence more = item;
+                more.insert(more.end(), tail.begin(), tail.end());
+                tail = {{true, newRule({more, {}})}};
+            }
+            out->insert(out->end(), tail.begin(), tail.end());
+        }
+        return true;
+    }
+
+    bool parseCount(uint32_t* out) {
+        skipSpace(false);
+        const char* start = p_;
+        uint32_t value = 0;
+        while (p_ < end_ && *p_ >= '0' && *p_ <= '9') {
+            value = value * 10 + (*p_++ - '0');
+            if (value > kMaxRepeat) return fail("repetition bound over 1000");
+        }
+        if (p_ == start) return fail("expected a number");
+        skipSpace(false);
+        *out = value;
+        return true;
+    }
+
+    /** One code point of a literal or class, escapes decoded. */
+    bool parseChar(uint32_t* out) {
+        if (p_ == end_ || *p_ == '\n') return fail("unterminated literal");
+        const auto c = static_cast<unsigned char>(*p_++);
+        if (c == '\\') {
+            if (p_ == end_) return fail("unterminated escape");
+            const char e = *p_++;
+            int digits = 0;
+            switch (e) {
+                case 'n': *out = '\n'; return true;
+                case 'r': *out = '\r'; return true;
+                case 't': *out = '\t'; return true;
+                case 'x': digits = 2; break;
+                case 'u': digits = 4; break;
+                case 'U': digits = 8; break;
+                case '\\': case '"': case '\'': case '[': case ']': case '-': case '^': case '/':
+                    *out = static_cast<unsigned char>(e);
+                    return true;
+                default:
+                    return fail(std::string("unknown escape \\") + e);
+            }
+            uint32_t value = 0;
+            for (int i = 0; i < digits; ++i) {
+                const char h = p_ < end_ ? *p_++ : '\0';
+                int v;
+                if (h >= '0' && h <= '9') v = h - '0';
+                else if (h >= 'a' && h <= 'f') v = h - 'a' + 10;
+                else if (h >= 'A' && h <= 'F') v = h - 'A' + 10;
+                else return fail("bad hex escape");
+                value = value << 4 | static_cast<uint32_t>(v);
+            }
+            if (value > 0x10FFFF) return fail("escape beyond U+10FFFF");
+            *out = value;
+            return true;
+        }
+        // Raw UTF-8 in the grammar source.
+        size_t length = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+        uint32_t cp = length == 1 ? c : c & (0x3F >> (length - 1));
+        for (size_t i = 1; i < length; ++i) {
+            if (p_ == end_ || (static_cast<unsigned char>(*p_) & 0xC0) != 0x80) {
+                return fail("malformed UTF-8");
+            }
+            cp = cp << 6 | (static_cast<unsigned char>(*p_++) & 0x3F);
+        }
+        *out = cp;
+        return true;
+    }
+
+    bool parseLiteral(Sequence* out) {
+        ++p_;
+        while (p_ < end_ && *p_ != '"' && *p_ != '\n') {
+            // Raw bytes are copied as they are; escapes are encoded.
+            if (*p_ != '\\') {
+                const auto b = static_cast<uint8_t>(*p_++);
+                out->push_back(byteRange(b, b));
+                continue;
+            }
+            uint32_t cp;
+            if (!parseChar(&cp)) return false;
+            uint8_t bytes[4];
+            const size_t length = encodeUtf8(cp, bytes);
+            for (size_t i = 0; i < length; ++i) out->push_back(byteRange(bytes[i], bytes[i]));
+        }
+        if (p_ == end_ || *p_ != '"') return fail("unterminated string");
+        ++p_;
+        return true;
+    }
+
+    bool parseClass(Sequence* out) {
+        ++p_;
+        const bool negated = p_ < end_ && *p_ == '^';
+        if (negated) ++p_;
+        std::vector<std::pair<uint32_t, uint32_t>> ranges;
+        while (p_ < end_ && *p_ != ']') {
+            uint32_t lo;
+            if (!parseChar(&lo)) return false;
+            uint32_t hi = lo;
+            if (end_ - p_ >= 2 && p_[0] == '-' && p_[1] != ']') {
+                ++p_;
+                if (!parseChar(&hi)) return false;
+                if (hi < lo) return fail("character range out of order");
+            }
+            ranges.emplace_back(lo, hi);
+        }
+        if (p_ == end_) return fail("unterminated character class");
+        ++p_;
+        if (negated) {
+            std::sort(ranges.begin(), ranges.end());
+            std::vector<std::pair<uint32_t, uint32_t>> complement;
+            uint32_t next = 0;
+            for (const auto& range : ranges) {
+                if (range.first > next) complement.emplace_back(next, range.first - 1);
+                next = std::max(next, range.second + 1);
+            }
+            if (next <= 0x10FFFF) complement.emplace_back(next, 0x10FFFF);
+            ranges = std::move(complement);
+        }
+        addClass(ranges, out);
+        return true;
+    }
+
+    /**
+     * Code point ranges (surrogates left out) as one byte set for the
+     * single-byte part plus, when the class reaches past ASCII, a rule
+     * with one alternative per run of multi-byte sequences.
+     */
+    void addClass(const std::vector<std::pair<uint32_t, uint32_t>>& ranges, Sequence* out) {
+        std::vector<ByteRanges> runs;
+        for (const auto& range : ranges) {
+            if (range.second < 0xD800 || range.first > 0xDFFF) {
+                addUtf8Range(range.first, range.second, &runs);
+                continue;
+            }
+            if (range.first < 0xD800) addUtf8Range(range.first, 0xD7FF, &runs);
+            if (range.second > 0xDFFF) addUtf8Range(0xE000, range.second, &runs);
+        }
+        ByteSet single = {};
+        bool hasSingle = false;
+        std::vector<Sequence> alternatives;
+        for (const ByteRanges& run : runs) {
+            if (run.size() == 1) {
+                for (unsigned b = run[0].first; b <= run[0].second; ++b) {
+                    single[b >> 6] |= 1ULL << (b & 63);
+                }
+                hasSingle = true;
+                continue;
+            }
+            Sequence sequence;
+            for (const auto& bytes : run) sequence.push_back(byteRange(bytes.first, bytes.second));
+            alternatives.push_back(std::move(sequence));
+        }
+        if (alternatives.empty()) {
+            out->push_back(byteSet(single));
+            return;
+        }
+        if (hasSingle) alternatives.push_back({byteSet(single)});
+        out->push_back({true, newRule(std::move(alternatives))});
+    }
+
+    bool check() {
+        for (size_t r = 0; r < names_.size(); ++r) {
+            if (!defined_[r]) {
+                p_ = referencedAt_[r];
+                return fail("undefined rule '" + names_[r] + "'");
+            }
+        }
+        auto root = ids_.find("root");
+        if (root == ids_.end()) {
+            p_ = end_;
+            return fail("no root rule");
+        }
+        out_->root_ = root->second;
+
+        // Nullable rules, to a fixed point.
+        std::vector<bool> nullable(names_.size(), false);
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (size_t r = 0; r < rules_.size(); ++r) {
+                if (nullable[r]) continue;
+                for (const Sequence& sequence : rules_[r]) {
+                    bool empty = true;
+                    for (const Symbol& symbol : sequence) {
+                        if (!symbol.rule || !nullable[symbol.value]) {
+                            empty = false;
+                            break;
+                        }
+                    }
+                    if (empty) {
+                        nullable[r] = true;
+                        changed = true;
+                        break;
+                    }
+                }
+            }
+        }
+
+        // A rule that can reach itself without consuming a byte would
+        // expand forever; look for a cycle among such leading references.
+        std::vector<std::vector<uint32_t>> leading(rules_.size());
+        for (size_t r = 0; r < rules_.size(); ++r) {
+            for (const Sequence& sequence : rules_[r]) {
+                for (const Symbol& symbol : sequence) {
+                    if (!symbol.rule) break;
+                    leading[r].push_back(symbol.value);
+                    if (!nullable[symbol.value]) break;
+                }
+            }
+        }
+        std::vector<uint8_t> color(rules_.size(), 0);  // 0 new, 1 on the path, 2 done
+        std::vector<std::pair<uint32_t, size_t>> path;
+        for (uint32_t start = 0; start < rules_.size(); ++start) {
+            if (color[start]) continue;
+            path.emplace_back(start, 0);
+            color[start] = 1;
+            while (!path.empty()) {
+                auto& top = path.back();
+                if (top.second == leading[top.first].size()) {
+                    color[top.first] = 2;
+                    path.pop_back();
+                    continue;
+                }
+                const uint32_t next = leading[top.first][top.second++];
+                if (color[next] == 1) {
+                    // Name the user's rule, not one generated for it.
+                    std::string name = names_[next];
+                    name = name.substr(0, name.find('#'));
+                    p_ = end_;
+                    error_ = "left recursion through rule '" + name + "'";
+                    return false;
+                }
+                if (color[next] == 0) {
+                    color[next] = 1;
+                    path.emplace_back(next, 0);
+                }
+            }
+        }
+        return true;
+    }
+
+    void layOut() {
+        Grammar& g = *out_;
+        g.byteSets_.resize(setIds_.size());
+        for (const auto& entry : setIds_) g.byteSets_[entry.second] = entry.first;
+        g.ruleNames_ = names_;
+        for (const auto& alternatives : rules_) {
+            g.ruleAlternatives_.push_back(static_cast<uint32_t>(g.alternatives_.size()));
+            for (const Sequence& sequence : alternatives) {
+                g.alternatives_.push_back(static_cast<uint32_t>(g.elements_.size()));
+                for (const Symbol& symbol : sequence) {
+                    g.elements_.push_back({symbol.rule ? Grammar::ElementType::Rule
+                                                       : Grammar::ElementType::Bytes,
+                                           symbol.value});
+                }
+                g.elements_.push_back({Grammar::ElementType::End, 0});
+            }
+        }
+        g.ruleAlternatives_.push_back(static_cast<uint32_t>(g.alternatives_.size()));
+    }
+
+    const char* begin_;
+    const char* p_;
+    const char* end_;
+    Grammar* out_;
+    std::string error_;
+
+    std::vector<std::string> names_;
+    std::unordered_map<std::string, uint32_t> ids_;
+    std::vector<std::vector<Sequence>> rules_;
+    std::vector<bool> defined_;
+    std::vector<const char*> referencedAt_;
+    std::map<ByteSet, uint32_t> setIds_;
+    std::string current_;
+    int generated_ = 0;
+};
+
+bool Grammar::parse(const std::string& source, Grammar* out, std::string* error) {
+    *out = Grammar();
+    return GbnfParser(source, out).run(error);
+}
+
+bool Grammar::fromJsonSchema(const std::string& schema, Grammar* out, std::string* error) {
+    JsonValue root;
+    if (!JsonValue::parse(schema.data(), schema.size(), &root, error)) return false;
+    std::string gbnf;
+    if (!jsonSchemaToGbnf(root, &gbnf, error)) return false;
+    if (!parse(gbnf, out, error)) {
+        *error = "schema grammar: " + *error;
+        return false;
+    }
+    return true;
+}
+
+size_t GrammarMatcher::StateHash::operator()(const std::vector<uint32_t>& frames) const {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (uint32_t frame : frames) h = (h ^ frame) * 0x100000001b3ULL;
+    return static_cast<size_t>(h);
+}
+
+GrammarMatcher::GrammarMatcher(std::shared_ptr<const Grammar> grammar,
+                               const std::vector<std::string>& tokens, int vocabSize,
+                               std::vector<int32_t> stopTokens)
+    : grammar_(std::move(grammar)),
+      vocabSize_(vocabSize),
+      maskWords_((static_cast<size_t>(vocabSize) + 63) / 64),
+      stopTokens_(std::move(stopTokens)) {
+    const size_t count = std::min(tokens.size(), static_cast<size_t>(vocabSize));
+    tokenOffsets_.reserve(count + 1);
+    for (size_t id = 0; id < count; ++id) {
+        tokenOffsets_.push_back(static_cast<uint32_t>(tokenText_.size()));
+        tokenText_ += tokens[id];
+    }
+    tokenOffsets_.push_back(static_cast<uint32_t>(tokenText_.size()));
+    buildTrie(tokens);
+    reset();
+}
+
+GrammarMatcher::GrammarMatcher(std::shared_ptr<const Grammar> grammar, const Tokenizer& tokenizer,
+                               int vocabSize, std::vector<int32_t> stopTokens)
+    : GrammarMatcher(std::move(grammar), vocabularyOf(tokenizer), vocabSize,
+                     std::move(stopTokens)) {}
+
+void GrammarMatcher::buildTrie(const std::vector<std::string>& tokens) {
+    std::vector<int32_t> order;
+    for (size_t id = 0; id + 1 < tokenOffsets_.size(); ++id) {
+        if (!tokens[id].empty()) order.push_back(static_cast<int32_t>(id));
+    }
+    std::sort(order.begin(), order.end(),
+              [&](int32_t a, int32_t b) { return tokens[a] < tokens[b]; });
+
+    // Sorted, a token shares its longest trie prefix with the one before.
+    std::vector<uint32_t> path;
+    const std::string* previous = nullptr;
+    size_t maxDepth = 0;
+    for (int32_t id : order) {
+        const std::string& bytes = tokens[id];
+        size_t common = 0;
+        if (previous) {
+            const size_t limit = std::min(previous->size(), bytes.size());
+            while (common < limit && (*previous)[common] == bytes[common]) ++common;
+        }
+        if (common == bytes.size()) continue;  // same bytes as the previous token
+        path.resize(common);
+        for (size_t d = common; d < bytes.size(); ++d) {
+            path.push_back(static_cast<uint32_t>(trieByte_.size()));
+            trieByte_.push_back(static_cast<uint8_t>(bytes[d]));
+            trieDepth_.push_back(static_cast<uint16_t>(d + 1));
+            trieToken_.push_back(-1);
+        }
+        trieToken_[path.back()] = id;
+        maxDepth = std::max(maxDepth, bytes.size());
+        previous = &bytes;
+    }
+
+    // A subtree ends at the next node no deeper than its root.
+    const auto n = static_cast<uint32_t>(trieByte_.size());
+    trieEnd_.assign(n, n);
+    std::vector<uint32_t> open;
+    for (uint32_t i = 0; i < n; ++i) {
+        while (!open.empty() && trieDepth_[open.back()] >= trieDepth_[i]) {
+            trieEnd_[open.back()] = i;
+            open.pop_back();
+        }
+        open.push_back(i);
+    }
+    walk_.assign(maxDepth + 1, kDead);
+}
+
+uint32_t GrammarMatcher::internFrame(uint32_t position, uint32_t parent) {
+    const uint64_t key = static_cast<uint64_t>(position) << 32 | parent;
+    auto it = frameIds_.find(key);
+    if (it != frameIds_.end()) return it->second;
+    const auto id = static_cast<uint32_t>(frames_.size());
+    frames_.emplace_back(position, parent);
+    frameIds_.emplace(key, id);
+    return id;
+}
+
+int32_t GrammarMatcher::internState(const std::vector<uint32_t>& frames) {
+    auto it = stateIds_.find(frames);
+    if (it != stateIds_.end()) return it->second;
+    const auto id = static_cast<int32_t>(states_.size());
+    states_.push_back(frames);
+    stateIds_.emplace(frames, id);
+    transitions_.resize(transitions_.size() + 256, kUnknown);
+    maskSlot_.push_back(-1);
+    return id;
+}
+
+void GrammarMatcher::expand(uint32_t position, uint32_t parent) {
+    const Grammar::Element& element = grammar_->element(position);
+    switch (element.type) {
+        case Grammar::ElementType::Bytes:
+            scratch_.push_back(internFrame(position, parent));
+            return;
+        case Grammar::ElementType::End:
+            if (parent == kNoFrame) {
+                scratch_.push_back(kAccept);
+            } else {
+                const auto frame = frames_[parent];
+                expand(frame.first, frame.second);
+            }
+            return;
+        case Grammar::ElementType::Rule: {
+            // A reference that ends its alternative returns straight to
+            // the caller's caller, so right recursion keeps stacks flat.
+            const uint32_t next = position + 1;
+            const uint32_t ret = grammar_->element(next).type == Grammar::ElementType::End
+                                     ? parent
+                                     : internFrame(next, parent);
+            const uint32_t* alternatives = grammar_->alternatives(element.value);
+            const size_t count = grammar_->alternativeCount(element.value);
+            for (size_t i = 0; i < count; ++i) expand(alternatives[i], ret);
+            return;
+        }
+    }
+}
+
+int32_t GrammarMatcher::advance(int32_t state, uint8_t byte) {
+    const size_t slot = static_cast<size_t>(state) * 256 + byte;
+    if (transitions_[slot] != kUnknown) return transitions_[slot];
+    scratch_.clear();
+    for (uint32_t frame : states_[state]) {
+        if (frame == kAccept) continue;
+        const auto top = frames_[frame];
+        if (grammar_->matches(top.first, byte)) expand(top.first + 1, top.second);
+    }
+    int32_t next = kDead;
+    if (!scratch_.empty()) {
+        std::sort(scratch_.begin(), scratch_.end());
+        scratch_.erase(std::unique(scratch_.begin(), scratch_.end()), scratch_.end());
+        next = internState(scratch_);
+    }
+    transitions_[slot] = next;
+    return next;
+}
+
+int32_t GrammarMatcher::advance(int32_t state, const char* bytes, size_t size) {
+    for (size_t i = 0; i < size && state != kDead; ++i) {
+        state = advance(state, static_cast<uint8_t>(bytes[i]));
+    }
+    return state;
+}
+
+void GrammarMatcher::reset() {
+    if (initial_ == kDead) {
+        scratch_.clear();
+        const uint32_t* alternatives = grammar_->alternatives(grammar_->root());
+        for (size_t i = 0; i < grammar_->alternativeCount(grammar_->root()); ++i) {
+            expand(alternatives[i], kNoFrame);
+        }
+        std::sort(scratch_.begin(), scratch_.end());
+        scratch_.erase(std::unique(scratch_.begin(), scratch_.end()), scratch_.end());
+        initial_ = internState(scratch_);
+    }
+    state_ = initial_;
+}
+
+bool GrammarMatcher::isComplete() const {
+    return state_ != kDead && !states_[state_].empty() && states_[state_].back() == kAccept;
+}
+
+bool GrammarMatcher::accept(int32_t token) {
+    if (std::find(stopTokens_.begin(), stopTokens_.end(), token) != stopTokens_.end()) {
+        return isComplete();
+    }
+    if (token < 0 || static_cast<size_t>(token) + 1 >= tokenOffsets_.size()) return false;
+    const uint32_t begin = tokenOffsets_[token];
+    const uint32_t end = tokenOffsets_[token + 1];
+    if (begin == end) return false;
+    const int32_t next = advance(state_, tokenText_.data() + begin, end - begin);
+    if (next == kDead) return false;
+    state_ = next;
+    if (states_.size() > kMaxStates) compact();
+    return true;
+}
+
+bool GrammarMatcher::acceptBytes(const std::string& bytes) {
+    const int32_t next = advance(state_, bytes.data(), bytes.size());
+    if (next == kDead) return false;
+    state_ = next;
+    if (states_.size() > kMaxStates) compact();
+    return true;
+}
+
+void GrammarMatcher::compact() {
+    const std::vector<uint32_t> current = states_[state_];
+    const std::vector<std::pair<uint32_t, uint32_t>> old = std::move(frames_);
+    frames_.clear();
+    frameIds_.clear();
+    states_.clear();
+    stateIds_.clear();
+    transitions_.clear();
+    maskSlot_.clear();
+    maskCount_ = 0;
+    initial_ = kDead;
+
+    // Copy each live stack bottom first, sharing frames as before.
+    std::vector<uint32_t> remap(old.size(), kNoFrame);
+    std::vector<uint32_t> chain;
+    std::vector<uint32_t> tops;
+    for (uint32_t frame : current) {
+        if (frame == kAccept) {
+            tops.push_back(kAccept);
+            continue;
+        }
+        chain.clear();
+        uint32_t f = frame;
+        for (; f != kNoFrame && remap[f] == kNoFrame; f = old[f].second) chain.push_back(f);
+        uint32_t parent = f == kNoFrame ? kNoFrame : remap[f];
+        for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+            remap[*it] = internFrame(old[*it].first, parent);
+            parent = remap[*it];
+        }
+        tops.push_back(remap[frame]);
+    }
+    std::sort(tops.begin(), tops.end());
+    state_ = internState(tops);
+}
+
+void GrammarMatcher::computeMask(int32_t state, uint64_t* mask) {
+    std::fill(mask, mask + maskWords_, 0);
+    // Preorder: the state at a node's parent is still in walk_ when the
+    // node comes up, and a rejected node skips its whole subtree.
+    walk_[0] = state;
+    const size_t n = trieByte_.size();
+    for (size_t i = 0; i < n;) {
+        const int32_t next = advance(walk_[trieDepth_[i] - 1], trieByte_[i]);
+        if (next == kDead) {
+            i = trieEnd_[i];
+            continue;
+        }
+        walk_[trieDepth_[i]] = next;
+        const int32_t token = trieToken_[i];
+        if (token >= 0) mask[token >> 6] |= 1ULL << (token & 63);
+        ++i;
+    }
+    if (!states_[state].empty() && states_[state].back() == kAccept) {
+        for (int32_t token : stopTokens_) {
+            if (token >= 0 && token < vocabSize_) mask[token >> 6] |= 1ULL << (token & 63);
+        }
+    }
+}
+
+const uint64_t* GrammarMatcher::currentMask() {
+    if (maskSlot_[state_] < 0) {
+        if (maskCount_ == kMaxMasks) {
+            std::fill(maskSlot_.begin(), maskSlot_.end(), -1);
+            maskCount_ = 0;
+        }
+        const size_t slot = maskCount_++;
+        if (masks_.size() < maskCount_ * maskWords_) masks_.resize(maskCount_ * maskWords_);
+        if (maskAllows_.size() < maskCount_) maskAllows_.resize(maskCount_);
+        uint64_t* mask = masks_.data() + slot * maskWords_;
+        computeMask(state_, mask);
+        maskAllows_[slot] =
+            std::any_of(mask, mask + maskWords_, [](uint64_t word) { return word != 0; });
+        // computeMask() may have added states, so index afresh.
+        maskSlot_[state_] = static_cast<int32_t>(slot);
+    }
+    return masks_.data() + static_cast<size_t>(maskSlot_[state_]) * maskWords_;
+}
+
+bool GrammarMatcher::applyMask(float* logits) {
+    if (state_ == kDead) return false;
+    const uint64_t* mask = currentMask();
+    if (!maskAllows_[maskSlot_[state_]]) return false;
+    maskLogits(mask, logits, vocabSize_);
+    return true;
+}
+
+} // namespace nimittam
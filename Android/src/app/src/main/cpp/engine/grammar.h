@@ -0,0 +1,207 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Grammar-constrained decoding: GBNF grammars (and the JSON schemas
+ * that translate to them) compiled to a byte-level pushdown automaton,
+ * and the per-state vocabulary masks that keep sampling inside it.
+ *
+ * Grammar works on bytes, not code points: string literals are stored
+ * as their UTF-8 bytes and a character class becomes alternatives of
+ * byte ranges, one per run of UTF-8 sequences with the same shape. A
+ * token's raw bytes then drive the automaton directly, even when the
+ * token ends partway through a character.
+ *
+ * GrammarMatcher runs the automaton lazily determinized. A state is
+ * the deduplicated set of parse stacks (stack frames are interned, so
+ * stacks sharing a bottom share storage) and every (state, byte)
+ * transition is computed once and remembered. The mask of a state is
+ * found by walking a trie of the vocabulary from it, skipping every
+ * subtree the automaton rejects, and is cached as a bitmask. Inside a
+ * string or a number the automaton keeps returning to the same few
+ * states, so after the first tokens a step costs one bitmask pass over
+ * the logits.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace nimittam {
+
+class Tokenizer;
+
+/**
+ * A compiled GBNF grammar, immutable once parsed. The dialect is
+ * llama.cpp's: `name ::= alternatives`, one rule per line unless inside
+ * parentheses or after `|`; string literals, character classes (with
+ * ^, ranges and \x, \u, \U escapes), `.`, grouping, and the postfix
+ * operators *, +, ? and {m}, {m,}, {m,n}. Rules reference each other by
+ * name, `#` starts a comment, and decoding starts at `root`.
+ */
+class Grammar {
+public:
+    /** A position in the rule table: what the automaton expects next. */
+    enum class ElementType : uint8_t { End, Bytes, Rule };
+
+    struct Element {
+        ElementType type;
+        // Byte set index for Bytes, rule index for Rule.
+        uint32_t value;
+    };
+
+    /**
+     * Compile GBNF source. Fails with a message naming the line for
+     * syntax errors, undefined rules and left recursion, which the
+     * automaton could not run.
+     */
+    static bool parse(const std::string& source, Grammar* out, std::string* error);
+
+    /** Compile a JSON schema by way of jsonSchemaToGbnf() (json_schema.h). */
+    static bool fromJsonSchema(const std::string& schema, Grammar* out, std::string* error);
+
+    const Element& element(uint32_t position) const { return elements_[position]; }
+    bool matches(uint32_t position, uint8_t byte) const {
+        const auto& set = byteSets_[elements_[position].value];
+        return (set[byte >> 6] >> (byte & 63)) & 1;
+    }
+    /** Start positions of the alternatives of [rule]. */
+    const uint32_t* alternatives(uint32_t rule) const {
+        return alternatives_.data() + ruleAlternatives_[rule];
+    }
+    size_t alternativeCount(uint32_t rule) const {
+        return ruleAlternatives_[rule + 1] - ruleAlternatives_[rule];
+    }
+    uint32_t root() const { return root_; }
+
+private:
+    friend class GbnfParser;
+
+    // Every rule's alternatives back to back, each a run of Bytes and
+    // Rule elements closed by an End.
+    std::vector<Element> elements_;
+    std::vector<std::array<uint64_t, 4>> byteSets_;
+    std::vector<uint32_t> alternatives_;
+    // Rule r's alternatives are alternatives_[ruleAlternatives_[r] .. [r + 1]).
+    std::vector<uint32_t> ruleAlternatives_;
+    std::vector<std::string> ruleNames_;
+    uint32_t root_ = 0;
+};
+
+/**
+ * Decoding state of one Grammar over one vocabulary, with the token
+ * masks it has worked out so far. Used by one decode at a time; keep it
+ * across requests with the same grammar to keep the masks.
+ */
+class GrammarMatcher {
+public:
+    /**
+     * [tokens] holds the bytes of every token id; ids with no bytes are
+     * never allowed. [stopTokens] are allowed only where the grammar is
+     * complete. Masks cover [vocabSize] logits.
+     */
+    GrammarMatcher(std::shared_ptr<const Grammar> grammar, const std::vector<std::string>& tokens,
+                   int vocabSize, std::vector<int32_t> stopTokens);
+
+    /** The same over [tokenizer]'s vocabulary; added tokens are never allowed. */
+    GrammarMatcher(std::shared_ptr<const Grammar> grammar, const Tokenizer& tokenizer,
+                   int vocabSize, std::vector<int32_t> stopTokens);
+
+    /** Back to the start of the grammar. */
+    void reset();
+
+    /**
+     * Set the logits of tokens the grammar does not allow next to
+     * kMaskedLogit (sampler.h). Returns false, leaving [logits] alone,
+     * if none is.
+     */
+    bool applyMask(float* logits);
+
+    /** Advance past [token]; false (and no change) if it is not allowed. */
+    bool accept(int32_t token);
+
+    /** Advance past raw bytes; false (and no change) if they do not fit. */
+    bool acceptBytes(const std::string& bytes);
+
+    /** Whether the text so far is a complete sentence of the grammar. */
+    bool isComplete() const;
+
+    /** Bitmask of allowed token ids, bit i of word i / 64, for the current state. */
+    const uint64_t* currentMask();
+
+    size_t cachedStates() const { return states_.size(); }
+    size_t cachedMasks() const { return maskCount_; }
+
+private:
+    // States past this are dropped (all but the current one) at the next accept().
+    static constexpr size_t kMaxStates = 4096;
+    // Masks past this many are all dropped before another is stored.
+    static constexpr size_t kMaxMasks = 64;
+    static constexpr int32_t kDead = -1;
+    static constexpr int32_t kUnknown = -2;
+    // Frame id of a finished parse in a state, and of "no parent frame".
+    static constexpr uint32_t kAccept = 0xFFFFFFFFu;
+    static constexpr uint32_t kNoFrame = 0xFFFFFFFFu;
+
+    struct StateHash {
+        size_t operator()(const std::vector<uint32_t>& frames) const;
+    };
+
+    void buildTrie(const std::vector<std::string>& tokens);
+    uint32_t internFrame(uint32_t position, uint32_t parent);
+    int32_t internState(const std::vector<uint32_t>& frames);
+    /** Push the Bytes frames reachable from [position] onto scratch_. */
+    void expand(uint32_t position, uint32_t parent);
+    int32_t advance(int32_t state, uint8_t byte);
+    int32_t advance(int32_t state, const char* bytes, size_t size);
+    void computeMask(int32_t state, uint64_t* mask);
+    /** Drop every state but the current one, which becomes state 0. */
+    void compact();
+
+    std::shared_ptr<const Grammar> grammar_;
+    int vocabSize_;
+    size_t maskWords_;
+    std::vector<int32_t> stopTokens_;
+    // Bytes of token i: tokenText_[tokenOffsets_[i] .. tokenOffsets_[i + 1]).
+    std::string tokenText_;
+    std::vector<uint32_t> tokenOffsets_;
+
+    // Vocabulary trie in preorder: node i spans [i, trieEnd_[i]).
+    std::vector<uint8_t> trieByte_;
+    std::vector<uint16_t> trieDepth_;
+    std::vector<uint32_t> trieEnd_;
+    std::vector<int32_t> trieToken_;
+    // State after each depth of the trie walk in computeMask().
+    std::vector<int32_t> walk_;
+
+    // Stack frames: (position, parent frame), interned.
+    std::vector<std::pair<uint32_t, uint32_t>> frames_;
+    std::unordered_map<uint64_t, uint32_t> frameIds_;
+    // States: sorted frame ids of the tops of every live stack.
+    std::vector<std::vector<uint32_t>> states_;
+    std::unordered_map<std::vector<uint32_t>, int32_t, StateHash> stateIds_;
+    // 256 entries per state: next state, kDead or kUnknown.
+    std::vector<int32_t> transitions_;
+    // Per state, its slot in masks_ or -1.
+    std::vector<int32_t> maskSlot_;
+    std::vector<uint64_t> masks_;
+    // Per slot, whether its mask allows any token at all.
+    std::vector<bool> maskAllows_;
+    size_t maskCount_ = 0;
+    std::vector<uint32_t> scratch_;
+
+    int32_t initial_ = kDead;
+    int32_t state_ = kDead;
+};
+
+} // namespace nimittam
@@ -0,0 +1,321 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "json.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace nimittam {
+
+namespace {
+
+void appendUtf8(std::string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out.push_back(static_cast<char>(cp));
+    } else if (cp < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else {
+        out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+}
+
+} // namespace
+
+class JsonParser {
+public:
+    JsonParser(const char* data, size_t size) : p_(data), begin_(data), end_(data + size) {}
+
+    bool parseDocument(JsonValue* out, std::string* error) {
+        skipWhitespace();
+        if (!parseValue(out, 0)) {
+            fail(error);
+            return false;
+        }
+        skipWhitespace();
+        if (p_ != end_) {
+            error_ = "trailing characters";
+            fail(error);
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static constexpr int kMaxDepth = 256;
+
+    void fail(std::string* error) const {
+        if (error) {
+            std::ostringstream msg;
+            msg << "JSON parse error at offset " << (p_ - begin_) << ": " << error_;
+            *error = msg.str();
+        }
+    }
+
+    void skipWhitespace() {
+        while (p_ < end_ && (*p_ == ' ' || *p_ == '\n' || *p_ == '\r' || *p_ == '\t')) ++p_;
+    }
+
+    bool expectLiteral(const char* literal) {
+        size_t len = std::strlen(literal);
+        if (static_cast<size_t>(end_ - p_) < len || std::memcmp(p_, literal, len) != 0) {
+            error_ = "invalid literal";
+            return false;
+        }
+        p_ += len;
+        return true;
+    }
+
+    bool parseValue(JsonValue* out, int depth) {
+        if (depth > kMaxDepth) {
+            error_ = "nesting too deep";
+            return false;
+        }
+        if (p_ >= end_) {
+            error_ = "unexpected end of input";
+            return false;
+        }
+        switch (*p_) {
+            case '{': return parseObject(out, depth);
+            case '[': return parseArray(out, depth);
+            case '"':
+                out->type_ = JsonValue::Type::String;
+                return parseString(&out->string_);
+            case 't':
+                out->type_ = JsonValue::Type::Bool;
+                out->bool_ = true;
+                return expectLiteral("true");
+            case 'f':
+                out->type_ = JsonValue::Type::Bool;
+                out->bool_ = false;
+                return expectLiteral("false");
+            case 'n':
+                out->type_ = JsonValue::Type::Null;
+                return expectLiteral("null");
+            default:
+                return parseNumber(out);
+        }
+    }
+
+    bool parseObject(JsonValue* out, int depth) {
+        out->type_ = JsonValue::Type::Object;
+        ++p_;
+        skipWhitespace();
+        if (p_ < end_ && *p_ == '}') {
+            ++p_;
+            return true;
+        }
+        while (true) {
+            skipWhitespace();
+            if (p_ >= end_ || *p_ != '"') {
+                error_ = "expected object key";
+                return false;
+            }
+            std::string key;
+            if (!parseString(&key)) return false;
+            skipWhitespace();
+            if (p_ >= end_ || *p_ != ':') {
+                error_ = "expected ':'";
+                return false;
+            }
+            ++p_;
+            skipWhitespace();
+            out->members_.emplace_back(std::move(key), JsonValue());
+            if (!parseValue(&out->members_.back().second, depth + 1)) return false;
+            skipWhitespace();
+            if (p_ < end_ && *p_ == ',') {
+                ++p_;
+                continue;
+            }
+            if (p_ < end_ && *p_ == '}') {
+                ++p_;
+                return true;
+            }
+            error_ = "expected ',' or '}'";
+            return false;
+        }
+    }
+
+    bool parseArray(JsonValue* out, int depth) {
+        out->type_ = JsonValue::Type::Array;
+        ++p_;
+        skipWhitespace();
+        if (p_ < end_ && *p_ == ']') {
+            ++p_;
+            return true;
+        }
+        while (true) {
+            skipWhitespace();
+            out->items_.emplace_back();
+            if (!parseValue(&out->items_.back(), depth + 1)) return false;
+            skipWhitespace();
+            if (p_ < end_ && *p_ == ',') {
+                ++p_;
+                continue;
+            }
+            if (p_ < end_ && *p_ == ']') {
+                ++p_;
+                return true;
+            }
+            error_ = "expected ',' or ']'";
+            return false;
+        }
+    }
+
+    bool parseHex4(uint32_t* cp) {
+        if (end_ - p_ < 4) {
+            error_ = "truncated \\u escape";
+            return false;
+        }
+        uint32_t value = 0;
+        for (int i = 0; i < 4; ++i) {
+            char c = *p_++;
+            value <<= 4;
+            if (c >= '0' && c <= '9') value |= c - '0';
+            else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+            else {
+                error_ = "invalid \\u escape";
+                return false;
+            }
+        }
+        *cp = value;
+        return true;
+    }
+
+    bool parseString(std::string* out) {
+        ++p_;  // opening quote
+        while (p_ < end_) {
+            // Copy plain runs in one go; tokenizer.json is mostly these.
+            const char* run = p_;
+            while (p_ < end_ && *p_ != '"' && *p_ != '\\') ++p_;
+            out->append(run, p_ - run);
+            if (p_ >= end_) break;
+            if (*p_ == '"') {
+                ++p_;
+                return true;
+            }
+            ++p_;  // backslash
+            if (p_ >= end_) break;
+            char esc = *p_++;
+            switch (esc) {
+                case '"': out->push_back('"'); break;
+                case '\\': out->push_back('\\'); break;
+                case '/': out->push_back('/'); break;
+                case 'b': out->push_back('\b'); break;
+                case 'f': out->push_back('\f'); break;
+                case 'n': out->push_back('\n'); break;
+                case 'r': out->push_back('\r'); break;
+                case 't': out->push_back('\t'); break;
+                case 'u': {
+                    uint32_t cp;
+                    if (!parseHex4(&cp)) return false;
+                    if (cp >= 0xD800 && cp <= 0xDBFF) {
+                        uint32_t low;
+                        if (end_ - p_ < 2 || p_[0] != '\\' || p_[1] != 'u') {
+                            error_ = "unpaired surrogate";
+                            return false;
+                        }
+                        p_ += 2;
+                        if (!parseHex4(&low) || low < 0xDC00 || low > 0xDFFF) {
+                            error_ = "invalid surrogate pair";
+                            return false;
+                        }
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    appendUtf8(*out, cp);
+                    break;
+                }
+                default:
+                    error_ = "invalid escape";
+                    return false;
+            }
+        }
+        error_ = "unterminated string";
+        return false;
+    }
+
+    bool parseNumber(JsonValue* out) {
+        const char* start = p_;
+        if (p_ < end_ && *p_ == '-') ++p_;
+        while (p_ < end_ && ((*p_ >= '0' && *p_ <= '9') || *p_ == '.' || *p_ == 'e' ||
+                             *p_ == 'E' || *p_ == '+' || *p_ == '-')) {
+            ++p_;
+        }
+        if (p_ == start) {
+            error_ = "unexpected character";
+            return false;
+        }
+        std::string text(start, p_ - start);
+        char* parsedEnd = nullptr;
+        out->number_ = std::strtod(text.c_str(), &parsedEnd);
+        if (parsedEnd != text.c_str() + text.size()) {
+            error_ = "invalid number";
+            return false;
+        }
+        out->type_ = JsonValue::Type::Number;
+        return true;
+    }
+
+    const char* p_;
+    const char* begin_;
+    const char* end_;
+    const char* error_ = "";
+};
+
+bool JsonValue::asBool(bool fallback) const {
+    return type_ == Type::Bool ? bool_ : fallback;
+}
+
+double JsonValue::asNumber(double fallback) const {
+    return type_ == Type::Number ? number_ : fallback;
+}
+
+int64_t JsonValue::asInt(int64_t fallback) const {
+    return type_ == Type::Number ? static_cast<int64_t>(number_) : fallback;
+}
+
+const JsonValue& JsonValue::operator[](const char* key) const {
+    static const JsonValue kNull;
+    for (const auto& member : members_) {
+        if (member.first == key) return member.second;
+    }
+    return kNull;
+}
+
+bool JsonValue::parse(const char* data, size_t size, JsonValue* out, std::string* error) {
+    *out = JsonValue();
+    JsonParser parser(data, size);
+    return parser.parseDocument(out, error);
+}
+
+bool JsonValue::parseFile(const std::string& path, JsonValue* out, std::string* error) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        if (error) *error = "cannot open " + path;
+        return false;
+    }
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (!parse(data.data(), data.size(), out, error)) {
+        if (error) *error = path + ": " + *error;
+        return false;
+    }
+    return true;
+}
+
+} // namespace nimittam
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Minimal JSON reader for model metadata.
+ *
+ * Only what the engine needs to read mlc-chat-config.json,
+ * ndarray-cache.json and tokenizer.json: a DOM with ordered objects,
+ * UTF-8 strings (\u escapes and surrogate pairs decoded) and doubles.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace nimittam {
+
+class JsonValue {
+public:
+    enum class Type { Null, Bool, Number, String, Array, Object };
+
+    Type type() const { return type_; }
+    bool isNull() const { return type_ == Type::Null; }
+    bool isNumber() const { return type_ == Type::Number; }
+    bool isString() const { return type_ == Type::String; }
+    bool isArray() const { return type_ == Type::Array; }
+    bool isObject() const { return type_ == Type::Object; }
+
+    bool asBool(bool fallback = false) const;
+    double asNumber(double fallback = 0.0) const;
+    int64_t asInt(int64_t fallback = 0) const;
+    const std::string& asString() const { return string_; }
+
+    /** Array elements; empty for non-arrays. */
+    const std::vector<JsonValue>& items() const { return items_; }
+
+    /** Object members in document order; empty for non-objects. */
+    const std::vector<std::pair<std::string, JsonValue>>& members() const { return members_; }
+
+    /** Member lookup; returns a shared null value when absent. */
+    const JsonValue& operator[](const char* key) const;
+
+    /**
+     * Parse a complete document. Returns false and fills [error]
+     * (with a byte offset) on malformed input.
+     */
+    static bool parse(const char* data, size_t size, JsonValue* out, std::string* error);
+
+    /** Read and parse a file. */
+    static bool parseFile(const std::string& path, JsonValue* out, std::string* error);
+
+private:
+    friend class JsonParser;
+
+    Type type_ = Type::Null;
+    bool bool_ = false;
+    double number_ = 0.0;
+    std::string string_;
+    std::vector<JsonValue> items_;
+    std::vector<std::pair<std::string, JsonValue>> members_;
+};
+
+} // namespace nimittam
@@ -0,0 +1,449 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "json_schema.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "json.h"
+
+namespace nimittam {
+
+namespace {
+
+struct Primitive {
+    const char* name;
+    const char* body;
+};
+
+// Emitted after the schema's own rules, each only if something uses it.
+const Primitive kPrimitives[] = {
+    {"ws", R"(| " " | "\n" [ \t]{0,20})"},
+    {"boolean", R"("true" | "false")"},
+    {"null", R"("null")"},
+    {"integer", R"("-"? ("0" | [1-9] [0-9]{0,15}))"},
+    {"number", R"("-"? ("0" | [1-9] [0-9]{0,15}) ("." [0-9]+)? ([eE] [-+]? [0-9]+)?)"},
+    {"char", R"([^"\\\x7F\x00-\x1F] | "\\" (["\\/bfnrt] | "u" [0-9a-fA-F]{4}))"},
+    {"string", R"("\"" char* "\"")"},
+    {"value", R"(object | array | string | number | boolean | null)"},
+    {"object", R"("{" ws ( string ws ":" ws value ws )"
+               R"(( "," ws string ws ":" ws value ws )* )? "}")"},
+    {"array", R"("[" ws ( value ws ( "," ws value ws )* )? "]")"},
+};
+
+// What each primitive refers to, by index into kPrimitives.
+const std::vector<std::vector<int>> kPrimitiveUses = {
+    {}, {}, {}, {}, {}, {}, {5}, {8, 9, 6, 4, 1, 2}, {0, 6, 7}, {0, 7},
+};
+
+void appendJsonString(const std::string& text, std::string* out) {
+    *out += '"';
+    for (char c : text) {
+        switch (c) {
+            case '"': *out += "\\\""; break;
+            case '\\': *out += "\\\\"; break;
+            case '\b': *out += "\\b"; break;
+            case '\f': *out += "\\f"; break;
+            case '\n': *out += "\\n"; break;
+            case '\r': *out += "\\r"; break;
+            case '\t': *out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escape[8];
+                    std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+                    *out += escape;
+                } else {
+                    *out += c;
+                }
+        }
+    }
+    *out += '"';
+}
+
+/** Compact JSON text of [value]. */
+void appendJson(const JsonValue& value, std::string* out) {
+    switch (value.type()) {
+        case JsonValue::Type::Null:
+            *out += "null";
+            return;
+        case JsonValue::Type::Bool:
+            *out += value.asBool() ? "true" : "false";
+            return;
+        case JsonValue::Type::Number: {
+            char text[32];
+            const double x = value.asNumber();
+            if (x == std::floor(x) && std::fabs(x) < 1e15) {
+                std::snprintf(text, sizeof(text), "%lld", static_cast<long long>(x));
+            } else {
+                std::snprintf(text, sizeof(text), "%.17g", x);
+            }
+            *out += text;
+            return;
+        }
+        case JsonValue::Type::String:
+            appendJsonString(value.asString(), out);
+            return;
+        case JsonValue::Type::Array:
+            *out += '[';
+            for (size_t i = 0; i < value.items().size(); ++i) {
+                if (i > 0) *out += ',';
+                appendJson(value.items()[i], out);
+            }
+            *out += ']';
+            return;
+        case JsonValue::Type::Object: {
+            *out += '{';
+            bool first = true;
+            for (const auto& member : value.members()) {
+                if (!first) *out += ',';
+                first = false;
+                appendJsonString(member.first, out);
+                *out += ':';
+                appendJson(member.second, out);
+            }
+            *out += '}';
+            return;
+        }
+    }
+}
+
+/** GBNF string literal matching exactly [text]. */
+std::string literal(const std::string& text) {
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c == '\n') {
+            out += "\\n";
+        } else if (c == '\r') {
+            out += "\\r";
+        } else if (c == '\t') {
+            out += "\\t";
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escape[8];
+            std::snprintf(escape, sizeof(escape), "\\x%02x", c);
+            out += escape;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+std::string jsonLiteral(const JsonValue& value) {
+    std::string text;
+    appendJson(value, &text);
+    return literal(text);
+}
+
+std::string keyLiteral(const std::string& key) {
+    std::string text;
+    appendJsonString(key, &text);
+    return literal(text);
+}
+
+/** Rule name material: letters, digits and dashes. */
+std::string sanitize(const std::string& text) {
+    std::string out;
+    for (char c : text) {
+        const bool keep = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                          (c >= '0' && c <= '9') || c == '-';
+        out += keep ? c : '-';
+    }
+    return out.empty() ? "x" : out;
+}
+
+/** Member [key] of [object], or nullptr; unlike operator[], tells null from absent. */
+const JsonValue* member(const JsonValue& object, const char* key) {
+    for (const auto& entry : object.members()) {
+        if (entry.first == key) return &entry.second;
+    }
+    return nullptr;
+}
+
+class SchemaConverter {
+public:
+    explicit SchemaConverter(const JsonValue& root) : root_(root) {
+        for (const Primitive& primitive : kPrimitives) taken_.insert(primitive.name);
+    }
+
+    bool convert(std::string* out, std::string* error) {
+        std::string expr;
+        if (!visit(root_, "root", &expr)) {
+            *error = error_;
+            return false;
+        }
+        out->clear();
+        if (expr != "root") *out += "root ::= " + expr + "\n";
+        for (const auto& rule : rules_) *out += rule.first + " ::= " + rule.second + "\n";
+        // Primitives pull in what they refer to (value and object refer
+        // to each other).
+        const int count = static_cast<int>(sizeof(kPrimitives) / sizeof(kPrimitives[0]));
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (int i = 0; i < count; ++i) {
+                if (!used_[i]) continue;
+                for (int dependency : kPrimitiveUses[i]) {
+                    changed |= !used_[dependency];
+                    used_[dependency] = true;
+                }
+            }
+        }
+        for (int i = 0; i < count; ++i) {
+            if (!used_[i]) continue;
+            *out += std::string(kPrimitives[i].name) + " ::= " + kPrimitives[i].body + "\n";
+        }
+        return true;
+    }
+
+private:
+    bool fail(const std::string& message) {
+        error_ = message;
+        return false;
+    }
+
+    std::string use(const char* name) {
+        const int count = static_cast<int>(sizeof(kPrimitives) / sizeof(kPrimitives[0]));
+        for (int i = 0; i < count; ++i) {
+            if (std::string(kPrimitives[i].name) == name) used_[i] = true;
+        }
+        return name;
+    }
+
+    std::string uniqueName(const std::string& base) {
+        std::string name = base;
+        for (int n = 2; taken_.count(name); ++n) name = base + "-" + std::to_string(n);
+        taken_.insert(name);
+        return name;
+    }
+
+    std::string addRule(const std::string& base, const std::string& body) {
+        const std::string name = uniqueName(base);
+        rules_.emplace_back(name, body);
+        return name;
+    }
+
+    bool visit(const JsonValue& schema, const std::string& name, std::string* expr) {
+        if (schema.type() == JsonValue::Type::Bool) {
+            if (!schema.asBool()) return fail(name + ": schema false accepts nothing");
+            *expr = use("value");
+            return true;
+        }
+        if (!schema.isObject()) return fail(name + ": schema is not an object");
+
+        if (const JsonValue* ref = member(schema, "$ref")) return visitRef(*ref, expr);
+        if (const JsonValue* value = member(schema, "const")) {
+            *expr = jsonLiteral(*value);
+            return true;
+        }
+        if (const JsonValue* values = member(schema, "enum")) {
+            if (!values->isArray() || values->items().empty()) {
+                return fail(name + ": enum is not a non-empty array");
+            }
+            *expr = "(";
+            for (size_t i = 0; i < values->items().size(); ++i) {
+                if (i > 0) *expr += " | ";
+                *expr += jsonLiteral(values->items()[i]);
+            }
+            *expr += ")";
+            return true;
+        }
+        for (const char* keyword : {"anyOf", "oneOf"}) {
+            const JsonValue* options = member(schema, keyword);
+            if (!options) continue;
+            if (!options->isArray() || options->items().empty()) {
+                return fail(name + ": " + keyword + " is not a non-empty array");
+            }
+            *expr = "(";
+            for (size_t i = 0; i < options->items().size(); ++i) {
+                std::string option;
+                if (!visit(options->items()[i], name + "-" + std::to_string(i), &option)) {
+                    return false;
+                }
+                if (i > 0) *expr += " | ";
+                *expr += option;
+            }
+            *expr += ")";
+            return true;
+        }
+
+        const JsonValue& type = schema["type"];
+        if (type.isString()) return visitType(schema, type.asString(), name, expr);
+        if (type.isArray()) {
+            *expr = "(";
+            for (size_t i = 0; i < type.items().size(); ++i) {
+                std::string option;
+                const std::string optionName = name + "-" + std::to_string(i);
+                if (!visitType(schema, type.items()[i].asString(), optionName, &option)) {
+                    return false;
+                }
+                if (i > 0) *expr += " | ";
+                *expr += option;
+            }
+            *expr += ")";
+            return true;
+        }
+        if (schema["properties"].isObject()) return visitType(schema, "object", name, expr);
+        if (member(schema, "items")) return visitType(schema, "array", name, expr);
+        *expr = use("value");
+        return true;
+    }
+
+    bool visitType(const JsonValue& schema, const std::string& type, const std::string& name,
+                   std::string* expr) {
+        if (type == "object") {
+            if (schema["properties"].members().empty()) {
+                *expr = use("object");
+                return true;
+            }
+            return visitObject(schema, name, expr);
+        }
+        if (type == "array") return visitArray(schema, name, expr);
+        if (type == "string") {
+            const JsonValue* minLength = member(schema, "minLength");
+            const JsonValue* maxLength = member(schema, "maxLength");
+            if (!minLength && !maxLength) {
+                *expr = use("string");
+                return true;
+            }
+            const std::string min = std::to_string(minLength ? minLength->asInt() : 0);
+            const std::string max = maxLength ? std::to_string(maxLength->asInt()) : "";
+            *expr = "\"\\\"\" " + use("char") + "{" + min + "," + max + "} \"\\\"\"";
+            return true;
+        }
+        if (type == "number" || type == "integer" || type == "boolean" || type == "null") {
+            *expr = use(type.c_str());
+            return true;
+        }
+        return fail(name + ": unsupported type '" + type + "'");
+    }
+
+    bool visitObject(const JsonValue& schema, const std::string& name, std::string* expr) {
+        std::set<std::string> required;
+        for (const JsonValue& key : schema["required"].items()) required.insert(key.asString());
+        use("ws");
+
+        std::vector<std::string> pairs;
+        std::vector<bool> mandatory;
+        for (const auto& property : schema["properties"].members()) {
+            const std::string propertyName = name + "-" + sanitize(property.first);
+            std::string value;
+            if (!visit(property.second, propertyName, &value)) return false;
+            pairs.push_back(addRule(propertyName + "-kv",
+                                    keyLiteral(property.first) +
+                                        " ws \":\" ws " + value + " ws"));
+            mandatory.push_back(required.count(property.first) > 0);
+        }
+
+        std::string members;
+        if (std::find(mandatory.begin(), mandatory.end(), false) == mandatory.end()) {
+            for (size_t i = 0; i < pairs.size(); ++i) {
+                members += i == 0 ? pairs[i] : " \",\" ws " + pairs[i];
+            }
+        } else {
+            // In order, each optional one may be left out: rest follows a
+            // member already written, first starts the object.
+            std::string rest;
+            std::string first;
+            for (size_t i = pairs.size(); i-- > 0;) {
+                const std::string tail = rest.empty() ? "" : " " + rest;
+                if (mandatory[i]) {
+                    first = pairs[i] + tail;
+                } else {
+                    first = "(" + pairs[i] + tail + (first.empty() ? " |)" : " | " + first + ")");
+                }
+                if (i == 0) break;
+                const std::string next = mandatory[i] ? "\",\" ws " + pairs[i]
+                                                      : "(\",\" ws " + pairs[i] + ")?";
+                rest = addRule(name + "-rest", next + tail);
+            }
+            members = first;
+        }
+        *expr = addRule(name, "\"{\" ws " + members + " \"}\"");
+        return true;
+    }
+
+    bool visitArray(const JsonValue& schema, const std::string& name, std::string* expr) {
+        std::string item = use("value");
+        if (const JsonValue* items = member(schema, "items")) {
+            if (!visit(*items, name + "-item", &item)) return false;
+        }
+        use("ws");
+        const int64_t min = schema["minItems"].asInt(0);
+        const int64_t max = member(schema, "maxItems") ? schema["maxItems"].asInt() : -1;
+        if (max >= 0 && max < min) return fail(name + ": maxItems is below minItems");
+        std::string body = "\"[\" ws ";
+        if (max != 0) {
+            std::string more = "(\",\" ws " + item + " ws)";
+            if (min <= 1 && max < 0) {
+                more += "*";
+            } else {
+                more += "{" + std::to_string(min > 1 ? min - 1 : 0) + "," +
+                        (max < 0 ? "" : std::to_string(max - 1)) + "}";
+            }
+            const std::string list = item + " ws " + more;
+            body += min == 0 ? "(" + list + ")? " : list + " ";
+        }
+        *expr = addRule(name, body + "\"]\"");
+        return true;
+    }
+
+    bool visitRef(const JsonValue& ref, std::string* expr) {
+        const std::string& path = ref.asString();
+        std::string key;
+        const JsonValue* definitions = nullptr;
+        for (const char* prefix : {"#/$defs/", "#/definitions/"}) {
+            const std::string p = prefix;
+            if (path.compare(0, p.size(), p) == 0) {
+                key = path.substr(p.size());
+                definitions = member(root_, prefix[2] == '$' ? "$defs" : "definitions");
+                break;
+            }
+        }
+        const JsonValue* target = definitions ? member(*definitions, key.c_str()) : nullptr;
+        if (!target) return fail("unsupported $ref '" + path + "'");
+
+        // Named before its body is visited, so a definition can refer to itself.
+        auto it = refs_.find(path);
+        if (it != refs_.end()) {
+            *expr = it->second;
+            return true;
+        }
+        const std::string name = uniqueName("ref-" + sanitize(key));
+        refs_.emplace(path, name);
+        const size_t slot = rules_.size();
+        rules_.emplace_back(name, "");
+        std::string body;
+        if (!visit(*target, name, &body)) return false;
+        rules_[slot].second = body;
+        *expr = name;
+        return true;
+    }
+
+    const JsonValue& root_;
+    std::string error_;
+    std::vector<std::pair<std::string, std::string>> rules_;
+    std::set<std::string> taken_;
+    std::unordered_map<std::string, std::string> refs_;
+    bool used_[sizeof(kPrimitives) / sizeof(kPrimitives[0])] = {};
+};
+
+} // namespace
+
+bool jsonSchemaToGbnf(const JsonValue& schema, std::string* out, std::string* error) {
+    return SchemaConverter(schema).convert(out, error);
+}
+
+} // namespace nimittam
@@ -0,0 +1,37 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * JSON schema to GBNF, for constrained decoding of structured replies
+ * (see grammar.h).
+ *
+ * Documents come out compact: whitespace is allowed only after { [ , :
+ * and after values inside containers, and never after the root value,
+ * so a finished document leaves the model nothing to do but stop.
+ */
+
+#pragma once
+
+#include <string>
+
+namespace nimittam {
+
+class JsonValue;
+
+/**
+ * GBNF for the JSON documents [schema] accepts. Covers type (including
+ * lists of types), properties and required (properties come in the
+ * order given; others are not allowed), items with minItems and
+ * maxItems, enum, const, anyOf and oneOf, minLength and maxLength on
+ * strings, and local $ref into $defs or definitions. Other keywords are
+ * ignored; an empty schema accepts any value. Returns false and fills
+ * [error] on what it cannot translate.
+ */
+bool jsonSchemaToGbnf(const JsonValue& schema, std::string* out, std::string* error);
+
+} // namespace nimittam
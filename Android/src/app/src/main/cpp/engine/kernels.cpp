@@ -0,0 +1,178 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "kernels.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace nimittam {
+
+namespace {
+
+float halfToFloatSlow(uint16_t h) {
+    uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1F;
+    uint32_t mantissa = h & 0x3FF;
+    uint32_t bits;
+    if (exponent == 0) {
+        if (mantissa == 0) {
+            bits = sign;
+        } else {
+            // Subnormal: renormalize.
+            exponent = 127 - 15 + 1;
+            while ((mantissa & 0x400) == 0) {
+                mantissa <<= 1;
+                --exponent;
+            }
+            mantissa &= 0x3FF;
+            bits = sign | (exponent << 23) | (mantissa << 13);
+        }
+    } else if (exponent == 0x1F) {
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    }
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+struct HalfTable {
+    float values[65536];
+    HalfTable() {
+        for (uint32_t i = 0; i < 65536; ++i) values[i] = halfToFloatSlow(static_cast<uint16_t>(i));
+    }
+};
+
+const HalfTable& halfTable() {
+    static const HalfTable table;
+    return table;
+}
+
+} // namespace
+
+float halfToFloat(uint16_t h) {
+    return halfTable().values[h];
+}
+
+const float* halfToFloatTable() {
+    return halfTable().values;
+}
+
+uint16_t floatToHalf(float f) {
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xFF) - 127 + 15;
+    uint32_t mantissa = bits & 0x7FFFFF;
+
+    if (((bits >> 23) & 0xFF) == 0xFF) {
+        return static_cast<uint16_t>(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+    }
+    if (exponent >= 0x1F) {
+        return static_cast<uint16_t>(sign | 0x7C00);
+    }
+    if (exponent <= 0) {
+        if (exponent < -10) return static_cast<uint16_t>(sign);
+        mantissa |= 0x800000;
+        uint32_t shift = static_cast<uint32_t>(14 - exponent);
+        uint32_t half = mantissa >> shift;
+        uint32_t rem = mantissa & ((1u << shift) - 1);
+        uint32_t midpoint = 1u << (shift - 1);
+        if (rem > midpoint || (rem == midpoint && (half & 1))) ++half;
+        return static_cast<uint16_t>(sign | half);
+    }
+    uint32_t half = sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+    uint32_t rem = mantissa & 0x1FFF;
+    if (rem > 0x1000 || (rem == 0x1000 && (half & 1))) ++half;
+    return static_cast<uint16_t>(half);
+}
+
+void rmsNorm(const float* x, const uint16_t* weight, float* out, int n, float eps) {
+    float sumSq = 0.0f;
+    for (int i = 0; i < n; ++i) sumSq += x[i] * x[i];
+    float inv = 1.0f / std::sqrt(sumSq / n + eps);
+    for (int i = 0; i < n; ++i) out[i] = x[i] * inv * halfToFloat(weight[i]);
+}
+
+void addBiasHalf(float* x, const uint16_t* bias, int n) {
+    for (int i = 0; i < n; ++i) x[i] += halfToFloat(bias[i]);
+}
+
+void addInPlace(float* y, const float* x, int n) {
+    for (int i = 0; i < n; ++i) y[i] += x[i];
+}
+
+void siluMul(const float* gate, const float* up, float* out, int n) {
+    for (int i = 0; i < n; ++i) {
+        float g = gate[i];
+        out[i] = g / (1.0f + std::exp(-g)) * up[i];
+    }
+}
+
+float dot(const float* a, const float* b, int n) {
+    float acc = 0.0f;
+    for (int i = 0; i < n; ++i) acc += a[i] * b[i];
+    return acc;
+}
+
+void axpy(float a, const float* x, float* y, int n) {
+    for (int i = 0; i < n; ++i) y[i] += a * x[i];
+}
+
+float dotHalf(const float* a, const uint16_t* b, int n) {
+    const float* table = halfTable().values;
+    float acc = 0.0f;
+    for (int i = 0; i < n; ++i) acc += a[i] * table[b[i]];
+    return acc;
+}
+
+void axpyHalf(float a, const uint16_t* x, float* y, int n) {
+    const float* table = halfTable().values;
+    for (int i = 0; i < n; ++i) y[i] += a * table[x[i]];
+}
+
+void softmax(float* x, int n) {
+    float maxValue = x[0];
+    for (int i = 1; i < n; ++i) maxValue = x[i] > maxValue ? x[i] : maxValue;
+    float sum = 0.0f;
+    for (int i = 0; i < n; ++i) {
+        x[i] = std::exp(x[i] - maxValue);
+        sum += x[i];
+    }
+    float inv = 1.0f / sum;
+    for (int i = 0; i < n; ++i) x[i] *= inv;
+}
+
+void ropeCosSin(int pos, int headDim, float theta, float* cosSin) {
+    const int half = headDim / 2;
+    for (int i = 0; i < half; ++i) {
+        double invFreq = std::pow(static_cast<double>(theta), -2.0 * i / headDim);
+        double angle = pos * invFreq;
+        cosSin[i] = static_cast<float>(std::cos(angle));
+        cosSin[half + i] = static_cast<float>(std::sin(angle));
+    }
+}
+
+void applyRope(float* heads, int numHeads, int headDim, const float* cosSin) {
+    const int half = headDim / 2;
+    const float* cosv = cosSin;
+    const float* sinv = cosSin + half;
+    for (int h = 0; h < numHeads; ++h) {
+        float* v = heads + h * headDim;
+        for (int i = 0; i < half; ++i) {
+            float x0 = v[i];
+            float x1 = v[i + half];
+            v[i] = x0 * cosv[i] - x1 * sinv[i];
+            v[i + half] = x0 * sinv[i] + x1 * cosv[i];
+        }
+    }
+}
+
+} // namespace nimittam
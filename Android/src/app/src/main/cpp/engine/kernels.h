@@ -0,0 +1,190 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Reference CPU kernels for the transformer forward pass.
+ *
+ * Activations are float32. Weights stay in MLC's q4f16_1 storage:
+ * each uint32 packs eight 4-bit values (element j in bits 4j..4j+3),
+ * groups of 32 input elements share one float16 scale, and the stored
+ * value is offset by 7, so w = (q - 7) * scale.
+ *
+ * The q4 kernels also take a repacked copy of the same weights
+ * (Q4Matrix::packed), built once per device by RepackedWeights. Rows are
+ * interleaved in tiles of kQ4PackRows; each tile holds, per group, one
+ * kQ4PackedBlockBytes block:
+ *   uint16 scale[kQ4PackRows]       float16, one per row
+ *   uint8  q[kQ4PackRows][16]       byte i: element i in the low nibble,
+ *                                   element i + 16 in the high nibble
+ * so one contiguous read feeds every row of the tile, and unpacking is a
+ * mask and a shift over whole bytes rather than eight shifts per word.
+ *
+ * The library is built for the ABI baseline, so the q4 kernels are also
+ * compiled for newer instruction set levels (armv8.2-a on arm64; SSE4.1,
+ * AVX2 and AVX-512 on x86_64) and the best one this CPU supports, going
+ * by cpu_features.h, is picked on first use.
+ *
+ * Variants with int8 dot products (SDOT / SMMLA on arm64, AVX2 or
+ * AVX512-VNNI on x86_64) also multiply packed q4 weights by activations
+ * quantized to int8 (Q8Activations): a group's 32 products are summed in
+ * integer registers, four or eight per instruction, and only its scaled
+ * total goes to float.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace nimittam {
+
+/** float16 bits -> float32 (table lookup). */
+float halfToFloat(uint16_t h);
+
+/** The 65536 floats behind halfToFloat(), indexed by float16 bits. */
+const float* halfToFloatTable();
+
+/** float32 -> float16 bits, round to nearest even. */
+uint16_t floatToHalf(float f);
+
+/**
+ * A q4f16_1 weight matrix of [rows, cols]: y = W x with x of length cols.
+ */
+struct Q4Matrix {
+    const uint32_t* qweight = nullptr;  // [rows, cols / 8]
+    const uint16_t* scales = nullptr;   // [rows, cols / 32]
+    // Same weights in the packed layout; used instead of the two above when set.
+    const uint8_t* packed = nullptr;
+    int rows = 0;
+    int cols = 0;
+};
+
+constexpr int kQ4GroupSize = 32;
+constexpr int kQ4ZeroPoint = 7;
+constexpr int kQ4PackRows = 4;
+constexpr size_t kQ4PackedBlockBytes = kQ4PackRows * (sizeof(uint16_t) + kQ4GroupSize / 2);
+
+/** Whether a [rows, cols] matrix has a packed layout. */
+inline bool q4CanPack(int rows, int cols) {
+    return rows > 0 && rows % kQ4PackRows == 0 && cols > 0 && cols % kQ4GroupSize == 0;
+}
+
+/** Bytes of the packed layout of a [rows, cols] matrix; the same as its q4f16_1 storage. */
+inline size_t q4PackedBytes(int rows, int cols) {
+    return static_cast<size_t>(rows / kQ4PackRows) * (cols / kQ4GroupSize) * kQ4PackedBlockBytes;
+}
+
+/**
+ * Write row tiles [tileBegin, tileEnd) of [w] (q4CanPack) in the packed
+ * layout to [out], which receives the bytes of those tiles only.
+ */
+void q4RepackTiles(const Q4Matrix& w, int tileBegin, int tileEnd, uint8_t* out);
+
+/**
+ * Identifies the packed layout and the kernel variant that reads it.
+ * Repacked files record it and are rebuilt when it changes.
+ */
+uint64_t q4PackedLayoutId();
+
+/** Name of the q4 kernel variant in use, e.g. "armv8.2-a" or "avx2". */
+const char* q4KernelName();
+
+/** q4 kernel variants built in that this CPU can run, best first. */
+std::vector<std::string> q4KernelVariants();
+
+/**
+ * Use the variant [name] from q4KernelVariants() from now on, in place of
+ * the detected one, along with its KV cache kernels (kv_quant.h); for
+ * tests and benchmarks. False if it cannot run here.
+ */
+bool useQ4Kernels(const std::string& name);
+
+/**
+ * Activations quantized for the int8 q4 kernels: each group of
+ * kQ4GroupSize elements becomes int8 values and one float scale,
+ * x ~= q * scale, plus the sum of its q for the weights' zero point.
+ */
+struct Q8Activations {
+    std::vector<int8_t> q;       // [n, cols]
+    std::vector<float> scales;   // [n, cols / 32]
+    std::vector<int32_t> sums;   // [n, cols / 32]
+    int n = 0;
+    int cols = 0;
+};
+
+/** Quantize [n] rows of [cols] floats (cols % 32 == 0) into [out], reusing its storage. */
+void q8Quantize(const float* x, int n, int cols, Q8Activations* out);
+
+/**
+ * Whether the q4 kernel variant in use has int8 kernels. Without them
+ * q4GemvQ8 / q4GemmQ8 still work, on a slow scalar reference.
+ */
+bool q4HasInt8Kernels();
+
+/** q4Gemv against int8 activations (x.n == 1); [w] must have a packed layout. */
+void q4GemvQ8(const Q4Matrix& w, const Q8Activations& x, float* y, int rowBegin, int rowEnd);
+
+/** q4Gemm against all x.n rows of int8 activations; [w] must have a packed layout. */
+void q4GemmQ8(const Q4Matrix& w, const Q8Activations& x, float* y, int ldy, int rowBegin,
+              int rowEnd);
+
+/** y[r] = dot(W[r], x) for r in [rowBegin, rowEnd). */
+void q4Gemv(const Q4Matrix& w, const float* x, float* y, int rowBegin, int rowEnd);
+
+/**
+ * Batched q4Gemv for prefill: y[t * ldy + r] = dot(W[r], x[t * cols])
+ * for n inputs and r in [rowBegin, rowEnd). Weight rows are dequantized
+ * once per tile of inputs instead of once per token, so the int4
+ * unpacking cost is shared across the batch.
+ */
+void q4Gemm(const Q4Matrix& w, const float* x, int n, float* y, int ldy, int rowBegin,
+            int rowEnd);
+
+/** Dequantize one row of W into out[cols] (embedding lookup). */
+void q4DequantRow(const Q4Matrix& w, int row, float* out);
+
+/** out = x / rms(x) * weight, weight in float16. */
+void rmsNorm(const float* x, const uint16_t* weight, float* out, int n, float eps);
+
+/** x += bias (float16). */
+void addBiasHalf(float* x, const uint16_t* bias, int n);
+
+/** y += x */
+void addInPlace(float* y, const float* x, int n);
+
+/** out[i] = silu(gate[i]) * up[i] */
+void siluMul(const float* gate, const float* up, float* out, int n);
+
+float dot(const float* a, const float* b, int n);
+
+/** y += a * x */
+void axpy(float a, const float* x, float* y, int n);
+
+/** dot() against a float16 vector (F16 KV cache rows). */
+float dotHalf(const float* a, const uint16_t* b, int n);
+
+/** axpy() with a float16 x. */
+void axpyHalf(float a, const uint16_t* x, float* y, int n);
+
+/** In-place numerically stable softmax. */
+void softmax(float* x, int n);
+
+/**
+ * Rotary embedding in the non-interleaved (GPT-NeoX / rotate_half)
+ * layout used by Qwen2: element i pairs with i + headDim / 2.
+ * [cosSin] holds headDim / 2 cosines followed by headDim / 2 sines
+ * for the token's position.
+ */
+void applyRope(float* heads, int numHeads, int headDim, const float* cosSin);
+
+/** Fill [cosSin] (headDim floats) for [pos]. */
+void ropeCosSin(int pos, int headDim, float theta, float* cosSin);
+
+} // namespace nimittam
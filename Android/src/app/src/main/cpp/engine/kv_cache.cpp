@@ -0,0 +1,171 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "kv_cache.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "kernels.h"
+#include "kv_quant.h"
+#include "log.h"
+
+namespace nimittam {
+
+KvBlockPool::~KvBlockPool() {
+    if (base_) munmap(base_, reserved_);
+}
+
+size_t KvBlockPool::strideFor(size_t blockBytes) {
+    // Page-aligned blocks so trim() releases exactly the blocks it names.
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return (blockBytes + page - 1) / page * page;
+}
+
+bool KvBlockPool::init(size_t blockBytes, int maxBlocks, std::string* error) {
+    stride_ = strideFor(blockBytes);
+    maxBlocks_ = maxBlocks;
+    reserved_ = stride_ * maxBlocks;
+    void* base = mmap(nullptr, reserved_, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        *error = "failed to reserve " + std::to_string(reserved_ >> 20) + " MB for the KV cache";
+        return false;
+    }
+    base_ = static_cast<uint8_t*>(base);
+    freeList_.resize(maxBlocks);
+    for (int i = 0; i < maxBlocks; ++i) freeList_[i] = maxBlocks - 1 - i;
+    touched_.assign(maxBlocks, 0);
+    return true;
+}
+
+int KvBlockPool::allocate() {
+    if (freeList_.empty()) return -1;
+    const int id = freeList_.back();
+    freeList_.pop_back();
+    touched_[id] = 1;
+    return id;
+}
+
+void KvBlockPool::release(int block) {
+    freeList_.push_back(block);
+}
+
+void KvBlockPool::trim() {
+    for (int id : freeList_) {
+        if (!touched_[id]) continue;
+        madvise(block(id), stride_, MADV_DONTNEED);
+        touched_[id] = 0;
+    }
+}
+
+namespace {
+
+bool quantizedType(KvCacheType type) {
+    return type == KvCacheType::Q8_0 || type == KvCacheType::Q4_0;
+}
+
+// The type init() settles on: quantized blocks must tile the row.
+KvCacheType usableType(int kvDim, KvCacheType type) {
+    return quantizedType(type) && kvDim % kKvQuantBlock != 0 ? KvCacheType::F16 : type;
+}
+
+size_t rowBytesFor(int kvDim, KvCacheType type) {
+    const size_t blocksPerRow = static_cast<size_t>(kvDim / kKvQuantBlock);
+    switch (type) {
+        case KvCacheType::F32: return static_cast<size_t>(kvDim) * 4;
+        case KvCacheType::F16: return static_cast<size_t>(kvDim) * 2;
+        case KvCacheType::Q8_0: return blocksPerRow * sizeof(BlockQ8_0);
+        case KvCacheType::Q4_0: return blocksPerRow * sizeof(BlockQ4_0);
+    }
+    return 0;
+}
+
+int blocksFor(int contextSize) {
+    return (contextSize + KvCache::kBlockTokens - 1) / KvCache::kBlockTokens;
+}
+
+} // namespace
+
+bool KvCache::init(int numLayers, int contextSize, int kvDim, KvCacheType type,
+                   std::string* error) {
+    if (usableType(kvDim, type) != type) {
+        LOGI("KV width %d is not a multiple of %d, using F16 instead of type %d", kvDim,
+             kKvQuantBlock, static_cast<int>(type));
+        type = KvCacheType::F16;
+    }
+    type_ = type;
+    numLayers_ = numLayers;
+    contextSize_ = contextSize;
+    kvDim_ = kvDim;
+    rowBytes_ = rowBytesFor(kvDim, type);
+    const int maxBlocks = blocksFor(contextSize);
+    blockTable_.clear();
+    blockTable_.reserve(maxBlocks);
+    return pool_.init(blockDataBytes(), maxBlocks, error);
+}
+
+size_t KvCache::reservedBytes(int numLayers, int contextSize, int kvDim, KvCacheType type) {
+    const size_t blockBytes = static_cast<size_t>(numLayers) * 2 * kBlockTokens *
+                              rowBytesFor(kvDim, usableType(kvDim, type));
+    return static_cast<size_t>(blocksFor(contextSize)) * KvBlockPool::strideFor(blockBytes);
+}
+
+void KvCache::reserve(int length) {
+    const size_t needed = static_cast<size_t>((length + kBlockTokens - 1) / kBlockTokens);
+    while (blockTable_.size() < needed) {
+        // Cannot run dry: the pool holds contextSize() positions.
+        blockTable_.push_back(pool_.allocate());
+    }
+}
+
+void KvCache::truncate(int length) {
+    const size_t kept = static_cast<size_t>((length + kBlockTokens - 1) / kBlockTokens);
+    while (blockTable_.size() > kept) {
+        pool_.release(blockTable_.back());
+        blockTable_.pop_back();
+    }
+}
+
+void KvCache::reset() {
+    for (auto it = blockTable_.rbegin(); it != blockTable_.rend(); ++it) pool_.release(*it);
+    blockTable_.clear();
+    pool_.trim();
+}
+
+void KvCache::store(int layer, int pos, const float* key, const float* value) {
+    uint8_t* k = row(layer, 0, pos);
+    uint8_t* v = row(layer, 1, pos);
+    switch (type_) {
+        case KvCacheType::F32:
+            std::memcpy(k, key, rowBytes_);
+            std::memcpy(v, value, rowBytes_);
+            break;
+        case KvCacheType::F16: {
+            uint16_t* kh = reinterpret_cast<uint16_t*>(k);
+            uint16_t* vh = reinterpret_cast<uint16_t*>(v);
+            for (int i = 0; i < kvDim_; ++i) {
+                kh[i] = floatToHalf(key[i]);
+                vh[i] = floatToHalf(value[i]);
+            }
+            break;
+        }
+        case KvCacheType::Q8_0:
+            quantizeRowQ8_0(key, reinterpret_cast<BlockQ8_0*>(k), kvDim_);
+            quantizeRowQ8_0(value, reinterpret_cast<BlockQ8_0*>(v), kvDim_);
+            break;
+        case KvCacheType::Q4_0:
+            quantizeRowQ4_0(key, reinterpret_cast<BlockQ4_0*>(k), kvDim_);
+            quantizeRowQ4_0(value, reinterpret_cast<BlockQ4_0*>(v), kvDim_);
+            break;
+    }
+}
+
+} // namespace nimittam
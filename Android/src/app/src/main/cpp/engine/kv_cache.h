@@ -0,0 +1,149 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Paged key/value cache.
+ *
+ * KV memory is handed out in blocks of kBlockTokens positions. A block
+ * holds every layer's keys and values for those positions,
+ * [layer][key|value][token][kvHeads * headDim], so one allocation covers
+ * a whole step of the forward pass. Blocks come from a KvBlockPool: an
+ * address range reserved once for the full context, whose pages the
+ * kernel only backs when a block is first written. Memory use therefore
+ * grows with the conversation, and reset() hands the pages back.
+ *
+ * A KvCache is one sequence: a block table mapping position / 16 to a
+ * pool block.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace nimittam {
+
+// KV Cache types, matching Kotlin KvCacheType
+enum class KvCacheType {
+    F32 = 0,
+    F16 = 1,
+    Q8_0 = 2,
+    Q4_0 = 3
+};
+
+/** Fixed-size blocks carved from one reserved, lazily committed arena. */
+class KvBlockPool {
+public:
+    KvBlockPool() = default;
+    ~KvBlockPool();
+
+    KvBlockPool(const KvBlockPool&) = delete;
+    KvBlockPool& operator=(const KvBlockPool&) = delete;
+
+    /** Reserve address space for [maxBlocks] blocks of at least [blockBytes]. */
+    bool init(size_t blockBytes, int maxBlocks, std::string* error);
+
+    /** Bytes init() sets aside per block of [blockBytes]. */
+    static size_t strideFor(size_t blockBytes);
+
+    /** Take a free block; -1 when the pool is exhausted. */
+    int allocate();
+
+    void release(int block);
+
+    /** Give the physical pages of every free, previously used block back to the OS. */
+    void trim();
+
+    uint8_t* block(int id) const { return base_ + static_cast<size_t>(id) * stride_; }
+    size_t blockBytes() const { return stride_; }
+    int maxBlocks() const { return maxBlocks_; }
+    int usedBlocks() const { return maxBlocks_ - static_cast<int>(freeList_.size()); }
+
+private:
+    uint8_t* base_ = nullptr;
+    size_t stride_ = 0;
+    size_t reserved_ = 0;
+    int maxBlocks_ = 0;
+    std::vector<int> freeList_;    // LIFO, low ids on top
+    std::vector<uint8_t> touched_; // block has been handed out since the last trim
+};
+
+class KvCache {
+public:
+    static constexpr int kBlockTokens = 16;
+
+    /**
+     * Size the pool for [contextSize] positions. Q8_0/Q4_0 rows are
+     * blocks of 32 (see kv_quant.h) and need kvDim % 32 == 0; other
+     * shapes fall back to F16.
+     */
+    bool init(int numLayers, int contextSize, int kvDim, KvCacheType type, std::string* error);
+
+    /** What bytes() will be after init() with these arguments. */
+    static size_t reservedBytes(int numLayers, int contextSize, int kvDim, KvCacheType type);
+
+    /** Back positions [0, length) with blocks; [length] must not exceed contextSize(). */
+    void reserve(int length);
+
+    /**
+     * Forget positions from [length] on, returning the blocks that no longer
+     * hold any kept position. Their pages stay committed for reuse.
+     */
+    void truncate(int length);
+
+    /** Forget every position and return all blocks (and their pages). */
+    void reset();
+
+    /** Write one position's keys and values (kvDim floats each), converting to type(). */
+    void store(int layer, int pos, const float* key, const float* value);
+
+    /**
+     * Row of kvDim elements for [pos], which must be reserved: float,
+     * uint16_t (F16), BlockQ8_0 or BlockQ4_0 according to type().
+     */
+    const void* keyRow(int layer, int pos) const { return row(layer, 0, pos); }
+    const void* valueRow(int layer, int pos) const { return row(layer, 1, pos); }
+
+    KvCacheType type() const { return type_; }
+    int numLayers() const { return numLayers_; }
+    int kvDim() const { return kvDim_; }
+    int contextSize() const { return contextSize_; }
+
+    /** Blocks backing the reserved positions, in position order. */
+    int blockCount() const { return static_cast<int>(blockTable_.size()); }
+    /** KV bytes in one block; the pool pads each block to whole pages. */
+    size_t blockDataBytes() const {
+        return static_cast<size_t>(numLayers_) * 2 * kBlockTokens * rowBytes_;
+    }
+    /** Raw contents of the [index]th block, for snapshots. */
+    uint8_t* blockData(int index) const { return pool_.block(blockTable_[index]); }
+    /** Address space reserved for the full context. */
+    size_t bytes() const { return static_cast<size_t>(pool_.maxBlocks()) * pool_.blockBytes(); }
+    /** Memory held by blocks currently in use. */
+    size_t committedBytes() const { return blockTable_.size() * pool_.blockBytes(); }
+
+private:
+    uint8_t* row(int layer, int kind, int pos) const {
+        uint8_t* block = pool_.block(blockTable_[pos / kBlockTokens]);
+        const size_t index =
+                (static_cast<size_t>(layer) * 2 + kind) * kBlockTokens + pos % kBlockTokens;
+        return block + index * rowBytes_;
+    }
+
+    KvBlockPool pool_;
+    std::vector<int> blockTable_;
+    KvCacheType type_ = KvCacheType::F16;
+    int numLayers_ = 0;
+    int contextSize_ = 0;
+    int kvDim_ = 0;
+    size_t rowBytes_ = 0;
+};
+
+} // namespace nimittam
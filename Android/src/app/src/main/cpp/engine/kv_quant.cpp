@@ -0,0 +1,289 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "kv_quant.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "kernels.h"
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define NIMITTAM_KV_NEON 1
+#include <arm_neon.h>
+#elif defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define NIMITTAM_KV_AVX2 1
+#include <immintrin.h>
+#endif
+
+namespace nimittam {
+
+namespace {
+
+// ---- Scalar reference ----
+
+float dotQ8_0Scalar(const float* a, const BlockQ8_0* blocks, int n) {
+    float acc = 0.0f;
+    for (int b = 0; b < n / kKvQuantBlock; ++b) {
+        const float* ab = a + b * kKvQuantBlock;
+        float sum = 0.0f;
+        for (int j = 0; j < kKvQuantBlock; ++j) sum += ab[j] * blocks[b].q[j];
+        acc += sum * halfToFloat(blocks[b].scale);
+    }
+    return acc;
+}
+
+float dotQ4_0Scalar(const float* a, const BlockQ4_0* blocks, int n) {
+    constexpr int half = kKvQuantBlock / 2;
+    float acc = 0.0f;
+    for (int b = 0; b < n / kKvQuantBlock; ++b) {
+        const float* ab = a + b * kKvQuantBlock;
+        float sum = 0.0f;
+        for (int j = 0; j < half; ++j) {
+            const uint8_t packed = blocks[b].q[j];
+            sum += ab[j] * ((packed & 0x0F) - 8) + ab[j + half] * ((packed >> 4) - 8);
+        }
+        acc += sum * halfToFloat(blocks[b].scale);
+    }
+    return acc;
+}
+
+void axpyQ8_0Scalar(float s, const BlockQ8_0* blocks, float* y, int n) {
+    for (int b = 0; b < n / kKvQuantBlock; ++b) {
+        const float d = s * halfToFloat(blocks[b].scale);
+        float* yb = y + b * kKvQuantBlock;
+        for (int j = 0; j < kKvQuantBlock; ++j) yb[j] += d * blocks[b].q[j];
+    }
+}
+
+void axpyQ4_0Scalar(float s, const BlockQ4_0* blocks, float* y, int n) {
+    constexpr int half = kKvQuantBlock / 2;
+    for (int b = 0; b < n / kKvQuantBlock; ++b) {
+        const float d = s * halfToFloat(blocks[b].scale);
+        float* yb = y + b * kKvQuantBlock;
+        for (int j = 0; j < half; ++j) {
+            const uint8_t packed = blocks[b].q[j];
+            yb[j] += d * ((packed & 0x0F) - 8);
+            yb[j + half] += d * ((packed >> 4) - 8);
+        }
+    }
+}
+
+#if NIMITTAM_KV_NEON
+
+// int8 lanes -> 4 float32x4 for 16 values
+inline void widen16(int8x16_t v, float32x4_t out[4]) {
+    const int16x8_t lo = vmovl_s8(vget_low_s8(v));
+    const int16x8_t hi = vmovl_s8(vget_high_s8(v));
+    out[0] = vcvtq_f32_s32(vmovl_s16(vget_low_s16(lo)));
+    out[1] = vcvtq_f32_s32(vmovl_s16(vget_high_s16(lo)));
+    out[2] = vcvtq_f32_s32(vmovl_s16(vget_low_s16(hi)));
+    out[3] = vcvtq_f32_s32(vmovl_s16(vget_high_s16(hi)));
+}
+
+// Dequantized block as 8 float32x4 (unscaled), elements 0..31 in order.
+inline void unpackQ8_0(const BlockQ8_0& block, float32x4_t out[8]) {
+    widen16(vld1q_s8(block.q), out);
+    widen16(vld1q_s8(block.q + 16), out + 4);
+}
+
+inline void unpackQ4_0(const BlockQ4_0& block, float32x4_t out[8]) {
+    const uint8x16_t packed = vld1q_u8(block.q);
+    const int8x16_t eight = vdupq_n_s8(8);
+    const int8x16_t lo = vsubq_s8(vreinterpretq_s8_u8(vandq_u8(packed, vdupq_n_u8(0x0F))), eight);
+    const int8x16_t hi = vsubq_s8(vreinterpretq_s8_u8(vshrq_n_u8(packed, 4)), eight);
+    widen16(lo, out);
+    widen16(hi, out + 4);
+}
+
+template <typename Block, void (*Unpack)(const Block&, float32x4_t*)>
+float dotNeon(const float* a, const Block* blocks, int n) {
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    for (int b = 0; b < n / kKvQuantBlock; ++b) {
+        float32x4_t q[8];
+        Unpack(blocks[b], q);
+        const float* ab = a + b * kKvQuantBlock;
+        float32x4_t sum = vmulq_f32(vld1q_f32(ab), q[0]);
+        for (int i = 1; i < 8; ++i) sum = vfmaq_f32(sum, vld1q_f32(ab + 4 * i), q[i]);
+        acc = vfmaq_n_f32(acc, sum, halfToFloat(blocks[b].scale));
+    }
+    return vaddvq_f32(acc);
+}
+
+template <typename Block, void (*Unpack)(const Block&, float32x4_t*)>
+void axpyNeon(float s, const Block* blocks, float* y, int n) {
+    for (int b = 0; b < n / kKvQuantBlock; ++b) {
+        float32x4_t q[8];
+        Unpack(blocks[b], q);
+        const float d = s * halfToFloat(blocks[b].scale);
+        float* yb = y + b * kKvQuantBlock;
+        for (int i = 0; i < 8; ++i) {
+            vst1q_f32(yb + 4 * i, vfmaq_n_f32(vld1q_f32(yb + 4 * i), q[i], d));
+        }
+    }
+}
+
+#endif // NIMITTAM_KV_NEON
+
+#if NIMITTAM_KV_AVX2
+
+#define NIMITTAM_AVX2 __attribute__((target("avx2,fma")))
+
+// Dequantized block as 4 __m256 (unscaled), elements 0..31 in order.
+NIMITTAM_AVX2 inline void unpackQ8_0Avx2(const BlockQ8_0& block, __m256 out[4]) {
+    for (int i = 0; i < 4; ++i) {
+        const __m128i q8 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(block.q + 8 * i));
+        out[i] = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(q8));
+    }
+}
+
+NIMITTAM_AVX2 inline void unpackQ4_0Avx2(const BlockQ4_0& block, __m256 out[4]) {
+    const __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block.q));
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    const __m128i eight = _mm_set1_epi8(8);
+    const __m128i lo = _mm_sub_epi8(_mm_and_si128(packed, mask), eight);
+    const __m128i hi = _mm_sub_epi8(_mm_and_si128(_mm_srli_epi16(packed, 4), mask), eight);
+    out[0] = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(lo));
+    out[1] = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_srli_si128(lo, 8)));
+    out[2] = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(hi));
+    out[3] = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_srli_si128(hi, 8)));
+}
+
+NIMITTAM_AVX2 inline float hsum(__m256 v) {
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+
+NIMITTAM_AVX2 float dotQ8_0Avx2(const float* a, const BlockQ8_0* blocks, int n) {
+    __m256 acc = _mm256_setzero_ps();
+    for (int b = 0; b < n / kKvQuantBlock; ++b) {
+        __m256 q[4];
+        unpackQ8_0Avx2(blocks[b], q);
+        const float* ab = a + b * kKvQuantBlock;
+        __m256 sum = _mm256_mul_ps(_mm256_loadu_ps(ab), q[0]);
+        for (int i = 1; i < 4; ++i) sum = _mm256_fmadd_ps(_mm256_loadu_ps(ab + 8 * i), q[i], sum);
+        acc = _mm256_fmadd_ps(_mm256_set1_ps(halfToFloat(blocks[b].scale)), sum, acc);
+    }
+    return hsum(acc);
+}
+
+NIMITTAM_AVX2 float dotQ4_0Avx2(const float* a, const BlockQ4_0* blocks, int n) {
+    __m256 acc = _mm256_setzero_ps();
+    for (int b = 0; b < n / kKvQuantBlock; ++b) {
+        __m256 q[4];
+        unpackQ4_0Avx2(blocks[b], q);
+        const float* ab = a + b * kKvQuantBlock;
+        __m256 sum = _mm256_mul_ps(_mm256_loadu_ps(ab), q[0]);
+        for (int i = 1; i < 4; ++i) sum = _mm256_fmadd_ps(_mm256_loadu_ps(ab + 8 * i), q[i], sum);
+        acc = _mm256_fmadd_ps(_mm256_set1_ps(halfToFloat(blocks[b].scale)), sum, acc);
+    }
+    return hsum(acc);
+}
+
+NIMITTAM_AVX2 void axpyQ8_0Avx2(float s, const BlockQ8_0* blocks, float* y, int n) {
+    for (int b = 0; b < n / kKvQuantBlock; ++b) {
+        __m256 q[4];
+        unpackQ8_0Avx2(blocks[b], q);
+        const __m256 d = _mm256_set1_ps(s * halfToFloat(blocks[b].scale));
+        float* yb = y + b * kKvQuantBlock;
+        for (int i = 0; i < 4; ++i) {
+            _mm256_storeu_ps(yb + 8 * i, _mm256_fmadd_ps(q[i], d, _mm256_loadu_ps(yb + 8 * i)));
+        }
+    }
+}
+
+NIMITTAM_AVX2 void axpyQ4_0Avx2(float s, const BlockQ4_0* blocks, float* y, int n) {
+    for (int b = 0; b < n / kKvQuantBlock; ++b) {
+        __m256 q[4];
+        unpackQ4_0Avx2(blocks[b], q);
+        const __m256 d = _mm256_set1_ps(s * halfToFloat(blocks[b].scale));
+        float* yb = y + b * kKvQuantBlock;
+        for (int i = 0; i < 4; ++i) {
+            _mm256_storeu_ps(yb + 8 * i, _mm256_fmadd_ps(q[i], d, _mm256_loadu_ps(yb + 8 * i)));
+        }
+    }
+}
+
+#endif // NIMITTAM_KV_AVX2
+
+} // namespace
+
+const KvQuantKernels kKvQuantScalar = {dotQ8_0Scalar, dotQ4_0Scalar, axpyQ8_0Scalar,
+                                       axpyQ4_0Scalar, "scalar"};
+
+#if NIMITTAM_KV_NEON
+const KvQuantKernels kKvQuantNeon = {
+        dotNeon<BlockQ8_0, unpackQ8_0>, dotNeon<BlockQ4_0, unpackQ4_0>,
+        axpyNeon<BlockQ8_0, unpackQ8_0>, axpyNeon<BlockQ4_0, unpackQ4_0>, "neon"};
+#endif
+
+#if NIMITTAM_KV_AVX2
+const KvQuantKernels kKvQuantAvx2 = {dotQ8_0Avx2, dotQ4_0Avx2, axpyQ8_0Avx2, axpyQ4_0Avx2,
+                                     "avx2"};
+#endif
+
+void quantizeRowQ8_0(const float* x, BlockQ8_0* out, int n) {
+    for (int b = 0; b < n / kKvQuantBlock; ++b) {
+        const float* xb = x + b * kKvQuantBlock;
+        float amax = 0.0f;
+        for (int j = 0; j < kKvQuantBlock; ++j) amax = std::max(amax, std::fabs(xb[j]));
+        // Quantize against the stored (float16) scale, not the exact one.
+        out[b].scale = floatToHalf(amax / 127.0f);
+        const float d = halfToFloat(out[b].scale);
+        const float id = d > 0.0f ? 1.0f / d : 0.0f;
+        for (int j = 0; j < kKvQuantBlock; ++j) {
+            const long v = std::lround(xb[j] * id);
+            out[b].q[j] = static_cast<int8_t>(std::max(-127L, std::min(127L, v)));
+        }
+    }
+}
+
+void quantizeRowQ4_0(const float* x, BlockQ4_0* out, int n) {
+    constexpr int half = kKvQuantBlock / 2;
+    for (int b = 0; b < n / kKvQuantBlock; ++b) {
+        const float* xb = x + b * kKvQuantBlock;
+        // Signed max so the extreme value maps to -8 and uses the full range.
+        float max = 0.0f;
+        for (int j = 0; j < kKvQuantBlock; ++j) {
+            if (std::fabs(xb[j]) > std::fabs(max)) max = xb[j];
+        }
+        out[b].scale = floatToHalf(max / -8.0f);
+        const float d = halfToFloat(out[b].scale);
+        const float id = d != 0.0f ? 1.0f / d : 0.0f;
+        auto nibble = [id](float v) {
+            return std::max(0, std::min(15, static_cast<int>(std::floor(v * id + 8.5f))));
+        };
+        for (int j = 0; j < half; ++j) {
+            out[b].q[j] = static_cast<uint8_t>(nibble(xb[j]) | (nibble(xb[j + half]) << 4));
+        }
+    }
+}
+
+float dotQ8_0(const float* a, const BlockQ8_0* blocks, int n) {
+    return kvQuantKernels().dotQ8_0(a, blocks, n);
+}
+
+float dotQ4_0(const float* a, const BlockQ4_0* blocks, int n) {
+    return kvQuantKernels().dotQ4_0(a, blocks, n);
+}
+
+void axpyQ8_0(float s, const BlockQ8_0* blocks, float* y, int n) {
+    kvQuantKernels().axpyQ8_0(s, blocks, y, n);
+}
+
+void axpyQ4_0(float s, const BlockQ4_0* blocks, float* y, int n) {
+    kvQuantKernels().axpyQ4_0(s, blocks, y, n);
+}
+
+const char* kvQuantKernelName() {
+    return kvQuantKernels().name;
+}
+
+} // namespace nimittam
@@ -0,0 +1,83 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Blockwise-quantized KV cache rows (KvCacheType::Q8_0 / Q4_0).
+ *
+ * Rows are split into blocks of 32 elements, each with one float16
+ * scale, in the ggml layouts:
+ *   Q8_0: scale, int8 q[32];              x = q * scale
+ *   Q4_0: scale, uint8 q[16] nibbles;     x = (nibble - 8) * scale
+ *         element j in the low nibble of q[j], j + 16 in the high one.
+ * Attention never materializes float rows: the dot/axpy kernels
+ * dequantize inside the multiply-accumulate. NEON versions are used on
+ * arm64; on x86 hosts AVX2+FMA versions are picked at runtime.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace nimittam {
+
+constexpr int kKvQuantBlock = 32;
+
+struct BlockQ8_0 {
+    uint16_t scale;
+    int8_t q[kKvQuantBlock];
+};
+
+struct BlockQ4_0 {
+    uint16_t scale;
+    uint8_t q[kKvQuantBlock / 2];
+};
+
+static_assert(sizeof(BlockQ8_0) == 34, "BlockQ8_0 must be packed");
+static_assert(sizeof(BlockQ4_0) == 18, "BlockQ4_0 must be packed");
+
+/** Quantize n floats (n % 32 == 0) into n / 32 blocks. */
+void quantizeRowQ8_0(const float* x, BlockQ8_0* out, int n);
+void quantizeRowQ4_0(const float* x, BlockQ4_0* out, int n);
+
+/** dot(a, dequant(blocks)) over n elements. */
+float dotQ8_0(const float* a, const BlockQ8_0* blocks, int n);
+float dotQ4_0(const float* a, const BlockQ4_0* blocks, int n);
+
+/** y += s * dequant(blocks) over n elements. */
+void axpyQ8_0(float s, const BlockQ8_0* blocks, float* y, int n);
+void axpyQ4_0(float s, const BlockQ4_0* blocks, float* y, int n);
+
+/**
+ * One implementation of the four kernels above. There is no separate
+ * detection for them: each q4 kernel variant (kernels.h) names the set
+ * its instruction set level can run, so useQ4Kernels() switches both.
+ */
+struct KvQuantKernels {
+    float (*dotQ8_0)(const float*, const BlockQ8_0*, int);
+    float (*dotQ4_0)(const float*, const BlockQ4_0*, int);
+    void (*axpyQ8_0)(float, const BlockQ8_0*, float*, int);
+    void (*axpyQ4_0)(float, const BlockQ4_0*, float*, int);
+    const char* name;
+};
+
+/** The sets built in for this architecture; the scalar one runs anywhere. */
+extern const KvQuantKernels kKvQuantScalar;
+#if defined(__aarch64__) && defined(__ARM_NEON)
+extern const KvQuantKernels kKvQuantNeon;
+#elif defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+extern const KvQuantKernels kKvQuantAvx2;
+#endif
+
+/** The set of the q4 kernel variant in use; defined next to that variant table. */
+const KvQuantKernels& kvQuantKernels();
+
+/** Name of the set in use ("neon", "avx2" or "scalar"), for logs. */
+const char* kvQuantKernelName();
+
+} // namespace nimittam
@@ -0,0 +1,157 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "kv_snapshot.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "log.h"
+#include "mapped_file.h"
+
+namespace nimittam {
+
+namespace {
+
+size_t pageSize() {
+    return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+uint64_t dataOffsetFor(uint32_t tokenCount) {
+    const size_t page = pageSize();
+    const size_t end = sizeof(KvSnapshotHeader) + static_cast<size_t>(tokenCount) * sizeof(int32_t);
+    return (end + page - 1) / page * page;
+}
+
+bool writeAll(FILE* file, const void* data, size_t bytes) {
+    return bytes == 0 || std::fwrite(data, 1, bytes, file) == bytes;
+}
+
+} // namespace
+
+bool saveKvSnapshot(const std::string& path, uint64_t modelHash, const KvCache& cache,
+                    const KvSnapshotContext& context, std::string* error) {
+    KvSnapshotHeader header;
+    header.modelHash = modelHash;
+    header.kvCacheType = static_cast<uint32_t>(cache.type());
+    header.numLayers = static_cast<uint32_t>(cache.numLayers());
+    header.kvDim = static_cast<uint32_t>(cache.kvDim());
+    header.blockTokens = KvCache::kBlockTokens;
+    header.blockBytes = cache.blockDataBytes();
+    header.tokenCount = static_cast<uint32_t>(context.tokens.size());
+    header.pendingToken = context.pendingToken;
+    header.blockCount = static_cast<uint32_t>(
+            (context.tokens.size() + KvCache::kBlockTokens - 1) / KvCache::kBlockTokens);
+    header.dataOffset = dataOffsetFor(header.tokenCount);
+    if (header.blockCount > static_cast<uint32_t>(cache.blockCount())) {
+        *error = "KV cache holds fewer positions than the token list";
+        return false;
+    }
+
+    const std::string tmpPath = path + ".tmp";
+    FILE* file = std::fopen(tmpPath.c_str(), "wb");
+    if (!file) {
+        *error = "cannot create " + tmpPath;
+        return false;
+    }
+    const size_t tokensEnd =
+            sizeof(header) + context.tokens.size() * sizeof(int32_t);
+    const std::vector<uint8_t> padding(header.dataOffset - tokensEnd, 0);
+    bool ok = writeAll(file, &header, sizeof(header)) &&
+              writeAll(file, context.tokens.data(), context.tokens.size() * sizeof(int32_t)) &&
+              writeAll(file, padding.data(), padding.size());
+    for (uint32_t b = 0; ok && b < header.blockCount; ++b) {
+        ok = writeAll(file, cache.blockData(static_cast<int>(b)), header.blockBytes);
+    }
+    ok = std::fflush(file) == 0 && fsync(fileno(file)) == 0 && ok;
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok || std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        std::remove(tmpPath.c_str());
+        *error = "failed to write " + path;
+        return false;
+    }
+    LOGI("Saved KV snapshot: %u tokens, %u blocks, %llu KB", header.tokenCount,
+         header.blockCount,
+         static_cast<unsigned long long>((header.dataOffset +
+                                          header.blockCount * header.blockBytes) >> 10));
+    return true;
+}
+
+bool loadKvSnapshot(const std::string& path, uint64_t modelHash, int vocabSize, KvCache* cache,
+                    KvSnapshotContext* context, std::string* error) {
+    MappedFile file;
+    if (!file.open(path, error)) return false;
+    if (file.size() < sizeof(KvSnapshotHeader)) {
+        *error = path + " is not a KV snapshot";
+        return false;
+    }
+
+    KvSnapshotHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (header.magic != KvSnapshotHeader::kMagic) {
+        *error = path + " is not a KV snapshot";
+        return false;
+    }
+    if (header.version != KvSnapshotHeader::kVersion) {
+        *error = "unsupported KV snapshot version " + std::to_string(header.version);
+        return false;
+    }
+    if (header.modelHash != modelHash) {
+        *error = "KV snapshot belongs to a different model";
+        return false;
+    }
+    if (header.kvCacheType != static_cast<uint32_t>(cache->type()) ||
+        header.numLayers != static_cast<uint32_t>(cache->numLayers()) ||
+        header.kvDim != static_cast<uint32_t>(cache->kvDim()) ||
+        header.blockTokens != static_cast<uint32_t>(KvCache::kBlockTokens) ||
+        header.blockBytes != cache->blockDataBytes()) {
+        *error = "KV snapshot layout does not match the KV cache";
+        return false;
+    }
+    if (header.tokenCount > static_cast<uint32_t>(cache->contextSize())) {
+        *error = "KV snapshot of " + std::to_string(header.tokenCount) +
+                 " tokens exceeds the context";
+        return false;
+    }
+    const uint64_t blocks =
+            (header.tokenCount + KvCache::kBlockTokens - 1) / KvCache::kBlockTokens;
+    if (header.blockCount != blocks || header.dataOffset != dataOffsetFor(header.tokenCount) ||
+        header.dataOffset + blocks * header.blockBytes != file.size()) {
+        *error = path + " is truncated or corrupt";
+        return false;
+    }
+
+    // Token ids index the embedding table, so a damaged one must not get
+    // as far as the model.
+    std::vector<int32_t> tokens(header.tokenCount);
+    std::memcpy(tokens.data(), file.data() + sizeof(header), tokens.size() * sizeof(int32_t));
+    auto outOfRange = [&](int32_t id) { return id < 0 || id >= vocabSize; };
+    if (std::any_of(tokens.begin(), tokens.end(), outOfRange) ||
+        (header.pendingToken != -1 && outOfRange(header.pendingToken))) {
+        *error = path + " holds token ids outside the vocabulary";
+        return false;
+    }
+
+    const uint8_t* data = file.data() + header.dataOffset;
+    file.advise(MADV_SEQUENTIAL);
+    cache->reset();
+    cache->reserve(static_cast<int>(header.tokenCount));
+    for (uint32_t b = 0; b < header.blockCount; ++b) {
+        std::memcpy(cache->blockData(static_cast<int>(b)), data + b * header.blockBytes,
+                    header.blockBytes);
+    }
+    context->tokens = std::move(tokens);
+    context->pendingToken = header.pendingToken;
+    return true;
+}
+
+} // namespace nimittam
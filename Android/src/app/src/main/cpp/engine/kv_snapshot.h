@@ -0,0 +1,77 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * On-disk snapshot of one conversation's context.
+ *
+ * Stores the token list and the used KV blocks exactly as they sit in
+ * the pool, so restoring is a map and a copy rather than a prefill.
+ * A snapshot only loads into an engine on the same model (by
+ * LoadedModel::modelHash) with the same KV layout and type.
+ *
+ * Layout (native byte order, little-endian on every supported ABI):
+ *   [0]           KvSnapshotHeader
+ *   [64]          int32 tokens[tokenCount]
+ *   [dataOffset]  blockCount blocks of blockBytes each, page aligned so
+ *                 the data can be mapped directly
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "kv_cache.h"
+
+namespace nimittam {
+
+struct KvSnapshotHeader {
+    static constexpr uint32_t kMagic = 0x53564b4e;  // 'NKVS'
+    static constexpr uint32_t kVersion = 1;
+
+    uint32_t magic = kMagic;
+    uint32_t version = kVersion;
+    uint64_t modelHash = 0;
+    uint32_t kvCacheType = 0;
+    uint32_t numLayers = 0;
+    uint32_t kvDim = 0;
+    uint32_t blockTokens = 0;
+    uint64_t blockBytes = 0;
+    uint32_t tokenCount = 0;
+    int32_t pendingToken = -1;  // sampled but not yet in the cache
+    uint32_t blockCount = 0;
+    uint32_t reserved = 0;
+    uint64_t dataOffset = 0;
+};
+static_assert(sizeof(KvSnapshotHeader) == 64, "snapshot header is 64 bytes");
+
+/** Conversation state stored next to the KV blocks. */
+struct KvSnapshotContext {
+    std::vector<int32_t> tokens;  // one per cached position
+    int32_t pendingToken = -1;
+};
+
+/**
+ * Write [cache] and [context] to [path] for the model [modelHash]. The
+ * file is written beside [path] and renamed over it, so a crash never
+ * leaves a torn snapshot.
+ */
+bool saveKvSnapshot(const std::string& path, uint64_t modelHash, const KvCache& cache,
+                    const KvSnapshotContext& context, std::string* error);
+
+/**
+ * Replace the contents of [cache] and [context] with the snapshot at
+ * [path]. Fails without touching either if the file is not a snapshot
+ * of [modelHash] with [cache]'s layout, does not fit its context or
+ * holds a token id outside [0, vocabSize).
+ */
+bool loadKvSnapshot(const std::string& path, uint64_t modelHash, int vocabSize, KvCache* cache,
+                    KvSnapshotContext* context, std::string* error);
+
+} // namespace nimittam
@@ -0,0 +1,42 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Logging macros shared by the JNI bridge and the native engine.
+ *
+ * On Android these forward to logcat; host builds (benchmarks, tests)
+ * write to stderr so the same sources compile as a plain Linux library.
+ */
+
+#pragma once
+
+#ifndef LOG_TAG
+#define LOG_TAG "MlcLlmJni"
+#endif
+
+#if defined(__ANDROID__)
+#include <android/log.h>
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+#else
+#include <cstdio>
+#define NIMITTAM_HOST_LOG(level, ...)                   \
+    do {                                                \
+        std::fprintf(stderr, "%s/%s: ", level, LOG_TAG); \
+        std::fprintf(stderr, __VA_ARGS__);              \
+        std::fputc('\n', stderr);                       \
+    } while (0)
+#define LOGI(...) NIMITTAM_HOST_LOG("I", __VA_ARGS__)
+#define LOGE(...) NIMITTAM_HOST_LOG("E", __VA_ARGS__)
+#ifdef NDEBUG
+#define LOGD(...) do { } while (0)
+#else
+#define LOGD(...) NIMITTAM_HOST_LOG("D", __VA_ARGS__)
+#endif
+#endif
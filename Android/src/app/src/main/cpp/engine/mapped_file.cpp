@@ -0,0 +1,98 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <utility>
+
+namespace nimittam {
+
+MappedFile::~MappedFile() {
+    unmap();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+        : base_(std::exchange(other.base_, nullptr)),
+          mapSize_(std::exchange(other.mapSize_, 0)),
+          data_(std::exchange(other.data_, nullptr)),
+          size_(std::exchange(other.size_, 0)) {}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        unmap();
+        base_ = std::exchange(other.base_, nullptr);
+        mapSize_ = std::exchange(other.mapSize_, 0);
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+    }
+    return *this;
+}
+
+bool MappedFile::open(const std::string& path, std::string* error) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        *error = "cannot open " + path;
+        return false;
+    }
+    return open(path, 0, static_cast<size_t>(st.st_size), error);
+}
+
+bool MappedFile::open(const std::string& path, uint64_t offset, size_t length,
+                      std::string* error) {
+    unmap();
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        *error = "cannot open " + path;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || offset + length > static_cast<uint64_t>(st.st_size)) {
+        ::close(fd);
+        *error = path + ": range past the end of the file";
+        return false;
+    }
+    if (length == 0) {
+        // mmap rejects empty ranges; an empty file is an empty mapping.
+        ::close(fd);
+        return true;
+    }
+    const uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    const uint64_t start = offset / page * page;
+    const size_t mapSize = static_cast<size_t>(offset - start) + length;
+    void* base = mmap(nullptr, mapSize, PROT_READ, MAP_PRIVATE, fd, static_cast<off_t>(start));
+    // The mapping keeps the file referenced.
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        *error = "cannot map " + path;
+        return false;
+    }
+    base_ = static_cast<uint8_t*>(base);
+    mapSize_ = mapSize;
+    data_ = base_ + (offset - start);
+    size_ = length;
+    return true;
+}
+
+void MappedFile::advise(int advice) const {
+    if (base_) madvise(base_, mapSize_, advice);
+}
+
+void MappedFile::unmap() {
+    if (base_) munmap(base_, mapSize_);
+    base_ = nullptr;
+    mapSize_ = 0;
+    data_ = nullptr;
+    size_ = 0;
+}
+
+} // namespace nimittam
@@ -0,0 +1,59 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Read-only memory mapping of a whole file.
+ *
+ * Pages are file-backed and clean, so the kernel can drop them under
+ * memory pressure and fault them back in on the next access instead of
+ * counting them against the process like a heap copy.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace nimittam {
+
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    /** Map [path] read-only; on failure fills [error] and stays empty. */
+    bool open(const std::string& path, std::string* error);
+
+    /**
+     * Map [length] bytes of [path] starting at [offset], which need not be
+     * page aligned (an uncompressed entry inside a zip, for instance).
+     */
+    bool open(const std::string& path, uint64_t offset, size_t length, std::string* error);
+
+    /** madvise() the whole mapping; a hint, so failures are ignored. */
+    void advise(int advice) const;
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    void unmap();
+
+    uint8_t* base_ = nullptr;  // page-aligned start of the mapping
+    size_t mapSize_ = 0;
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+} // namespace nimittam
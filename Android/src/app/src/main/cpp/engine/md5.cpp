@@ -0,0 +1,108 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "md5.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace nimittam {
+
+namespace {
+
+// RFC 1321 per-round shift amounts and sine-derived constants.
+constexpr uint32_t kShift[64] = {
+        7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+        5, 9,  14, 20, 5, 9,  14, 20, 5, 9,  14, 20, 5, 9,  14, 20,
+        4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+        6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21};
+
+constexpr uint32_t kSine[64] = {
+        0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613,
+        0xfd469501, 0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193,
+        0xa679438e, 0x49b40821, 0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d,
+        0x02441453, 0xd8a1e681, 0xe7d3fbc8, 0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed,
+        0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a, 0xfffa3942, 0x8771f681, 0x6d9d6122,
+        0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70, 0x289b7ec6, 0xeaa127fa,
+        0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665, 0xf4292244,
+        0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+        0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb,
+        0xeb86d391};
+
+uint32_t rotateLeft(uint32_t x, uint32_t n) {
+    return (x << n) | (x >> (32 - n));
+}
+
+} // namespace
+
+Md5::Md5() : state_{0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476} {}
+
+void Md5::update(const uint8_t* data, size_t size) {
+    size_t used = static_cast<size_t>(length_ % 64);
+    length_ += size;
+    if (used > 0) {
+        const size_t take = std::min(size, 64 - used);
+        std::memcpy(buffer_ + used, data, take);
+        data += take;
+        size -= take;
+        if (used + take < 64) return;
+        transform(buffer_);
+    }
+    for (; size >= 64; data += 64, size -= 64) transform(data);
+    std::memcpy(buffer_, data, size);
+}
+
+std::string Md5::hexDigest() {
+    const uint64_t bits = length_ * 8;
+    static const uint8_t kPadding[64] = {0x80};
+    const size_t used = static_cast<size_t>(length_ % 64);
+    update(kPadding, used < 56 ? 56 - used : 120 - used);
+    uint8_t lengthBytes[8];
+    for (int i = 0; i < 8; ++i) lengthBytes[i] = static_cast<uint8_t>(bits >> (8 * i));
+    update(lengthBytes, 8);
+
+    static const char kHex[] = "0123456789abcdef";
+    std::string hex;
+    for (uint32_t word : state_) {
+        for (int i = 0; i < 4; ++i) {
+            const uint8_t byte = static_cast<uint8_t>(word >> (8 * i));
+            hex.push_back(kHex[byte >> 4]);
+            hex.push_back(kHex[byte & 15]);
+        }
+    }
+    return hex;
+}
+
+void Md5::transform(const uint8_t* block) {
+    uint32_t m[16];
+    for (int i = 0; i < 16; ++i) {
+        m[i] = static_cast<uint32_t>(block[i * 4]) | static_cast<uint32_t>(block[i * 4 + 1]) << 8 |
+               static_cast<uint32_t>(block[i * 4 + 2]) << 16 |
+               static_cast<uint32_t>(block[i * 4 + 3]) << 24;
+    }
+    uint32_t a = state_[0], b = state_[1], c = state_[2], d = state_[3];
+    // One loop per round keeps the round function and message index free
+    // of per-step branches, so the compiler can unroll each round.
+    auto step = [&](uint32_t f, int i, int g) {
+        const uint32_t next = d;
+        d = c;
+        c = b;
+        b = b + rotateLeft(a + f + kSine[i] + m[g], kShift[i]);
+        a = next;
+    };
+    for (int i = 0; i < 16; ++i) step((b & c) | (~b & d), i, i);
+    for (int i = 16; i < 32; ++i) step((d & b) | (~d & c), i, (5 * i + 1) % 16);
+    for (int i = 32; i < 48; ++i) step(b ^ c ^ d, i, (3 * i + 5) % 16);
+    for (int i = 48; i < 64; ++i) step(c ^ (b | ~d), i, (7 * i) % 16);
+    state_[0] += a;
+    state_[1] += b;
+    state_[2] += c;
+    state_[3] += d;
+}
+
+} // namespace nimittam
@@ -0,0 +1,39 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * MD5, as used for the per-shard "md5sum" in MLC's ndarray-cache.json.
+ * Only for detecting corrupt or truncated files, not for security.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace nimittam {
+
+class Md5 {
+public:
+    Md5();
+
+    void update(const uint8_t* data, size_t size);
+
+    /** Lower-case hex digest; the object must not be updated afterwards. */
+    std::string hexDigest();
+
+private:
+    void transform(const uint8_t* block);
+
+    uint32_t state_[4];
+    uint64_t length_ = 0;  // bytes hashed so far
+    uint8_t buffer_[64];
+};
+
+} // namespace nimittam
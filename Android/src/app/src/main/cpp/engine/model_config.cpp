@@ -0,0 +1,78 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "model_config.h"
+
+#include "json.h"
+#include "model_source.h"
+
+namespace nimittam {
+
+bool ModelConfig::load(const ModelSource& source, ModelConfig* out, std::string* error) {
+    JsonValue root;
+    if (!source.parseJson("mlc-chat-config.json", &root, error)) {
+        return false;
+    }
+
+    const JsonValue& model = root["model_config"];
+    if (!model.isObject()) {
+        *error = "mlc-chat-config.json has no model_config";
+        return false;
+    }
+
+    ModelConfig config;
+    config.modelType = root["model_type"].asString();
+    config.quantization = root["quantization"].asString();
+    config.hiddenSize = static_cast<int>(model["hidden_size"].asInt());
+    config.intermediateSize = static_cast<int>(model["intermediate_size"].asInt());
+    config.numLayers = static_cast<int>(model["num_hidden_layers"].asInt());
+    config.numHeads = static_cast<int>(model["num_attention_heads"].asInt());
+    config.numKvHeads = static_cast<int>(model["num_key_value_heads"].asInt(config.numHeads));
+    config.vocabSize = static_cast<int>(model["vocab_size"].asInt());
+    config.headDim = static_cast<int>(model["head_dim"].asInt(
+            config.numHeads > 0 ? config.hiddenSize / config.numHeads : 0));
+    config.rmsNormEps = static_cast<float>(model["rms_norm_eps"].asNumber(1e-6));
+    config.ropeTheta = static_cast<float>(model["rope_theta"].asNumber(10000.0));
+    config.tieWordEmbeddings = model["tie_word_embeddings"].asBool(false);
+    config.contextWindowSize = static_cast<int>(root["context_window_size"].asInt(
+            model["context_window_size"].asInt(4096)));
+    config.prefillChunkSize = static_cast<int>(root["prefill_chunk_size"].asInt(512));
+
+    for (const JsonValue& id : root["conv_template"]["stop_token_ids"].items()) {
+        config.stopTokenIds.push_back(static_cast<int32_t>(id.asInt()));
+    }
+    const JsonValue& eos = root["eos_token_id"];
+    if (eos.isNumber()) {
+        config.stopTokenIds.push_back(static_cast<int32_t>(eos.asInt()));
+    }
+    for (const JsonValue& id : eos.items()) {
+        config.stopTokenIds.push_back(static_cast<int32_t>(id.asInt()));
+    }
+
+    if (config.modelType != "qwen2") {
+        *error = "unsupported model_type '" + config.modelType + "' (expected qwen2)";
+        return false;
+    }
+    if (config.quantization != "q4f16_1") {
+        *error = "unsupported quantization '" + config.quantization + "' (expected q4f16_1)";
+        return false;
+    }
+    if (config.hiddenSize <= 0 || config.numLayers <= 0 || config.numHeads <= 0 ||
+        config.numKvHeads <= 0 || config.headDim <= 0 || config.vocabSize <= 0 ||
+        config.numHeads % config.numKvHeads != 0 || config.headDim % 2 != 0 ||
+        config.hiddenSize % config.quantGroupSize != 0 ||
+        config.intermediateSize % config.quantGroupSize != 0) {
+        *error = "inconsistent model_config dimensions";
+        return false;
+    }
+
+    *out = std::move(config);
+    return true;
+}
+
+} // namespace nimittam
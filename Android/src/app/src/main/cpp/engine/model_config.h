@@ -0,0 +1,56 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Model hyper-parameters read from mlc-chat-config.json.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace nimittam {
+
+class ModelSource;
+
+struct ModelConfig {
+    std::string modelType;
+    std::string quantization;
+
+    int hiddenSize = 0;
+    int intermediateSize = 0;
+    int numLayers = 0;
+    int numHeads = 0;
+    int numKvHeads = 0;
+    int headDim = 0;
+    int vocabSize = 0;
+    int contextWindowSize = 0;
+    int prefillChunkSize = 0;
+    float rmsNormEps = 1e-6f;
+    float ropeTheta = 10000.0f;
+    bool tieWordEmbeddings = false;
+
+    // q4f16_1: 4-bit weights, groups of 32 along the input dimension,
+    // one float16 scale per group, zero point fixed at 7.
+    int quantGroupSize = 32;
+
+    std::vector<int32_t> stopTokenIds;
+
+    int qDim() const { return numHeads * headDim; }
+    int kvDim() const { return numKvHeads * headDim; }
+
+    /**
+     * Load mlc-chat-config.json from [source]. Only qwen2 / q4f16_1 is
+     * supported by the CPU path; anything else is rejected with [error].
+     */
+    static bool load(const ModelSource& source, ModelConfig* out, std::string* error);
+};
+
+} // namespace nimittam
@@ -0,0 +1,70 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "model_source.h"
+
+#include <climits>
+#include <cstdlib>
+
+namespace nimittam {
+
+namespace {
+
+std::string canonicalPath(const std::string& path) {
+    char resolved[PATH_MAX];
+    return realpath(path.c_str(), resolved) ? std::string(resolved) : path;
+}
+
+} // namespace
+
+bool ModelSource::open(const std::string& location, std::string* error) {
+    const size_t separator = location.find(kArchiveSeparator);
+    if (separator == std::string::npos) {
+        archive_.reset();
+        dir_ = canonicalPath(location);
+        location_ = dir_;
+        return true;
+    }
+
+    auto archive = std::make_shared<ZipArchive>();
+    if (!archive->open(canonicalPath(location.substr(0, separator)), error)) return false;
+    dir_ = location.substr(separator + 2);
+    while (!dir_.empty() && dir_.back() == '/') dir_.pop_back();
+    location_ = archive->path() + kArchiveSeparator + dir_;
+    archive_ = std::move(archive);
+    return true;
+}
+
+bool ModelSource::map(const std::string& name, MappedFile* out, std::string* error) const {
+    if (!archive_) return out->open(dir_ + "/" + name, error);
+
+    const std::string entryName = dir_.empty() ? name : dir_ + "/" + name;
+    const ZipArchive::Entry* entry = archive_->find(entryName);
+    if (!entry) {
+        *error = entryName + " not found in " + archive_->path();
+        return false;
+    }
+    if (!entry->stored) {
+        *error = entryName + " is compressed; it must be stored (noCompress) to be mapped";
+        return false;
+    }
+    return out->open(archive_->path(), entry->dataOffset, static_cast<size_t>(entry->size),
+                     error);
+}
+
+bool ModelSource::parseJson(const std::string& name, JsonValue* out, std::string* error) const {
+    MappedFile file;
+    if (!map(name, &file, error)) return false;
+    if (!JsonValue::parse(reinterpret_cast<const char*>(file.data()), file.size(), out, error)) {
+        *error = name + ": " + *error;
+        return false;
+    }
+    return true;
+}
+
+} // namespace nimittam
@@ -0,0 +1,53 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Where a model's files are read from.
+ *
+ * A location is either a directory ("/data/.../Qwen2.5-0.5B") or a
+ * directory inside a zip archive, written "<archive>!/<dir>" as in jar
+ * URLs ("/data/app/.../base.apk!/assets/Qwen2.5-0.5B"). Files inside an
+ * archive must be stored uncompressed; they are mapped in place, so an
+ * APK needs no extraction step and the weights exist once on disk.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "json.h"
+#include "mapped_file.h"
+#include "zip_archive.h"
+
+namespace nimittam {
+
+class ModelSource {
+public:
+    static constexpr const char* kArchiveSeparator = "!/";
+
+    /** Open [location]; fills [error] if the directory or archive is unusable. */
+    bool open(const std::string& location, std::string* error);
+
+    /** Map the model file [name] read-only. */
+    bool map(const std::string& name, MappedFile* out, std::string* error) const;
+
+    /** Map and parse the JSON model file [name]. */
+    bool parseJson(const std::string& name, JsonValue* out, std::string* error) const;
+
+    /** Canonical location, stable across spellings of the same path. */
+    const std::string& location() const { return location_; }
+    bool inArchive() const { return archive_ != nullptr; }
+
+private:
+    std::string location_;
+    std::string dir_;  // directory, or the entry prefix inside archive_
+    std::shared_ptr<ZipArchive> archive_;
+};
+
+} // namespace nimittam
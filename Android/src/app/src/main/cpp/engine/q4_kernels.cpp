@@ -0,0 +1,689 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "cpu_features.h"
+#include "kernels.h"
+#include "kv_quant.h"
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define NIMITTAM_Q4_ARM64 1
+#include <arm_neon.h>
+#elif defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define NIMITTAM_Q4_X86 1
+#include <immintrin.h>
+#endif
+
+namespace nimittam {
+
+namespace {
+
+// Bumped whenever the packed layout or how the kernels read it changes.
+constexpr uint32_t kQ4PackVersion = 1;
+
+// The ABI baseline: what the library itself is compiled for.
+namespace baseline {
+#define NIMITTAM_Q4_TARGET
+#include "q4_kernels_impl.h"
+#undef NIMITTAM_Q4_TARGET
+} // namespace baseline
+
+#if NIMITTAM_Q4_ARM64
+// FP16 arithmetic and dot product, which every big core since Cortex-A75
+// (and nearly every little one since A55) has.
+namespace armv82 {
+#define NIMITTAM_Q4_TARGET __attribute__((target("arch=armv8.2-a+fp16+dotprod")))
+#include "q4_kernels_impl.h"
+#undef NIMITTAM_Q4_TARGET
+} // namespace armv82
+#endif
+
+#if NIMITTAM_Q4_X86
+namespace sse41 {
+#define NIMITTAM_Q4_TARGET __attribute__((target("sse4.1")))
+#include "q4_kernels_impl.h"
+#undef NIMITTAM_Q4_TARGET
+} // namespace sse41
+
+namespace avx2 {
+#define NIMITTAM_Q4_TARGET __attribute__((target("avx2,fma,f16c")))
+#include "q4_kernels_impl.h"
+#undef NIMITTAM_Q4_TARGET
+} // namespace avx2
+
+namespace avx512 {
+#define NIMITTAM_Q4_TARGET \
+    __attribute__((target("avx512f,avx512bw,avx512vl,avx2,fma,f16c")))
+#include "q4_kernels_impl.h"
+#undef NIMITTAM_Q4_TARGET
+} // namespace avx512
+#endif
+
+// ---- Packed GEMV ----
+//
+// Decode is bound by the packed q4Gemv, so it is written out per
+// instruction set rather than left to the vectorizer. All of them keep
+// each row's scaled products in vector accumulators across groups and
+// reduce once per row, and fold the zero point into the nibbles, so the
+// group loop has neither horizontal adds nor per-group sums of x.
+
+#if NIMITTAM_Q4_ARM64
+
+float32x4_t nibblesToFloat(int16x4_t nibbles) {
+    return vcvtq_f32_s32(vmovl_s16(nibbles));
+}
+
+void gemvPackedNeon(const Q4Matrix& w, const float* x, float* y, int rowBegin, int rowEnd) {
+    const int groups = w.cols / kQ4GroupSize;
+    const float* table = halfToFloatTable();
+    const int8x16_t zero = vdupq_n_s8(kQ4ZeroPoint);
+    const uint8x16_t mask = vdupq_n_u8(0xF);
+    const size_t tileBytes = groups * kQ4PackedBlockBytes;
+    for (int tile = rowBegin / kQ4PackRows; tile * kQ4PackRows < rowEnd; ++tile) {
+        const uint8_t* block = w.packed + tile * tileBytes;
+        float32x4_t acc[kQ4PackRows][4];
+        for (int lane = 0; lane < kQ4PackRows; ++lane) {
+            for (int k = 0; k < 4; ++k) acc[lane][k] = vdupq_n_f32(0.0f);
+        }
+        for (int g = 0; g < groups; ++g, block += kQ4PackedBlockBytes) {
+            const uint16_t* scales = reinterpret_cast<const uint16_t*>(block);
+            const uint8_t* q = block + kQ4PackRows * sizeof(uint16_t);
+            const float* xg = x + g * kQ4GroupSize;
+            float32x4_t xv[8];
+            for (int k = 0; k < 8; ++k) xv[k] = vld1q_f32(xg + 4 * k);
+            for (int lane = 0; lane < kQ4PackRows; ++lane) {
+                const uint8x16_t bytes = vld1q_u8(q + lane * (kQ4GroupSize / 2));
+                const int8x16_t lo = vsubq_s8(vreinterpretq_s8_u8(vandq_u8(bytes, mask)), zero);
+                const int8x16_t hi = vsubq_s8(vreinterpretq_s8_u8(vshrq_n_u8(bytes, 4)), zero);
+                const int16x8_t lo16[2] = {vmovl_s8(vget_low_s8(lo)), vmovl_high_s8(lo)};
+                const int16x8_t hi16[2] = {vmovl_s8(vget_low_s8(hi)), vmovl_high_s8(hi)};
+                const float scale = table[scales[lane]];
+                for (int k = 0; k < 4; ++k) {
+                    const int16x8_t l8 = lo16[k / 2];
+                    const int16x8_t h8 = hi16[k / 2];
+                    const int16x4_t l = k % 2 ? vget_high_s16(l8) : vget_low_s16(l8);
+                    const int16x4_t h = k % 2 ? vget_high_s16(h8) : vget_low_s16(h8);
+                    float32x4_t t = vmulq_f32(xv[k], nibblesToFloat(l));
+                    t = vfmaq_f32(t, xv[k + 4], nibblesToFloat(h));
+                    acc[lane][k] = vfmaq_n_f32(acc[lane][k], t, scale);
+                }
+            }
+        }
+        for (int lane = 0; lane < kQ4PackRows; ++lane) {
+            const int r = tile * kQ4PackRows + lane;
+            if (r < rowBegin || r >= rowEnd) continue;
+            y[r] = vaddvq_f32(vaddq_f32(vaddq_f32(acc[lane][0], acc[lane][1]),
+                                        vaddq_f32(acc[lane][2], acc[lane][3])));
+        }
+    }
+}
+
+#endif // NIMITTAM_Q4_ARM64
+
+#if NIMITTAM_Q4_X86
+
+__attribute__((target("avx2,fma,f16c")))
+inline __m256 nibblesToFloat(__m256i nibbles, __m256i zero) {
+    return _mm256_cvtepi32_ps(_mm256_sub_epi32(nibbles, zero));
+}
+
+__attribute__((target("avx2,fma,f16c")))
+void gemvPackedAvx2(const Q4Matrix& w, const float* x, float* y, int rowBegin, int rowEnd) {
+    const int groups = w.cols / kQ4GroupSize;
+    const __m256i zero = _mm256_set1_epi32(kQ4ZeroPoint);
+    const __m256i mask = _mm256_set1_epi32(0xF);
+    const size_t tileBytes = groups * kQ4PackedBlockBytes;
+    for (int tile = rowBegin / kQ4PackRows; tile * kQ4PackRows < rowEnd; ++tile) {
+        const uint8_t* block = w.packed + tile * tileBytes;
+        // acc[lane][0] holds elements 0-7 (and 16-23) of every group, [1] 8-15 (and 24-31).
+        __m256 acc[kQ4PackRows][2];
+        for (int lane = 0; lane < kQ4PackRows; ++lane) {
+            acc[lane][0] = _mm256_setzero_ps();
+            acc[lane][1] = _mm256_setzero_ps();
+        }
+        for (int g = 0; g < groups; ++g, block += kQ4PackedBlockBytes) {
+            float scales[kQ4PackRows];
+            _mm_storeu_ps(scales, _mm_cvtph_ps(_mm_loadl_epi64(
+                                          reinterpret_cast<const __m128i*>(block))));
+            const uint8_t* q = block + kQ4PackRows * sizeof(uint16_t);
+            const float* xg = x + g * kQ4GroupSize;
+            const __m256 x0 = _mm256_loadu_ps(xg);
+            const __m256 x1 = _mm256_loadu_ps(xg + 8);
+            const __m256 x2 = _mm256_loadu_ps(xg + 16);
+            const __m256 x3 = _mm256_loadu_ps(xg + 24);
+            for (int lane = 0; lane < kQ4PackRows; ++lane) {
+                const __m128i bytes = _mm_loadu_si128(
+                        reinterpret_cast<const __m128i*>(q + lane * (kQ4GroupSize / 2)));
+                const __m256i b0 = _mm256_cvtepu8_epi32(bytes);
+                const __m256i b1 = _mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8));
+                const __m256 s = _mm256_set1_ps(scales[lane]);
+                __m256 t0 = _mm256_mul_ps(x0, nibblesToFloat(_mm256_and_si256(b0, mask), zero));
+                __m256 t1 = _mm256_mul_ps(x1, nibblesToFloat(_mm256_and_si256(b1, mask), zero));
+                t0 = _mm256_fmadd_ps(x2, nibblesToFloat(_mm256_srli_epi32(b0, 4), zero), t0);
+                t1 = _mm256_fmadd_ps(x3, nibblesToFloat(_mm256_srli_epi32(b1, 4), zero), t1);
+                acc[lane][0] = _mm256_fmadd_ps(t0, s, acc[lane][0]);
+                acc[lane][1] = _mm256_fmadd_ps(t1, s, acc[lane][1]);
+            }
+        }
+        for (int lane = 0; lane < kQ4PackRows; ++lane) {
+            const int r = tile * kQ4PackRows + lane;
+            if (r < rowBegin || r >= rowEnd) continue;
+            const __m256 sum8 = _mm256_add_ps(acc[lane][0], acc[lane][1]);
+            __m128 sum = _mm_add_ps(_mm256_castps256_ps128(sum8), _mm256_extractf128_ps(sum8, 1));
+            sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+            sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+            y[r] = _mm_cvtss_f32(sum);
+        }
+    }
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vl,avx2,fma,f16c")))
+void gemvPackedAvx512(const Q4Matrix& w, const float* x, float* y, int rowBegin, int rowEnd) {
+    const int groups = w.cols / kQ4GroupSize;
+    const __m512i zero = _mm512_set1_epi32(kQ4ZeroPoint);
+    const __m512i mask = _mm512_set1_epi32(0xF);
+    const size_t tileBytes = groups * kQ4PackedBlockBytes;
+    for (int tile = rowBegin / kQ4PackRows; tile * kQ4PackRows < rowEnd; ++tile) {
+        const uint8_t* block = w.packed + tile * tileBytes;
+        __m512 acc[kQ4PackRows];
+        for (int lane = 0; lane < kQ4PackRows; ++lane) acc[lane] = _mm512_setzero_ps();
+        for (int g = 0; g < groups; ++g, block += kQ4PackedBlockBytes) {
+            float scales[kQ4PackRows];
+            _mm_storeu_ps(scales, _mm_cvtph_ps(_mm_loadl_epi64(
+                                          reinterpret_cast<const __m128i*>(block))));
+            const uint8_t* q = block + kQ4PackRows * sizeof(uint16_t);
+            const float* xg = x + g * kQ4GroupSize;
+            const __m512 lo = _mm512_loadu_ps(xg);
+            const __m512 hi = _mm512_loadu_ps(xg + kQ4GroupSize / 2);
+            for (int lane = 0; lane < kQ4PackRows; ++lane) {
+                const __m512i bytes = _mm512_cvtepu8_epi32(_mm_loadu_si128(
+                        reinterpret_cast<const __m128i*>(q + lane * (kQ4GroupSize / 2))));
+                const __m512 qlo = _mm512_cvtepi32_ps(
+                        _mm512_sub_epi32(_mm512_and_si512(bytes, mask), zero));
+                const __m512 qhi = _mm512_cvtepi32_ps(
+                        _mm512_sub_epi32(_mm512_srli_epi32(bytes, 4), zero));
+                const __m512 t = _mm512_fmadd_ps(hi, qhi, _mm512_mul_ps(lo, qlo));
+                acc[lane] = _mm512_fmadd_ps(t, _mm512_set1_ps(scales[lane]), acc[lane]);
+            }
+        }
+        for (int lane = 0; lane < kQ4PackRows; ++lane) {
+            const int r = tile * kQ4PackRows + lane;
+            if (r >= rowBegin && r < rowEnd) y[r] = _mm512_reduce_add_ps(acc[lane]);
+        }
+    }
+}
+
+#endif // NIMITTAM_Q4_X86
+
+// ---- q4 x q8 ----
+//
+// A tile kernel returns the four rows of one packed tile against one row
+// of int8 activations; the drivers below walk tiles and tokens with it.
+// In GEMM each tile is reused from L1 for every token.
+
+using TileQ8 = void (*)(const uint8_t* tile, int groups, const int8_t* xq, const float* xs,
+                        const int32_t* xsums, float* out);
+// Two tokens at once, for SMMLA's 2x2 outputs.
+using TilePairQ8 = void (*)(const uint8_t* tile, int groups, const int8_t* xq0,
+                            const float* xs0, const int8_t* xq1, const float* xs1, float* out0,
+                            float* out1);
+
+/** Reference tile kernel, for variants without int8 dot products. */
+void tileQ8Scalar(const uint8_t* block, int groups, const int8_t* xq, const float* xs,
+                  const int32_t* xsums, float* out) {
+    const float* table = halfToFloatTable();
+    float acc[kQ4PackRows] = {};
+    for (int g = 0; g < groups; ++g, block += kQ4PackedBlockBytes) {
+        const uint16_t* scales = reinterpret_cast<const uint16_t*>(block);
+        const uint8_t* q = block + kQ4PackRows * sizeof(uint16_t);
+        const int8_t* xg = xq + g * kQ4GroupSize;
+        for (int lane = 0; lane < kQ4PackRows; ++lane) {
+            const uint8_t* ql = q + lane * (kQ4GroupSize / 2);
+            int32_t dot = 0;
+            for (int i = 0; i < kQ4GroupSize / 2; ++i) {
+                dot += (ql[i] & 0xF) * xg[i] + (ql[i] >> 4) * xg[i + kQ4GroupSize / 2];
+            }
+            acc[lane] += table[scales[lane]] * xs[g] *
+                         static_cast<float>(dot - kQ4ZeroPoint * xsums[g]);
+        }
+    }
+    for (int lane = 0; lane < kQ4PackRows; ++lane) out[lane] = acc[lane];
+}
+
+template <TileQ8 tile>
+void gemvQ8(const Q4Matrix& w, const Q8Activations& x, float* y, int rowBegin, int rowEnd) {
+    const int groups = w.cols / kQ4GroupSize;
+    const size_t tileBytes = groups * kQ4PackedBlockBytes;
+    for (int t = rowBegin / kQ4PackRows; t * kQ4PackRows < rowEnd; ++t) {
+        float out[kQ4PackRows];
+        tile(w.packed + t * tileBytes, groups, x.q.data(), x.scales.data(), x.sums.data(), out);
+        for (int lane = 0; lane < kQ4PackRows; ++lane) {
+            const int r = t * kQ4PackRows + lane;
+            if (r >= rowBegin && r < rowEnd) y[r] = out[lane];
+        }
+    }
+}
+
+template <TileQ8 tile, TilePairQ8 pair = nullptr>
+void gemmQ8(const Q4Matrix& w, const Q8Activations& x, float* y, int ldy, int rowBegin,
+            int rowEnd) {
+    const int groups = w.cols / kQ4GroupSize;
+    const size_t tileBytes = groups * kQ4PackedBlockBytes;
+    auto store = [&](int t, int token, const float* out) {
+        for (int lane = 0; lane < kQ4PackRows; ++lane) {
+            const int r = t * kQ4PackRows + lane;
+            if (r >= rowBegin && r < rowEnd) y[static_cast<size_t>(token) * ldy + r] = out[lane];
+        }
+    };
+    for (int t = rowBegin / kQ4PackRows; t * kQ4PackRows < rowEnd; ++t) {
+        const uint8_t* block = w.packed + t * tileBytes;
+        int token = 0;
+        for (; pair && token + 1 < x.n; token += 2) {
+            float out0[kQ4PackRows];
+            float out1[kQ4PackRows];
+            const size_t first = static_cast<size_t>(token) * x.cols;
+            pair(block, groups, x.q.data() + first, x.scales.data() + token * groups,
+                 x.q.data() + first + x.cols, x.scales.data() + (token + 1) * groups, out0, out1);
+            store(t, token, out0);
+            store(t, token + 1, out1);
+        }
+        for (; token < x.n; ++token) {
+            float out[kQ4PackRows];
+            tile(block, groups, x.q.data() + static_cast<size_t>(token) * x.cols,
+                 x.scales.data() + token * groups, x.sums.data() + token * groups, out);
+            store(t, token, out);
+        }
+    }
+}
+
+#if NIMITTAM_Q4_ARM64
+
+/** SDOT: four int8 products per lane; the nibbles are made signed so no zero point fix-up. */
+__attribute__((target("arch=armv8.2-a+fp16+dotprod")))
+void tileQ8Dot(const uint8_t* block, int groups, const int8_t* xq, const float* xs,
+               const int32_t*, float* out) {
+    const float* table = halfToFloatTable();
+    const uint8x16_t mask = vdupq_n_u8(0xF);
+    const int8x16_t zero = vdupq_n_s8(kQ4ZeroPoint);
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    for (int g = 0; g < groups; ++g, block += kQ4PackedBlockBytes) {
+        const uint16_t* scales = reinterpret_cast<const uint16_t*>(block);
+        const uint8_t* q = block + kQ4PackRows * sizeof(uint16_t);
+        const int8x16_t xlo = vld1q_s8(xq + g * kQ4GroupSize);
+        const int8x16_t xhi = vld1q_s8(xq + g * kQ4GroupSize + kQ4GroupSize / 2);
+        int32x4_t dots[kQ4PackRows];
+        for (int lane = 0; lane < kQ4PackRows; ++lane) {
+            const uint8x16_t bytes = vld1q_u8(q + lane * (kQ4GroupSize / 2));
+            const int8x16_t lo = vsubq_s8(vreinterpretq_s8_u8(vandq_u8(bytes, mask)), zero);
+            const int8x16_t hi = vsubq_s8(vreinterpretq_s8_u8(vshrq_n_u8(bytes, 4)), zero);
+            dots[lane] = vdotq_s32(vdotq_s32(vdupq_n_s32(0), lo, xlo), hi, xhi);
+        }
+        // [row 0, row 1, row 2, row 3]
+        const int32x4_t rows =
+                vpaddq_s32(vpaddq_s32(dots[0], dots[1]), vpaddq_s32(dots[2], dots[3]));
+        const float rowScales[kQ4PackRows] = {table[scales[0]], table[scales[1]],
+                                              table[scales[2]], table[scales[3]]};
+        acc = vfmaq_f32(acc, vcvtq_f32_s32(rows), vmulq_n_f32(vld1q_f32(rowScales), xs[g]));
+    }
+    vst1q_f32(out, acc);
+}
+
+/**
+ * SMMLA: each instruction multiplies 2 rows x 8 elements by 8 elements x
+ * 2 tokens, twice the work of an SDOT.
+ */
+__attribute__((target("arch=armv8.2-a+fp16+dotprod+i8mm")))
+void tilePairQ8Mmla(const uint8_t* block, int groups, const int8_t* xq0, const float* xs0,
+                    const int8_t* xq1, const float* xs1, float* out0, float* out1) {
+    const float* table = halfToFloatTable();
+    const uint8x16_t mask = vdupq_n_u8(0xF);
+    const int8x16_t zero = vdupq_n_s8(kQ4ZeroPoint);
+    // [row 0 token 0, row 0 token 1, row 1 token 0, row 1 token 1], and rows 2-3.
+    float32x4_t acc01 = vdupq_n_f32(0.0f);
+    float32x4_t acc23 = vdupq_n_f32(0.0f);
+    for (int g = 0; g < groups; ++g, block += kQ4PackedBlockBytes) {
+        const uint16_t* scales = reinterpret_cast<const uint16_t*>(block);
+        const uint8_t* q = block + kQ4PackRows * sizeof(uint16_t);
+        // Elements 0-7, 8-15, 16-23 and 24-31 of the group, per row.
+        int8x8_t w[kQ4PackRows][4];
+        for (int lane = 0; lane < kQ4PackRows; ++lane) {
+            const uint8x16_t bytes = vld1q_u8(q + lane * (kQ4GroupSize / 2));
+            const int8x16_t lo = vsubq_s8(vreinterpretq_s8_u8(vandq_u8(bytes, mask)), zero);
+            const int8x16_t hi = vsubq_s8(vreinterpretq_s8_u8(vshrq_n_u8(bytes, 4)), zero);
+            w[lane][0] = vget_low_s8(lo);
+            w[lane][1] = vget_high_s8(lo);
+            w[lane][2] = vget_low_s8(hi);
+            w[lane][3] = vget_high_s8(hi);
+        }
+        const int8_t* x0 = xq0 + g * kQ4GroupSize;
+        const int8_t* x1 = xq1 + g * kQ4GroupSize;
+        int32x4_t dot01 = vdupq_n_s32(0);
+        int32x4_t dot23 = vdupq_n_s32(0);
+        for (int c = 0; c < 4; ++c) {
+            const int8x16_t tokens = vcombine_s8(vld1_s8(x0 + 8 * c), vld1_s8(x1 + 8 * c));
+            dot01 = vmmlaq_s32(dot01, vcombine_s8(w[0][c], w[1][c]), tokens);
+            dot23 = vmmlaq_s32(dot23, vcombine_s8(w[2][c], w[3][c]), tokens);
+        }
+        const float s0 = table[scales[0]], s1 = table[scales[1]];
+        const float s2 = table[scales[2]], s3 = table[scales[3]];
+        const float scale01[4] = {s0 * xs0[g], s0 * xs1[g], s1 * xs0[g], s1 * xs1[g]};
+        const float scale23[4] = {s2 * xs0[g], s2 * xs1[g], s3 * xs0[g], s3 * xs1[g]};
+        acc01 = vfmaq_f32(acc01, vcvtq_f32_s32(dot01), vld1q_f32(scale01));
+        acc23 = vfmaq_f32(acc23, vcvtq_f32_s32(dot23), vld1q_f32(scale23));
+    }
+    float r01[4];
+    float r23[4];
+    vst1q_f32(r01, acc01);
+    vst1q_f32(r23, acc23);
+    out0[0] = r01[0];
+    out1[0] = r01[1];
+    out0[1] = r01[2];
+    out1[1] = r01[3];
+    out0[2] = r23[0];
+    out1[2] = r23[1];
+    out0[3] = r23[2];
+    out1[3] = r23[3];
+}
+
+#endif // NIMITTAM_Q4_ARM64
+
+#if NIMITTAM_Q4_X86
+
+/**
+ * VPMADDUBSW pairs unsigned nibbles with signed activations into int16,
+ * VPMADDWD finishes the sums of four; two rows per register. The zero
+ * point is subtracted once per row, from lane 0 of its four.
+ */
+__attribute__((target("avx2,fma,f16c")))
+void tileQ8Avx2(const uint8_t* block, int groups, const int8_t* xq, const float* xs,
+                const int32_t* xsums, float* out) {
+    const __m256i mask = _mm256_set1_epi8(0xF);
+    const __m256i ones = _mm256_set1_epi16(1);
+    const __m256i rows01 = _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1);
+    const __m256i rows23 = _mm256_setr_epi32(2, 2, 2, 2, 3, 3, 3, 3);
+    __m256 acc01 = _mm256_setzero_ps();
+    __m256 acc23 = _mm256_setzero_ps();
+    for (int g = 0; g < groups; ++g, block += kQ4PackedBlockBytes) {
+        const __m256 scales = _mm256_castps128_ps256(
+                _mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(block))));
+        const uint8_t* q = block + kQ4PackRows * sizeof(uint16_t);
+        const int8_t* xg = xq + g * kQ4GroupSize;
+        const __m256i xlo =
+                _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(xg)));
+        const __m256i xhi = _mm256_broadcastsi128_si256(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(xg + kQ4GroupSize / 2)));
+        const int32_t zeroPoint = -kQ4ZeroPoint * xsums[g];
+        const __m256i bias = _mm256_setr_epi32(zeroPoint, 0, 0, 0, zeroPoint, 0, 0, 0);
+        const __m256 xs8 = _mm256_set1_ps(xs[g]);
+        for (int half = 0; half < 2; ++half) {
+            const __m256i bytes =
+                    _mm256_loadu_si256(reinterpret_cast<const __m256i*>(q + 32 * half));
+            const __m256i lo = _mm256_and_si256(bytes, mask);
+            const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(bytes, 4), mask);
+            const __m256i pairs = _mm256_add_epi16(_mm256_maddubs_epi16(lo, xlo),
+                                                   _mm256_maddubs_epi16(hi, xhi));
+            const __m256i dots = _mm256_add_epi32(_mm256_madd_epi16(pairs, ones), bias);
+            const __m256 rowScales = _mm256_mul_ps(
+                    _mm256_permutevar8x32_ps(scales, half ? rows23 : rows01), xs8);
+            __m256& acc = half ? acc23 : acc01;
+            acc = _mm256_fmadd_ps(_mm256_cvtepi32_ps(dots), rowScales, acc);
+        }
+    }
+    float lanes01[8];
+    float lanes23[8];
+    _mm256_storeu_ps(lanes01, acc01);
+    _mm256_storeu_ps(lanes23, acc23);
+    for (int r = 0; r < 2; ++r) {
+        out[r] = lanes01[4 * r] + lanes01[4 * r + 1] + lanes01[4 * r + 2] + lanes01[4 * r + 3];
+        out[r + 2] = lanes23[4 * r] + lanes23[4 * r + 1] + lanes23[4 * r + 2] + lanes23[4 * r + 3];
+    }
+}
+
+/** VPDPBUSD: four unsigned x signed products summed into each int32 lane, all four rows at once. */
+__attribute__((target("avx512f,avx512bw,avx512vl,avx512vnni,avx2,fma,f16c")))
+void tileQ8Vnni(const uint8_t* block, int groups, const int8_t* xq, const float* xs,
+                const int32_t* xsums, float* out) {
+    const __m512i mask = _mm512_set1_epi8(0xF);
+    const __m512i rows = _mm512_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3);
+    __m512 acc = _mm512_setzero_ps();
+    for (int g = 0; g < groups; ++g, block += kQ4PackedBlockBytes) {
+        const __m512 scales = _mm512_castps128_ps512(
+                _mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(block))));
+        const __m512i bytes = _mm512_loadu_si512(block + kQ4PackRows * sizeof(uint16_t));
+        const int8_t* xg = xq + g * kQ4GroupSize;
+        const __m512i xlo =
+                _mm512_broadcast_i32x4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(xg)));
+        const __m512i xhi = _mm512_broadcast_i32x4(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(xg + kQ4GroupSize / 2)));
+        __m512i dots = _mm512_maskz_set1_epi32(0x1111, -kQ4ZeroPoint * xsums[g]);
+        dots = _mm512_dpbusd_epi32(dots, _mm512_and_si512(bytes, mask), xlo);
+        dots = _mm512_dpbusd_epi32(dots, _mm512_and_si512(_mm512_srli_epi16(bytes, 4), mask), xhi);
+        const __m512 rowScales =
+                _mm512_mul_ps(_mm512_permutexvar_ps(rows, scales), _mm512_set1_ps(xs[g]));
+        acc = _mm512_fmadd_ps(_mm512_cvtepi32_ps(dots), rowScales, acc);
+    }
+    float lanes[16];
+    _mm512_storeu_ps(lanes, acc);
+    for (int r = 0; r < kQ4PackRows; ++r) {
+        out[r] = lanes[4 * r] + lanes[4 * r + 1] + lanes[4 * r + 2] + lanes[4 * r + 3];
+    }
+}
+
+#endif // NIMITTAM_Q4_X86
+
+struct Q4Kernels {
+    const char* name;
+    // Stable per variant; part of q4PackedLayoutId().
+    uint32_t id;
+    bool (*supported)(const CpuFeatures&);
+    void (*gemvPacked)(const Q4Matrix&, const float*, float*, int, int);
+    void (*gemvStorage)(const Q4Matrix&, const float*, float*, int, int);
+    void (*gemm)(const Q4Matrix&, const float*, int, float*, int, int, int);
+    void (*dequantRow)(const Q4Matrix&, int, float*);
+    // Whether gemvQ8 / gemmQ8 use int8 dot products; otherwise they are the
+    // scalar reference and slower than the float kernels.
+    bool int8;
+    void (*gemvQ8)(const Q4Matrix&, const Q8Activations&, float*, int, int);
+    void (*gemmQ8)(const Q4Matrix&, const Q8Activations&, float*, int, int, int);
+    // Quantized KV cache kernels at the same level.
+    const KvQuantKernels* kv;
+};
+
+bool always(const CpuFeatures&) {
+    return true;
+}
+
+#if NIMITTAM_Q4_ARM64
+bool hasArmv82(const CpuFeatures& cpu) {
+    return cpu.asimdHp && cpu.dotProd;
+}
+
+bool hasI8mm(const CpuFeatures& cpu) {
+    return hasArmv82(cpu) && cpu.i8mm;
+}
+#endif
+
+#if NIMITTAM_Q4_X86
+bool hasSse41(const CpuFeatures& cpu) {
+    return cpu.sse41;
+}
+
+bool hasAvx2(const CpuFeatures& cpu) {
+    return cpu.avx2 && cpu.fma && cpu.f16c;
+}
+
+bool hasAvx512(const CpuFeatures& cpu) {
+    return hasAvx2(cpu) && cpu.avx512f && cpu.avx512bw && cpu.avx512vl;
+}
+
+bool hasAvx512Vnni(const CpuFeatures& cpu) {
+    return hasAvx512(cpu) && cpu.avx512vnni;
+}
+#endif
+
+// Built-in variants, best first. The last one is the baseline and runs anywhere.
+const Q4Kernels kVariants[] = {
+#if NIMITTAM_Q4_ARM64
+        {"armv8.2-a+i8mm", 0x103, hasI8mm, gemvPackedNeon, armv82::gemvStorage, armv82::gemm,
+         armv82::dequantRow, true, gemvQ8<tileQ8Dot>, gemmQ8<tileQ8Dot, tilePairQ8Mmla>,
+         &kKvQuantNeon},
+        {"armv8.2-a", 0x102, hasArmv82, gemvPackedNeon, armv82::gemvStorage, armv82::gemm,
+         armv82::dequantRow, true, gemvQ8<tileQ8Dot>, gemmQ8<tileQ8Dot>, &kKvQuantNeon},
+        {"neon", 0x101, always, gemvPackedNeon, baseline::gemvStorage, baseline::gemm,
+         baseline::dequantRow, false, gemvQ8<tileQ8Scalar>, gemmQ8<tileQ8Scalar>, &kKvQuantNeon},
+#elif NIMITTAM_Q4_X86
+        {"avx512vnni", 0x205, hasAvx512Vnni, gemvPackedAvx512, avx512::gemvStorage, avx512::gemm,
+         avx512::dequantRow, true, gemvQ8<tileQ8Vnni>, gemmQ8<tileQ8Vnni>, &kKvQuantAvx2},
+        {"avx512", 0x204, hasAvx512, gemvPackedAvx512, avx512::gemvStorage, avx512::gemm,
+         avx512::dequantRow, true, gemvQ8<tileQ8Avx2>, gemmQ8<tileQ8Avx2>, &kKvQuantAvx2},
+        {"avx2", 0x203, hasAvx2, gemvPackedAvx2, avx2::gemvStorage, avx2::gemm,
+         avx2::dequantRow, true, gemvQ8<tileQ8Avx2>, gemmQ8<tileQ8Avx2>, &kKvQuantAvx2},
+        {"sse4.1", 0x202, hasSse41, sse41::gemvPacked, sse41::gemvStorage, sse41::gemm,
+         sse41::dequantRow, false, gemvQ8<tileQ8Scalar>, gemmQ8<tileQ8Scalar>, &kKvQuantScalar},
+        {"sse2", 0x201, always, baseline::gemvPacked, baseline::gemvStorage, baseline::gemm,
+         baseline::dequantRow, false, gemvQ8<tileQ8Scalar>, gemmQ8<tileQ8Scalar>, &kKvQuantScalar},
+#else
+        {"generic", 0x001, always, baseline::gemvPacked, baseline::gemvStorage, baseline::gemm,
+         baseline::dequantRow, false, gemvQ8<tileQ8Scalar>, gemmQ8<tileQ8Scalar>, &kKvQuantScalar},
+#endif
+};
+
+const Q4Kernels* best() {
+    for (const Q4Kernels& variant : kVariants) {
+        if (variant.supported(cpuFeatures())) return &variant;
+    }
+    return &kVariants[sizeof(kVariants) / sizeof(kVariants[0]) - 1];
+}
+
+std::atomic<const Q4Kernels*> selected{nullptr};
+
+const Q4Kernels& kernels() {
+    const Q4Kernels* current = selected.load(std::memory_order_acquire);
+    if (!current) {
+        // Leaves a variant chosen by useQ4Kernels() in the meantime alone.
+        const Q4Kernels* detected = best();
+        current = selected.compare_exchange_strong(current, detected) ? detected : current;
+    }
+    return *current;
+}
+
+} // namespace
+
+void q4RepackTiles(const Q4Matrix& w, int tileBegin, int tileEnd, uint8_t* out) {
+    const int wordsPerRow = w.cols / 8;
+    const int groups = w.cols / kQ4GroupSize;
+    for (int tile = tileBegin; tile < tileEnd; ++tile) {
+        for (int g = 0; g < groups; ++g, out += kQ4PackedBlockBytes) {
+            uint16_t* scales = reinterpret_cast<uint16_t*>(out);
+            uint8_t* q = out + kQ4PackRows * sizeof(uint16_t);
+            for (int lane = 0; lane < kQ4PackRows; ++lane, q += kQ4GroupSize / 2) {
+                const size_t row = static_cast<size_t>(tile) * kQ4PackRows + lane;
+                scales[lane] = w.scales[row * groups + g];
+                const uint32_t* words = w.qweight + row * wordsPerRow + g * (kQ4GroupSize / 8);
+                auto nibble = [&](int i) { return (words[i / 8] >> (4 * (i % 8))) & 0xF; };
+                for (int i = 0; i < kQ4GroupSize / 2; ++i) {
+                    q[i] = static_cast<uint8_t>(nibble(i) | nibble(i + kQ4GroupSize / 2) << 4);
+                }
+            }
+        }
+    }
+}
+
+uint64_t q4PackedLayoutId() {
+    // A file packed under one kernel variant is only reused by the same one.
+    return static_cast<uint64_t>(kQ4PackVersion) << 32 | kernels().id;
+}
+
+const char* q4KernelName() {
+    return kernels().name;
+}
+
+std::vector<std::string> q4KernelVariants() {
+    std::vector<std::string> names;
+    for (const Q4Kernels& variant : kVariants) {
+        if (variant.supported(cpuFeatures())) names.push_back(variant.name);
+    }
+    return names;
+}
+
+const KvQuantKernels& kvQuantKernels() {
+    return *kernels().kv;
+}
+
+bool useQ4Kernels(const std::string& name) {
+    for (const Q4Kernels& variant : kVariants) {
+        if (name == variant.name && variant.supported(cpuFeatures())) {
+            selected.store(&variant, std::memory_order_release);
+            return true;
+        }
+    }
+    return false;
+}
+
+void q4Gemv(const Q4Matrix& w, const float* x, float* y, int rowBegin, int rowEnd) {
+    const Q4Kernels& selected = kernels();
+    if (w.packed) {
+        selected.gemvPacked(w, x, y, rowBegin, rowEnd);
+    } else {
+        selected.gemvStorage(w, x, y, rowBegin, rowEnd);
+    }
+}
+
+void q4Gemm(const Q4Matrix& w, const float* x, int n, float* y, int ldy, int rowBegin,
+            int rowEnd) {
+    kernels().gemm(w, x, n, y, ldy, rowBegin, rowEnd);
+}
+
+void q4DequantRow(const Q4Matrix& w, int row, float* out) {
+    kernels().dequantRow(w, row, out);
+}
+
+void q8Quantize(const float* x, int n, int cols, Q8Activations* out) {
+    const int groups = cols / kQ4GroupSize;
+    out->n = n;
+    out->cols = cols;
+    out->q.resize(static_cast<size_t>(n) * cols);
+    out->scales.resize(static_cast<size_t>(n) * groups);
+    out->sums.resize(static_cast<size_t>(n) * groups);
+    for (size_t g = 0; g < static_cast<size_t>(n) * groups; ++g) {
+        const float* xg = x + g * kQ4GroupSize;
+        int8_t* qg = out->q.data() + g * kQ4GroupSize;
+        float amax = 0.0f;
+        for (int i = 0; i < kQ4GroupSize; ++i) amax = std::max(amax, std::fabs(xg[i]));
+        const float inverse = amax > 0.0f ? 127.0f / amax : 0.0f;
+        int32_t sum = 0;
+        for (int i = 0; i < kQ4GroupSize; ++i) {
+            const int v = static_cast<int>(std::nearbyint(xg[i] * inverse));
+            qg[i] = static_cast<int8_t>(v);
+            sum += v;
+        }
+        out->scales[g] = amax / 127.0f;
+        out->sums[g] = sum;
+    }
+}
+
+bool q4HasInt8Kernels() {
+    return kernels().int8;
+}
+
+void q4GemvQ8(const Q4Matrix& w, const Q8Activations& x, float* y, int rowBegin, int rowEnd) {
+    kernels().gemvQ8(w, x, y, rowBegin, rowEnd);
+}
+
+void q4GemmQ8(const Q4Matrix& w, const Q8Activations& x, float* y, int ldy, int rowBegin,
+              int rowEnd) {
+    kernels().gemmQ8(w, x, y, ldy, rowBegin, rowEnd);
+}
+
+} // namespace nimittam
@@ -0,0 +1,203 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Body of the q4 GEMV / GEMM kernels, compiled once per instruction set.
+ *
+ * There is deliberately no include guard: q4_kernels.cpp includes this
+ * inside one namespace per variant, with NIMITTAM_Q4_TARGET set to that
+ * variant's target attribute, and the compiler vectorizes each copy for
+ * its level. Every function here must carry NIMITTAM_Q4_TARGET, and the
+ * standard headers are included by q4_kernels.cpp, not here.
+ */
+
+// Inputs per tile in gemm: 16 rows of the widest activation (4864
+// floats) stay within a typical 512 KB L2 alongside the dequantized rows.
+constexpr int kGemmTokenTile = 16;
+constexpr int kGemmRowBlock = 4;
+
+/**
+ * q4Gemv over the packed layout, a whole row tile at a time. Unused by
+ * variants with a hand-written one in q4_kernels.cpp.
+ */
+NIMITTAM_Q4_TARGET [[maybe_unused]]
+void gemvPacked(const Q4Matrix& w, const float* x, float* y, int rowBegin, int rowEnd) {
+    const int groups = w.cols / kQ4GroupSize;
+    const float* table = halfToFloatTable();
+    // sum((q - 7) * x) = sum(q * x) - 7 * sum(x); sum(x) is shared by every row.
+    thread_local std::vector<float> groupSums;
+    groupSums.resize(groups);
+    for (int g = 0; g < groups; ++g) {
+        const float* xg = x + g * kQ4GroupSize;
+        float sum = 0.0f;
+        for (int i = 0; i < kQ4GroupSize; ++i) sum += xg[i];
+        groupSums[g] = kQ4ZeroPoint * sum;
+    }
+
+    const size_t tileBytes = groups * kQ4PackedBlockBytes;
+    for (int tile = rowBegin / kQ4PackRows; tile * kQ4PackRows < rowEnd; ++tile) {
+        const uint8_t* block = w.packed + tile * tileBytes;
+        float acc[kQ4PackRows] = {};
+        for (int g = 0; g < groups; ++g, block += kQ4PackedBlockBytes) {
+            const uint16_t* scales = reinterpret_cast<const uint16_t*>(block);
+            const uint8_t* q = block + kQ4PackRows * sizeof(uint16_t);
+            const float* lo = x + g * kQ4GroupSize;
+            const float* hi = lo + kQ4GroupSize / 2;
+            // Products first, sums after: the product loop vectorizes over
+            // the whole block, which a running sum per lane does not.
+            float products[kQ4PackRows][kQ4GroupSize / 2];
+            for (int lane = 0; lane < kQ4PackRows; ++lane) {
+                const uint8_t* ql = q + lane * (kQ4GroupSize / 2);
+                for (int i = 0; i < kQ4GroupSize / 2; ++i) {
+                    products[lane][i] = lo[i] * static_cast<float>(ql[i] & 0xF) +
+                                        hi[i] * static_cast<float>(ql[i] >> 4);
+                }
+            }
+            for (int lane = 0; lane < kQ4PackRows; ++lane) {
+                float qx = 0.0f;
+                for (int i = 0; i < kQ4GroupSize / 2; ++i) qx += products[lane][i];
+                acc[lane] += table[scales[lane]] * (qx - groupSums[g]);
+            }
+        }
+        for (int lane = 0; lane < kQ4PackRows; ++lane) {
+            const int r = tile * kQ4PackRows + lane;
+            if (r >= rowBegin && r < rowEnd) y[r] = acc[lane];
+        }
+    }
+}
+
+/** q4Gemv over MLC's storage layout, a row at a time. */
+NIMITTAM_Q4_TARGET
+void gemvStorage(const Q4Matrix& w, const float* x, float* y, int rowBegin, int rowEnd) {
+    const int wordsPerRow = w.cols / 8;
+    const int groups = w.cols / kQ4GroupSize;
+    const float* table = halfToFloatTable();
+
+    for (int r = rowBegin; r < rowEnd; ++r) {
+        const uint32_t* q = w.qweight + static_cast<size_t>(r) * wordsPerRow;
+        const uint16_t* s = w.scales + static_cast<size_t>(r) * groups;
+        float acc = 0.0f;
+        for (int g = 0; g < groups; ++g) {
+            const float* xg = x + g * kQ4GroupSize;
+            const uint32_t* qg = q + g * (kQ4GroupSize / 8);
+            // sum((q - 7) * x) = sum(q * x) - 7 * sum(x)
+            float qx = 0.0f;
+            float xs = 0.0f;
+            for (int word = 0; word < kQ4GroupSize / 8; ++word) {
+                uint32_t packed = qg[word];
+                const float* xw = xg + word * 8;
+                for (int j = 0; j < 8; ++j) {
+                    qx += xw[j] * static_cast<float>((packed >> (4 * j)) & 0xF);
+                    xs += xw[j];
+                }
+            }
+            acc += table[s[g]] * (qx - kQ4ZeroPoint * xs);
+        }
+        y[r] = acc;
+    }
+}
+
+NIMITTAM_Q4_TARGET
+void dequantRowPacked(const Q4Matrix& w, int row, const float* table, float* out) {
+    const int groups = w.cols / kQ4GroupSize;
+    const int lane = row % kQ4PackRows;
+    const uint8_t* block = w.packed + (row / kQ4PackRows) * groups * kQ4PackedBlockBytes;
+    for (int g = 0; g < groups; ++g, block += kQ4PackedBlockBytes) {
+        const float scale = table[reinterpret_cast<const uint16_t*>(block)[lane]];
+        const uint8_t* q = block + kQ4PackRows * sizeof(uint16_t) + lane * (kQ4GroupSize / 2);
+        float* lo = out + g * kQ4GroupSize;
+        float* hi = lo + kQ4GroupSize / 2;
+        for (int i = 0; i < kQ4GroupSize / 2; ++i) {
+            lo[i] = static_cast<float>(static_cast<int>(q[i] & 0xF) - kQ4ZeroPoint) * scale;
+            hi[i] = static_cast<float>(static_cast<int>(q[i] >> 4) - kQ4ZeroPoint) * scale;
+        }
+    }
+}
+
+NIMITTAM_Q4_TARGET
+void dequantRowStorage(const Q4Matrix& w, int row, const float* table, float* out) {
+    const int groups = w.cols / kQ4GroupSize;
+    const uint32_t* q = w.qweight + static_cast<size_t>(row) * (w.cols / 8);
+    const uint16_t* s = w.scales + static_cast<size_t>(row) * groups;
+    for (int g = 0; g < groups; ++g) {
+        const float scale = table[s[g]];
+        const uint32_t* qg = q + g * (kQ4GroupSize / 8);
+        float* og = out + g * kQ4GroupSize;
+        for (int word = 0; word < kQ4GroupSize / 8; ++word) {
+            uint32_t packed = qg[word];
+            for (int j = 0; j < 8; ++j) {
+                og[word * 8 + j] =
+                        static_cast<float>(static_cast<int>((packed >> (4 * j)) & 0xF) -
+                                           kQ4ZeroPoint) * scale;
+            }
+        }
+    }
+}
+
+NIMITTAM_Q4_TARGET
+void dequantRow(const Q4Matrix& w, int row, float* out) {
+    if (w.packed) {
+        dequantRowPacked(w, row, halfToFloatTable(), out);
+    } else {
+        dequantRowStorage(w, row, halfToFloatTable(), out);
+    }
+}
+
+NIMITTAM_Q4_TARGET
+float dotRow(const float* a, const float* b, int n) {
+    float acc = 0.0f;
+    for (int i = 0; i < n; ++i) acc += a[i] * b[i];
+    return acc;
+}
+
+NIMITTAM_Q4_TARGET
+void gemm(const Q4Matrix& w, const float* x, int n, float* y, int ldy, int rowBegin,
+          int rowEnd) {
+    const int cols = w.cols;
+    thread_local std::vector<float> rows;
+    rows.resize(static_cast<size_t>(kGemmRowBlock) * cols);
+
+    for (int t0 = 0; t0 < n; t0 += kGemmTokenTile) {
+        const int t1 = std::min(n, t0 + kGemmTokenTile);
+        for (int r0 = rowBegin; r0 < rowEnd; r0 += kGemmRowBlock) {
+            const int block = std::min(kGemmRowBlock, rowEnd - r0);
+            for (int b = 0; b < block; ++b) {
+                dequantRow(w, r0 + b, rows.data() + static_cast<size_t>(b) * cols);
+            }
+            if (block == kGemmRowBlock) {
+                const float* w0 = rows.data();
+                const float* w1 = w0 + cols;
+                const float* w2 = w1 + cols;
+                const float* w3 = w2 + cols;
+                for (int t = t0; t < t1; ++t) {
+                    const float* xt = x + static_cast<size_t>(t) * cols;
+                    float a0 = 0.0f, a1 = 0.0f, a2 = 0.0f, a3 = 0.0f;
+                    for (int i = 0; i < cols; ++i) {
+                        a0 += w0[i] * xt[i];
+                        a1 += w1[i] * xt[i];
+                        a2 += w2[i] * xt[i];
+                        a3 += w3[i] * xt[i];
+                    }
+                    float* yt = y + static_cast<size_t>(t) * ldy + r0;
+                    yt[0] = a0;
+                    yt[1] = a1;
+                    yt[2] = a2;
+                    yt[3] = a3;
+                }
+            } else {
+                for (int t = t0; t < t1; ++t) {
+                    const float* xt = x + static_cast<size_t>(t) * cols;
+                    for (int b = 0; b < block; ++b) {
+                        y[static_cast<size_t>(t) * ldy + r0 + b] =
+                                dotRow(rows.data() + static_cast<size_t>(b) * cols, xt, cols);
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,302 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "qwen2_model.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include "attention.h"
+#include "kv_quant.h"
+#include "repacked_weights.h"
+#include "thread_pool.h"
+#include "weight_prefetcher.h"
+#include "weights.h"
+
+namespace nimittam {
+
+namespace {
+
+bool bindQ4(const WeightStore& weights, const RepackedWeights* repacked,
+            const std::string& prefix, int rows, int cols, Q4Matrix* out, std::string* error) {
+    const TensorView* q = weights.find(prefix + ".q_weight");
+    const TensorView* s = weights.find(prefix + ".q_scale");
+    if (!q || !s) {
+        *error = "missing weight " + prefix;
+        return false;
+    }
+    if (q->dtype != DType::UInt32 || s->dtype != DType::Float16 ||
+        q->dim(0) != rows || q->dim(1) != cols / 8 ||
+        s->dim(0) != rows || s->dim(1) != cols / kQ4GroupSize) {
+        *error = "unexpected layout for " + prefix;
+        return false;
+    }
+    out->qweight = static_cast<const uint32_t*>(q->data);
+    out->scales = static_cast<const uint16_t*>(s->data);
+    out->rows = rows;
+    out->cols = cols;
+    const RepackedWeights::Matrix* packed = repacked ? repacked->find(prefix) : nullptr;
+    if (packed && packed->rows == rows && packed->cols == cols) out->packed = packed->data;
+    return true;
+}
+
+bool bindHalf(const WeightStore& weights, const std::string& name, int64_t size,
+              const uint16_t** out, std::string* error) {
+    const TensorView* t = weights.find(name);
+    if (!t || t->dtype != DType::Float16 || t->dim(0) != size) {
+        *error = "missing or malformed weight " + name;
+        return false;
+    }
+    *out = static_cast<const uint16_t*>(t->data);
+    return true;
+}
+
+// Quantized blocks must not straddle heads.
+KvCacheType kvTypeFor(const ModelConfig& config, KvCacheType type) {
+    const bool quantized = type == KvCacheType::Q8_0 || type == KvCacheType::Q4_0;
+    return quantized && config.headDim % kKvQuantBlock != 0 ? KvCacheType::F16 : type;
+}
+
+// Largest int8 matmul input for [n] tokens; the down projection's is the widest.
+size_t q8Values(const ModelConfig& config, int n) {
+    return static_cast<size_t>(n) * std::max(config.hiddenSize, config.intermediateSize);
+}
+
+// Floats in each of a step's buffers for [n] tokens, in allocateStep() order.
+std::array<size_t, 9> stepBufferFloats(const ModelConfig& config, int n, int contextSize,
+                                       bool flashAttention) {
+    const size_t batch = static_cast<size_t>(n);
+    const size_t qkvDim = static_cast<size_t>(config.qDim()) + 2 * config.kvDim();
+    return {batch * config.hiddenSize,            // hidden
+            batch * config.hiddenSize,            // normed
+            batch * qkvDim,                       // qkv
+            batch * config.qDim(),                // attnOut
+            batch * config.hiddenSize,            // proj
+            batch * 2 * config.intermediateSize,  // gateUp
+            batch * config.intermediateSize,      // mlp
+            batch * config.headDim,               // cosSin
+            // scores, a row of the whole context per head
+            flashAttention ? 0 : static_cast<size_t>(config.numHeads) * contextSize};
+}
+
+} // namespace
+
+Qwen2Model::MemoryPlan Qwen2Model::planMemory(const ModelConfig& config, int contextSize,
+                                              KvCacheType kvCacheType, int maxBatch,
+                                              bool flashAttention) {
+    MemoryPlan plan;
+    plan.kvCacheBytes = KvCache::reservedBytes(config.numLayers, contextSize, config.kvDim(),
+                                               kvTypeFor(config, kvCacheType));
+    for (size_t floats : stepBufferFloats(config, std::max(maxBatch, 1), contextSize,
+                                          flashAttention)) {
+        plan.arenaBytes += Arena::alignedSize(floats * sizeof(float));
+    }
+    const size_t values = q8Values(config, std::max(maxBatch, 1));
+    plan.q8Bytes = values + values / kQ4GroupSize * (sizeof(float) + sizeof(int32_t));
+    return plan;
+}
+
+bool Qwen2Model::init(const ModelConfig& config, const WeightStore& weights,
+                      const RepackedWeights* repacked, int contextSize, KvCacheType kvCacheType,
+                      int maxBatch, ThreadPool* pool, std::string* error) {
+    config_ = config;
+    pool_ = pool;
+    maxBatch_ = std::max(maxBatch, 1);
+    const int hidden = config.hiddenSize;
+    const int qkvDim = config.qDim() + 2 * config.kvDim();
+
+    if (!config.tieWordEmbeddings) {
+        *error = "untied LM head is not supported";
+        return false;
+    }
+    if (!bindQ4(weights, repacked, "model.embed_tokens", config.vocabSize, hidden, &embedding_,
+                error) ||
+        !bindHalf(weights, "model.norm.weight", hidden, &finalNorm_, error)) {
+        return false;
+    }
+
+    layers_.resize(config.numLayers);
+    for (int i = 0; i < config.numLayers; ++i) {
+        const std::string p = "model.layers." + std::to_string(i);
+        LayerWeights& l = layers_[i];
+        if (!bindHalf(weights, p + ".input_layernorm.weight", hidden, &l.inputNorm, error) ||
+            !bindHalf(weights, p + ".post_attention_layernorm.weight", hidden,
+                      &l.postAttentionNorm, error) ||
+            !bindHalf(weights, p + ".self_attn.c_attn.bias", qkvDim, &l.qkvBias, error) ||
+            !bindQ4(weights, repacked, p + ".self_attn.c_attn", qkvDim, hidden, &l.qkv, error) ||
+            !bindQ4(weights, repacked, p + ".self_attn.o_proj", hidden, config.qDim(), &l.out,
+                    error) ||
+            !bindQ4(weights, repacked, p + ".mlp.gate_up_proj", 2 * config.intermediateSize,
+                    hidden, &l.gateUp, error) ||
+            !bindQ4(weights, repacked, p + ".mlp.down_proj", hidden, config.intermediateSize,
+                    &l.down, error)) {
+            return false;
+        }
+    }
+
+    if (!kvCache_.init(config.numLayers, contextSize, config.kvDim(),
+                       kvTypeFor(config, kvCacheType), error)) {
+        return false;
+    }
+
+    const MemoryPlan plan =
+            planMemory(config, contextSize, kvCacheType, maxBatch_, flashAttention_);
+    if (!arena_.reserve(plan.arenaBytes, error)) return false;
+    // q8Quantize() then reuses this storage without reallocating.
+    const size_t values = q8Values(config, maxBatch_);
+    q8_.q.reserve(values);
+    q8_.scales.reserve(values / kQ4GroupSize);
+    q8_.sums.reserve(values / kQ4GroupSize);
+    return true;
+}
+
+size_t Qwen2Model::activationBytes() const {
+    return arena_.capacity() + q8_.q.capacity() * sizeof(int8_t) +
+           q8_.scales.capacity() * sizeof(float) + q8_.sums.capacity() * sizeof(int32_t);
+}
+
+void Qwen2Model::allocateStep(int n) {
+    arena_.reset();
+    const auto floats = stepBufferFloats(config_, n, kvCache_.contextSize(), flashAttention_);
+    float** buffers[] = {&hidden_, &normed_, &qkv_,    &attnOut_, &proj_,
+                         &gateUp_, &mlp_,    &cosSin_, &scores_};
+    for (size_t i = 0; i < floats.size(); ++i) {
+        // Cannot fail: init() reserved the same buffers for maxBatch tokens.
+        *buffers[i] = floats[i] > 0 ? arena_.allocate<float>(floats[i]) : nullptr;
+    }
+}
+
+void Qwen2Model::matmul(const Q4Matrix& w, const float* x, int n, float* y) {
+    if (int8Activations_ && w.packed) {
+        q8Quantize(x, n, w.cols, &q8_);
+        pool_->parallelFor(w.rows, 16, [&](int begin, int end) {
+            if (cancelled()) return;
+            if (n == 1) {
+                q4GemvQ8(w, q8_, y, begin, end);
+            } else {
+                q4GemmQ8(w, q8_, y, w.rows, begin, end);
+            }
+        });
+        return;
+    }
+    if (n == 1) {
+        pool_->parallelFor(w.rows, 16, [&](int begin, int end) {
+            if (!cancelled()) q4Gemv(w, x, y, begin, end);
+        });
+        return;
+    }
+    pool_->parallelFor(w.rows, 16, [&](int begin, int end) {
+        if (!cancelled()) q4Gemm(w, x, n, y, w.rows, begin, end);
+    });
+}
+
+void Qwen2Model::attention(int layer, int pos, int n) {
+    AttentionArgs args;
+    args.cache = &kvCache_;
+    args.layer = layer;
+    args.pos = pos;
+    args.n = n;
+    args.headDim = config_.headDim;
+    args.groupSize = config_.numHeads / config_.numKvHeads;
+    args.scale = 1.0f / std::sqrt(static_cast<float>(config_.headDim));
+    args.q = qkv_;
+    args.qStride = config_.qDim() + 2 * config_.kvDim();
+    args.out = attnOut_;
+    args.outStride = config_.qDim();
+
+    if (!flashAttention_) {
+        pool_->parallelFor(config_.numHeads, 1, [&](int headBegin, int headEnd) {
+            for (int h = headBegin; h < headEnd && !cancelled(); ++h) {
+                naiveAttention(args, h, scores_ + static_cast<size_t>(h) * kvCache_.contextSize());
+            }
+        });
+        return;
+    }
+    // One item per head and query tile, so prefill has work for every thread.
+    const int queryTiles = (n + kAttentionQueryTile - 1) / kAttentionQueryTile;
+    pool_->parallelFor(config_.numHeads * queryTiles, 1, [&](int begin, int end) {
+        for (int item = begin; item < end && !cancelled(); ++item) {
+            const int h = item % config_.numHeads;
+            const int q0 = (item / config_.numHeads) * kAttentionQueryTile;
+            flashAttention(args, h, q0, std::min(n, q0 + kAttentionQueryTile));
+        }
+    });
+}
+
+bool Qwen2Model::forwardBatch(const int32_t* tokens, int n, int pos, float* logits,
+                              const CancellationToken* cancel) {
+    cancel_ = cancel;
+    if (cancelled()) return false;
+    kvCache_.reserve(pos + n);
+    allocateStep(n);
+
+    const int hidden = config_.hiddenSize;
+    const int qDim = config_.qDim();
+    const int kvDim = config_.kvDim();
+    const int qkvDim = qDim + 2 * kvDim;
+    const int inter = config_.intermediateSize;
+    const int headDim = config_.headDim;
+
+    for (int b = 0; b < n; ++b) {
+        q4DequantRow(embedding_, tokens[b], hidden_ + static_cast<size_t>(b) * hidden);
+        ropeCosSin(pos + b, headDim, config_.ropeTheta,
+                   cosSin_ + static_cast<size_t>(b) * headDim);
+    }
+
+    for (int i = 0; i < config_.numLayers; ++i) {
+        const LayerWeights& l = layers_[i];
+        if (prefetcher_) prefetcher_->willRun(i);
+
+        for (int b = 0; b < n; ++b) {
+            const size_t row = static_cast<size_t>(b) * hidden;
+            rmsNorm(hidden_ + row, l.inputNorm, normed_ + row, hidden,
+                    config_.rmsNormEps);
+        }
+        matmul(l.qkv, normed_, n, qkv_);
+
+        for (int b = 0; b < n; ++b) {
+            float* q = qkv_ + static_cast<size_t>(b) * qkvDim;
+            float* k = q + qDim;
+            float* v = k + kvDim;
+            const float* cosSin = cosSin_ + static_cast<size_t>(b) * headDim;
+            addBiasHalf(q, l.qkvBias, qkvDim);
+            applyRope(q, config_.numHeads, headDim, cosSin);
+            applyRope(k, config_.numKvHeads, headDim, cosSin);
+            kvCache_.store(i, pos + b, k, v);
+        }
+
+        attention(i, pos, n);
+        matmul(l.out, attnOut_, n, proj_);
+        addInPlace(hidden_, proj_, n * hidden);
+
+        for (int b = 0; b < n; ++b) {
+            const size_t row = static_cast<size_t>(b) * hidden;
+            rmsNorm(hidden_ + row, l.postAttentionNorm, normed_ + row, hidden,
+                    config_.rmsNormEps);
+        }
+        matmul(l.gateUp, normed_, n, gateUp_);
+        for (int b = 0; b < n; ++b) {
+            const float* gateUp = gateUp_ + static_cast<size_t>(b) * 2 * inter;
+            siluMul(gateUp, gateUp + inter, mlp_ + static_cast<size_t>(b) * inter, inter);
+        }
+        matmul(l.down, mlp_, n, proj_);
+        addInPlace(hidden_, proj_, n * hidden);
+        if (cancelled()) return false;
+        if (prefetcher_) prefetcher_->didRun(i);
+    }
+
+    if (logits) {
+        const float* last = hidden_ + static_cast<size_t>(n - 1) * hidden;
+        rmsNorm(last, finalNorm_, normed_, hidden, config_.rmsNormEps);
+        matmul(embedding_, normed_, 1, logits);
+    }
+    return !cancelled();
+}
+
+} // namespace nimittam
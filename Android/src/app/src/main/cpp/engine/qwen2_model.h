@@ -0,0 +1,160 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Qwen2 decoder-only transformer over MLC q4f16_1 weights.
+ *
+ * Parameter names follow MLC's qwen2 export: fused c_attn (q|k|v with
+ * bias), fused gate_up_proj (gate|up) and tied embeddings used as the
+ * LM head.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "arena.h"
+#include "cancellation.h"
+#include "kernels.h"
+#include "kv_cache.h"
+#include "model_config.h"
+
+namespace nimittam {
+
+class RepackedWeights;
+class ThreadPool;
+class WeightPrefetcher;
+class WeightStore;
+
+class Qwen2Model {
+public:
+    /** Memory a model needs besides its weights, known before it is built. */
+    struct MemoryPlan {
+        // Address space for the KV cache of the whole context.
+        size_t kvCacheBytes = 0;
+        // Activation arena: one forwardBatch() of maxBatch tokens.
+        size_t arenaBytes = 0;
+        // int8 copy of the widest matmul input (setInt8Activations).
+        size_t q8Bytes = 0;
+
+        size_t activationBytes() const { return arenaBytes + q8Bytes; }
+        size_t totalBytes() const { return kvCacheBytes + activationBytes(); }
+    };
+
+    /** What init() reserves for these arguments and attention choice. */
+    static MemoryPlan planMemory(const ModelConfig& config, int contextSize,
+                                 KvCacheType kvCacheType, int maxBatch, bool flashAttention);
+
+    /**
+     * [pool] parallelizes matrix rows and attention heads; not owned.
+     * [maxBatch] bounds the tokens per forwardBatch() call and sizes the
+     * activation arena, which every call then carves up afresh. Matrices
+     * found in [repacked] (may be null) run on their packed copies.
+     */
+    bool init(const ModelConfig& config, const WeightStore& weights,
+              const RepackedWeights* repacked, int contextSize, KvCacheType kvCacheType,
+              int maxBatch, ThreadPool* pool, std::string* error);
+
+    /**
+     * Run one token at [pos], appending its keys/values to the cache.
+     * Writes vocabSize logits when [logits] is non-null. Returns false
+     * if [cancel] fired part way through; the cache entry at [pos] and
+     * the logits are then garbage and [pos] must be run again.
+     */
+    bool forward(int32_t token, int pos, float* logits,
+                 const CancellationToken* cancel = nullptr) {
+        return forwardBatch(&token, 1, pos, logits, cancel);
+    }
+
+    /**
+     * Run [n] <= maxBatch() consecutive tokens starting at [pos] as one
+     * batch: projections use q4Gemm and attention is causal within the
+     * batch. [logits] receives the last token's logits when non-null.
+     * Cancellation behaves as in forward() for the whole batch.
+     */
+    bool forwardBatch(const int32_t* tokens, int n, int pos, float* logits,
+                      const CancellationToken* cancel = nullptr);
+
+    const ModelConfig& config() const { return config_; }
+    int contextSize() const { return kvCache_.contextSize(); }
+    int maxBatch() const { return maxBatch_; }
+    const KvCache& kvCache() const { return kvCache_; }
+    KvCache& kvCache() { return kvCache_; }
+    /** Drop cached positions from [length] on; earlier ones stay valid. */
+    void truncateCache(int length) { kvCache_.truncate(length); }
+    /** Drop all cached positions and release their KV blocks. */
+    void resetCache() { kvCache_.reset(); }
+    /** Told which layer runs next so it can warm the one after; not owned, may be null. */
+    void setPrefetcher(WeightPrefetcher* prefetcher) { prefetcher_ = prefetcher; }
+    /**
+     * Quantize activations to int8 for matmuls against packed weights
+     * (q4GemvQ8 / q4GemmQ8). Off by default; worth it only with
+     * q4HasInt8Kernels().
+     */
+    void setInt8Activations(bool enabled) { int8Activations_ = enabled; }
+    bool int8Activations() const { return int8Activations_; }
+    /**
+     * Use the tiled online-softmax attention (flashAttention); on by
+     * default. Off runs naiveAttention, which keeps a contextSize score
+     * row per head. Must be called before init(), which sizes the arena.
+     */
+    void setFlashAttention(bool enabled) { flashAttention_ = enabled; }
+    /** Activation memory reserved at init (planMemory().activationBytes()). */
+    size_t activationBytes() const;
+    /** Most of the arena any forwardBatch() has used so far. */
+    size_t activationHighWater() const { return arena_.highWater(); }
+
+private:
+    struct LayerWeights {
+        const uint16_t* inputNorm = nullptr;
+        const uint16_t* postAttentionNorm = nullptr;
+        const uint16_t* qkvBias = nullptr;
+        Q4Matrix qkv;
+        Q4Matrix out;
+        Q4Matrix gateUp;
+        Q4Matrix down;
+    };
+
+    /** y[t] = W x[t] for [n] rows of x; gemv when n == 1, else q4Gemm. */
+    void matmul(const Q4Matrix& w, const float* x, int n, float* y);
+    void attention(int layer, int pos, int n);
+    /** Carve this step's buffers for [n] tokens out of the reset arena. */
+    void allocateStep(int n);
+    bool cancelled() const { return cancel_ && cancel_->cancelled(); }
+
+    ModelConfig config_;
+    Q4Matrix embedding_;
+    const uint16_t* finalNorm_ = nullptr;
+    std::vector<LayerWeights> layers_;
+    KvCache kvCache_;
+    ThreadPool* pool_ = nullptr;
+    WeightPrefetcher* prefetcher_ = nullptr;
+    int maxBatch_ = 1;
+    // Token of the forward() in progress; parallel chunks bail out early.
+    const CancellationToken* cancel_ = nullptr;
+    bool int8Activations_ = false;
+    bool flashAttention_ = true;
+
+    // Backs the step buffers below, which are valid during forwardBatch() only.
+    Arena arena_;
+    // [n, dim] row-major for the n tokens of the current step.
+    float* hidden_ = nullptr;
+    float* normed_ = nullptr;
+    float* qkv_ = nullptr;
+    float* attnOut_ = nullptr;
+    float* proj_ = nullptr;
+    float* gateUp_ = nullptr;
+    float* mlp_ = nullptr;
+    float* cosSin_ = nullptr;  // [n, headDim]
+    float* scores_ = nullptr;  // [numHeads, contextSize], unfused attention only
+    Q8Activations q8_;         // matmul input when int8Activations_; reserved at init
+};
+
+} // namespace nimittam
@@ -0,0 +1,204 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "repacked_weights.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "kernels.h"
+#include "log.h"
+#include "weights.h"
+
+namespace nimittam {
+
+namespace {
+
+constexpr size_t kMatrixAlignment = 64;
+// Tiles repacked per write, about 1 MB for the widest matrices.
+constexpr int kTilesPerWrite = 256;
+
+uint64_t hashName(const std::string& name) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char c : name) hash = (hash ^ c) * 0x100000001b3ULL;
+    return hash;
+}
+
+size_t alignUp(size_t value) {
+    return (value + kMatrixAlignment - 1) / kMatrixAlignment * kMatrixAlignment;
+}
+
+struct Candidate {
+    std::string prefix;
+    Q4Matrix matrix;
+};
+
+/** Every "<prefix>.q_weight" with a matching "<prefix>.q_scale" that has a packed layout. */
+std::vector<Candidate> packableMatrices(const WeightStore& weights) {
+    static const std::string kSuffix = ".q_weight";
+    std::vector<Candidate> found;
+    for (const auto& entry : weights.tensors()) {
+        const std::string& name = entry.first;
+        if (name.size() <= kSuffix.size() ||
+            name.compare(name.size() - kSuffix.size(), kSuffix.size(), kSuffix) != 0) {
+            continue;
+        }
+        const std::string prefix = name.substr(0, name.size() - kSuffix.size());
+        const TensorView& q = entry.second;
+        const TensorView* s = weights.find(prefix + ".q_scale");
+        const int64_t rows = q.dim(0);
+        const int64_t cols = q.dim(1) * 8;
+        if (!s || q.dtype != DType::UInt32 || s->dtype != DType::Float16 ||
+            q.shape.size() != 2 || s->dim(0) != rows || s->dim(1) * kQ4GroupSize != cols ||
+            !q4CanPack(static_cast<int>(rows), static_cast<int>(cols))) {
+            continue;
+        }
+        Candidate candidate;
+        candidate.prefix = prefix;
+        candidate.matrix.qweight = static_cast<const uint32_t*>(q.data);
+        candidate.matrix.scales = static_cast<const uint16_t*>(s->data);
+        candidate.matrix.rows = static_cast<int>(rows);
+        candidate.matrix.cols = static_cast<int>(cols);
+        found.push_back(std::move(candidate));
+    }
+    // Hash map order is arbitrary; keep the file deterministic.
+    std::sort(found.begin(), found.end(),
+              [](const Candidate& a, const Candidate& b) { return a.prefix < b.prefix; });
+    return found;
+}
+
+bool writeAll(FILE* file, const void* data, size_t bytes) {
+    return bytes == 0 || std::fwrite(data, 1, bytes, file) == bytes;
+}
+
+} // namespace
+
+std::string RepackedWeights::fileName(uint64_t modelHash) {
+    char name[64];
+    std::snprintf(name, sizeof(name), "weights-%016llx-%016llx.q4p",
+                  static_cast<unsigned long long>(modelHash),
+                  static_cast<unsigned long long>(q4PackedLayoutId()));
+    return name;
+}
+
+bool RepackedWeights::build(const std::string& path, uint64_t modelHash,
+                            const WeightStore& weights, std::string* error) {
+    const auto start = std::chrono::steady_clock::now();
+    const std::vector<Candidate> matrices = packableMatrices(weights);
+
+    RepackHeader header;
+    header.modelHash = modelHash;
+    header.layoutId = q4PackedLayoutId();
+    header.entryCount = static_cast<uint32_t>(matrices.size());
+    std::vector<RepackEntry> entries(matrices.size());
+    size_t offset = alignUp(sizeof(header) + entries.size() * sizeof(RepackEntry));
+    for (size_t i = 0; i < matrices.size(); ++i) {
+        const Q4Matrix& m = matrices[i].matrix;
+        entries[i].nameHash = hashName(matrices[i].prefix);
+        entries[i].offset = offset;
+        entries[i].rows = static_cast<uint32_t>(m.rows);
+        entries[i].cols = static_cast<uint32_t>(m.cols);
+        offset = alignUp(offset + q4PackedBytes(m.rows, m.cols));
+    }
+    header.fileBytes = offset;
+
+    const std::string tmpPath = path + ".tmp";
+    FILE* file = std::fopen(tmpPath.c_str(), "wb");
+    if (!file) {
+        *error = "cannot create " + tmpPath;
+        return false;
+    }
+    bool ok = writeAll(file, &header, sizeof(header)) &&
+              writeAll(file, entries.data(), entries.size() * sizeof(RepackEntry));
+    size_t written = sizeof(header) + entries.size() * sizeof(RepackEntry);
+    std::vector<uint8_t> buffer;
+    const std::vector<uint8_t> zeros(kMatrixAlignment, 0);
+    for (size_t i = 0; ok && i < matrices.size(); ++i) {
+        ok = writeAll(file, zeros.data(), entries[i].offset - written);
+        const Q4Matrix& m = matrices[i].matrix;
+        const int tiles = m.rows / kQ4PackRows;
+        const size_t tileBytes = q4PackedBytes(kQ4PackRows, m.cols);
+        for (int t = 0; ok && t < tiles; t += kTilesPerWrite) {
+            const int end = std::min(tiles, t + kTilesPerWrite);
+            buffer.resize((end - t) * tileBytes);
+            q4RepackTiles(m, t, end, buffer.data());
+            ok = writeAll(file, buffer.data(), buffer.size());
+        }
+        written = entries[i].offset + q4PackedBytes(m.rows, m.cols);
+    }
+    ok = ok && writeAll(file, zeros.data(), header.fileBytes - written);
+    ok = std::fflush(file) == 0 && fsync(fileno(file)) == 0 && ok;
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok || std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        std::remove(tmpPath.c_str());
+        *error = "failed to write " + path;
+        return false;
+    }
+    LOGI("Repacked %zu q4 matrices (%llu MB) into %s in %.0f ms", matrices.size(),
+         static_cast<unsigned long long>(header.fileBytes >> 20), path.c_str(),
+         std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+                 .count());
+    return true;
+}
+
+bool RepackedWeights::open(const std::string& path, uint64_t modelHash, std::string* error) {
+    matrices_.clear();
+    if (!file_.open(path, error)) return false;
+
+    RepackHeader header;
+    if (file_.size() >= sizeof(header)) std::memcpy(&header, file_.data(), sizeof(header));
+    if (file_.size() < sizeof(header) || header.magic != RepackHeader::kMagic ||
+        header.version != RepackHeader::kVersion) {
+        *error = path + " is not a repacked weight file";
+        file_ = MappedFile();
+        return false;
+    }
+    if (header.modelHash != modelHash || header.layoutId != q4PackedLayoutId()) {
+        *error = path + " was packed for another model or kernel build";
+        file_ = MappedFile();
+        return false;
+    }
+    const size_t tableEnd = sizeof(header) + header.entryCount * sizeof(RepackEntry);
+    if (header.fileBytes != file_.size() || tableEnd > file_.size()) {
+        *error = path + " is truncated or corrupt";
+        file_ = MappedFile();
+        return false;
+    }
+
+    const uint8_t* table = file_.data() + sizeof(header);
+    for (uint32_t i = 0; i < header.entryCount; ++i) {
+        RepackEntry entry;
+        std::memcpy(&entry, table + i * sizeof(entry), sizeof(entry));
+        Matrix matrix;
+        matrix.rows = static_cast<int>(entry.rows);
+        matrix.cols = static_cast<int>(entry.cols);
+        matrix.bytes = q4PackedBytes(matrix.rows, matrix.cols);
+        if (!q4CanPack(matrix.rows, matrix.cols) || entry.offset % kMatrixAlignment != 0 ||
+            entry.offset + matrix.bytes > file_.size()) {
+            *error = path + " is truncated or corrupt";
+            matrices_.clear();
+            file_ = MappedFile();
+            return false;
+        }
+        matrix.data = file_.data() + entry.offset;
+        matrices_[entry.nameHash] = matrix;
+    }
+    return true;
+}
+
+const RepackedWeights::Matrix* RepackedWeights::find(const std::string& prefix) const {
+    auto it = matrices_.find(hashName(prefix));
+    return it == matrices_.end() ? nullptr : &it->second;
+}
+
+} // namespace nimittam
@@ -0,0 +1,97 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * On-disk cache of the q4 weights in the kernels' packed layout.
+ *
+ * The first load on a device repacks every q4 matrix (each "<p>.q_weight"
+ * with its "<p>.q_scale") into kernels.h's packed layout and writes them
+ * to one file; later loads map that file and bind it in place, so the
+ * repack is paid once per device rather than per launch. The file name
+ * and header carry the model hash and q4PackedLayoutId(), so a different
+ * model, layout version or kernel variant builds its own file.
+ *
+ * Layout (native byte order):
+ *   [0]            RepackHeader
+ *   [64]           RepackEntry[entryCount]
+ *   [entry.offset] packed matrix, 64-byte aligned
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+#include "mapped_file.h"
+
+namespace nimittam {
+
+class WeightStore;
+
+struct RepackHeader {
+    static constexpr uint32_t kMagic = 0x5034514e;  // 'NQ4P'
+    static constexpr uint32_t kVersion = 1;
+
+    uint32_t magic = kMagic;
+    uint32_t version = kVersion;
+    uint64_t modelHash = 0;
+    uint64_t layoutId = 0;
+    uint32_t entryCount = 0;
+    uint32_t reserved = 0;
+    uint64_t fileBytes = 0;
+    uint64_t padding[3] = {};
+};
+static_assert(sizeof(RepackHeader) == 64, "repack header is 64 bytes");
+
+struct RepackEntry {
+    uint64_t nameHash = 0;  // FNV-1a of the parameter prefix, e.g. "model.layers.0.mlp.down_proj"
+    uint64_t offset = 0;
+    uint32_t rows = 0;
+    uint32_t cols = 0;
+};
+static_assert(sizeof(RepackEntry) == 24, "repack entry is 24 bytes");
+
+class RepackedWeights {
+public:
+    struct Matrix {
+        const uint8_t* data = nullptr;
+        size_t bytes = 0;
+        int rows = 0;
+        int cols = 0;
+    };
+
+    /**
+     * Map the repacked weights at [path]. Fails if the file is missing,
+     * truncated or was built for another model or layout.
+     */
+    bool open(const std::string& path, uint64_t modelHash, std::string* error);
+
+    /**
+     * Repack every q4 matrix of [weights] into a new file at [path],
+     * replacing it atomically. [weights] should be verified first: the
+     * file is trusted as is on later loads.
+     */
+    static bool build(const std::string& path, uint64_t modelHash, const WeightStore& weights,
+                      std::string* error);
+
+    /** File name for [modelHash] under the current layout. */
+    static std::string fileName(uint64_t modelHash);
+
+    /** Packed copy of the q4 matrix [prefix]; nullptr if it has none. */
+    const Matrix* find(const std::string& prefix) const;
+
+    size_t size() const { return matrices_.size(); }
+
+private:
+    MappedFile file_;
+    std::unordered_map<uint64_t, Matrix> matrices_;
+};
+
+} // namespace nimittam
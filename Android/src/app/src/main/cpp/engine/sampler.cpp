@@ -0,0 +1,432 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "sampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <random>
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define NIMITTAM_SAMPLER_NEON 1
+#include <arm_neon.h>
+#elif defined(__x86_64__)
+#define NIMITTAM_SAMPLER_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace nimittam {
+
+namespace {
+
+using Candidate = std::pair<float, int32_t>;
+
+// Ties go to the lower id so the order, and with it every draw, is fixed.
+bool ranksBefore(const Candidate& a, const Candidate& b) {
+    return a.first > b.first || (a.first == b.first && a.second < b.second);
+}
+
+// selectTopK() buffers this many times k candidates between selections.
+constexpr size_t kTopKSlack = 4;
+
+// Top-p on its own bins the last ring of candidates this finely.
+constexpr int kRingBins = 256;
+
+// Open upper bound for gatherRange(); not infinity, under -ffast-math.
+constexpr float kNoLimit = std::numeric_limits<float>::max();
+
+// exp() as a Cephes-style polynomial, so weights do not depend on the
+// C library; the vector versions below evaluate the same steps. Inputs
+// are <= 0 here, and anything under -87 is as good as 0.
+constexpr float kExpMin = -87.0f;
+constexpr float kLog2e = 1.44269504f;
+constexpr float kLn2Hi = 0.693359375f;
+constexpr float kLn2Lo = -2.12194440e-4f;
+constexpr float kExpP0 = 1.9875691500e-4f;
+constexpr float kExpP1 = 1.3981999507e-3f;
+constexpr float kExpP2 = 8.3334519073e-3f;
+constexpr float kExpP3 = 4.1665795894e-2f;
+constexpr float kExpP4 = 1.6666665459e-1f;
+constexpr float kExpP5 = 5.0000001201e-1f;
+
+float expApprox(float x) {
+    x = std::max(x, kExpMin);
+    const float n = std::nearbyint(x * kLog2e);
+    const float r = x - n * kLn2Hi - n * kLn2Lo;
+    float y = ((((kExpP0 * r + kExpP1) * r + kExpP2) * r + kExpP3) * r + kExpP4) * r + kExpP5;
+    y = y * r * r + r + 1.0f;
+    const int32_t bits = (static_cast<int32_t>(n) + 127) << 23;
+    float scale;
+    std::memcpy(&scale, &bits, sizeof(scale));
+    return y * scale;
+}
+
+#if defined(NIMITTAM_SAMPLER_NEON)
+float32x4_t expApprox(float32x4_t x) {
+    x = vmaxq_f32(x, vdupq_n_f32(kExpMin));
+    const int32x4_t ni = vcvtnq_s32_f32(vmulq_n_f32(x, kLog2e));
+    const float32x4_t n = vcvtq_f32_s32(ni);
+    const float32x4_t r = vsubq_f32(vsubq_f32(x, vmulq_n_f32(n, kLn2Hi)), vmulq_n_f32(n, kLn2Lo));
+    float32x4_t y = vaddq_f32(vmulq_n_f32(r, kExpP0), vdupq_n_f32(kExpP1));
+    y = vaddq_f32(vmulq_f32(y, r), vdupq_n_f32(kExpP2));
+    y = vaddq_f32(vmulq_f32(y, r), vdupq_n_f32(kExpP3));
+    y = vaddq_f32(vmulq_f32(y, r), vdupq_n_f32(kExpP4));
+    y = vaddq_f32(vmulq_f32(y, r), vdupq_n_f32(kExpP5));
+    y = vaddq_f32(vaddq_f32(vmulq_f32(vmulq_f32(y, r), r), r), vdupq_n_f32(1.0f));
+    const int32x4_t bits = vshlq_n_s32(vaddq_s32(ni, vdupq_n_s32(127)), 23);
+    return vmulq_f32(y, vreinterpretq_f32_s32(bits));
+}
+#elif defined(NIMITTAM_SAMPLER_SSE2)
+__m128 expApprox(__m128 x) {
+    x = _mm_max_ps(x, _mm_set1_ps(kExpMin));
+    const __m128i ni = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(kLog2e)));  // nearest
+    const __m128 n = _mm_cvtepi32_ps(ni);
+    const __m128 r = _mm_sub_ps(_mm_sub_ps(x, _mm_mul_ps(n, _mm_set1_ps(kLn2Hi))),
+                                _mm_mul_ps(n, _mm_set1_ps(kLn2Lo)));
+    __m128 y = _mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(kExpP0)), _mm_set1_ps(kExpP1));
+    y = _mm_add_ps(_mm_mul_ps(y, r), _mm_set1_ps(kExpP2));
+    y = _mm_add_ps(_mm_mul_ps(y, r), _mm_set1_ps(kExpP3));
+    y = _mm_add_ps(_mm_mul_ps(y, r), _mm_set1_ps(kExpP4));
+    y = _mm_add_ps(_mm_mul_ps(y, r), _mm_set1_ps(kExpP5));
+    y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(y, r), r), r), _mm_set1_ps(1.0f));
+    const __m128i bits = _mm_slli_epi32(_mm_add_epi32(ni, _mm_set1_epi32(127)), 23);
+    return _mm_mul_ps(y, _mm_castsi128_ps(bits));
+}
+#endif
+
+/** Softmax denominator: the sum of exp((x - maxLogit) * invTemperature). */
+float expSum(const float* x, int n, float maxLogit, float invTemperature) {
+    int i = 0;
+    float sum = 0.0f;
+#if defined(NIMITTAM_SAMPLER_NEON)
+    const float32x4_t m = vdupq_n_f32(maxLogit);
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    for (; i + 4 <= n; i += 4) {
+        const float32x4_t v = vld1q_f32(x + i);
+        acc = vaddq_f32(acc, expApprox(vmulq_n_f32(vsubq_f32(v, m), invTemperature)));
+    }
+    sum = vaddvq_f32(acc);
+#elif defined(NIMITTAM_SAMPLER_SSE2)
+    const __m128 m = _mm_set1_ps(maxLogit);
+    const __m128 t = _mm_set1_ps(invTemperature);
+    __m128 acc = _mm_setzero_ps();
+    for (; i + 4 <= n; i += 4) {
+        acc = _mm_add_ps(acc, expApprox(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(x + i), m), t)));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+    for (; i < n; ++i) sum += expApprox((x[i] - maxLogit) * invTemperature);
+    return sum;
+}
+
+float maxValue(const float* x, int n) {
+    int i = 0;
+    float best = x[0];
+#if defined(NIMITTAM_SAMPLER_NEON)
+    if (n >= 8) {
+        float32x4_t m0 = vld1q_f32(x);
+        float32x4_t m1 = vld1q_f32(x + 4);
+        for (i = 8; i + 8 <= n; i += 8) {
+            m0 = vmaxq_f32(m0, vld1q_f32(x + i));
+            m1 = vmaxq_f32(m1, vld1q_f32(x + i + 4));
+        }
+        best = vmaxvq_f32(vmaxq_f32(m0, m1));
+    }
+#elif defined(NIMITTAM_SAMPLER_SSE2)
+    if (n >= 8) {
+        __m128 m0 = _mm_loadu_ps(x);
+        __m128 m1 = _mm_loadu_ps(x + 4);
+        for (i = 8; i + 8 <= n; i += 8) {
+            m0 = _mm_max_ps(m0, _mm_loadu_ps(x + i));
+            m1 = _mm_max_ps(m1, _mm_loadu_ps(x + i + 4));
+        }
+        float lanes[4];
+        _mm_storeu_ps(lanes, _mm_max_ps(m0, m1));
+        best = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+    }
+#endif
+    for (; i < n; ++i) best = std::max(best, x[i]);
+    return best;
+}
+
+/** Index of the first element equal to [value], which must occur. */
+int firstIndexOf(const float* x, int n, float value) {
+    int i = 0;
+#if defined(NIMITTAM_SAMPLER_NEON)
+    const float32x4_t v = vdupq_n_f32(value);
+    for (; i + 4 <= n; i += 4) {
+        if (vmaxvq_u32(vceqq_f32(vld1q_f32(x + i), v))) break;
+    }
+#elif defined(NIMITTAM_SAMPLER_SSE2)
+    const __m128 v = _mm_set1_ps(value);
+    for (; i + 4 <= n; i += 4) {
+        if (_mm_movemask_ps(_mm_cmpeq_ps(_mm_loadu_ps(x + i), v))) break;
+    }
+#endif
+    while (i < n - 1 && x[i] != value) ++i;
+    return i;
+}
+
+/** Write (logit, id) for every logit in [low, high); returns how many. */
+size_t gatherRange(const float* x, int n, float low, float high, Candidate* out) {
+    size_t count = 0;
+    int i = 0;
+#if defined(NIMITTAM_SAMPLER_NEON)
+    const float32x4_t lo = vdupq_n_f32(low);
+    const float32x4_t hi = vdupq_n_f32(high);
+    for (; i + 4 <= n; i += 4) {
+        const float32x4_t v = vld1q_f32(x + i);
+        if (!vmaxvq_u32(vandq_u32(vcgeq_f32(v, lo), vcltq_f32(v, hi)))) continue;
+        for (int k = i; k < i + 4; ++k) {
+            if (x[k] >= low && x[k] < high) out[count++] = {x[k], k};
+        }
+    }
+#elif defined(NIMITTAM_SAMPLER_SSE2)
+    const __m128 lo = _mm_set1_ps(low);
+    const __m128 hi = _mm_set1_ps(high);
+    for (; i + 4 <= n; i += 4) {
+        const __m128 v = _mm_loadu_ps(x + i);
+        int mask = _mm_movemask_ps(_mm_and_ps(_mm_cmpge_ps(v, lo), _mm_cmplt_ps(v, hi)));
+        while (mask) {
+            const int k = i + __builtin_ctz(mask);
+            out[count++] = {x[k], k};
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; i < n; ++i) {
+        if (x[i] >= low && x[i] < high) out[count++] = {x[i], i};
+    }
+    return count;
+}
+
+/**
+ * The [k] best (logit, id) pairs, in no particular order, in out[0..k).
+ * One pass: candidates collect in [out] until it holds kTopKSlack * k,
+ * then a partial selection keeps the best k and the k-th becomes the bar
+ * to clear. The bar rises quickly, so almost every block of four is
+ * passed over with a single compare.
+ */
+size_t selectTopK(const float* x, int n, int k, Candidate* out) {
+    const size_t room = std::min(static_cast<size_t>(n), kTopKSlack * k);
+    size_t count = 0;
+    float bar = std::numeric_limits<float>::lowest();
+    // Later ids lose ties, so a token must beat the bar outright.
+    auto offer = [&](int i) {
+        if (!(x[i] > bar)) return;
+        out[count++] = {x[i], i};
+        if (count == room) {
+            std::nth_element(out, out + k - 1, out + count, ranksBefore);
+            count = static_cast<size_t>(k);
+            bar = out[k - 1].first;
+        }
+    };
+    int i = 0;
+#if defined(NIMITTAM_SAMPLER_NEON)
+    for (; i + 4 <= n; i += 4) {
+        if (!vmaxvq_u32(vcgtq_f32(vld1q_f32(x + i), vdupq_n_f32(bar)))) continue;
+        for (int lane = i; lane < i + 4; ++lane) offer(lane);
+    }
+#elif defined(NIMITTAM_SAMPLER_SSE2)
+    for (; i + 4 <= n; i += 4) {
+        int mask = _mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(x + i), _mm_set1_ps(bar)));
+        while (mask) {
+            offer(i + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; i < n; ++i) offer(i);
+    if (count > static_cast<size_t>(k)) {
+        std::nth_element(out, out + k - 1, out + count, ranksBefore);
+        count = static_cast<size_t>(k);
+    }
+    return count;
+}
+
+} // namespace
+
+void Sampler::reset(int64_t seed) {
+    if (seed < 0) {
+        std::random_device device;
+        seed_ = (static_cast<uint64_t>(device()) << 32) | device();
+    } else {
+        seed_ = static_cast<uint64_t>(seed);
+    }
+    draws_ = 0;
+}
+
+float Sampler::nextUniform() {
+    uint64_t z = seed_ + ++draws_ * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    return static_cast<float>(z >> 40) * (1.0f / 16777216.0f);
+}
+
+void Sampler::countHistory(const std::vector<int32_t>& history, int vocabSize) {
+    if (counts_.size() != static_cast<size_t>(vocabSize)) {
+        counts_.assign(vocabSize, 0);
+        counted_.clear();
+        distinct_.clear();
+    }
+    auto valid = [vocabSize](int32_t id) { return id >= 0 && id < vocabSize; };
+
+    // Usually the history only grew; after a rewritten transcript the
+    // tail past the common prefix is uncounted first.
+    const size_t limit = std::min(counted_.size(), history.size());
+    const size_t common = static_cast<size_t>(
+        std::mismatch(counted_.begin(), counted_.begin() + limit, history.begin()).first -
+        counted_.begin());
+    bool emptied = false;
+    for (size_t i = common; i < counted_.size(); ++i) {
+        if (valid(counted_[i]) && --counts_[counted_[i]] == 0) emptied = true;
+    }
+    if (emptied) {
+        distinct_.erase(std::remove_if(distinct_.begin(), distinct_.end(),
+                                       [this](int32_t id) { return counts_[id] == 0; }),
+                        distinct_.end());
+    }
+    counted_.resize(common);
+    for (size_t i = common; i < history.size(); ++i) {
+        const int32_t id = history[i];
+        if (valid(id) && counts_[id]++ == 0) distinct_.push_back(id);
+    }
+    counted_.insert(counted_.end(), history.begin() + common, history.end());
+}
+
+int32_t Sampler::sample(float* logits, int vocabSize, const SamplingParams& params,
+                        const std::vector<int32_t>& history) {
+    // CTRL-style repetition penalty over every distinct token in context.
+    if (params.repeatPenalty > 0.0f && params.repeatPenalty != 1.0f) {
+        countHistory(history, vocabSize);
+        for (int32_t id : distinct_) {
+            logits[id] = logits[id] > 0.0f ? logits[id] / params.repeatPenalty
+                                            : logits[id] * params.repeatPenalty;
+        }
+    }
+
+    const float maxLogit = maxValue(logits, vocabSize);
+    if (params.temperature <= 0.0f || params.topK == 1) {
+        return firstIndexOf(logits, vocabSize, maxLogit);
+    }
+
+    const float invTemperature = 1.0f / params.temperature;
+    const bool topK = params.topK > 0 && params.topK < vocabSize;
+    const bool topP = params.topP > 0.0f && params.topP < 1.0f;
+    if (candidates_.size() < static_cast<size_t>(vocabSize)) candidates_.resize(vocabSize);
+    Candidate* const first = candidates_.data();
+    auto weigh = [&](const Candidate& c) {
+        return expApprox((c.first - maxLogit) * invTemperature);
+    };
+
+    // Past this distance below the best a token's weight is under
+    // 1e-6 / vocabSize, so all of them together cannot move the sample.
+    const float margin = params.temperature * (std::log(static_cast<float>(vocabSize)) + 13.8f);
+    size_t count = 0;
+    // Candidates before this index are kept by top-p whatever the order.
+    size_t unordered = 0;
+    float target = 0.0f;
+    bool weighed = false;
+    if (topK) {
+        count = selectTopK(logits, vocabSize, params.topK, first);
+        // Masked tokens (kMaskedLogit) must not get the clamped exp()'s
+        // tiny weight or be the fallback pick below.
+        const float floor = maxLogit - margin;
+        auto belowFloor = [&](const Candidate& c) { return c.first < floor; };
+        count = static_cast<size_t>(std::remove_if(first, first + count, belowFloor) - first);
+    } else if (topP) {
+        // Widen the distance below the best a ring at a time until the
+        // tokens within it hold the kept share of the whole vocabulary's
+        // mass. Rings are weighed as they are gathered; everything inside
+        // the last one is kept whatever its order.
+        target = params.topP * expSum(logits, vocabSize, maxLogit, invTemperature);
+        float inner = 0.0f;
+        float delta = std::min(params.temperature, margin);
+        float mass = 0.0f;
+        float innerMass = 0.0f;
+        size_t ringStart = 0;
+        while (true) {
+            const float high = inner > 0.0f ? maxLogit - inner : kNoLimit;
+            const size_t added = gatherRange(logits, vocabSize, maxLogit - delta, high,
+                                             first + count);
+            ringStart = count;
+            count += added;
+            innerMass = mass;
+            for (size_t i = ringStart; i < count; ++i) {
+                first[i].first = weigh(first[i]);
+                mass += first[i].first;
+            }
+            if (mass >= target || delta == margin) break;
+            inner = delta;
+            delta = std::min(delta * 2.0f, margin);
+        }
+        weighed = true;
+
+        // The last ring is binned by weight to find the bin the cut falls
+        // in, and only that bin is left to order.
+        Candidate* const last = first + count;
+        Candidate* const ring = first + ringStart;
+        const float ringHigh = expApprox(-inner * invTemperature);
+        const float ringLow = expApprox(-delta * invTemperature);
+        const float scale = kRingBins / std::max(ringHigh - ringLow, 1e-30f);
+        auto binOf = [&](const Candidate& c) {
+            const int bin = static_cast<int>((ringHigh - c.first) * scale);
+            return std::min(std::max(bin, 0), kRingBins - 1);
+        };
+        float masses[kRingBins] = {};
+        for (const Candidate* c = ring; c < last; ++c) masses[binOf(*c)] += c->first;
+        float cumulative = innerMass;
+        int cutBin = 0;
+        while (cutBin < kRingBins - 1 && cumulative + masses[cutBin] < target) {
+            cumulative += masses[cutBin++];
+        }
+        Candidate* const cutStart =
+            std::partition(ring, last, [&](const Candidate& c) { return binOf(c) < cutBin; });
+        Candidate* const cutEnd =
+            std::partition(cutStart, last, [&](const Candidate& c) { return binOf(c) == cutBin; });
+        unordered = static_cast<size_t>(cutStart - first);
+        count = static_cast<size_t>(cutEnd - first);
+    } else {
+        count = gatherRange(logits, vocabSize, maxLogit - margin, kNoLimit, first);
+    }
+
+    // Logits become softmax weights in place.
+    float sum = 0.0f;
+    float kept = 0.0f;
+    for (size_t i = 0; i < count; ++i) {
+        if (!weighed) first[i].first = weigh(first[i]);
+        sum += first[i].first;
+        if (i < unordered) kept += first[i].first;
+    }
+
+    if (topP) {
+        if (topK) target = params.topP * sum;
+        std::sort(first + unordered, first + count, ranksBefore);
+        float cumulative = kept;
+        size_t cut = unordered;
+        while (cut < count && cumulative < target) cumulative += first[cut++].first;
+        if (cumulative >= target) {
+            count = cut;
+            sum = cumulative;
+        }
+    }
+
+    float r = nextUniform() * sum;
+    for (size_t i = 0; i < count; ++i) {
+        r -= first[i].first;
+        if (r < 0.0f) return first[i].second;
+    }
+    return first[count - 1].second;
+}
+
+} // namespace nimittam
@@ -0,0 +1,84 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Token sampler: repetition penalty, temperature, top-k and top-p,
+ * mirroring GenerationParams on the Kotlin side.
+ *
+ * Over a 150K vocabulary the work is kept off the full logit vector as
+ * far as possible. One vectorized pass finds the best logit. Top-k then
+ * streams the logits through a small buffer behind a rising bar, so only
+ * a few hundred tokens are ever ordered. Top-p alone sums the softmax mass
+ * in a second vectorized pass and gathers rings of growing distance below
+ * the best until they hold the kept share; the last ring is binned by
+ * weight and only the bin the cut falls in is sorted. The repetition
+ * penalty keeps a per-token count table in step with the history instead
+ * of rescanning it, so each step touches only the tokens that changed.
+ *
+ * Draws come from a counter-based generator (SplitMix64 over the seed
+ * and draw number) rather than a standard-library distribution, so a
+ * seeded run picks the same tokens on every platform and build.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace nimittam {
+
+/**
+ * Logit that takes a token out of sampling, as grammar masks do. Not
+ * -infinity, which -ffast-math assumes away, and not the lowest float
+ * either: scaled by 1 / temperature or the repetition penalty it must
+ * stay finite, while still lying far below any logit a model produces.
+ */
+constexpr float kMaskedLogit = -1e30f;
+
+struct SamplingParams {
+    float temperature = 0.7f;
+    float topP = 0.9f;
+    int topK = 40;
+    float repeatPenalty = 1.1f;
+    int64_t seed = -1;  // -1 = random
+};
+
+class Sampler {
+public:
+    /** Reseed for a new request; negative seeds draw from random_device. */
+    void reset(int64_t seed);
+
+    /**
+     * Pick the next token. [logits] is modified in place. [history] is the
+     * token context the repetition penalty applies to.
+     */
+    int32_t sample(float* logits, int vocabSize, const SamplingParams& params,
+                   const std::vector<int32_t>& history);
+
+private:
+    /** Bring counts_ in line with [history], touching only what changed. */
+    void countHistory(const std::vector<int32_t>& history, int vocabSize);
+
+    /** Uniform in [0, 1), a pure function of the seed and the draw number. */
+    float nextUniform();
+
+    uint64_t seed_ = 0;
+    uint64_t draws_ = 0;
+
+    // Repetition penalty bookkeeping: the history as last counted, the
+    // occurrences of each token id in it and the ids that occur at all.
+    std::vector<int32_t> counted_;
+    std::vector<uint32_t> counts_;
+    std::vector<int32_t> distinct_;
+
+    // (logit, then weight; token id), sized to the vocabulary once.
+    std::vector<std::pair<float, int32_t>> candidates_;
+};
+
+} // namespace nimittam
@@ -0,0 +1,99 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "stop_matcher.h"
+
+#include <algorithm>
+
+namespace nimittam {
+
+void StopMatcher::build(const std::vector<std::string>& stops) {
+    next_.assign(kAlphabet, -1);
+    depth_.assign(1, 0);
+    match_.assign(1, 0);
+    held_.clear();
+    state_ = 0;
+
+    // Trie of the sequences.
+    for (const std::string& stop : stops) {
+        if (stop.empty()) continue;
+        int32_t node = 0;
+        for (unsigned char c : stop) {
+            int32_t& child = next_[node * kAlphabet + c];
+            if (child < 0) {
+                child = static_cast<int32_t>(depth_.size());
+                depth_.push_back(depth_[node] + 1);
+                match_.push_back(0);
+                next_.resize(next_.size() + kAlphabet, -1);
+            }
+            node = next_[node * kAlphabet + c];
+        }
+        match_[node] = static_cast<uint32_t>(stop.size());
+    }
+
+    // Breadth first, so a state's failure link is finished before the
+    // states below it: missing transitions borrow the failure state's,
+    // and a state also matches whatever its failure state matches.
+    std::vector<int32_t> fail(depth_.size(), 0);
+    std::vector<int32_t> queue;
+    queue.reserve(depth_.size());
+    for (int c = 0; c < kAlphabet; ++c) {
+        int32_t& child = next_[c];
+        if (child < 0) {
+            child = 0;
+        } else {
+            queue.push_back(child);
+        }
+    }
+    for (size_t head = 0; head < queue.size(); ++head) {
+        const int32_t node = queue[head];
+        for (int c = 0; c < kAlphabet; ++c) {
+            int32_t& child = next_[node * kAlphabet + c];
+            const int32_t fallback = next_[fail[node] * kAlphabet + c];
+            if (child < 0) {
+                child = fallback;
+            } else {
+                fail[child] = fallback;
+                match_[child] = std::max(match_[child], match_[fallback]);
+                queue.push_back(child);
+            }
+        }
+    }
+}
+
+bool StopMatcher::feed(const std::string& text, std::string* out) {
+    if (empty()) {
+        *out = text;
+        return false;
+    }
+    out->clear();
+    const size_t start = held_.size();
+    held_ += text;
+    for (size_t i = start; i < held_.size(); ++i) {
+        state_ = next_[state_ * kAlphabet + static_cast<unsigned char>(held_[i])];
+        if (match_[state_] > 0) {
+            out->append(held_, 0, i + 1 - match_[state_]);
+            held_.clear();
+            state_ = 0;
+            return true;
+        }
+    }
+    // Everything before the state's depth can no longer start a match.
+    const size_t release = held_.size() - depth_[state_];
+    out->append(held_, 0, release);
+    held_.erase(0, release);
+    return false;
+}
+
+void StopMatcher::finish(std::string* out) {
+    out->append(held_);
+    held_.clear();
+    state_ = 0;
+}
+
+} // namespace nimittam
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Finds stop sequences in streamed text as it is generated.
+ *
+ * build() compiles the sequences into an Aho-Corasick automaton with
+ * every byte transition filled in, so feeding text costs one table
+ * lookup per byte and nothing is ever scanned twice. The depth of the
+ * current state is exactly how much of the stream's tail could still
+ * turn into a stop sequence; that tail is held back and everything
+ * before it is released. When a sequence completes, the text is cut
+ * just before it and the caller ends the generation, so no stop text
+ * (or a partial one) reaches the reply and no token is decoded past it.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace nimittam {
+
+class StopMatcher {
+public:
+    /** Compile [stops] (empty strings are ignored) and start a new stream. */
+    void build(const std::vector<std::string>& stops);
+
+    /** No stop sequences: feed() passes text straight through. */
+    bool empty() const { return depth_.size() <= 1; }
+
+    /**
+     * Feed the next piece of text. [out] is set to the text that can no
+     * longer be part of a stop sequence. Returns true when a stop
+     * sequence completes; [out] then ends just before it and the rest of
+     * [text] is dropped.
+     */
+    bool feed(const std::string& text, std::string* out);
+
+    /** End of the stream without a match: append the held-back text to [out]. */
+    void finish(std::string* out);
+
+    /** Bytes held back as the possible start of a stop sequence. */
+    size_t heldBytes() const { return held_.size(); }
+
+private:
+    static constexpr int kAlphabet = 256;
+
+    std::vector<int32_t> next_;    // kAlphabet transitions per state
+    std::vector<uint32_t> depth_;  // bytes from the root
+    std::vector<uint32_t> match_;  // longest sequence ending at the state, 0 if none
+    std::string held_;
+    int32_t state_ = 0;
+};
+
+} // namespace nimittam
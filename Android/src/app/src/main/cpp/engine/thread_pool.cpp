@@ -0,0 +1,188 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "thread_pool.h"
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+
+#include "cpu_features.h"
+
+namespace nimittam {
+
+namespace {
+
+constexpr uint64_t pack(uint32_t begin, uint32_t end) {
+    return static_cast<uint64_t>(begin) << 32 | end;
+}
+
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// Poll [done] for up to [micros]; true once it holds. Yields now and then
+// so a spinning thread cannot starve the one it waits for on a busy core.
+template <typename Done>
+bool spinUntil(int micros, Done done) {
+    if (micros <= 0) return done();
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(micros);
+    for (int i = 1;; ++i) {
+        if (done()) return true;
+        if (i % 64 != 0) {
+            cpuRelax();
+            continue;
+        }
+        if (std::chrono::steady_clock::now() >= deadline) return false;
+        std::this_thread::yield();
+    }
+}
+
+void pinCurrentThread(const std::vector<int>& cpus) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) CPU_SET(cpu, &set);
+    // Best effort: a restrictive cpuset leaves the thread where it was.
+    sched_setaffinity(0, sizeof(set), &set);
+#else
+    (void)cpus;
+#endif
+}
+
+} // namespace
+
+ThreadPool::ThreadPool(int threads, const ThreadPoolOptions& options)
+        : spinMicros_(std::max(options.spinMicros, 0)) {
+    threads = std::max(threads, 1);
+    const int workers = threads - 1;
+    if (options.pinToFastCores && workers > 0) pinnedCpus_ = fastestCpus(threads);
+    runs_ = std::make_unique<ChunkRun[]>(threads);
+    workers_.reserve(workers);
+    for (int i = 0; i < workers; ++i) {
+        workers_.emplace_back([this, i] { workerLoop(i + 1); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_.store(true, std::memory_order_relaxed);
+    }
+    wake_.notify_all();
+    for (auto& worker : workers_) worker.join();
+}
+
+void ThreadPool::parallelFor(int n, int grain, const std::function<void(int, int)>& fn) {
+    if (n <= 0) return;
+    grain = std::max(grain, 1);
+    if (workers_.empty() || n <= grain) {
+        fn(0, n);
+        return;
+    }
+
+    job_ = &fn;
+    jobSize_ = n;
+    // A few chunks per thread leaves something to steal without much
+    // claiming traffic.
+    chunkSize_ = std::max(grain, n / (size() * 4));
+    const int chunks = (n + chunkSize_ - 1) / chunkSize_;
+    for (int i = 0; i < size(); ++i) {
+        const uint32_t begin = static_cast<uint32_t>(static_cast<int64_t>(chunks) * i / size());
+        const uint32_t end = static_cast<uint32_t>(static_cast<int64_t>(chunks) * (i + 1) / size());
+        runs_[i].range.store(pack(begin, end), std::memory_order_relaxed);
+    }
+    activeWorkers_.store(static_cast<int>(workers_.size()), std::memory_order_relaxed);
+    bool sleepers;
+    {
+        // Under the lock so that a worker about to sleep either sees the new
+        // generation or is counted in parkedWorkers_ and gets woken.
+        std::lock_guard<std::mutex> lock(mutex_);
+        generation_.fetch_add(1, std::memory_order_release);
+        sleepers = parkedWorkers_ > 0;
+    }
+    if (sleepers) wake_.notify_all();
+
+    runChunks(0);
+
+    auto finished = [this] { return activeWorkers_.load(std::memory_order_acquire) == 0; };
+    if (!spinUntil(spinMicros_, finished)) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, finished);
+    }
+    job_ = nullptr;
+}
+
+bool ThreadPool::claimChunk(int index, int* chunk) {
+    // Own run first, from the front.
+    std::atomic<uint64_t>& own = runs_[index].range;
+    uint64_t range = own.load(std::memory_order_relaxed);
+    while (static_cast<uint32_t>(range >> 32) < static_cast<uint32_t>(range)) {
+        const uint32_t begin = static_cast<uint32_t>(range >> 32);
+        if (own.compare_exchange_weak(range, pack(begin + 1, static_cast<uint32_t>(range)),
+                                      std::memory_order_acq_rel)) {
+            *chunk = static_cast<int>(begin);
+            return true;
+        }
+    }
+    // Then the others', from the back, starting with the next thread over.
+    for (int k = 1; k < size(); ++k) {
+        std::atomic<uint64_t>& victim = runs_[(index + k) % size()].range;
+        range = victim.load(std::memory_order_relaxed);
+        while (static_cast<uint32_t>(range >> 32) < static_cast<uint32_t>(range)) {
+            const uint32_t end = static_cast<uint32_t>(range) - 1;
+            if (victim.compare_exchange_weak(range, pack(static_cast<uint32_t>(range >> 32), end),
+                                             std::memory_order_acq_rel)) {
+                *chunk = static_cast<int>(end);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void ThreadPool::runChunks(int index) {
+    int chunk;
+    while (claimChunk(index, &chunk)) {
+        const int begin = chunk * chunkSize_;
+        (*job_)(begin, std::min(begin + chunkSize_, jobSize_));
+    }
+}
+
+void ThreadPool::workerLoop(int index) {
+    if (!pinnedCpus_.empty()) pinCurrentThread(pinnedCpus_);
+    uint64_t seen = 0;
+    while (true) {
+        auto woken = [&] {
+            return stopping_.load(std::memory_order_relaxed) ||
+                   generation_.load(std::memory_order_acquire) != seen;
+        };
+        if (!spinUntil(spinMicros_, woken)) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            ++parkedWorkers_;
+            wake_.wait(lock, woken);
+            --parkedWorkers_;
+        }
+        if (stopping_.load(std::memory_order_relaxed)) return;
+        seen = generation_.load(std::memory_order_acquire);
+        runChunks(index);
+        if (activeWorkers_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            done_.notify_one();
+        }
+    }
+}
+
+} // namespace nimittam
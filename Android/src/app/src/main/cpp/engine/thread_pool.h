@@ -0,0 +1,96 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Fixed-size worker pool for data-parallel kernels.
+ *
+ * One pool per engine instance so concurrent sessions never contend
+ * for each other's workers. parallelFor() cuts a range into chunks and
+ * deals every thread, the caller included, a contiguous run of them.
+ * A thread works through its own run from the front and then steals
+ * chunks from the back of the others', so a thread that lands on a
+ * little core of a big.LITTLE SoC, or is preempted, hands its leftovers
+ * to the faster ones instead of holding up the whole call.
+ *
+ * Workers can be pinned to the highest-capacity cores, and can spin for
+ * a while after a job before sleeping: decode issues a few hundred short
+ * jobs per token, and waking a sleeping thread costs tens of
+ * microseconds each time.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace nimittam {
+
+struct ThreadPoolOptions {
+    // Keep workers on the fastest cores, per fastestCpus(threads).
+    bool pinToFastCores = false;
+    // How long an idle worker (or the caller waiting on workers) spins
+    // before sleeping; 0 sleeps straight away.
+    int spinMicros = 0;
+};
+
+class ThreadPool {
+public:
+    /** [threads] counts the caller, so 1 means no extra workers. */
+    explicit ThreadPool(int threads, const ThreadPoolOptions& options = ThreadPoolOptions());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const { return static_cast<int>(workers_.size()) + 1; }
+
+    /** CPUs the workers are confined to; empty when they are not pinned. */
+    const std::vector<int>& pinnedCpus() const { return pinnedCpus_; }
+
+    /**
+     * Run fn(begin, end) over [0, n) in chunks of at least [grain]
+     * items and block until every chunk is done. Not reentrant.
+     */
+    void parallelFor(int n, int grain, const std::function<void(int, int)>& fn);
+
+private:
+    // One thread's unclaimed chunks [begin, end), packed as begin << 32 | end.
+    struct alignas(64) ChunkRun {
+        std::atomic<uint64_t> range{0};
+    };
+
+    void workerLoop(int index);
+    void runChunks(int index);
+    bool claimChunk(int index, int* chunk);
+
+    const int spinMicros_;
+    std::vector<int> pinnedCpus_;
+    std::vector<std::thread> workers_;
+    std::unique_ptr<ChunkRun[]> runs_;  // [size()], 0 is the caller's
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    std::atomic<bool> stopping_{false};
+    std::atomic<uint64_t> generation_{0};
+    int parkedWorkers_ = 0;  // guarded by mutex_
+
+    // Current job
+    const std::function<void(int, int)>* job_ = nullptr;
+    int jobSize_ = 0;
+    int chunkSize_ = 1;
+    std::atomic<int> activeWorkers_{0};
+};
+
+} // namespace nimittam
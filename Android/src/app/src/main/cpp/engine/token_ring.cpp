@@ -0,0 +1,128 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "token_ring.h"
+
+#include <cstring>
+
+namespace nimittam {
+
+namespace {
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "token ring indices must be lock-free to be shared with Kotlin");
+
+uint32_t roundUpPow2(uint32_t v) {
+    uint32_t p = 1024;
+    while (p < v) p <<= 1;
+    return p;
+}
+
+uint64_t align8(uint64_t v) {
+    return (v + 7) & ~static_cast<uint64_t>(7);
+}
+
+} // namespace
+
+TokenRing::TokenRing(uint32_t capacityBytes)
+    : capacity_(roundUpPow2(capacityBytes)),
+      storage_(static_cast<uint8_t*>(
+          ::operator new[](kHeaderBytes + capacity_, std::align_val_t(64)))) {
+    std::memset(storage_.get(), 0, kHeaderBytes);
+    std::memcpy(storage_.get(), &kMagic, sizeof(kMagic));
+    std::memcpy(storage_.get() + kCapacityOffset, &capacity_, sizeof(capacity_));
+    for (size_t offset : {kWriteIndexOffset, kReadIndexOffset, kDroppedOffset,
+                          kBackpressureOffset}) {
+        new (storage_.get() + offset) std::atomic<uint64_t>(0);
+    }
+}
+
+std::atomic<uint64_t>& TokenRing::counter(size_t offset) const {
+    return *reinterpret_cast<std::atomic<uint64_t>*>(storage_.get() + offset);
+}
+
+bool TokenRing::tryPush(int32_t tokenId, const char* bytes, uint32_t length) {
+    if (length > maxPayload()) return false;
+
+    const uint64_t need = align8(kRecordHeaderBytes + length);
+    uint64_t write = counter(kWriteIndexOffset).load(std::memory_order_relaxed);
+    const uint64_t read = counter(kReadIndexOffset).load(std::memory_order_acquire);
+    const uint64_t mask = capacity_ - 1;
+
+    uint64_t pos = write & mask;
+    const uint64_t tail = capacity_ - pos;
+    const uint64_t skip = need > tail ? tail : 0;
+    if (write + skip + need - read > capacity_) return false;
+
+    if (skip) {
+        // Not enough room before the end: leave a wrap marker and restart
+        // at offset 0. [tail] is a multiple of 8, so the marker fits.
+        std::memcpy(data() + pos, &kWrapMarker, sizeof(kWrapMarker));
+        write += skip;
+        pos = 0;
+    }
+    uint8_t* record = data() + pos;
+    std::memcpy(record, &tokenId, sizeof(tokenId));
+    std::memcpy(record + 4, &length, sizeof(length));
+    std::memcpy(record + kRecordHeaderBytes, bytes, length);
+    counter(kWriteIndexOffset).store(write + need, std::memory_order_release);
+    return true;
+}
+
+void TokenRing::addDropped(uint64_t tokens) {
+    counter(kDroppedOffset).fetch_add(tokens, std::memory_order_relaxed);
+}
+
+void TokenRing::addBackpressure() {
+    counter(kBackpressureOffset).fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t TokenRing::writeIndex() const {
+    return counter(kWriteIndexOffset).load(std::memory_order_acquire);
+}
+
+void TokenRing::setReadIndex(uint64_t index) {
+    counter(kReadIndexOffset).store(index, std::memory_order_release);
+}
+
+uint64_t TokenRing::readIndex() const {
+    return counter(kReadIndexOffset).load(std::memory_order_relaxed);
+}
+
+bool TokenRing::tryPop(int32_t* tokenId, std::string* bytes) {
+    uint64_t read = counter(kReadIndexOffset).load(std::memory_order_relaxed);
+    const uint64_t write = writeIndex();
+    const uint64_t mask = capacity_ - 1;
+    while (read < write) {
+        const uint8_t* record = data() + (read & mask);
+        int32_t id;
+        std::memcpy(&id, record, sizeof(id));
+        if (id == kWrapMarker) {
+            read += capacity_ - (read & mask);
+            continue;
+        }
+        uint32_t length;
+        std::memcpy(&length, record + 4, sizeof(length));
+        *tokenId = id;
+        bytes->assign(reinterpret_cast<const char*>(record + kRecordHeaderBytes), length);
+        setReadIndex(read + align8(kRecordHeaderBytes + length));
+        return true;
+    }
+    setReadIndex(read);
+    return false;
+}
+
+uint64_t TokenRing::droppedTokens() const {
+    return counter(kDroppedOffset).load(std::memory_order_relaxed);
+}
+
+uint64_t TokenRing::backpressureEvents() const {
+    return counter(kBackpressureOffset).load(std::memory_order_relaxed);
+}
+
+} // namespace nimittam
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Single-producer / single-consumer ring of decoded tokens.
+ *
+ * The decode thread writes, the Kotlin collector reads. The whole ring
+ * is one contiguous block so it can be handed to Kotlin as a direct
+ * ByteBuffer; records are consumed in place without a JNI string per
+ * token.
+ *
+ * Layout (native byte order):
+ *   [0]    uint32 magic ('TKRG'), uint32 data capacity in bytes
+ *   [64]   uint64 write index  (producer: release store)
+ *   [128]  uint64 read index   (consumer: release store)
+ *   [192]  uint64 dropped tokens, uint64 backpressure events
+ *   [256]  data: records of { int32 tokenId, uint32 length, bytes },
+ *          each padded to 8 bytes. A record with tokenId == kWrapMarker
+ *          means "continue at the start of the data area"; one with
+ *          tokenId == kNoToken carries text that belongs to no token.
+ *
+ * Indices are monotonically increasing byte counters; the offset in the
+ * data area is index & (capacity - 1). Each index sits on its own cache
+ * line so producer and consumer never false-share.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <string>
+
+namespace nimittam {
+
+class TokenRing {
+public:
+    static constexpr uint32_t kMagic = 0x47524B54;  // "TKRG"
+    static constexpr int32_t kWrapMarker = INT32_MIN;
+    static constexpr int32_t kNoToken = -1;
+    static constexpr size_t kHeaderBytes = 256;
+    static constexpr size_t kCapacityOffset = 4;
+    static constexpr size_t kWriteIndexOffset = 64;
+    static constexpr size_t kReadIndexOffset = 128;
+    static constexpr size_t kDroppedOffset = 192;
+    static constexpr size_t kBackpressureOffset = 200;
+    static constexpr size_t kRecordHeaderBytes = 8;
+
+    /** [capacityBytes] is rounded up to a power of two. */
+    explicit TokenRing(uint32_t capacityBytes = 64 * 1024);
+
+    TokenRing(const TokenRing&) = delete;
+    TokenRing& operator=(const TokenRing&) = delete;
+
+    // ---- Producer (decode thread) ----
+
+    /** Append one token; false when the ring is full. Never blocks. */
+    bool tryPush(int32_t tokenId, const char* bytes, uint32_t length);
+
+    void addDropped(uint64_t tokens);
+    void addBackpressure();
+
+    // ---- Consumer ----
+
+    /** Acquire-load of the write index: everything before it is readable. */
+    uint64_t writeIndex() const;
+
+    /** Release-store of the read index: everything before it may be reused. */
+    void setReadIndex(uint64_t index);
+    uint64_t readIndex() const;
+
+    /**
+     * Pop one record (native consumers and tests). Returns false when
+     * the ring is empty.
+     */
+    bool tryPop(int32_t* tokenId, std::string* bytes);
+
+    // ---- Shared ----
+
+    void* buffer() { return storage_.get(); }
+    size_t bufferBytes() const { return kHeaderBytes + capacity_; }
+    uint32_t capacity() const { return capacity_; }
+    uint64_t droppedTokens() const;
+    uint64_t backpressureEvents() const;
+
+    /** Largest token payload a single record can carry. */
+    uint32_t maxPayload() const { return capacity_ / 4; }
+
+private:
+    std::atomic<uint64_t>& counter(size_t offset) const;
+    uint8_t* data() const { return storage_.get() + kHeaderBytes; }
+
+    struct AlignedDelete {
+        void operator()(uint8_t* p) const { ::operator delete[](p, std::align_val_t(64)); }
+    };
+
+    uint32_t capacity_;
+    std::unique_ptr<uint8_t[], AlignedDelete> storage_;
+};
+
+} // namespace nimittam
@@ -0,0 +1,639 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "tokenizer.h"
+
+#include <algorithm>
+
+#include "json.h"
+#include "model_source.h"
+#include "unicode_tables.h"
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define NIMITTAM_TOKENIZER_NEON 1
+#include <arm_neon.h>
+#elif defined(__x86_64__)
+#define NIMITTAM_TOKENIZER_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace nimittam {
+
+namespace {
+
+// ---- Unicode classification -------------------------------------------------
+
+template <size_t N>
+bool inRanges(const unicode::UnicodeRange (&ranges)[N], uint32_t cp) {
+    size_t lo = 0;
+    size_t hi = N;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (cp < ranges[mid].first) hi = mid;
+        else if (cp > ranges[mid].last) lo = mid + 1;
+        else return true;
+    }
+    return false;
+}
+
+bool isLetter(uint32_t cp) {
+    if (cp < 0x80) return (cp | 0x20) >= 'a' && (cp | 0x20) <= 'z';
+    return inRanges(unicode::kLetterRanges, cp);
+}
+
+bool isNumber(uint32_t cp) {
+    if (cp < 0x80) return cp >= '0' && cp <= '9';
+    return inRanges(unicode::kNumberRanges, cp);
+}
+
+bool isSpace(uint32_t cp) {
+    if (cp < 0x80) return cp == ' ' || (cp >= '\t' && cp <= '\r');
+    return cp == 0x85 || cp == 0xA0 || cp == 0x1680 || (cp >= 0x2000 && cp <= 0x200A) ||
+           cp == 0x2028 || cp == 0x2029 || cp == 0x202F || cp == 0x205F || cp == 0x3000;
+}
+
+bool isNewline(uint32_t cp) {
+    return cp == '\r' || cp == '\n';
+}
+
+/** Decode one code point; malformed bytes decode as U+FFFD of length 1. */
+uint32_t decodeUtf8(const unsigned char* p, size_t remaining, uint32_t* length) {
+    unsigned char c = p[0];
+    if (c < 0x80) {
+        *length = 1;
+        return c;
+    }
+    uint32_t need;
+    uint32_t cp;
+    if ((c & 0xE0) == 0xC0) {
+        need = 1;
+        cp = c & 0x1F;
+    } else if ((c & 0xF0) == 0xE0) {
+        need = 2;
+        cp = c & 0x0F;
+    } else if ((c & 0xF8) == 0xF0) {
+        need = 3;
+        cp = c & 0x07;
+    } else {
+        *length = 1;
+        return 0xFFFD;
+    }
+    if (remaining <= need) {
+        *length = 1;
+        return 0xFFFD;
+    }
+    for (uint32_t i = 1; i <= need; ++i) {
+        if ((p[i] & 0xC0) != 0x80) {
+            *length = 1;
+            return 0xFFFD;
+        }
+        cp = (cp << 6) | (p[i] & 0x3F);
+    }
+    *length = need + 1;
+    return cp;
+}
+
+// ---- GPT-2 byte <-> unicode mapping -----------------------------------------
+
+struct ByteDecoder {
+    // Mapped code point -> original byte; -1 when not part of the alphabet.
+    int16_t byteOf[512];
+
+    ByteDecoder() {
+        std::fill(std::begin(byteOf), std::end(byteOf), static_cast<int16_t>(-1));
+        int next = 0;
+        for (int b = 0; b < 256; ++b) {
+            bool printable = (b >= '!' && b <= '~') || (b >= 0xA1 && b <= 0xAC) ||
+                             (b >= 0xAE && b <= 0xFF);
+            int cp = printable ? b : 256 + next++;
+            byteOf[cp] = static_cast<int16_t>(b);
+        }
+    }
+};
+
+const ByteDecoder& byteDecoder() {
+    static const ByteDecoder decoder;
+    return decoder;
+}
+
+/** Undo the byte-level mapping of a vocabulary string. */
+bool unmapBytes(const std::string& mapped, std::string* out) {
+    const ByteDecoder& decoder = byteDecoder();
+    out->clear();
+    const auto* p = reinterpret_cast<const unsigned char*>(mapped.data());
+    size_t i = 0;
+    while (i < mapped.size()) {
+        uint32_t length;
+        uint32_t cp = decodeUtf8(p + i, mapped.size() - i, &length);
+        if (cp >= 512 || decoder.byteOf[cp] < 0) return false;
+        out->push_back(static_cast<char>(decoder.byteOf[cp]));
+        i += length;
+    }
+    return true;
+}
+
+// Token ids, and the pair of them a merge slot is keyed on, in 20 bits each.
+constexpr int kIdBits = 20;
+constexpr uint64_t kPairMask = (uint64_t{1} << (2 * kIdBits)) - 1;
+
+uint64_t pairKey(int32_t left, int32_t right) {
+    return static_cast<uint64_t>(left) << kIdBits | static_cast<uint64_t>(right);
+}
+
+// Fibonacci hashing: the top bits of key * 2^64 / phi.
+size_t mergeHash(uint64_t key, int shift) {
+    return static_cast<size_t>((key * 0x9E3779B97F4A7C15ULL) >> shift);
+}
+
+} // namespace
+
+// ---- Pre-tokenizer ------------------------------------------------------------
+
+namespace {
+
+enum class CharClass : uint8_t { Letter, Number, Space, Newline, Other };
+
+CharClass classify(uint32_t cp) {
+    if (isNewline(cp)) return CharClass::Newline;
+    if (isLetter(cp)) return CharClass::Letter;
+    if (isNumber(cp)) return CharClass::Number;
+    if (isSpace(cp)) return CharClass::Space;
+    return CharClass::Other;
+}
+
+bool isAsciiLetter(unsigned char b) {
+    return static_cast<unsigned char>((b | 0x20) - 'a') < 26;
+}
+
+bool isAsciiSpace(unsigned char b) {
+    return b == ' ' || (b >= '\t' && b <= '\r');
+}
+
+// Length of the run of ASCII letters at [p], at most [n] bytes.
+size_t asciiLetterRun(const unsigned char* p, size_t n) {
+    size_t i = 0;
+#if defined(NIMITTAM_TOKENIZER_NEON)
+    for (; i + 16 <= n; i += 16) {
+        const uint8x16_t folded = vorrq_u8(vld1q_u8(p + i), vdupq_n_u8(0x20));
+        const uint8x16_t letter = vcltq_u8(vsubq_u8(folded, vdupq_n_u8('a')), vdupq_n_u8(26));
+        // One nibble per byte: all ones for a letter.
+        const uint64_t mask =
+                vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(letter), 4)), 0);
+        if (mask != ~0ULL) return i + __builtin_ctzll(~mask) / 4;
+    }
+#elif defined(NIMITTAM_TOKENIZER_SSE2)
+    for (; i + 16 <= n; i += 16) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        const __m128i folded = _mm_or_si128(bytes, _mm_set1_epi8(0x20));
+        const __m128i offset = _mm_sub_epi8(folded, _mm_set1_epi8('a'));
+        // Unsigned offset < 26, as min(offset, 25) == offset.
+        const __m128i letter = _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8(25)), offset);
+        const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(letter));
+        if (mask != 0xFFFF) return i + __builtin_ctz(~mask);
+    }
+#endif
+    while (i < n && isAsciiLetter(p[i])) ++i;
+    return i;
+}
+
+// Length of the run of ASCII whitespace at [p], at most [n] bytes. Sets
+// [lastNewline] to the offset of the run's last \r or \n, if it has one.
+size_t asciiSpaceRun(const unsigned char* p, size_t n, size_t* lastNewline) {
+    size_t i = 0;
+#if defined(NIMITTAM_TOKENIZER_NEON)
+    for (; i + 16 <= n; i += 16) {
+        const uint8x16_t v = vld1q_u8(p + i);
+        const uint8x16_t control = vcltq_u8(vsubq_u8(v, vdupq_n_u8('\t')), vdupq_n_u8(5));
+        const uint8x16_t space = vorrq_u8(control, vceqq_u8(v, vdupq_n_u8(' ')));
+        const uint8x16_t newline = vorrq_u8(vceqq_u8(v, vdupq_n_u8('\n')),
+                                            vceqq_u8(v, vdupq_n_u8('\r')));
+        const uint64_t spaceMask =
+                vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(space), 4)), 0);
+        uint64_t newlineMask = vget_lane_u64(
+                vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(newline), 4)), 0);
+        const int run = spaceMask == ~0ULL ? 16 : __builtin_ctzll(~spaceMask) / 4;
+        if (run < 16) newlineMask &= (1ULL << (4 * run)) - 1;
+        if (newlineMask) *lastNewline = i + (63 - __builtin_clzll(newlineMask)) / 4;
+        if (run < 16) return i + run;
+    }
+#elif defined(NIMITTAM_TOKENIZER_SSE2)
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        const __m128i offset = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+        const __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8(4)), offset);
+        const __m128i space = _mm_or_si128(control, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+        const __m128i newline = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                                             _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+        const unsigned spaceMask = static_cast<unsigned>(_mm_movemask_epi8(space));
+        unsigned newlineMask = static_cast<unsigned>(_mm_movemask_epi8(newline));
+        const int run = spaceMask == 0xFFFF ? 16 : __builtin_ctz(~spaceMask);
+        newlineMask &= (1u << run) - 1;
+        if (newlineMask) *lastNewline = i + 31 - __builtin_clz(newlineMask);
+        if (run < 16) return i + run;
+    }
+#endif
+    for (; i < n && isAsciiSpace(p[i]); ++i) {
+        if (p[i] == '\n' || p[i] == '\r') *lastNewline = i;
+    }
+    return i;
+}
+
+} // namespace
+
+void preTokenize(const char* data, size_t size, std::vector<TextSpan>* pieces) {
+    const auto* bytes = reinterpret_cast<const unsigned char*>(data);
+    auto emit = [&](size_t from, size_t to) {
+        pieces->push_back({static_cast<uint32_t>(from), static_cast<uint32_t>(to - from)});
+    };
+    // Code point at byte [i] < size, and its length.
+    auto at = [&](size_t i, uint32_t* length) { return decodeUtf8(bytes + i, size - i, length); };
+    auto classAt = [&](size_t i, uint32_t* length) {
+        if (bytes[i] < 0x80) {
+            *length = 1;
+            return classify(bytes[i]);
+        }
+        return classify(at(i, length));
+    };
+    // End of the run of letters starting at [i].
+    auto letterRunEnd = [&](size_t i) {
+        while (i < size) {
+            i += asciiLetterRun(bytes + i, size - i);
+            uint32_t length;
+            if (i == size || bytes[i] < 0x80 || !isLetter(at(i, &length))) break;
+            i += length;
+        }
+        return i;
+    };
+
+    size_t i = 0;
+    while (i < size) {
+        uint32_t length;
+        const uint32_t c = at(i, &length);
+        const CharClass cls = classify(c);
+        const size_t next = i + length;
+
+        // (?i:'s|'t|'re|'ve|'m|'ll|'d)
+        if (c == '\'' && next < size) {
+            const unsigned char a = bytes[next] < 0x80 ? bytes[next] | 0x20 : 0;
+            if (a == 's' || a == 't' || a == 'm' || a == 'd') {
+                emit(i, next + 1);
+                i = next + 1;
+                continue;
+            }
+            if (next + 1 < size && bytes[next + 1] < 0x80) {
+                const unsigned char b = bytes[next + 1] | 0x20;
+                if ((a == 'r' && b == 'e') || (a == 'v' && b == 'e') || (a == 'l' && b == 'l')) {
+                    emit(i, next + 2);
+                    i = next + 2;
+                    continue;
+                }
+            }
+        }
+
+        // [^\r\n\p{L}\p{N}]?\p{L}+
+        if (cls == CharClass::Letter) {
+            const size_t end = letterRunEnd(next);
+            emit(i, end);
+            i = end;
+            continue;
+        }
+        if (cls != CharClass::Newline && cls != CharClass::Number && next < size) {
+            uint32_t nextLength;
+            if (classAt(next, &nextLength) == CharClass::Letter) {
+                const size_t end = letterRunEnd(next + nextLength);
+                emit(i, end);
+                i = end;
+                continue;
+            }
+        }
+
+        // \p{N}
+        if (cls == CharClass::Number) {
+            emit(i, next);
+            i = next;
+            continue;
+        }
+
+        // ' ?[^\s\p{L}\p{N}]+[\r\n]*'
+        {
+            size_t j = c == ' ' ? next : i;
+            uint32_t otherLength;
+            if (j < size && classAt(j, &otherLength) == CharClass::Other) {
+                j += otherLength;
+                while (j < size && classAt(j, &otherLength) == CharClass::Other) j += otherLength;
+                while (j < size && (bytes[j] == '\r' || bytes[j] == '\n')) ++j;
+                emit(i, j);
+                i = j;
+                continue;
+            }
+        }
+
+        if (cls == CharClass::Space || cls == CharClass::Newline) {
+            size_t end = i;
+            size_t lastNewline = size;
+            size_t lastStart = i;  // the run's last code point
+            size_t count = 0;      // code points in the run
+            while (end < size) {
+                size_t runNewline = size;
+                const size_t run = asciiSpaceRun(bytes + end, size - end, &runNewline);
+                if (run > 0) {
+                    if (runNewline != size) lastNewline = end + runNewline;
+                    end += run;
+                    lastStart = end - 1;
+                    count += run;
+                }
+                uint32_t spaceLength;
+                if (end == size || bytes[end] < 0x80 || !isSpace(at(end, &spaceLength))) break;
+                lastStart = end;
+                end += spaceLength;
+                ++count;
+            }
+            // \s*[\r\n]+
+            if (lastNewline != size) {
+                emit(i, lastNewline + 1);
+                i = lastNewline + 1;
+                continue;
+            }
+            // \s+(?!\S) leaves the last space for the following word.
+            if (end < size && count >= 2) {
+                emit(i, lastStart);
+                i = lastStart;
+                continue;
+            }
+            // \s+
+            emit(i, end);
+            i = end;
+            continue;
+        }
+
+        emit(i, next);
+        i = next;
+    }
+}
+
+// ---- Tokenizer ----------------------------------------------------------------
+
+bool Tokenizer::load(const ModelSource& source, std::string* error) {
+    JsonValue root;
+    if (!source.parseJson("tokenizer.json", &root, error)) {
+        return false;
+    }
+    const JsonValue& model = root["model"];
+    if (model["type"].asString() != "BPE") {
+        *error = "tokenizer.json: only BPE models are supported";
+        return false;
+    }
+
+    int32_t maxId = -1;
+    for (const auto& entry : model["vocab"].members()) {
+        maxId = std::max(maxId, static_cast<int32_t>(entry.second.asInt()));
+    }
+    for (const JsonValue& added : root["added_tokens"].items()) {
+        maxId = std::max(maxId, static_cast<int32_t>(added["id"].asInt()));
+    }
+    if (maxId < 0) {
+        *error = "tokenizer.json: empty vocabulary";
+        return false;
+    }
+    idToBytes_.assign(static_cast<size_t>(maxId) + 1, std::string());
+
+    std::string bytes;
+    for (const auto& entry : model["vocab"].members()) {
+        if (!unmapBytes(entry.first, &bytes)) {
+            *error = "tokenizer.json: vocabulary entry outside the byte-level alphabet";
+            return false;
+        }
+        auto id = static_cast<int32_t>(entry.second.asInt());
+        idToBytes_[id] = bytes;
+        bytesToId_.emplace(bytes, id);
+    }
+    for (int b = 0; b < 256; ++b) {
+        auto it = bytesToId_.find(std::string(1, static_cast<char>(b)));
+        if (it == bytesToId_.end()) {
+            *error = "tokenizer.json: missing byte token";
+            return false;
+        }
+        byteTokens_[b] = it->second;
+    }
+
+    if (idToBytes_.size() > (size_t{1} << kIdBits)) {
+        *error = "tokenizer.json: vocabulary too large";
+        return false;
+    }
+    const auto& merges = model["merges"].items();
+    // Merge pairs in rank order; the merged tokens go to mergedIds_.
+    std::vector<uint64_t> pairs;
+    pairs.reserve(merges.size());
+    mergedIds_.clear();
+    mergedIds_.reserve(merges.size());
+    std::string left;
+    std::string right;
+    for (size_t rank = 0; rank < merges.size(); ++rank) {
+        const JsonValue& merge = merges[rank];
+        std::string a;
+        std::string b;
+        if (merge.isString()) {
+            const std::string& text = merge.asString();
+            size_t space = text.find(' ');
+            if (space == std::string::npos) continue;
+            a = text.substr(0, space);
+            b = text.substr(space + 1);
+        } else if (merge.items().size() == 2) {
+            a = merge.items()[0].asString();
+            b = merge.items()[1].asString();
+        } else {
+            continue;
+        }
+        if (!unmapBytes(a, &left) || !unmapBytes(b, &right)) continue;
+        auto l = bytesToId_.find(left);
+        auto r = bytesToId_.find(right);
+        auto m = bytesToId_.find(left + right);
+        if (l == bytesToId_.end() || r == bytesToId_.end() || m == bytesToId_.end()) continue;
+        pairs.push_back(pairKey(l->second, r->second));
+        mergedIds_.push_back(m->second);
+    }
+    buildMergeTable(pairs);
+
+    for (const JsonValue& added : root["added_tokens"].items()) {
+        auto id = static_cast<int32_t>(added["id"].asInt());
+        const std::string& content = added["content"].asString();
+        if (content.empty()) continue;
+        idToBytes_[id] = content;
+        bytesToId_[content] = id;
+        addedTokens_.emplace_back(content, id);
+        addedTokenStart_[static_cast<unsigned char>(content[0])] = true;
+    }
+    // Prefer the longest added token when several start at the same offset.
+    std::sort(addedTokens_.begin(), addedTokens_.end(),
+              [](const auto& a, const auto& b) { return a.first.size() > b.first.size(); });
+    return true;
+}
+
+void Tokenizer::buildMergeTable(const std::vector<uint64_t>& pairs) {
+    // At most 2/3 full keeps linear probes short; 8-byte slots keep the
+    // table for Qwen2's 151k merges at 2 MB.
+    int bits = 1;
+    while ((size_t{1} << bits) * 2 < 3 * pairs.size()) ++bits;
+    mergeShift_ = 64 - bits;
+    mergeTable_.assign(size_t{1} << bits, kEmptySlot);
+    const size_t mask = mergeTable_.size() - 1;
+    for (size_t rank = 0; rank < pairs.size(); ++rank) {
+        size_t slot = mergeHash(pairs[rank], mergeShift_);
+        while (mergeTable_[slot] != kEmptySlot && (mergeTable_[slot] & kPairMask) != pairs[rank]) {
+            slot = (slot + 1) & mask;
+        }
+        // A pair listed twice keeps its first (lowest) rank.
+        if (mergeTable_[slot] == kEmptySlot) {
+            mergeTable_[slot] = static_cast<uint64_t>(rank) << (2 * kIdBits) | pairs[rank];
+        }
+    }
+}
+
+int32_t Tokenizer::findMerge(int32_t left, int32_t right) const {
+    const uint64_t key = pairKey(left, right);
+    const size_t mask = mergeTable_.size() - 1;
+    for (size_t slot = mergeHash(key, mergeShift_);; slot = (slot + 1) & mask) {
+        const uint64_t entry = mergeTable_[slot];
+        if ((entry & kPairMask) == key) return static_cast<int32_t>(entry >> (2 * kIdBits));
+        if (entry == kEmptySlot) return -1;
+    }
+}
+
+const std::string& Tokenizer::tokenBytes(int32_t id) const {
+    static const std::string kEmpty;
+    if (id < 0 || static_cast<size_t>(id) >= idToBytes_.size()) return kEmpty;
+    return idToBytes_[id];
+}
+
+int32_t Tokenizer::tokenId(const std::string& bytes) const {
+    auto it = bytesToId_.find(bytes);
+    return it == bytesToId_.end() ? -1 : it->second;
+}
+
+std::vector<int32_t> Tokenizer::encode(const std::string& text) const {
+    std::vector<int32_t> ids;
+    ids.reserve(text.size() / 3);
+    size_t start = 0;
+    for (size_t pos = 0; pos < text.size(); ++pos) {
+        if (!addedTokenStart_[static_cast<unsigned char>(text[pos])]) continue;
+        // Longest first, so the longest added token at [pos] wins.
+        for (const auto& added : addedTokens_) {
+            if (text.compare(pos, added.first.size(), added.first) != 0) continue;
+            encodeChunk(text.data() + start, pos - start, &ids);
+            ids.push_back(added.second);
+            start = pos + added.first.size();
+            pos = start - 1;
+            break;
+        }
+    }
+    encodeChunk(text.data() + start, text.size() - start, &ids);
+    return ids;
+}
+
+void Tokenizer::encodeChunk(const char* data, size_t size, std::vector<int32_t>* out) const {
+    if (size == 0) return;
+    thread_local std::vector<TextSpan> pieces;
+    pieces.clear();
+    preTokenize(data, size, &pieces);
+    for (const TextSpan& piece : pieces) {
+        encodeWord(data + piece.offset, piece.length, out);
+    }
+}
+
+void Tokenizer::encodeShortWord(const char* data, size_t size, std::vector<int32_t>* out) const {
+    // Symbols and the rank of each adjacent pair's merge, in arrays small
+    // enough that a scan for the best pair beats keeping a heap.
+    int32_t ids[kShortWord];
+    uint32_t ranks[kShortWord];  // -1, the largest, when the pair does not merge
+    int n = static_cast<int>(size);
+    for (int i = 0; i < n; ++i) ids[i] = byteTokens_[static_cast<unsigned char>(data[i])];
+    for (int i = 0; i + 1 < n; ++i) ranks[i] = static_cast<uint32_t>(findMerge(ids[i], ids[i + 1]));
+    while (n > 1) {
+        int best = 0;
+        for (int i = 1; i + 1 < n; ++i) {
+            if (ranks[i] < ranks[best]) best = i;
+        }
+        if (ranks[best] == static_cast<uint32_t>(-1)) break;
+        ids[best] = mergedIds_[ranks[best]];
+        --n;
+        for (int i = best + 1; i < n; ++i) {
+            ids[i] = ids[i + 1];
+            ranks[i] = ranks[i + 1];
+        }
+        if (best > 0) ranks[best - 1] = static_cast<uint32_t>(findMerge(ids[best - 1], ids[best]));
+        if (best + 1 < n) ranks[best] = static_cast<uint32_t>(findMerge(ids[best], ids[best + 1]));
+    }
+    out->insert(out->end(), ids, ids + n);
+}
+
+void Tokenizer::encodeWord(const char* data, size_t size, std::vector<int32_t>* out) const {
+    if (size == 1) {
+        out->push_back(byteTokens_[static_cast<unsigned char>(data[0])]);
+        return;
+    }
+    if (size <= kShortWord) {
+        encodeShortWord(data, size, out);
+        return;
+    }
+    // The word's symbols as a linked list over its bytes; a merge keeps the
+    // left symbol and unlinks the right one.
+    struct Symbol {
+        int32_t id;
+        int32_t prev;
+        int32_t next;
+    };
+    // A pair that could merge, checked against the list when popped.
+    struct Candidate {
+        int32_t rank;
+        int32_t left;
+        int32_t leftId;
+        int32_t rightId;
+        // Heap order: lowest rank, then leftmost.
+        bool operator<(const Candidate& other) const {
+            return rank != other.rank ? rank > other.rank : left > other.left;
+        }
+    };
+    thread_local std::vector<Symbol> symbols;
+    thread_local std::vector<Candidate> heap;
+    const int32_t n = static_cast<int32_t>(size);
+    symbols.resize(size);
+    heap.clear();
+    for (int32_t i = 0; i < n; ++i) {
+        symbols[i] = {byteTokens_[static_cast<unsigned char>(data[i])], i - 1,
+                      i + 1 < n ? i + 1 : -1};
+    }
+    auto push = [&](int32_t left) {
+        const int32_t right = symbols[left].next;
+        if (right < 0) return;
+        const int32_t rank = findMerge(symbols[left].id, symbols[right].id);
+        if (rank < 0) return;
+        heap.push_back({rank, left, symbols[left].id, symbols[right].id});
+        std::push_heap(heap.begin(), heap.end());
+    };
+    for (int32_t i = 0; i + 1 < n; ++i) push(i);
+
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end());
+        const Candidate c = heap.back();
+        heap.pop_back();
+        Symbol& left = symbols[c.left];
+        // Stale once either side has merged since: symbols only grow, so
+        // a changed symbol never matches its old id again.
+        if (left.id != c.leftId || left.next < 0 || symbols[left.next].id != c.rightId) continue;
+        const int32_t right = left.next;
+        left.id = mergedIds_[c.rank];
+        left.next = symbols[right].next;
+        if (left.next >= 0) symbols[left.next].prev = c.left;
+        symbols[right].id = -1;
+        if (left.prev >= 0) push(left.prev);
+        push(c.left);
+    }
+    for (int32_t i = 0; i >= 0; i = symbols[i].next) out->push_back(symbols[i].id);
+}
+
+} // namespace nimittam
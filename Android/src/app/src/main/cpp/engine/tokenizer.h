@@ -0,0 +1,94 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Byte-level BPE tokenizer for HuggingFace tokenizer.json files
+ * (Qwen2 / GPT-4 style).
+ *
+ * Vocabulary entries are stored as raw bytes (the GPT-2 byte-to-unicode
+ * mapping is undone at load time) so encode and decode never touch the
+ * mapped alphabet. NFC normalization is not applied; Android IMEs
+ * already deliver composed text.
+ *
+ * Merges live in one flat open-addressed array of plain structs, and a
+ * word is merged through a min-heap of candidate pairs, so a long run of
+ * punctuation or whitespace in pasted code costs n log n rather than n^2.
+ * The pre-tokenizer works on the UTF-8 bytes directly and scans ASCII
+ * letter and whitespace runs 16 bytes at a time.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace nimittam {
+
+class ModelSource;
+
+class Tokenizer {
+public:
+    /** Load tokenizer.json from [source]. */
+    bool load(const ModelSource& source, std::string* error);
+
+    /** Encode UTF-8 text; added tokens such as <|im_start|> are matched verbatim. */
+    std::vector<int32_t> encode(const std::string& text) const;
+
+    /** Raw bytes of a token (may be a partial UTF-8 sequence). */
+    const std::string& tokenBytes(int32_t id) const;
+
+    int vocabSize() const { return static_cast<int>(idToBytes_.size()); }
+
+    /** Id of an exact vocabulary or added-token string, or -1. */
+    int32_t tokenId(const std::string& bytes) const;
+
+    /** Added tokens such as <|im_start|> with their ids, longest first. */
+    const std::vector<std::pair<std::string, int32_t>>& addedTokens() const {
+        return addedTokens_;
+    }
+
+private:
+    // Merge table slot: rank << 40 | left << 20 | right.
+    static constexpr uint64_t kEmptySlot = ~0ULL;
+    // Words up to this many bytes skip the heap (encodeShortWord).
+    static constexpr size_t kShortWord = 16;
+
+    void buildMergeTable(const std::vector<uint64_t>& pairs);
+    /** Rank of the merge of (left, right), or -1. */
+    int32_t findMerge(int32_t left, int32_t right) const;
+    void encodeChunk(const char* data, size_t size, std::vector<int32_t>* out) const;
+    void encodeWord(const char* data, size_t size, std::vector<int32_t>* out) const;
+    void encodeShortWord(const char* data, size_t size, std::vector<int32_t>* out) const;
+
+    std::vector<std::string> idToBytes_;
+    std::unordered_map<std::string, int32_t> bytesToId_;
+    std::vector<uint64_t> mergeTable_;  // open-addressed, power-of-two size
+    int mergeShift_ = 64;
+    std::vector<int32_t> mergedIds_;    // by rank
+    std::vector<std::pair<std::string, int32_t>> addedTokens_;
+    // Whether some added token starts with the byte.
+    bool addedTokenStart_[256] = {};
+    int32_t byteTokens_[256] = {};
+};
+
+struct TextSpan {
+    uint32_t offset;
+    uint32_t length;
+};
+
+/**
+ * Split text with the Qwen2 pre-tokenizer pattern
+ *   (?i:'s|'t|'re|'ve|'m|'ll|'d)|[^\r\n\p{L}\p{N}]?\p{L}+|\p{N}
+ *   | ?[^\s\p{L}\p{N}]+[\r\n]*|\s*[\r\n]+|\s+(?!\S)|\s+
+ * appending one span per piece. Hand-written; std::regex has no \p{..}.
+ */
+void preTokenize(const char* data, size_t size, std::vector<TextSpan>* pieces);
+
+} // namespace nimittam
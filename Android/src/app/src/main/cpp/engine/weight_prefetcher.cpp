@@ -0,0 +1,213 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "weight_prefetcher.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+
+#include "log.h"
+#include "repacked_weights.h"
+#include "weights.h"
+
+namespace nimittam {
+
+namespace {
+
+const char kLayerPrefix[] = "model.layers.";
+const char kWeightSuffix[] = ".q_weight";
+const char kScaleSuffix[] = ".q_scale";
+// progress() while every byte is resident but verification is still running.
+constexpr float kUnfinishedProgress = 0.999f;
+
+size_t pageSize() {
+    return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+template <size_t N>
+bool endsWith(const std::string& name, const char (&suffix)[N]) {
+    return name.size() >= N - 1 && name.compare(name.size() - (N - 1), N - 1, suffix) == 0;
+}
+
+/** Stage of tensor [name]: layer i is stage i + 1, anything else stage 0. */
+int stageOf(const std::string& name, int numLayers) {
+    if (name.compare(0, sizeof(kLayerPrefix) - 1, kLayerPrefix) != 0) return 0;
+    const char* digits = name.c_str() + sizeof(kLayerPrefix) - 1;
+    char* end = nullptr;
+    const long layer = std::strtol(digits, &end, 10);
+    if (end == digits || *end != '.' || layer < 0 || layer >= numLayers) return 0;
+    return static_cast<int>(layer) + 1;
+}
+
+} // namespace
+
+WeightPrefetcher::WeightPrefetcher(const WeightStore& weights, const RepackedWeights* repacked,
+                                   int numLayers)
+    : weights_(weights),
+      numStages_(std::max(numLayers, 0) + 1),
+      stages_(numStages_),
+      stageBytes_(numStages_, 0),
+      resident_(new std::atomic<bool>[numStages_]) {
+    for (const auto& entry : weights.tensors()) {
+        const std::string& name = entry.first;
+        Range range = {static_cast<const uint8_t*>(entry.second.data), entry.second.nbytes};
+        // A repacked q4 matrix is read from its packed copy, never from storage.
+        if (repacked && endsWith(name, kScaleSuffix) &&
+            repacked->find(name.substr(0, name.size() - (sizeof(kScaleSuffix) - 1)))) {
+            continue;
+        }
+        if (repacked && endsWith(name, kWeightSuffix)) {
+            const RepackedWeights::Matrix* packed =
+                    repacked->find(name.substr(0, name.size() - (sizeof(kWeightSuffix) - 1)));
+            if (packed) range = {packed->data, packed->bytes};
+        }
+        const int stage = stageOf(name, numLayers);
+        stages_[stage].push_back(range);
+        stageBytes_[stage] += range.bytes;
+        totalBytes_ += range.bytes;
+    }
+    // Tensors come out of a hash map; walk each stage in address order.
+    for (auto& ranges : stages_) {
+        std::sort(ranges.begin(), ranges.end(),
+                  [](const Range& a, const Range& b) { return a.data < b.data; });
+    }
+    for (int s = 0; s < numStages_; ++s) resident_[s].store(false, std::memory_order_relaxed);
+}
+
+WeightPrefetcher::~WeightPrefetcher() {
+    stop_ = true;
+    if (thread_.joinable()) thread_.join();
+}
+
+void WeightPrefetcher::start(bool verify) {
+    thread_ = std::thread([this, verify]() { run(verify); });
+}
+
+void WeightPrefetcher::willRun(int layer) {
+    if (complete_.load(std::memory_order_relaxed)) return;
+    wanted_.store(layer + 2, std::memory_order_relaxed);
+}
+
+void WeightPrefetcher::didRun(int layer) {
+    if (complete_.load(std::memory_order_relaxed)) return;
+    if (layer + 1 < numStages_) markResident(layer + 1);
+}
+
+bool WeightPrefetcher::waitForLayers(int layers) {
+    const int count = std::min(layers + 1, numStages_);
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [&]() { return failed() || finished_ || stagesResident(count); });
+    return !failed() && stagesResident(count);
+}
+
+bool WeightPrefetcher::finish() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [&]() { return finished_.load(); });
+    return !failed() && complete_.load();
+}
+
+float WeightPrefetcher::progress() const {
+    const float resident =
+            totalBytes_ == 0
+                    ? 1.0f
+                    : static_cast<float>(static_cast<double>(residentBytes_.load()) / totalBytes_);
+    if (finished_.load(std::memory_order_acquire)) return resident;
+    return std::min(resident, kUnfinishedProgress);
+}
+
+std::string WeightPrefetcher::error() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return error_;
+}
+
+void WeightPrefetcher::run(bool verify) {
+    const auto start = std::chrono::steady_clock::now();
+    advise(0);
+    for (int stage = nextStage(); stage >= 0 && !stop_; stage = nextStage()) {
+        // Read-ahead for the likely next stage overlaps this one's faults.
+        if (stage + 1 < numStages_) advise(stage + 1);
+        touch(stage);
+        if (!stop_) markResident(stage);
+    }
+    const double warmMs =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+                    .count();
+    if (!stop_) complete_ = true;
+
+    std::string failure;
+    for (size_t i = 0; verify && !stop_ && i < weights_.shardCount(); ++i) {
+        if (!weights_.verifyShard(i, &failure)) break;
+    }
+    if (!stop_) {
+        LOGI("Weights warm in %.0f ms%s", warmMs,
+             !verify ? "" : failure.empty() ? ", checksums verified" : ", verification failed");
+    }
+    if (!failure.empty()) LOGE("Weights unusable: %s", failure.c_str());
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!failure.empty()) {
+        error_ = failure;
+        failed_.store(true, std::memory_order_release);
+    }
+    finished_.store(true, std::memory_order_release);
+    changed_.notify_all();
+}
+
+int WeightPrefetcher::nextStage() const {
+    const int from = std::min(std::max(wanted_.load(std::memory_order_relaxed), 0), numStages_);
+    for (int s = from; s < numStages_; ++s) {
+        if (!resident_[s].load(std::memory_order_relaxed)) return s;
+    }
+    for (int s = 0; s < from; ++s) {
+        if (!resident_[s].load(std::memory_order_relaxed)) return s;
+    }
+    return -1;
+}
+
+void WeightPrefetcher::touch(int stage) const {
+    const size_t page = pageSize();
+    uint8_t sink = 0;
+    for (const Range& range : stages_[stage]) {
+        if (stop_) return;
+        // Volatile reads so the loads are not elided.
+        const volatile uint8_t* bytes = range.data;
+        for (size_t offset = 0; offset < range.bytes; offset += page) sink ^= bytes[offset];
+        if (range.bytes > 0) sink ^= bytes[range.bytes - 1];
+    }
+    (void)sink;
+}
+
+void WeightPrefetcher::advise(int stage) const {
+    const uintptr_t pageMask = ~static_cast<uintptr_t>(pageSize() - 1);
+    for (const Range& range : stages_[stage]) {
+        const uintptr_t begin = reinterpret_cast<uintptr_t>(range.data) & pageMask;
+        const uintptr_t end = reinterpret_cast<uintptr_t>(range.data) + range.bytes;
+        // A hint; failures are ignored.
+        madvise(reinterpret_cast<void*>(begin), end - begin, MADV_WILLNEED);
+    }
+}
+
+void WeightPrefetcher::markResident(int stage) {
+    if (resident_[stage].exchange(true)) return;
+    residentBytes_ += stageBytes_[stage];
+    std::lock_guard<std::mutex> lock(mutex_);
+    changed_.notify_all();
+}
+
+bool WeightPrefetcher::stagesResident(int count) const {
+    for (int s = 0; s < count; ++s) {
+        if (!resident_[s].load()) return false;
+    }
+    return true;
+}
+
+} // namespace nimittam
@@ -0,0 +1,122 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Background warm-up of mapped weights, one decoder layer at a time.
+ *
+ * Mapped weights fault in on first use, so whatever runs first pays for
+ * every page it reads. The prefetcher walks the weights in forward order
+ * on its own thread, reading one byte per page. The model tells it which
+ * layer it is about to run and the prefetcher jumps to the layer after
+ * that one, so layer N + 1 is faulting in while layer N computes; a
+ * layer the model has run is resident by definition.
+ *
+ * Stage 0 is everything outside the decoder layers (embedding, final
+ * norm) and stage i + 1 is layer i. Shard checksums deferred from the
+ * load are verified here once every stage is resident.
+ *
+ * Residency only measures warm-up: the pages stay clean page cache the
+ * kernel may evict again under memory pressure.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace nimittam {
+
+class RepackedWeights;
+class WeightStore;
+
+class WeightPrefetcher {
+public:
+    /**
+     * Stages over [weights], with the q4 matrices found in [repacked] (may
+     * be null) taken from their packed copies instead; tensors named
+     * "model.layers.<i>." belong to layer i.
+     */
+    WeightPrefetcher(const WeightStore& weights, const RepackedWeights* repacked, int numLayers);
+    /** Stops the walk (or verification) at the next page range and joins. */
+    ~WeightPrefetcher();
+
+    WeightPrefetcher(const WeightPrefetcher&) = delete;
+    WeightPrefetcher& operator=(const WeightPrefetcher&) = delete;
+
+    /** Start warming; with [verify], check every shard's checksum afterwards. */
+    void start(bool verify);
+
+    /** The model is about to run [layer]; warm the layer after it next. */
+    void willRun(int layer);
+
+    /** The model has run [layer], so its pages are resident. */
+    void didRun(int layer);
+
+    /**
+     * Block until stage 0 and layers [0, layers) are resident. Returns
+     * false if verification failed first.
+     */
+    bool waitForLayers(int layers);
+
+    /** Block until every stage is resident and verification is done; false if it failed. */
+    bool finish();
+
+    /**
+     * Fraction of weight bytes resident, 0 to 1. Held just below 1 until
+     * the background run (verification included) is over, so a caller
+     * polling for 1 does not stop before failed() can turn true.
+     */
+    float progress() const;
+
+    /** Verification found a corrupt shard; error() says which. */
+    bool failed() const { return failed_.load(std::memory_order_acquire); }
+    std::string error() const;
+
+private:
+    struct Range {
+        const uint8_t* data;
+        size_t bytes;
+    };
+
+    void run(bool verify);
+    /** First stage not yet resident, searching from the one the model wants next. */
+    int nextStage() const;
+    void touch(int stage) const;
+    void advise(int stage) const;
+    void markResident(int stage);
+    bool stagesResident(int count) const;
+
+    const WeightStore& weights_;
+    const int numStages_;
+    std::vector<std::vector<Range>> stages_;
+    std::vector<size_t> stageBytes_;
+    size_t totalBytes_ = 0;
+
+    std::unique_ptr<std::atomic<bool>[]> resident_;
+    std::atomic<size_t> residentBytes_{0};
+    std::atomic<int> wanted_{0};
+    std::atomic<bool> complete_{false};  // every stage resident
+    std::atomic<bool> failed_{false};
+    std::atomic<bool> stop_{false};
+
+    mutable std::mutex mutex_;
+    std::condition_variable changed_;
+    // Written under mutex_; atomic so progress() can read it without.
+    std::atomic<bool> finished_{false};
+    std::string error_;
+    std::thread thread_;
+};
+
+} // namespace nimittam
@@ -0,0 +1,186 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "weights.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "json.h"
+#include "log.h"
+#include "md5.h"
+#include "model_source.h"
+
+namespace nimittam {
+
+namespace {
+
+DType parseDType(const std::string& name) {
+    if (name == "float16") return DType::Float16;
+    if (name == "float32") return DType::Float32;
+    if (name == "uint32") return DType::UInt32;
+    return DType::Unknown;
+}
+
+bool mapShard(const ModelSource& source, const std::string& name, size_t expectedBytes,
+              MappedFile* out, std::string* error) {
+    if (!source.map(name, out, error)) return false;
+    if (out->size() != expectedBytes) {
+        *error = name + ": expected " + std::to_string(expectedBytes) + " bytes, found " +
+                 std::to_string(out->size());
+        return false;
+    }
+    // No read-ahead here: WeightPrefetcher asks for the pages layer by
+    // layer, in the order the model needs them.
+    return true;
+}
+
+bool checkShard(const MappedFile& shard, const std::string& name, const std::string& expected,
+                std::string* error) {
+    if (expected.empty()) return true;
+    Md5 md5;
+    md5.update(shard.data(), shard.size());
+    const std::string actual = md5.hexDigest();
+    if (actual != expected) {
+        *error = name + ": checksum mismatch (corrupt or partial copy), md5 " + actual +
+                 ", manifest " + expected;
+        return false;
+    }
+    return true;
+}
+
+double elapsedMs(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since)
+            .count();
+}
+
+/** Map shard [record], fault in its first page and optionally verify it, timing each step. */
+bool loadShard(const ModelSource& source, const JsonValue& record, bool verify,
+               std::chrono::steady_clock::time_point origin, MappedFile* out,
+               ShardLoadTiming* timing, std::string* error) {
+    const std::string path = record["dataPath"].asString();
+    timing->name = path;
+    timing->bytes = static_cast<size_t>(record["nbytes"].asInt());
+    timing->startMs = elapsedMs(origin);
+
+    auto step = std::chrono::steady_clock::now();
+    if (!mapShard(source, path, timing->bytes, out, error)) return false;
+    timing->mapMs = elapsedMs(step);
+    // Inside an archive the shard starts wherever zipalign put it.
+    if (reinterpret_cast<uintptr_t>(out->data()) % alignof(uint32_t) != 0) {
+        *error = path + " is not 4-byte aligned in the archive; zipalign the APK";
+        return false;
+    }
+
+    step = std::chrono::steady_clock::now();
+    if (out->size() > 0) {
+        volatile uint8_t first = out->data()[0];
+        (void)first;
+    }
+    timing->firstTouchMs = elapsedMs(step);
+
+    const std::string& expected = record["md5sum"].asString();
+    if (verify && !expected.empty()) {
+        step = std::chrono::steady_clock::now();
+        if (!checkShard(*out, path, expected, error)) return false;
+        timing->verifyMs = elapsedMs(step);
+        timing->verified = true;
+    }
+    timing->endMs = elapsedMs(origin);
+    return true;
+}
+
+} // namespace
+
+bool WeightStore::load(const ModelSource& source, const WeightLoadOptions& options,
+                       std::string* error) {
+    const auto origin = std::chrono::steady_clock::now();
+    JsonValue manifest;
+    if (!source.parseJson("ndarray-cache.json", &manifest, error)) {
+        return false;
+    }
+
+    const auto& shards = manifest["records"].items();
+    if (shards.empty()) {
+        *error = "ndarray-cache.json lists no shards";
+        return false;
+    }
+
+    // Shards are independent; a few threads keep several reads in flight.
+    shards_.clear();
+    shards_.resize(shards.size());
+    timeline_.assign(shards.size(), ShardLoadTiming());
+    std::vector<std::string> errors(shards.size());
+    std::atomic<size_t> next{0};
+    std::atomic<bool> failed{false};
+    auto worker = [&]() {
+        for (size_t i = next++; i < shards.size() && !failed.load(); i = next++) {
+            if (!loadShard(source, shards[i], options.verifyChecksums, origin, &shards_[i],
+                           &timeline_[i], &errors[i])) {
+                failed = true;
+            }
+        }
+    };
+    const int threads = std::max(1, std::min(options.ioThreads, static_cast<int>(shards.size())));
+    std::vector<std::thread> helpers;
+    for (int t = 1; t < threads; ++t) helpers.emplace_back(worker);
+    worker();
+    for (auto& helper : helpers) helper.join();
+    for (const std::string& shardError : errors) {
+        if (!shardError.empty()) {
+            *error = shardError;
+            return false;
+        }
+    }
+
+    tensors_.clear();
+    checksums_.clear();
+    totalBytes_ = 0;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        const JsonValue& shard = shards[i];
+        checksums_.push_back(shard["md5sum"].asString());
+        const std::string& path = timeline_[i].name;
+        const size_t shardBytes = timeline_[i].bytes;
+        totalBytes_ += shardBytes;
+
+        for (const JsonValue& record : shard["records"].items()) {
+            TensorView view;
+            view.dtype = parseDType(record["dtype"].asString());
+            view.nbytes = static_cast<size_t>(record["nbytes"].asInt());
+            for (const JsonValue& dim : record["shape"].items()) view.shape.push_back(dim.asInt());
+            const size_t offset = static_cast<size_t>(record["byteOffset"].asInt());
+            if (offset + view.nbytes > shardBytes) {
+                *error = "tensor " + record["name"].asString() + " overruns " + path;
+                return false;
+            }
+            view.data = shards_[i].data() + offset;
+            tensors_[record["name"].asString()] = std::move(view);
+        }
+        [[maybe_unused]] const ShardLoadTiming& t = timeline_[i];
+        LOGD("%s: %zu KB, start %.1f, map %.2f, first touch %.2f, verify %.1f, done %.1f ms",
+             t.name.c_str(), t.bytes >> 10, t.startMs, t.mapMs, t.firstTouchMs, t.verifyMs,
+             t.endMs);
+    }
+    LOGI("Mapped %zu shards (%zu MB) on %d I/O threads in %.0f ms%s", shards.size(),
+         totalBytes_ >> 20, threads, elapsedMs(origin),
+         options.verifyChecksums ? ", checksums verified" : "");
+    return true;
+}
+
+bool WeightStore::verifyShard(size_t index, std::string* error) const {
+    return checkShard(shards_[index], timeline_[index].name, checksums_[index], error);
+}
+
+const TensorView* WeightStore::find(const std::string& name) const {
+    auto it = tensors_.find(name);
+    return it == tensors_.end() ? nullptr : &it->second;
+}
+
+} // namespace nimittam
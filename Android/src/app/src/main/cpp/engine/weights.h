@@ -0,0 +1,109 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Weight shards described by ndarray-cache.json.
+ *
+ * MLC lays parameters out as raw shards (params_shard_N.bin); the cache
+ * manifest names every tensor with its shard, byte offset, dtype and
+ * shape. The store maps the shards read-only and hands out typed views
+ * into the mappings by name: weights are used in place, never copied to
+ * the heap, and stay evictable page cache rather than anonymous memory.
+ *
+ * Shards are mapped and checked against the manifest's md5sum on a few
+ * I/O threads at once, and each shard's load is timed stage by stage so
+ * cold-start cost can be attributed. Verification can also be left to
+ * verifyShard() later, off the load's critical path.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mapped_file.h"
+
+namespace nimittam {
+
+class ModelSource;
+
+enum class DType {
+    Float16,
+    Float32,
+    UInt32,
+    Unknown
+};
+
+struct TensorView {
+    const void* data = nullptr;
+    DType dtype = DType::Unknown;
+    std::vector<int64_t> shape;
+    size_t nbytes = 0;
+
+    int64_t dim(size_t i) const { return i < shape.size() ? shape[i] : 1; }
+};
+
+/** How one shard's load went; times in ms from the start of WeightStore::load(). */
+struct ShardLoadTiming {
+    std::string name;
+    size_t bytes = 0;
+    double startMs = 0.0;
+    double mapMs = 0.0;         // open + mmap
+    double firstTouchMs = 0.0;  // fault in the first page
+    double verifyMs = 0.0;      // md5 over the whole shard; 0 if not verified
+    double endMs = 0.0;
+    bool verified = false;
+};
+
+struct WeightLoadOptions {
+    // Check each shard against the manifest's md5sum. Reads every page.
+    bool verifyChecksums = true;
+    // Upper bound on concurrent shard loads.
+    int ioThreads = 4;
+};
+
+class WeightStore {
+public:
+    /**
+     * Map every shard listed in ndarray-cache.json of [source]. Fails if a
+     * shard is missing, has the wrong size or (when verifying) the wrong
+     * checksum.
+     */
+    bool load(const ModelSource& source, const WeightLoadOptions& options, std::string* error);
+
+    /** Lookup by parameter name; nullptr if absent. */
+    const TensorView* find(const std::string& name) const;
+
+    /** Every tensor by parameter name. */
+    const std::unordered_map<std::string, TensorView>& tensors() const { return tensors_; }
+
+    size_t shardCount() const { return shards_.size(); }
+
+    /**
+     * Check shard [index] against the manifest's md5sum; true if it
+     * matches or the manifest has none. Reads every page of the shard.
+     */
+    bool verifyShard(size_t index, std::string* error) const;
+
+    /** Total bytes of weight data mapped. */
+    size_t totalBytes() const { return totalBytes_; }
+
+    /** Per-shard timeline of the last load(), in manifest order. */
+    const std::vector<ShardLoadTiming>& loadTimeline() const { return timeline_; }
+
+private:
+    std::vector<MappedFile> shards_;
+    std::unordered_map<std::string, TensorView> tensors_;
+    std::vector<ShardLoadTiming> timeline_;
+    std::vector<std::string> checksums_;  // manifest md5sum per shard
+    size_t totalBytes_ = 0;
+};
+
+} // namespace nimittam
@@ -0,0 +1,127 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "zip_archive.h"
+
+#include "mapped_file.h"
+
+namespace nimittam {
+
+namespace {
+
+constexpr uint32_t kEndOfCentralDirSig = 0x06054b50;
+constexpr uint32_t kCentralDirEntrySig = 0x02014b50;
+constexpr uint32_t kLocalHeaderSig = 0x04034b50;
+constexpr size_t kEndOfCentralDirBytes = 22;
+constexpr size_t kCentralDirEntryBytes = 46;
+constexpr size_t kLocalHeaderBytes = 30;
+constexpr size_t kMaxCommentBytes = 0xffff;
+
+uint16_t read16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | p[1] << 8);
+}
+
+uint32_t read32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 |
+           static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+} // namespace
+
+bool ZipArchive::open(const std::string& path, std::string* error) {
+    entries_.clear();
+    path_ = path;
+    // Mapping the whole archive only reserves address space; the
+    // directory pages are the only ones read.
+    MappedFile file;
+    if (!file.open(path, error)) return false;
+    const uint8_t* data = file.data();
+    const size_t size = file.size();
+    if (size < kEndOfCentralDirBytes) {
+        *error = path + " is not a zip archive";
+        return false;
+    }
+
+    // The end record sits before a trailing comment of up to 64 KB.
+    const size_t lowest = size > kEndOfCentralDirBytes + kMaxCommentBytes
+                                  ? size - kEndOfCentralDirBytes - kMaxCommentBytes
+                                  : 0;
+    const uint8_t* end = nullptr;
+    for (size_t pos = size - kEndOfCentralDirBytes + 1; pos-- > lowest;) {
+        if (read32(data + pos) == kEndOfCentralDirSig) {
+            end = data + pos;
+            break;
+        }
+    }
+    if (!end) {
+        *error = path + " is not a zip archive";
+        return false;
+    }
+    const uint16_t count = read16(end + 10);
+    const uint32_t dirSize = read32(end + 12);
+    const uint32_t dirOffset = read32(end + 16);
+    if (count == 0xffff || dirOffset == 0xffffffffu) {
+        *error = path + " is a zip64 archive";
+        return false;
+    }
+    if (static_cast<uint64_t>(dirOffset) + dirSize > size) {
+        *error = path + ": central directory past the end of the archive";
+        return false;
+    }
+
+    const uint8_t* p = data + dirOffset;
+    const uint8_t* dirEnd = p + dirSize;
+    for (uint16_t i = 0; i < count; ++i) {
+        if (p + kCentralDirEntryBytes > dirEnd || read32(p) != kCentralDirEntrySig) {
+            *error = path + ": corrupt central directory";
+            return false;
+        }
+        const uint16_t method = read16(p + 10);
+        const uint32_t compressedSize = read32(p + 20);
+        const uint32_t uncompressedSize = read32(p + 24);
+        const uint16_t nameLength = read16(p + 28);
+        const uint16_t extraLength = read16(p + 30);
+        const uint16_t commentLength = read16(p + 32);
+        const uint32_t localOffset = read32(p + 42);
+        const uint8_t* name = p + kCentralDirEntryBytes;
+        p = name + nameLength + extraLength + commentLength;
+        if (p > dirEnd) {
+            *error = path + ": corrupt central directory";
+            return false;
+        }
+
+        // The local header's name and extra fields can differ in length
+        // from the central copy (zipalign pads the local extra field).
+        if (static_cast<uint64_t>(localOffset) + kLocalHeaderBytes > size ||
+            read32(data + localOffset) != kLocalHeaderSig) {
+            *error = path + ": bad local header for " +
+                     std::string(reinterpret_cast<const char*>(name), nameLength);
+            return false;
+        }
+        const uint8_t* local = data + localOffset;
+        Entry entry;
+        entry.dataOffset = static_cast<uint64_t>(localOffset) + kLocalHeaderBytes +
+                           read16(local + 26) + read16(local + 28);
+        entry.size = uncompressedSize;
+        entry.compressedSize = compressedSize;
+        entry.stored = method == 0;
+        if (entry.dataOffset + compressedSize > size) {
+            *error = path + ": entry past the end of the archive";
+            return false;
+        }
+        entries_[std::string(reinterpret_cast<const char*>(name), nameLength)] = entry;
+    }
+    return true;
+}
+
+const ZipArchive::Entry* ZipArchive::find(const std::string& name) const {
+    auto it = entries_.find(name);
+    return it == entries_.end() ? nullptr : &it->second;
+}
+
+} // namespace nimittam
@@ -0,0 +1,48 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Index of a zip archive's entries, such as an installed APK.
+ *
+ * Only the central directory is read. Entries stored without
+ * compression (noCompress assets) can then be mapped straight from the
+ * archive at dataOffset; compressed entries are listed but not readable
+ * here. Zip64 archives are not supported.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+namespace nimittam {
+
+class ZipArchive {
+public:
+    struct Entry {
+        uint64_t dataOffset = 0;  // first byte of the entry's data in the archive
+        uint64_t size = 0;        // uncompressed size
+        uint64_t compressedSize = 0;
+        bool stored = false;      // method 0: the data is the file itself
+    };
+
+    bool open(const std::string& path, std::string* error);
+
+    /** Entry by its full name inside the archive; nullptr if absent. */
+    const Entry* find(const std::string& name) const;
+
+    const std::string& path() const { return path_; }
+    size_t entryCount() const { return entries_.size(); }
+
+private:
+    std::string path_;
+    std::unordered_map<std::string, Entry> entries_;
+};
+
+} // namespace nimittam
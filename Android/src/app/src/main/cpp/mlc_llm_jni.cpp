@@ -15,56 +15,51 @@
  * - OpenCL GPU (fallback)
  * - CPU (universal fallback)
  * 
+ * The CPU path is served by the in-tree reference engine (engine/),
+ * which runs Qwen2 q4f16_1 weights directly and also builds as a plain
+ * Linux library for host benchmarking.
+ * 
  * Build Requirements:
  * - Android NDK r26+
  * - CMake 3.22+
- * - MLC-LLM pre-built libraries (tvm_runtime, mlc_llm)
  */
 
 #include <jni.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
 #include <string>
 #include <memory>
-#include <android/log.h>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 #include <dlfcn.h>
 
-#define LOG_TAG "MlcLlmJni"
-#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
-#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
-#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
-
-// Forward declarations for MLC-LLM types
-// These would be provided by the MLC-LLM headers
-namespace mlc {
-namespace llm {
-    class LLMChat;
-    class ChatModule;
-}
-}
-
-// Backend types matching Kotlin HardwareBackend enum
-enum class Backend {
-    CPU = 0,
-    VULKAN_GPU = 1,
-    OPENCL_GPU = 2,
-    NPU_HEXAGON = 3,
-    NPU_MEDIATEK = 4,
-    METAL_GPU = 5
-};
+#include "engine/cancellation.h"
+#include "engine/cpu_features.h"
+#include "engine/detokenizer.h"
+#include "engine/engine.h"
+#include "engine/generation_loop.h"
+#include "engine/grammar.h"
+#include "engine/kernels.h"
+#include "engine/kv_quant.h"
+#include "engine/token_ring.h"
+#include "engine/log.h"
 
-// KV Cache types
-enum class KvCacheType {
-    F32 = 0,
-    F16 = 1,
-    Q8_0 = 2,
-    Q4_0 = 3
-};
+using nimittam::Backend;
+using nimittam::KvCacheType;
 
 /**
  * Engine state holder
  */
 struct MlcLlmState {
-    // MLC-LLM chat module pointer
-    void* chatModule = nullptr;
+    // CPU inference engine
+    std::unique_ptr<nimittam::Engine> chatModule;
+    
+    // Its weights, read without callMutex by the warm-up and timeline
+    // queries; set before the handle is published and never reset, so
+    // they stay valid after nativeRelease drops chatModule
+    std::shared_ptr<const nimittam::LoadedModel> model;
     
     // Configuration
     Backend backend = Backend::CPU;
@@ -75,24 +70,278 @@ struct MlcLlmState {
     bool useFlashAttention = true;
     KvCacheType kvCacheType = KvCacheType::F16;
     
-    // Generation state
-    bool isGenerating = false;
-    bool shouldStop = false;
+    // Generation state, read from Kotlin threads while the decode thread runs
+    std::atomic<bool> isGenerating{false};
+    
+    // Cancellation token of the current prompt/generation request
+    std::mutex requestMutex;
+    std::shared_ptr<nimittam::CancellationToken> request;
     
-    // Token buffer
-    std::string pendingToken;
+    // Streamed tokens, shared with Kotlin as a direct ByteBuffer
+    std::unique_ptr<nimittam::TokenRing> tokenRing;
     
-    ~MlcLlmState() {
-        // Cleanup would happen here
-        if (chatModule) {
-            // mlc_llm_free(chatModule);
-            chatModule = nullptr;
+    // Matcher of the last grammar or JSON schema asked for, kept so its
+    // masks carry over to the next request using it (under callMutex);
+    // declared before the loop that reads it so it is destroyed after
+    std::string grammarKey;
+    std::unique_ptr<nimittam::GrammarMatcher> grammar;
+    
+    // Background decode loop for streaming generation
+    std::unique_ptr<nimittam::GenerationLoop> generationLoop;
+    
+    // Serializes prompt/generate/reset on this handle
+    std::mutex callMutex;
+    
+    // nativeGenerate's text, reused from token to token (under callMutex)
+    nimittam::Detokenizer detokenizer;
+    std::string piece;
+    std::vector<jchar> utf16;
+    
+    /**
+     * Wait out a streaming generation before touching the engine from a
+     * JNI call. Returns false if nativeRelease tore the engine down while
+     * the caller waited for the lock, so a handle released mid-call acts
+     * like a stale one. Caller holds callMutex.
+     */
+    bool awaitGeneration() {
+        if (!chatModule) {
+            return false;
         }
+        generationLoop->join();
+        return true;
+    }
+    
+    /**
+     * Start a new request with a fresh cancellation token. A stop aimed
+     * at an earlier request does not carry over, and neither do bytes
+     * the detokenizer was holding back. Caller holds callMutex.
+     */
+    std::shared_ptr<nimittam::CancellationToken> beginRequest() {
+        detokenizer.reset();
+        auto token = std::make_shared<nimittam::CancellationToken>();
+        std::lock_guard<std::mutex> lock(requestMutex);
+        request = token;
+        return token;
+    }
+    
+    /**
+     * Matcher for GBNF [source], or for a JSON schema when [isSchema],
+     * reusing the previous one when the grammar is unchanged; nullptr
+     * with [error] filled if it does not compile. Caller holds
+     * callMutex with no generation running.
+     */
+    nimittam::GrammarMatcher* grammarFor(const std::string& source, bool isSchema,
+                                         std::string* error) {
+        std::string key = (isSchema ? "schema:" : "gbnf:") + source;
+        if (grammar && key == grammarKey) {
+            return grammar.get();
+        }
+        auto compiled = std::make_shared<nimittam::Grammar>();
+        bool ok = isSchema ? nimittam::Grammar::fromJsonSchema(source, compiled.get(), error)
+                           : nimittam::Grammar::parse(source, compiled.get(), error);
+        if (!ok) {
+            return nullptr;
+        }
+        const auto& config = chatModule->modelConfig();
+        grammar = std::make_unique<nimittam::GrammarMatcher>(
+            std::move(compiled), chatModule->tokenizer(), config.vocabSize, config.stopTokenIds);
+        grammarKey = std::move(key);
+        return grammar.get();
+    }
+    
+    std::shared_ptr<nimittam::CancellationToken> currentRequest() {
+        std::lock_guard<std::mutex> lock(requestMutex);
+        return request;
     }
 };
 
-// Store engine instances
-static std::unique_ptr<MlcLlmState> g_state;
+/**
+ * Rings a Kotlin NativeTokenCallback when the decode thread has
+ * published tokens to the ring; the collector drains the ring itself.
+ * Attaches the decode thread to the VM on first use and detaches when
+ * the generation finishes.
+ */
+class JniTokenSink : public nimittam::TokenSink {
+public:
+    static std::unique_ptr<JniTokenSink> create(JNIEnv* env, jobject callback,
+                                                std::atomic<bool>* generating) {
+        JavaVM* vm = nullptr;
+        if (env->GetJavaVM(&vm) != JNI_OK) {
+            return nullptr;
+        }
+        jclass cls = env->GetObjectClass(callback);
+        jmethodID onTokensAvailable = env->GetMethodID(cls, "onTokensAvailable", "()V");
+        jmethodID onComplete = env->GetMethodID(cls, "onComplete", "(IIDDID)V");
+        env->DeleteLocalRef(cls);
+        if (!onTokensAvailable || !onComplete) {
+            env->ExceptionClear();
+            LOGE("NativeTokenCallback methods not found");
+            return nullptr;
+        }
+        auto sink = std::unique_ptr<JniTokenSink>(new JniTokenSink());
+        sink->vm_ = vm;
+        sink->callback_ = env->NewGlobalRef(callback);
+        sink->onTokensAvailable_ = onTokensAvailable;
+        sink->onComplete_ = onComplete;
+        sink->generating_ = generating;
+        return sink;
+    }
+    
+    ~JniTokenSink() override {
+        if (JNIEnv* env = attach()) {
+            env->DeleteGlobalRef(callback_);
+        }
+        if (attached_) {
+            vm_->DetachCurrentThread();
+        }
+    }
+    
+    void onTokensAvailable() override {
+        JNIEnv* env = attach();
+        if (!env) return;
+        env->CallVoidMethod(callback_, onTokensAvailable_);
+        clearException(env);
+    }
+    
+    void onComplete(const nimittam::EngineStats& stats, nimittam::FinishReason reason) override {
+        generating_->store(false);
+        JNIEnv* env = attach();
+        if (!env) return;
+        env->CallVoidMethod(callback_, onComplete_,
+                            static_cast<jint>(stats.promptTokens),
+                            static_cast<jint>(stats.generatedTokens),
+                            static_cast<jdouble>(stats.prefillMs),
+                            static_cast<jdouble>(stats.decodeMs),
+                            static_cast<jint>(reason),
+                            static_cast<jdouble>(stats.stopLatencyMs));
+        clearException(env);
+    }
+    
+private:
+    JniTokenSink() = default;
+    
+    JNIEnv* attach() {
+        if (env_) return env_;
+        JNIEnv* env = nullptr;
+        if (vm_->GetEnv(reinterpret_cast<void**>(&env), JNI_VERSION_1_6) == JNI_OK) {
+            env_ = env;
+        } else if (vm_->AttachCurrentThread(&env, nullptr) == JNI_OK) {
+            env_ = env;
+            attached_ = true;
+        } else {
+            LOGE("Failed to attach decode thread to the JVM");
+        }
+        return env_;
+    }
+    
+    static void clearException(JNIEnv* env) {
+        // A throwing collector must not take down the decode thread.
+        if (env->ExceptionCheck()) {
+            env->ExceptionClear();
+            LOGE("NativeTokenCallback threw");
+        }
+    }
+    
+    JavaVM* vm_ = nullptr;
+    JNIEnv* env_ = nullptr;
+    bool attached_ = false;
+    jobject callback_ = nullptr;
+    jmethodID onTokensAvailable_ = nullptr;
+    jmethodID onComplete_ = nullptr;
+    std::atomic<bool>* generating_ = nullptr;
+};
+
+/**
+ * Engine instances keyed by the opaque handle returned from nativeInit.
+ * Handles are never reused, so a stale handle from Kotlin resolves to
+ * nothing instead of to another session.
+ */
+static std::mutex g_registryMutex;
+static std::unordered_map<jlong, std::shared_ptr<MlcLlmState>> g_engines;
+static jlong g_nextHandle = 1;
+
+static std::shared_ptr<MlcLlmState> lookupState(jlong handle) {
+    std::lock_guard<std::mutex> lock(g_registryMutex);
+    auto it = g_engines.find(handle);
+    if (it == g_engines.end()) {
+        LOGE("Invalid engine handle: %lld", static_cast<long long>(handle));
+        return nullptr;
+    }
+    return it->second;
+}
+
+/**
+ * Java string from well-formed UTF-8. NewStringUTF takes modified UTF-8,
+ * in which a 4-byte sequence (any emoji) is invalid and aborts under
+ * CheckJNI, so this goes through UTF-16 in [scratch] instead.
+ */
+static jstring newJavaString(JNIEnv* env, const std::string& utf8, std::vector<jchar>* scratch) {
+    const auto* p = reinterpret_cast<const unsigned char*>(utf8.data());
+    const size_t size = utf8.size();
+    scratch->clear();
+    for (size_t i = 0; i < size;) {
+        uint32_t cp = p[i];
+        size_t length = 1;
+        if (cp >= 0xF0) {
+            cp &= 0x07;
+            length = 4;
+        } else if (cp >= 0xE0) {
+            cp &= 0x0F;
+            length = 3;
+        } else if (cp >= 0xC0) {
+            cp &= 0x1F;
+            length = 2;
+        }
+        length = std::min(length, size - i);
+        for (size_t k = 1; k < length; ++k) cp = (cp << 6) | (p[i + k] & 0x3F);
+        i += length;
+        if (cp >= 0x10000) {
+            cp -= 0x10000;
+            scratch->push_back(static_cast<jchar>(0xD800 + (cp >> 10)));
+            scratch->push_back(static_cast<jchar>(0xDC00 + (cp & 0x3FF)));
+        } else {
+            scratch->push_back(static_cast<jchar>(cp));
+        }
+    }
+    return env->NewString(scratch->data(), static_cast<jsize>(scratch->size()));
+}
+
+/**
+ * Standard UTF-8 of a Java string. GetStringUTFChars returns modified
+ * UTF-8, which spells characters outside the BMP differently from the
+ * text the model produces.
+ */
+static std::string utf8FromJava(JNIEnv* env, jstring str) {
+    std::string out;
+    const jsize length = env->GetStringLength(str);
+    const jchar* chars = env->GetStringChars(str, nullptr);
+    for (jsize i = 0; i < length; ++i) {
+        uint32_t cp = chars[i];
+        if (cp >= 0xD800 && cp < 0xDC00 && i + 1 < length &&
+            chars[i + 1] >= 0xDC00 && chars[i + 1] < 0xE000) {
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (chars[++i] - 0xDC00);
+        } else if (cp >= 0xD800 && cp < 0xE000) {
+            cp = 0xFFFD;  // unpaired surrogate
+        }
+        if (cp < 0x80) {
+            out += static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            out += static_cast<char>(0xC0 | (cp >> 6));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            out += static_cast<char>(0xE0 | (cp >> 12));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (cp >> 18));
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+    }
+    env->ReleaseStringChars(str, chars);
+    return out;
+}
 
 extern "C" {
 
@@ -158,7 +407,8 @@ Java_com_google_ai_edge_gallery_llm_engine_MlcLlmEngine_nativeInit(
     jint batchSize,
     jint threads,
     jboolean useFlashAttention,
-    jint kvCacheType
+    jint kvCacheType,
+    jstring repackDir
 ) {
     const char* path = env->GetStringUTFChars(modelPath, nullptr);
     LOGI("Initializing MLC-LLM engine with model: %s", path);
@@ -166,34 +416,90 @@ Java_com_google_ai_edge_gallery_llm_engine_MlcLlmEngine_nativeInit(
          backend, gpuLayers, contextSize, batchSize, threads);
     
     // Create state
-    g_state = std::make_unique<MlcLlmState>();
-    g_state->backend = static_cast<Backend>(backend);
-    g_state->gpuLayers = gpuLayers;
-    g_state->contextSize = contextSize;
-    g_state->batchSize = batchSize;
-    g_state->threads = threads;
-    g_state->useFlashAttention = useFlashAttention;
-    g_state->kvCacheType = static_cast<KvCacheType>(kvCacheType);
-    
-    /*
-     * In a full implementation, this would:
-     * 1. Load the MLC-LLM compiled model
-     * 2. Initialize TVM runtime with selected backend
-     * 3. Set up KV cache and memory allocation
-     * 4. Warm up the model
-     * 
-     * Example (pseudocode):
-     * 
-     * tvm::runtime::Module mod = tvm::runtime::Module::LoadFromFile(path);
-     * g_state->chatModule = new mlc::llm::ChatModule(mod, backend_str);
-     * g_state->chatModule->SetConfig(contextSize, batchSize);
-     * g_state->chatModule->WarmUp();
-     */
+    auto state = std::make_shared<MlcLlmState>();
+    state->backend = static_cast<Backend>(backend);
+    state->gpuLayers = gpuLayers;
+    state->contextSize = contextSize;
+    state->batchSize = batchSize;
+    state->threads = threads;
+    state->useFlashAttention = useFlashAttention;
+    state->kvCacheType = static_cast<KvCacheType>(kvCacheType);
     
+    nimittam::EngineOptions options;
+    options.backend = state->backend;
+    options.gpuLayers = gpuLayers;
+    options.contextSize = contextSize;
+    options.batchSize = batchSize;
+    options.threads = threads;
+    options.useFlashAttention = useFlashAttention;
+    options.kvCacheType = state->kvCacheType;
+    if (repackDir) {
+        const char* dir = env->GetStringUTFChars(repackDir, nullptr);
+        options.repackDir = dir;
+        env->ReleaseStringUTFChars(repackDir, dir);
+    }
+    
+    std::string error;
+    state->chatModule = nimittam::Engine::create(path, options, &error);
     env->ReleaseStringUTFChars(modelPath, path);
     
-    LOGI("MLC-LLM engine initialized successfully");
-    return reinterpret_cast<jlong>(g_state.get());
+    if (!state->chatModule) {
+        LOGE("Failed to initialize engine: %s", error.c_str());
+        return 0;
+    }
+    state->model = state->chatModule->loadedModel();
+    state->tokenRing = std::make_unique<nimittam::TokenRing>();
+    state->generationLoop = std::make_unique<nimittam::GenerationLoop>(
+        state->chatModule.get(), state->tokenRing.get());
+    
+    jlong handle;
+    {
+        std::lock_guard<std::mutex> lock(g_registryMutex);
+        handle = g_nextHandle++;
+        g_engines.emplace(handle, std::move(state));
+    }
+    LOGI("MLC-LLM engine initialized successfully (handle %lld)", static_cast<long long>(handle));
+    return handle;
+}
+
+/**
+ * Peak memory nativeInit would lead to with these settings, read from the
+ * model's config and manifest without loading it, as a JSON object:
+ * {"weightBytes":...,"kvCacheBytes":...,"activationBytes":...,
+ * "contextSize":...,"prefillChunk":...}; null if the model is unreadable
+ */
+JNIEXPORT jstring JNICALL
+Java_com_google_ai_edge_gallery_llm_engine_MlcLlmEngine_nativeEstimateMemory(
+    JNIEnv* env,
+    jobject thiz,
+    jstring modelPath,
+    jint contextSize,
+    jint batchSize,
+    jboolean useFlashAttention,
+    jint kvCacheType
+) {
+    nimittam::EngineOptions options;
+    options.contextSize = contextSize;
+    options.batchSize = batchSize;
+    options.useFlashAttention = useFlashAttention;
+    options.kvCacheType = static_cast<KvCacheType>(kvCacheType);
+
+    const char* path = env->GetStringUTFChars(modelPath, nullptr);
+    nimittam::MemoryEstimate estimate;
+    std::string error;
+    const bool ok = nimittam::Engine::estimateMemory(path, options, &estimate, &error);
+    env->ReleaseStringUTFChars(modelPath, path);
+    if (!ok) {
+        LOGE("Failed to estimate engine memory: %s", error.c_str());
+        return nullptr;
+    }
+    char json[256];
+    snprintf(json, sizeof(json),
+             "{\"weightBytes\":%zu,\"kvCacheBytes\":%zu,\"activationBytes\":%zu,"
+             "\"contextSize\":%d,\"prefillChunk\":%d}",
+             estimate.weightBytes, estimate.kvCacheBytes, estimate.activationBytes,
+             estimate.contextSize, estimate.prefillChunk);
+    return env->NewStringUTF(json);
 }
 
 /**
@@ -206,24 +512,22 @@ Java_com_google_ai_edge_gallery_llm_engine_MlcLlmEngine_nativePrompt(
     jlong handle,
     jstring prompt
 ) {
-    if (!g_state) {
-        LOGE("Engine not initialized");
+    auto state = lookupState(handle);
+    if (!state) {
         return -1;
     }
     
     const char* promptStr = env->GetStringUTFChars(prompt, nullptr);
     LOGD("Processing prompt: %.50s...", promptStr);
     
-    /*
-     * In a full implementation:
-     * 
-     * auto* state = reinterpret_cast<MlcLlmState*>(handle);
-     * int numTokens = state->chatModule->Prefill(promptStr);
-     * return numTokens;
-     */
-    
-    // Stub: estimate token count (rough approximation)
-    int tokenCount = strlen(promptStr) / 4;
+    int tokenCount = -1;
+    {
+        std::lock_guard<std::mutex> lock(state->callMutex);
+        if (state->awaitGeneration()) {
+            auto request = state->beginRequest();
+            tokenCount = state->chatModule->prefill(promptStr, request.get());
+        }
+    }
     
     env->ReleaseStringUTFChars(prompt, promptStr);
     
@@ -232,7 +536,45 @@ Java_com_google_ai_edge_gallery_llm_engine_MlcLlmEngine_nativePrompt(
 }
 
 /**
- * Generate next token
+ * Replace the context with a full chat transcript, prefilling only what
+ * follows the prefix already in the KV cache. Returns the number of
+ * tokens prefilled, -1 on overflow or an invalid handle, -2 if stopped.
+ */
+JNIEXPORT jint JNICALL
+Java_com_google_ai_edge_gallery_llm_engine_MlcLlmEngine_nativePromptTranscript(
+    JNIEnv* env,
+    jobject thiz,
+    jlong handle,
+    jstring transcript
+) {
+    auto state = lookupState(handle);
+    if (!state) {
+        return -1;
+    }
+
+    const char* transcriptStr = env->GetStringUTFChars(transcript, nullptr);
+
+    int tokenCount = -1;
+    int reused = 0;
+    {
+        std::lock_guard<std::mutex> lock(state->callMutex);
+        if (state->awaitGeneration()) {
+            auto request = state->beginRequest();
+            tokenCount = state->chatModule->prefillTranscript(transcriptStr, request.get());
+            reused = state->chatModule->stats().reusedTokens;
+        }
+    }
+
+    env->ReleaseStringUTFChars(transcript, transcriptStr);
+
+    LOGD("Transcript processed: %d tokens prefilled, %d reused from cache", tokenCount, reused);
+    return tokenCount;
+}
+
+/**
+ * Generate next token. Returns the text it completes, which is empty
+ * while a character split across tokens is still unfinished, or null
+ * once generation is over.
  */
 JNIEXPORT jstring JNICALL
 Java_com_google_ai_edge_gallery_llm_engine_MlcLlmEngine_nativeGenerate(
@@ -246,47 +588,228 @@ Java_com_google_ai_edge_gallery_llm_engine_MlcLlmEngine_nativeGenerate(
     jfloat repeatPenalty,
     jlong seed
 ) {
-    if (!g_state) {
-        LOGE("Engine not initialized");
+    auto state = lookupState(handle);
+    if (!state) {
         return nullptr;
     }
     
-    if (g_state->shouldStop) {
-        LOGD("Generation stopped by user");
+    std::lock_guard<std::mutex> lock(state->callMutex);
+    if (!state->awaitGeneration()) {
         return nullptr;
     }
+    auto request = state->currentRequest();
+    state->isGenerating = true;
     
-    g_state->isGenerating = true;
-    
-    /*
-     * In a full implementation:
-     * 
-     * auto* state = reinterpret_cast<MlcLlmState*>(handle);
-     * 
-     * mlc::llm::GenerationConfig config;
-     * config.temperature = temperature;
-     * config.top_p = topP;
-     * config.top_k = topK;
-     * config.repetition_penalty = repeatPenalty;
-     * 
-     * std::string token = state->chatModule->Generate(config);
-     * 
-     * if (token.empty() || state->chatModule->IsEOS()) {
-     *     state->isGenerating = false;
-     *     return nullptr;
-     * }
-     * 
-     * return env->NewStringUTF(token.c_str());
-     */
+    nimittam::SamplingParams params;
+    params.temperature = temperature;
+    params.topP = topP;
+    params.topK = topK;
+    params.repeatPenalty = repeatPenalty;
+    params.seed = seed;
+    
+    if (!state->chatModule->generate(maxTokens, params, &state->piece, nullptr, request.get())) {
+        state->isGenerating = false;
+        // A reply ending partway through a character gets U+FFFD for it
+        const std::string& tail = state->detokenizer.finish();
+        return tail.empty() ? nullptr : newJavaString(env, tail, &state->utf16);
+    }
+    
+    return newJavaString(env, state->detokenizer.push(state->piece), &state->utf16);
+}
+
+/**
+ * Start streaming generation on a native thread.
+ *
+ * Tokens are written to the handle's token ring and
+ * callback.onTokensAvailable() is called at most once per batch; the
+ * run ends with exactly one callback.onComplete(promptTokens,
+ * generatedTokens, prefillMs, decodeMs, finishReason, stopLatencyMs),
+ * after the last token has been published. The run ends with
+ * FINISH_STOP_SEQUENCE as soon as the text contains one of
+ * [stopSequences], which is cut from the published text. A non-null
+ * [grammar] (GBNF) or [jsonSchema] restricts every token to replies the
+ * grammar allows, and stop tokens to where it is complete; the compiled
+ * grammar is kept for the next run asking for the same one. The run
+ * belongs to the request opened by the preceding nativePrompt. Returns
+ * false if the handle is invalid, the callback lacks those methods or
+ * the grammar does not compile.
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_google_ai_edge_gallery_llm_engine_MlcLlmEngine_nativeStartGeneration(
+    JNIEnv* env,
+    jobject thiz,
+    jlong handle,
+    jint maxTokens,
+    jfloat temperature,
+    jfloat topP,
+    jint topK,
+    jfloat repeatPenalty,
+    jlong seed,
+    jobjectArray stopSequences,
+    jstring grammar,
+    jstring jsonSchema,
+    jobject callback
+) {
+    auto state = lookupState(handle);
+    if (!state) {
+        return JNI_FALSE;
+    }
+    
+    auto sink = JniTokenSink::create(env, callback, &state->isGenerating);
+    if (!sink) {
+        return JNI_FALSE;
+    }
+    
+    nimittam::SamplingParams params;
+    params.temperature = temperature;
+    params.topP = topP;
+    params.topK = topK;
+    params.repeatPenalty = repeatPenalty;
+    params.seed = seed;
+    
+    std::vector<std::string> stops;
+    const jsize stopCount = stopSequences ? env->GetArrayLength(stopSequences) : 0;
+    for (jsize i = 0; i < stopCount; ++i) {
+        auto stop = static_cast<jstring>(env->GetObjectArrayElement(stopSequences, i));
+        if (!stop) continue;
+        stops.push_back(utf8FromJava(env, stop));
+        env->DeleteLocalRef(stop);
+    }
     
-    // Stub implementation for testing
-    // Returns empty to signal end of generation
-    g_state->isGenerating = false;
-    return nullptr;
+    std::lock_guard<std::mutex> lock(state->callMutex);
+    if (!state->awaitGeneration()) {
+        return JNI_FALSE;
+    }
+    nimittam::GrammarMatcher* matcher = nullptr;
+    if (grammar || jsonSchema) {
+        std::string error;
+        matcher = state->grammarFor(utf8FromJava(env, grammar ? grammar : jsonSchema),
+                                    grammar == nullptr, &error);
+        if (!matcher) {
+            LOGE("Invalid %s: %s", grammar ? "grammar" : "JSON schema", error.c_str());
+            return JNI_FALSE;
+        }
+    }
+    auto request = state->currentRequest();
+    if (!request) {
+        request = state->beginRequest();
+    }
+    state->isGenerating = true;
+    state->generationLoop->start(maxTokens, params, std::move(sink), std::move(request), stops,
+                                 matcher);
+    return JNI_TRUE;
+}
+
+/**
+ * Direct ByteBuffer over the handle's token ring (layout in
+ * engine/token_ring.h). The buffer is valid until nativeRelease.
+ */
+JNIEXPORT jobject JNICALL
+Java_com_google_ai_edge_gallery_llm_engine_MlcLlmEngine_nativeGetTokenRing(
+    JNIEnv* env,
+    jobject thiz,
+    jlong handle
+) {
+    auto state = lookupState(handle);
+    if (!state || !state->tokenRing) {
+        return nullptr;
+    }
+    return env->NewDirectByteBuffer(state->tokenRing->buffer(),
+                                    static_cast<jlong>(state->tokenRing->bufferBytes()));
+}
+
+/**
+ * Fraction of the model weights resident in memory (0 to 1, reaching 1
+ * only once background verification has passed), or -1 if it found them
+ * corrupt. Safe to call while nativeRelease runs.
+ */
+JNIEXPORT jfloat JNICALL
+Java_com_google_ai_edge_gallery_llm_engine_MlcLlmEngine_nativeGetWarmUpProgress(
+    JNIEnv* env,
+    jobject thiz,
+    jlong handle
+) {
+    auto state = lookupState(handle);
+    if (!state) {
+        return -1.0f;
+    }
+    return state->model->warmUpProgress();
+}
+
+/**
+ * Per-shard weight load timeline as a JSON array, one object per shard
+ * in manifest order with its name, size and stage times in ms
+ */
+JNIEXPORT jstring JNICALL
+Java_com_google_ai_edge_gallery_llm_engine_MlcLlmEngine_nativeGetLoadTimeline(
+    JNIEnv* env,
+    jobject thiz,
+    jlong handle
+) {
+    auto state = lookupState(handle);
+    if (!state) {
+        return nullptr;
+    }
+    std::string json = "[";
+    char entry[256];
+    for (const nimittam::ShardLoadTiming& t : state->model->weights.loadTimeline()) {
+        snprintf(entry, sizeof(entry),
+                 "%s{\"bytes\":%zu,\"startMs\":%.3f,\"mapMs\":%.3f,\"firstTouchMs\":%.3f,"
+                 "\"verifyMs\":%.3f,\"endMs\":%.3f,\"verified\":%s,\"name\":\"",
+                 json.size() > 1 ? "," : "", t.bytes, t.startMs, t.mapMs, t.firstTouchMs,
+                 t.verifyMs, t.endMs, t.verified ? "true" : "false");
+        json += entry;
+        for (char c : t.name) {
+            if (c == '"' || c == '\\') json += '\\';
+            json += c;
+        }
+        json += "\"}";
+    }
+    json += "]";
+    return env->NewStringUTF(json.c_str());
+}
+
+/**
+ * CPU features detected at runtime and the kernel variants they selected,
+ * as a JSON object: {"cpuFeatures":"asimd,asimddp,...","q4Kernels":...,
+ * "kvQuantKernels":...}
+ */
+JNIEXPORT jstring JNICALL
+Java_com_google_ai_edge_gallery_llm_engine_MlcLlmEngine_nativeGetCpuKernels(
+    JNIEnv* env,
+    jobject thiz
+) {
+    // Names are plain identifiers; nothing to escape.
+    std::string json = "{\"cpuFeatures\":\"" + nimittam::cpuFeatureList() +
+                       "\",\"q4Kernels\":\"" + nimittam::q4KernelName() +
+                       "\",\"kvQuantKernels\":\"" + nimittam::kvQuantKernelName() + "\"}";
+    return env->NewStringUTF(json.c_str());
+}
+
+/**
+ * Release ring bytes up to readIndex and return the current write
+ * index. The load/store pair gives the Kotlin consumer the
+ * acquire/release ordering a plain ByteBuffer read cannot.
+ */
+JNIEXPORT jlong JNICALL
+Java_com_google_ai_edge_gallery_llm_engine_MlcLlmEngine_nativeRingPoll(
+    JNIEnv* env,
+    jobject thiz,
+    jlong handle,
+    jlong readIndex
+) {
+    auto state = lookupState(handle);
+    if (!state || !state->tokenRing) {
+        return -1;
+    }
+    state->tokenRing->setReadIndex(static_cast<uint64_t>(readIndex));
+    return static_cast<jlong>(state->tokenRing->writeIndex());
 }
 
 /**
- * Stop generation
+ * Cancel the current request. Prefill and decode poll the token inside
+ * the model, so the worker threads go idle within one parallel chunk;
+ * the measured latency is reported through onComplete.
  */
 JNIEXPORT void JNICALL
 Java_com_google_ai_edge_gallery_llm_engine_MlcLlmEngine_nativeStopGeneration(
@@ -294,8 +817,10 @@ Java_com_google_ai_edge_gallery_llm_engine_MlcLlmEngine_nativeStopGeneration(
     jobject thiz,
     jlong handle
 ) {
-    if (g_state) {
-        g_state->shouldStop = true;
+    if (auto state = lookupState(handle)) {
+        if (auto request = state->currentRequest()) {
+            request->cancel();
+        }
         LOGI("Generation stop requested");
     }
 }
@@ -309,15 +834,80 @@ Java_com_google_ai_edge_gallery_llm_engine_MlcLlmEngine_nativeResetContext(
     jobject thiz,
     jlong handle
 ) {
-    if (g_state) {
-        /*
-         * In a full implementation:
-         * auto* state = reinterpret_cast<MlcLlmState*>(handle);
-         * state->chatModule->ResetKVCache();
-         */
-        g_state->shouldStop = false;
-        LOGI("Context reset");
+    if (auto state = lookupState(handle)) {
+        std::lock_guard<std::mutex> lock(state->callMutex);
+        if (state->awaitGeneration()) {
+            state->chatModule->resetContext();
+            LOGI("Context reset");
+        }
+    }
+}
+
+/**
+ * Write the conversation's tokens and KV cache to a snapshot file
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_google_ai_edge_gallery_llm_engine_MlcLlmEngine_nativeSaveContext(
+    JNIEnv* env,
+    jobject thiz,
+    jlong handle,
+    jstring path
+) {
+    auto state = lookupState(handle);
+    if (!state) {
+        return JNI_FALSE;
+    }
+
+    const char* pathStr = env->GetStringUTFChars(path, nullptr);
+    std::string error;
+    bool saved = false;
+    {
+        std::lock_guard<std::mutex> lock(state->callMutex);
+        if (state->awaitGeneration()) {
+            saved = state->chatModule->saveContext(pathStr, &error);
+        } else {
+            error = "engine released";
+        }
+    }
+    if (!saved) {
+        LOGE("Failed to save context to %s: %s", pathStr, error.c_str());
+    }
+    env->ReleaseStringUTFChars(path, pathStr);
+    return saved ? JNI_TRUE : JNI_FALSE;
+}
+
+/**
+ * Restore a conversation saved by nativeSaveContext; the current one is
+ * kept if the snapshot is missing or belongs to another model
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_google_ai_edge_gallery_llm_engine_MlcLlmEngine_nativeLoadContext(
+    JNIEnv* env,
+    jobject thiz,
+    jlong handle,
+    jstring path
+) {
+    auto state = lookupState(handle);
+    if (!state) {
+        return JNI_FALSE;
+    }
+
+    const char* pathStr = env->GetStringUTFChars(path, nullptr);
+    std::string error;
+    bool loaded = false;
+    {
+        std::lock_guard<std::mutex> lock(state->callMutex);
+        if (state->awaitGeneration()) {
+            loaded = state->chatModule->loadContext(pathStr, &error);
+        } else {
+            error = "engine released";
+        }
     }
+    if (!loaded) {
+        LOGE("Failed to load context from %s: %s", pathStr, error.c_str());
+    }
+    env->ReleaseStringUTFChars(path, pathStr);
+    return loaded ? JNI_TRUE : JNI_FALSE;
 }
 
 /**
@@ -329,10 +919,25 @@ Java_com_google_ai_edge_gallery_llm_engine_MlcLlmEngine_nativeRelease(
     jobject thiz,
     jlong handle
 ) {
-    if (g_state) {
-        g_state.reset();
-        LOGI("Engine released");
+    std::shared_ptr<MlcLlmState> state;
+    {
+        std::lock_guard<std::mutex> lock(g_registryMutex);
+        auto it = g_engines.find(handle);
+        if (it == g_engines.end()) {
+            return;
+        }
+        state = std::move(it->second);
+        g_engines.erase(it);
+    }
+    // Cancel first so an in-flight prefill or decode returns promptly,
+    // then wait for it before tearing down.
+    if (auto request = state->currentRequest()) {
+        request->cancel();
     }
+    std::lock_guard<std::mutex> lock(state->callMutex);
+    state->generationLoop.reset();
+    state->chatModule.reset();
+    LOGI("Engine released (handle %lld)", static_cast<long long>(handle));
 }
 
 } // extern "C"
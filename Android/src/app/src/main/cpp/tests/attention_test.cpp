@@ -0,0 +1,156 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "attention.h"
+#include "kv_cache.h"
+#include "test_util.h"
+
+using namespace nimittam;
+
+namespace {
+
+constexpr int kHeads = 4;
+constexpr int kKvHeads = 2;
+constexpr int kHeadDim = 64;
+constexpr int kKvDim = kKvHeads * kHeadDim;
+constexpr int kContext = 256;
+
+struct Fixture {
+    KvCache cache;
+    std::vector<float> keys;    // [kContext, kKvDim]
+    std::vector<float> values;  // [kContext, kKvDim]
+
+    explicit Fixture(KvCacheType type) {
+        std::string error;
+        EXPECT_TRUE(cache.init(1, kContext, kKvDim, type, &error));
+        cache.reserve(kContext);
+        std::mt19937 rng(23);
+        std::normal_distribution<float> normal;
+        keys.resize(static_cast<size_t>(kContext) * kKvDim);
+        values.resize(keys.size());
+        for (auto& k : keys) k = normal(rng);
+        for (auto& v : values) v = normal(rng);
+        for (int t = 0; t < kContext; ++t) {
+            cache.store(0, t, keys.data() + static_cast<size_t>(t) * kKvDim,
+                        values.data() + static_cast<size_t>(t) * kKvDim);
+        }
+    }
+};
+
+AttentionArgs makeArgs(const KvCache& cache, int pos, int n, const std::vector<float>& q,
+                       std::vector<float>* out) {
+    AttentionArgs args;
+    args.cache = &cache;
+    args.pos = pos;
+    args.n = n;
+    args.headDim = kHeadDim;
+    args.groupSize = kHeads / kKvHeads;
+    args.scale = 1.0f / std::sqrt(static_cast<float>(kHeadDim));
+    args.q = q.data();
+    args.qStride = kHeads * kHeadDim;
+    out->assign(static_cast<size_t>(n) * kHeads * kHeadDim, 0.0f);
+    args.out = out->data();
+    args.outStride = kHeads * kHeadDim;
+    return args;
+}
+
+std::vector<float> randomQueries(int n, float magnitude, std::mt19937& rng) {
+    std::normal_distribution<float> normal(0.0f, magnitude);
+    std::vector<float> q(static_cast<size_t>(n) * kHeads * kHeadDim);
+    for (auto& v : q) v = normal(rng);
+    return q;
+}
+
+void runFlash(const AttentionArgs& args) {
+    // Split the queries unevenly to check ranges that do not start at 0.
+    const int split = args.n / 3;
+    for (int h = 0; h < kHeads; ++h) {
+        flashAttention(args, h, 0, split);
+        flashAttention(args, h, split, args.n);
+    }
+}
+
+// Softmax(q K^T) V in double, straight from the float keys and values.
+void testFlashMatchesReference() {
+    Fixture f(KvCacheType::F32);
+    std::mt19937 rng(29);
+    const struct {
+        int pos;
+        int n;
+        float magnitude;  // larger queries make peakier softmaxes
+    } cases[] = {{0, 37, 1.0f}, {150, 20, 1.0f}, {199, 1, 1.0f}, {60, 70, 8.0f}};
+    for (const auto& c : cases) {
+        const std::vector<float> q = randomQueries(c.n, c.magnitude, rng);
+        std::vector<float> out;
+        const AttentionArgs args = makeArgs(f.cache, c.pos, c.n, q, &out);
+        runFlash(args);
+
+        for (int b = 0; b < c.n; ++b) {
+            const int length = c.pos + b + 1;
+            for (int h = 0; h < kHeads; ++h) {
+                const float* qh = q.data() + static_cast<size_t>(b) * args.qStride + h * kHeadDim;
+                const int kvOffset = (h / args.groupSize) * kHeadDim;
+                std::vector<double> scores(length);
+                double max = -1e300;
+                for (int t = 0; t < length; ++t) {
+                    const float* k = f.keys.data() + static_cast<size_t>(t) * kKvDim + kvOffset;
+                    double s = 0.0;
+                    for (int i = 0; i < kHeadDim; ++i) s += static_cast<double>(qh[i]) * k[i];
+                    scores[t] = s * args.scale;
+                    max = std::max(max, scores[t]);
+                }
+                double sum = 0.0;
+                for (double& s : scores) sum += (s = std::exp(s - max));
+                const float* actual = out.data() + static_cast<size_t>(b) * args.outStride +
+                                      h * kHeadDim;
+                for (int i = 0; i < kHeadDim; ++i) {
+                    double expected = 0.0;
+                    for (int t = 0; t < length; ++t) {
+                        expected += scores[t] / sum *
+                                    f.values[static_cast<size_t>(t) * kKvDim + kvOffset + i];
+                    }
+                    EXPECT_NEAR(actual[i], expected, 1e-4);
+                }
+            }
+        }
+    }
+}
+
+// Both read the cache through the same row kernels, so they agree for every type.
+void testFlashMatchesNaive() {
+    for (KvCacheType type : {KvCacheType::F32, KvCacheType::F16, KvCacheType::Q8_0,
+                             KvCacheType::Q4_0}) {
+        Fixture f(type);
+        std::mt19937 rng(31);
+        const int pos = 100;
+        const int n = 45;
+        const std::vector<float> q = randomQueries(n, 2.0f, rng);
+        std::vector<float> flash;
+        std::vector<float> naive;
+        const AttentionArgs flashArgs = makeArgs(f.cache, pos, n, q, &flash);
+        const AttentionArgs naiveArgs = makeArgs(f.cache, pos, n, q, &naive);
+        runFlash(flashArgs);
+        std::vector<float> scores(pos + n);
+        for (int h = 0; h < kHeads; ++h) naiveAttention(naiveArgs, h, scores.data());
+        for (size_t i = 0; i < flash.size(); ++i) EXPECT_NEAR(flash[i], naive[i], 1e-4);
+    }
+}
+
+} // namespace
+
+int main() {
+    testFlashMatchesReference();
+    testFlashMatchesNaive();
+    return test::finish("attention_test");
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <algorithm>
+#include <random>
+#include <string>
+
+#include "detokenizer.h"
+#include "test_util.h"
+
+using namespace nimittam;
+
+namespace {
+
+const std::string kFffd = "\xEF\xBF\xBD";
+
+void testHoldsBackSplitCharacters() {
+    Detokenizer detokenizer;
+    // U+1F600 one byte per token.
+    EXPECT_EQ(detokenizer.push("\xF0"), "");
+    EXPECT_EQ(detokenizer.push("\x9F"), "");
+    EXPECT_EQ(detokenizer.pendingBytes(), 2u);
+    EXPECT_EQ(detokenizer.push("\x98"), "");
+    EXPECT_EQ(detokenizer.push("\x80"), "\xF0\x9F\x98\x80");
+    EXPECT_EQ(detokenizer.pendingBytes(), 0u);
+
+    // Two CJK characters straddling three tokens, with ASCII around them.
+    EXPECT_EQ(detokenizer.push("a \xE6\x97"), "a ");
+    EXPECT_EQ(detokenizer.push("\xA5\xE6"), "\xE6\x97\xA5");
+    EXPECT_EQ(detokenizer.push("\x9C\xAC."), "\xE6\x9C\xAC.");
+    EXPECT_EQ(detokenizer.finish(), "");
+}
+
+void testReplacesIllFormedBytes() {
+    Detokenizer detokenizer;
+    EXPECT_EQ(detokenizer.push("\x80x"), kFffd + "x");
+    // Overlong forms and a surrogate: no prefix of them is valid.
+    EXPECT_EQ(detokenizer.push("\xC0\xAF"), kFffd + kFffd);
+    EXPECT_EQ(detokenizer.push("\xE0\x80\xAF"), kFffd + kFffd + kFffd);
+    EXPECT_EQ(detokenizer.push("\xED\xA0\x80"), kFffd + kFffd + kFffd);
+    EXPECT_EQ(detokenizer.push("\xF4\x90\x80\x80"), kFffd + kFffd + kFffd + kFffd);
+    // A truncated sequence is one U+FFFD; the byte that broke it is kept.
+    EXPECT_EQ(detokenizer.push("\xF0\x9F\x98"), "");
+    EXPECT_EQ(detokenizer.push("y"), kFffd + "y");
+    EXPECT_EQ(detokenizer.push("\xE4\xB8"), "");
+    EXPECT_EQ(detokenizer.push("\xE4\xB8\xAD"), kFffd + "\xE4\xB8\xAD");
+    // The stream ends partway through a character.
+    EXPECT_EQ(detokenizer.push("\xE4"), "");
+    EXPECT_EQ(detokenizer.finish(), kFffd);
+    EXPECT_EQ(detokenizer.pendingBytes(), 0u);
+    EXPECT_EQ(detokenizer.finish(), "");
+}
+
+void testResetDropsPendingBytes() {
+    Detokenizer detokenizer;
+    EXPECT_EQ(detokenizer.push("\xE4\xB8"), "");
+    detokenizer.reset();
+    EXPECT_EQ(detokenizer.push("\xAD" "ok"), kFffd + "ok");
+}
+
+// Well-formed text cut at arbitrary byte offsets comes back unchanged.
+void testRandomSplitsRoundTrip() {
+    const std::string text = "Hello, \xE4\xB8\x96\xE7\x95\x8C! \xF0\x9F\x98\x80\xF0\x9F\x91\x8D "
+                             "caf\xC3\xA9 \xD0\x9F\xD1\x80\xD0\xB8 \xEF\xBF\xBD\xF4\x8F\xBF\xBF\n";
+    std::mt19937 rng(7);
+    Detokenizer detokenizer;
+    for (int round = 0; round < 200; ++round) {
+        std::string out;
+        for (size_t i = 0; i < text.size();) {
+            const size_t length = std::min<size_t>(1 + rng() % 5, text.size() - i);
+            out += detokenizer.push(text.data() + i, length);
+            i += length;
+        }
+        out += detokenizer.finish();
+        EXPECT_EQ(out, text);
+    }
+}
+
+} // namespace
+
+int main() {
+    testHoldsBackSplitCharacters();
+    testReplacesIllFormedBytes();
+    testResetDropsPendingBytes();
+    testRandomSplitsRoundTrip();
+    return test::finish("detokenizer_test");
+}
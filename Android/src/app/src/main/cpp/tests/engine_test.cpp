@@ -0,0 +1,438 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * End-to-end checks against the bundled Qwen2.5-0.5B weights.
+ */
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "engine.h"
+#include "generation_loop.h"
+#include "kv_snapshot.h"
+#include "token_ring.h"
+#include "test_util.h"
+
+using namespace nimittam;
+
+namespace {
+
+const char* kPrompt =
+        "<|im_start|>user\nName three primary colors.<|im_end|>\n<|im_start|>assistant\n";
+
+EngineOptions testOptions() {
+    EngineOptions options;
+    options.contextSize = 256;
+    options.threads = 2;
+    return options;
+}
+
+SamplingParams greedy() {
+    SamplingParams params;
+    params.temperature = 0.0f;
+    return params;
+}
+
+std::unique_ptr<Engine> createEngine(const EngineOptions& options = testOptions()) {
+    std::string error;
+    auto engine = Engine::create(MLC_LLM_TEST_MODEL_DIR, options, &error);
+    if (!engine) std::printf("load failed: %s\n", error.c_str());
+    return engine;
+}
+
+std::string run(Engine& engine, int tokens) {
+    std::string text;
+    std::string piece;
+    while (engine.generate(tokens, greedy(), &piece)) text += piece;
+    return text;
+}
+
+void testInstancesShareWeightsAndKeepSeparateContexts() {
+    auto first = createEngine();
+    auto second = createEngine();
+    EXPECT_TRUE(first && second);
+    if (!first || !second) return;
+
+    std::string error;
+    auto a = LoadedModel::acquire(MLC_LLM_TEST_MODEL_DIR, ModelLoadOptions(), &error);
+    auto b = LoadedModel::acquire(MLC_LLM_TEST_MODEL_DIR, ModelLoadOptions(), &error);
+    EXPECT_TRUE(a && a == b);
+    // Different load options get their own copy rather than the first one's.
+    ModelLoadOptions unverified;
+    unverified.weights.verifyChecksums = false;
+    auto c = LoadedModel::acquire(MLC_LLM_TEST_MODEL_DIR, unverified, &error);
+    EXPECT_TRUE(c && c != a);
+
+    EXPECT_TRUE(first->prefill(kPrompt) > 0);
+    const std::string expected = run(*first, 8);
+    EXPECT_TRUE(!expected.empty());
+
+    // Interleave two sessions token by token; each must match the
+    // sequential result.
+    first->resetContext();
+    EXPECT_TRUE(first->prefill(kPrompt) > 0);
+    EXPECT_TRUE(second->prefill(kPrompt) > 0);
+    std::string textA;
+    std::string textB;
+    std::string piece;
+    for (int i = 0; i < 8; ++i) {
+        if (first->generate(8, greedy(), &piece)) textA += piece;
+        if (second->generate(8, greedy(), &piece)) textB += piece;
+    }
+    EXPECT_EQ(textA, expected);
+    EXPECT_EQ(textB, expected);
+}
+
+void testChunkedPrefillMatchesTokenByToken() {
+    EngineOptions single = testOptions();
+    single.batchSize = 1;
+    EngineOptions chunked = testOptions();
+    chunked.batchSize = 5;  // several uneven chunks
+    auto reference = createEngine(single);
+    auto engine = createEngine(chunked);
+    if (!reference || !engine) return;
+
+    const int promptTokens = engine->prefill(kPrompt);
+    EXPECT_EQ(reference->prefill(kPrompt), promptTokens);
+    EXPECT_EQ(engine->stats().prefillChunks, (promptTokens + 4) / 5);
+    EXPECT_EQ(run(*engine, 8), run(*reference, 8));
+}
+
+void testKvCacheGrowsWithContextAndIsReclaimed() {
+    auto engine = createEngine();
+    if (!engine) return;
+    EXPECT_EQ(engine->kvCacheBytesInUse(), 0u);
+
+    const int promptTokens = engine->prefill(kPrompt);
+    const size_t blocks = (promptTokens + KvCache::kBlockTokens - 1) / KvCache::kBlockTokens;
+    const size_t afterPrompt = engine->kvCacheBytesInUse();
+    EXPECT_TRUE(afterPrompt > 0 && blocks > 0);
+    run(*engine, 24);
+    EXPECT_TRUE(engine->kvCacheBytesInUse() > afterPrompt);
+
+    engine->resetContext();
+    EXPECT_EQ(engine->kvCacheBytesInUse(), 0u);
+    EXPECT_EQ(engine->prefill(kPrompt), promptTokens);
+    EXPECT_EQ(engine->kvCacheBytesInUse(), afterPrompt);
+}
+
+void testOverflowingPromptKeepsContext() {
+    auto engine = createEngine();
+    if (!engine) return;
+
+    EXPECT_TRUE(engine->prefill(kPrompt) > 0);
+    run(*engine, 4);
+    // The last sampled token is still pending and must survive a refusal.
+    const int position = engine->position();
+    std::string huge;
+    for (int i = 0; i < 300; ++i) huge += " again";
+    EXPECT_EQ(engine->prefill(huge), -1);
+    EXPECT_EQ(engine->position(), position);
+    const int promptTokens = engine->prefill("<|im_end|>\n");
+    EXPECT_TRUE(promptTokens > 0);
+    EXPECT_EQ(engine->position(), position + 1 + promptTokens);
+}
+
+// The estimate is what create() reserves, and no step outgrows it.
+void testMemoryEstimateMatchesEngine() {
+    EngineOptions options = testOptions();
+    options.batchSize = 8;
+    MemoryEstimate estimate;
+    std::string error;
+    EXPECT_TRUE(Engine::estimateMemory(MLC_LLM_TEST_MODEL_DIR, options, &estimate, &error));
+    EXPECT_TRUE(estimate.weightBytes > 0 && estimate.kvCacheBytes > 0);
+    EXPECT_EQ(estimate.prefillChunk, 8);
+
+    EngineOptions unfused = options;
+    unfused.useFlashAttention = false;
+    MemoryEstimate unfusedEstimate;
+    EXPECT_TRUE(Engine::estimateMemory(MLC_LLM_TEST_MODEL_DIR, unfused, &unfusedEstimate,
+                                       &error));
+    EXPECT_TRUE(unfusedEstimate.activationBytes > estimate.activationBytes);
+
+    auto engine = createEngine(options);
+    if (!engine) return;
+    EXPECT_EQ(engine->activationBytes(), estimate.activationBytes);
+    EXPECT_EQ(engine->activationHighWater(), 0u);
+    EXPECT_TRUE(engine->prefill(kPrompt) > 8);
+    const size_t afterPrefill = engine->activationHighWater();
+    EXPECT_TRUE(afterPrefill > 0 && afterPrefill <= engine->activationBytes());
+    run(*engine, 8);
+    EXPECT_EQ(engine->activationHighWater(), afterPrefill);
+}
+
+void testF32AndF16CachesAgree() {
+    EngineOptions f32 = testOptions();
+    f32.kvCacheType = KvCacheType::F32;
+    auto reference = createEngine(f32);
+    auto engine = createEngine();
+    if (!reference || !engine) return;
+    EXPECT_TRUE(reference->prefill(kPrompt) > 0);
+    EXPECT_TRUE(engine->prefill(kPrompt) > 0);
+    EXPECT_EQ(run(*engine, 8), run(*reference, 8));
+}
+
+std::vector<std::string> listDir(const std::string& dir) {
+    std::vector<std::string> names;
+    if (DIR* d = opendir(dir.c_str())) {
+        while (dirent* entry = readdir(d)) {
+            if (entry->d_name[0] != '.') names.push_back(dir + "/" + entry->d_name);
+        }
+        closedir(d);
+    }
+    return names;
+}
+
+void testRepackedWeightsAreBuiltOnceAndAgree() {
+    std::string expected;
+    {
+        auto engine = createEngine();
+        if (!engine) return;
+        EXPECT_TRUE(engine->prefill(kPrompt) > 0);
+        expected = run(*engine, 8);
+    }
+
+    const std::string dir = "engine_test_repack";
+    mkdir(dir.c_str(), 0755);
+    EngineOptions repack = testOptions();
+    repack.repackDir = dir;
+    // The first load builds the file, the second maps it.
+    for (int load = 0; load < 2; ++load) {
+        auto engine = createEngine(repack);
+        if (!engine) break;
+        EXPECT_EQ(listDir(dir).size(), 1u);
+        EXPECT_TRUE(engine->prefill(kPrompt) > 0);
+        EXPECT_EQ(run(*engine, 8), expected);
+    }
+    for (const std::string& path : listDir(dir)) std::remove(path.c_str());
+    rmdir(dir.c_str());
+}
+
+void testQuantizedCachesShrinkKvMemory() {
+    EngineOptions q8 = testOptions();
+    q8.kvCacheType = KvCacheType::Q8_0;
+    EngineOptions q4 = testOptions();
+    q4.kvCacheType = KvCacheType::Q4_0;
+    auto f16Engine = createEngine();
+    auto q8Engine = createEngine(q8);
+    auto q4Engine = createEngine(q4);
+    if (!f16Engine || !q8Engine || !q4Engine) return;
+
+    EXPECT_TRUE(f16Engine->prefill(kPrompt) > 0);
+    EXPECT_TRUE(q8Engine->prefill(kPrompt) > 0);
+    EXPECT_TRUE(q4Engine->prefill(kPrompt) > 0);
+    // Per block of 32: F16 64 bytes, Q8_0 34, Q4_0 18 (pages round up).
+    EXPECT_TRUE(q8Engine->kvCacheBytesInUse() * 10 <= f16Engine->kvCacheBytesInUse() * 6);
+    EXPECT_TRUE(q4Engine->kvCacheBytesInUse() * 10 <= f16Engine->kvCacheBytesInUse() * 3);
+
+    const std::string expected = run(*f16Engine, 8);
+    EXPECT_EQ(run(*q8Engine, 8), expected);
+    EXPECT_TRUE(!run(*q4Engine, 8).empty());
+}
+
+void testTranscriptReusesCachedPrefix() {
+    auto engine = createEngine();
+    auto reference = createEngine();
+    if (!engine || !reference) return;
+
+    const int firstTokens = engine->prefillTranscript(kPrompt);
+    EXPECT_TRUE(firstTokens > 0);
+    EXPECT_EQ(engine->stats().reusedTokens, 0);
+    const std::string transcript = std::string(kPrompt) + run(*engine, 8) +
+            "<|im_end|>\n<|im_start|>user\nAnd three secondary ones?<|im_end|>\n"
+            "<|im_start|>assistant\n";
+
+    // Only the new turn is prefilled, and the result is the same as
+    // prefilling everything from scratch.
+    const int secondTokens = engine->prefillTranscript(transcript);
+    const int reused = engine->stats().reusedTokens;
+    EXPECT_TRUE(reused >= firstTokens);
+    EXPECT_EQ(reference->prefill(transcript), secondTokens + reused);
+    EXPECT_EQ(run(*engine, 8), run(*reference, 8));
+
+    // An edited earlier turn keeps only the common prefix.
+    const std::string edited =
+            "<|im_start|>user\nName three prime numbers.<|im_end|>\n<|im_start|>assistant\n";
+    const int editedTokens = engine->prefillTranscript(edited);
+    EXPECT_TRUE(engine->stats().reusedTokens > 0 && engine->stats().reusedTokens < firstTokens);
+    EXPECT_EQ(engine->position(), editedTokens + engine->stats().reusedTokens);
+    reference->resetContext();
+    EXPECT_EQ(reference->prefill(edited), engine->position());
+    EXPECT_EQ(run(*engine, 8), run(*reference, 8));
+}
+
+void testSnapshotRestoresConversation() {
+    auto engine = createEngine();
+    auto restored = createEngine();
+    EngineOptions q8 = testOptions();
+    q8.kvCacheType = KvCacheType::Q8_0;
+    auto other = createEngine(q8);
+    if (!engine || !restored || !other) return;
+
+    const std::string path = "engine_test_snapshot.kv";
+    std::string error;
+    const int promptTokens = engine->prefill(kPrompt);
+    EXPECT_TRUE(engine->saveContext(path, &error));
+    EXPECT_TRUE(restored->loadContext(path, &error));
+    EXPECT_EQ(run(*restored, 8), run(*engine, 8));
+
+    // The restored context is a cached prefix for the same transcript.
+    restored->loadContext(path, &error);
+    EXPECT_EQ(restored->prefillTranscript(kPrompt), 1);
+    EXPECT_EQ(restored->stats().reusedTokens, promptTokens - 1);
+
+    // A different KV layout is refused and keeps its own conversation.
+    EXPECT_TRUE(other->prefill(kPrompt) > 0);
+    EXPECT_TRUE(!other->loadContext(path, &error) && !error.empty());
+    EXPECT_EQ(other->position(), promptTokens);
+
+    // So is one whose token list names ids past the vocabulary.
+    const int position = restored->position();
+    const int32_t badToken = engine->modelConfig().vocabSize;
+    FILE* file = std::fopen(path.c_str(), "r+b");
+    EXPECT_TRUE(file != nullptr);
+    if (file) {
+        std::fseek(file, sizeof(KvSnapshotHeader) + 3 * sizeof(int32_t), SEEK_SET);
+        std::fwrite(&badToken, sizeof(badToken), 1, file);
+        std::fclose(file);
+    }
+    error.clear();
+    EXPECT_TRUE(!restored->loadContext(path, &error) && !error.empty());
+    EXPECT_EQ(restored->position(), position);
+    std::remove(path.c_str());
+}
+
+struct DoorbellSink : TokenSink {
+    int* doorbells;
+    FinishReason* reason;
+
+    void onTokensAvailable() override { ++*doorbells; }
+    void onComplete(const EngineStats&, FinishReason finish) override { *reason = finish; }
+};
+
+void testStreamingLoopMatchesSynchronousGeneration() {
+    auto engine = createEngine();
+    if (!engine) return;
+    EXPECT_TRUE(engine->prefill(kPrompt) > 0);
+    const std::string expected = run(*engine, 6);
+
+    engine->resetContext();
+    EXPECT_TRUE(engine->prefill(kPrompt) > 0);
+    int doorbells = 0;
+    FinishReason reason = FinishReason::None;
+    auto sink = std::make_unique<DoorbellSink>();
+    sink->doorbells = &doorbells;
+    sink->reason = &reason;
+
+    TokenRing ring;
+    GenerationLoop loop(engine.get(), &ring);
+    loop.start(6, greedy(), std::move(sink), std::make_shared<CancellationToken>());
+    loop.join();
+
+    std::string text;
+    std::string bytes;
+    int32_t id;
+    int tokens = 0;
+    std::vector<size_t> tokenEnds;
+    while (ring.tryPop(&id, &bytes)) {
+        text += bytes;
+        tokenEnds.push_back(text.size());
+        ++tokens;
+    }
+    EXPECT_EQ(text, expected);
+    EXPECT_EQ(tokens, 6);
+    EXPECT_TRUE(doorbells >= 1 && doorbells <= tokens);
+    EXPECT_TRUE(ring.droppedTokens() == 0);
+    EXPECT_TRUE(reason == FinishReason::Length);
+
+    // A stop sequence from the middle of that reply ends the run on the
+    // token that completes it and is cut from the text.
+    const std::string stop = expected.substr(expected.size() / 2, 2);
+    engine->resetContext();
+    EXPECT_TRUE(engine->prefill(kPrompt) > 0);
+    reason = FinishReason::None;
+    sink = std::make_unique<DoorbellSink>();
+    sink->doorbells = &doorbells;
+    sink->reason = &reason;
+    loop.start(6, greedy(), std::move(sink), std::make_shared<CancellationToken>(), {stop});
+    loop.join();
+    text.clear();
+    while (ring.tryPop(&id, &bytes)) text += bytes;
+    EXPECT_EQ(text, expected.substr(0, expected.find(stop)));
+    EXPECT_TRUE(reason == FinishReason::StopSequence);
+    const size_t stopEnd = expected.find(stop) + stop.size();
+    const int stopTokens = static_cast<int>(
+        std::lower_bound(tokenEnds.begin(), tokenEnds.end(), stopEnd) - tokenEnds.begin()) + 1;
+    EXPECT_EQ(engine->stats().generatedTokens, stopTokens);
+}
+
+void testCancellationIsPerRequest() {
+    auto engine = createEngine();
+    if (!engine) return;
+
+    // A token cancelled before prefill stops it before the first layer.
+    CancellationToken stopped;
+    stopped.cancel();
+    EXPECT_EQ(engine->prefill(kPrompt, &stopped), Engine::kPrefillCancelled);
+    EXPECT_EQ(engine->position(), 0);
+    std::string piece;
+    EXPECT_TRUE(!engine->generate(8, greedy(), &piece));
+
+    // A stop mid-decode ends the run with a measured latency, and the
+    // next request with a fresh token runs normally.
+    engine->resetContext();
+    EXPECT_TRUE(engine->prefill(kPrompt) > 0);
+    int doorbells = 0;
+    FinishReason reason = FinishReason::None;
+    auto sink = std::make_unique<DoorbellSink>();
+    sink->doorbells = &doorbells;
+    sink->reason = &reason;
+    auto cancel = std::make_shared<CancellationToken>();
+    TokenRing ring;
+    GenerationLoop loop(engine.get(), &ring);
+    loop.start(0, greedy(), std::move(sink), cancel);
+    std::string bytes;
+    int32_t id;
+    while (!ring.tryPop(&id, &bytes)) std::this_thread::yield();
+    cancel->cancel();
+    loop.join();
+    EXPECT_TRUE(reason == FinishReason::Cancelled);
+    EXPECT_TRUE(engine->stats().stopLatencyMs > 0.0);
+    std::printf("stop latency: %.3f ms\n", engine->stats().stopLatencyMs);
+
+    engine->resetContext();
+    CancellationToken fresh;
+    EXPECT_TRUE(engine->prefill(kPrompt, &fresh) > 0);
+    EXPECT_TRUE(engine->generate(8, greedy(), &piece, nullptr, &fresh));
+}
+
+} // namespace
+
+int main() {
+    testInstancesShareWeightsAndKeepSeparateContexts();
+    testChunkedPrefillMatchesTokenByToken();
+    testKvCacheGrowsWithContextAndIsReclaimed();
+    testOverflowingPromptKeepsContext();
+    testMemoryEstimateMatchesEngine();
+    testF32AndF16CachesAgree();
+    testQuantizedCachesShrinkKvMemory();
+    testRepackedWeightsAreBuiltOnceAndAgree();
+    testTranscriptReusesCachedPrefix();
+    testSnapshotRestoresConversation();
+    testStreamingLoopMatchesSynchronousGeneration();
+    testCancellationIsPerRequest();
+    return test::finish("engine_test");
+}
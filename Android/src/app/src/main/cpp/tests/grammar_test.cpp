@@ -0,0 +1,202 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "grammar.h"
+#include "sampler.h"
+#include "test_util.h"
+
+using namespace nimittam;
+
+namespace {
+
+constexpr int32_t kStop = 100;
+
+std::shared_ptr<const Grammar> compile(const std::string& source, bool isSchema = false) {
+    auto grammar = std::make_shared<Grammar>();
+    std::string error;
+    const bool ok = isSchema ? Grammar::fromJsonSchema(source, grammar.get(), &error)
+                             : Grammar::parse(source, grammar.get(), &error);
+    if (!ok) std::printf("compile failed: %s\n", error.c_str());
+    EXPECT_TRUE(ok);
+    return grammar;
+}
+
+/** 1 if [text] is a sentence of the grammar, 0 if a prefix of one, -1 otherwise. */
+int check(const std::shared_ptr<const Grammar>& grammar, const std::string& text) {
+    GrammarMatcher matcher(grammar, std::vector<std::string>{}, 0, {});
+    if (!matcher.acceptBytes(text)) return -1;
+    return matcher.isComplete() ? 1 : 0;
+}
+
+bool allowed(const uint64_t* mask, int32_t token) { return (mask[token >> 6] >> (token & 63)) & 1; }
+
+void testParseErrors() {
+    const struct {
+        const char* source;
+        const char* message;
+    } kCases[] = {
+        {"root ::= item\n", "undefined"},
+        {"root ::= root \"a\" | \"a\"\n", "left recursion"},
+        {"root ::= x\nx ::= \"\"? x \"b\" | \"b\"\n", "left recursion"},
+        {"root ::= \"abc\n", "line 1"},
+        {"item ::= \"a\"\n", "root"},
+        {"root ::= [a-\n", "line 1"},
+    };
+    for (const auto& c : kCases) {
+        Grammar grammar;
+        std::string error;
+        EXPECT_TRUE(!Grammar::parse(c.source, &grammar, &error));
+        EXPECT_TRUE(error.find(c.message) != std::string::npos);
+    }
+}
+
+void testBytes() {
+    auto digits = compile("root ::= \"a\" [0-9]{2,3} tail*\ntail ::= \"x\" | \"yz\"  # comment\n");
+    EXPECT_EQ(check(digits, "a12"), 1);
+    EXPECT_EQ(check(digits, "a1"), 0);
+    EXPECT_EQ(check(digits, "a123"), 1);
+    EXPECT_EQ(check(digits, "a1234"), -1);
+    EXPECT_EQ(check(digits, "a12yzx"), 1);
+    EXPECT_EQ(check(digits, "a12y"), 0);
+    EXPECT_EQ(check(digits, "b"), -1);
+
+    // Classes match whole characters; a split one is a prefix.
+    auto greek = compile("root ::= [α-ω]+\n");
+    EXPECT_EQ(check(greek, "αβω"), 1);
+    EXPECT_EQ(check(greek, "\xCE"), 0);
+    EXPECT_EQ(check(greek, "a"), -1);
+    EXPECT_EQ(check(greek, "Ω"), -1);
+
+    auto quoted = compile("root ::= \"\\\"\" [^\"\\\\]* \"\\\"\"\n");
+    EXPECT_EQ(check(quoted, "\"héllo 😀\""), 1);
+    EXPECT_EQ(check(quoted, "\"a\"b"), -1);
+    EXPECT_EQ(check(quoted, "\"\\"), -1);
+    // Lone surrogates are not characters.
+    EXPECT_EQ(check(quoted, "\"\xED\xA0\x80"), -1);
+}
+
+void testJsonSchema() {
+    auto person = compile(R"({
+        "type": "object",
+        "properties": {
+            "name": {"type": "string", "maxLength": 8},
+            "age": {"type": "integer"},
+            "role": {"enum": ["admin", "user"]},
+            "tags": {"type": "array", "items": {"$ref": "#/$defs/tag"}, "maxItems": 2}
+        },
+        "required": ["name", "age"],
+        "$defs": {"tag": {"type": "string"}}
+    })", true);
+    EXPECT_EQ(check(person, R"({"name":"Ann","age":30})"), 1);
+    EXPECT_EQ(check(person, "{ \"name\": \"Ann\",\n  \"age\": -4, \"tags\": [\"a\", \"b\"] }"), 1);
+    EXPECT_EQ(check(person, R"({"name":"Ann","age":30,"role":"user"})"), 1);
+    EXPECT_EQ(check(person, R"({"name":"Ann","age":30,"role":"root"})"), -1);
+    EXPECT_EQ(check(person, R"({"name":"Ann","age":3.5})"), -1);
+    EXPECT_EQ(check(person, R"({"name":"Ann"})"), -1);
+    EXPECT_EQ(check(person, R"({"name":"Annabelle!"})"), -1);
+    EXPECT_EQ(check(person, R"({"age":30})"), -1);
+    EXPECT_EQ(check(person, R"({"name":"Ann","age":1,"tags":["a","b","c"]})"), -1);
+    // Nothing may follow the document.
+    EXPECT_EQ(check(person, R"({"name":"Ann","age":30} )"), -1);
+
+    auto any = compile("{}", true);
+    EXPECT_EQ(check(any, R"([1, {"a": [true, null, "x"]}, -2.5e3])"), 1);
+    EXPECT_EQ(check(any, R"({"a" 1})"), -1);
+
+    Grammar grammar;
+    std::string error;
+    EXPECT_TRUE(!Grammar::fromJsonSchema(R"({"$ref": "#/$defs/missing"})", &grammar, &error));
+    EXPECT_TRUE(!Grammar::fromJsonSchema("{\"type\": ", &grammar, &error));
+}
+
+void testMasks() {
+    const std::vector<std::string> tokens = {"a", "b", "ab", "ba", "abc", "", "aba", "\xCE"};
+    const int vocabSize = kStop + 1;
+    GrammarMatcher matcher(compile("root ::= (\"a\" \"b\")+\n"), tokens, vocabSize, {kStop});
+
+    const uint64_t* mask = matcher.currentMask();
+    EXPECT_TRUE(allowed(mask, 0) && allowed(mask, 2) && allowed(mask, 6));
+    EXPECT_TRUE(!allowed(mask, 1) && !allowed(mask, 3) && !allowed(mask, 4));
+    EXPECT_TRUE(!allowed(mask, 5) && !allowed(mask, 7) && !allowed(mask, kStop));
+    EXPECT_TRUE(!matcher.accept(1));
+    EXPECT_TRUE(!matcher.accept(kStop));
+
+    EXPECT_TRUE(matcher.accept(6));
+    mask = matcher.currentMask();
+    EXPECT_TRUE(allowed(mask, 1) && allowed(mask, 3) && !allowed(mask, 0) && !allowed(mask, kStop));
+    EXPECT_TRUE(matcher.accept(1));
+    EXPECT_TRUE(matcher.isComplete());
+
+    std::vector<float> logits(vocabSize, 1.0f);
+    EXPECT_TRUE(matcher.applyMask(logits.data()));
+    for (int32_t id = 0; id < vocabSize; ++id) {
+        const bool open = id == 0 || id == 2 || id == 6 || id == kStop;
+        EXPECT_EQ(logits[id] == kMaskedLogit, !open);
+    }
+    EXPECT_TRUE(matcher.accept(kStop));
+
+    // Nothing left to say but the stop token.
+    GrammarMatcher done(compile("root ::= \"ab\"\n"), tokens, vocabSize, {kStop});
+    EXPECT_TRUE(done.accept(2));
+    logits.assign(vocabSize, 1.0f);
+    EXPECT_TRUE(done.applyMask(logits.data()));
+    EXPECT_EQ(logits[kStop], 1.0f);
+    EXPECT_TRUE(logits[0] == kMaskedLogit && logits[2] == kMaskedLogit);
+
+    // A grammar with no way forward leaves the logits alone.
+    GrammarMatcher stuck(compile("root ::= \"c\"\n"), tokens, vocabSize, {kStop});
+    logits.assign(vocabSize, 1.0f);
+    EXPECT_TRUE(!stuck.applyMask(logits.data()));
+    EXPECT_EQ(logits[0], 1.0f);
+}
+
+/** Along random walks, every mask bit must agree with feeding the token's bytes. */
+void testMasksMatchBytes() {
+    std::vector<std::string> tokens;
+    for (int c = 0x20; c < 0x7F; ++c) tokens.emplace_back(1, static_cast<char>(c));
+    for (const char* piece : {"{\"", "\":", "\",\"", "\"}", "true", "null", ", ", "[1", "],",
+                              "é", "\xC3", "\xA9\"", "12", ".5e", "\n  ", "\"\n}"}) {
+        tokens.emplace_back(piece);
+    }
+    const int32_t stop = static_cast<int32_t>(tokens.size());
+    const auto grammar = compile("{}", true);
+    GrammarMatcher matcher(grammar, tokens, stop + 1, {stop});
+    std::mt19937 rng(9);
+    for (int walk = 0; walk < 20; ++walk) {
+        matcher.reset();
+        for (int step = 0; step < 60; ++step) {
+            const uint64_t* mask = matcher.currentMask();
+            std::vector<int32_t> open;
+            for (int32_t id = 0; id < stop; ++id) {
+                GrammarMatcher probe = matcher;
+                const bool fits = probe.acceptBytes(tokens[id]);
+                EXPECT_EQ(allowed(mask, id), fits);
+                if (fits) open.push_back(id);
+            }
+            EXPECT_EQ(allowed(mask, stop), matcher.isComplete());
+            if (open.empty()) break;
+            EXPECT_TRUE(matcher.accept(open[rng() % open.size()]));
+        }
+    }
+}
+
+} // namespace
+
+int main() {
+    testParseErrors();
+    testBytes();
+    testJsonSchema();
+    testMasks();
+    testMasksMatchBytes();
+    return test::finish("grammar_test");
+}
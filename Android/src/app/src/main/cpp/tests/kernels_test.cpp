@@ -0,0 +1,324 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "cpu_features.h"
+#include "kernels.h"
+#include "kv_quant.h"
+#include "test_util.h"
+
+using namespace nimittam;
+
+namespace {
+
+struct RandomQ4 {
+    std::vector<uint32_t> qweight;
+    std::vector<uint16_t> scales;
+    Q4Matrix matrix;
+
+    RandomQ4(int rows, int cols, std::mt19937& rng) {
+        std::uniform_int_distribution<uint32_t> word;
+        std::uniform_real_distribution<float> scale(0.001f, 0.05f);
+        qweight.resize(static_cast<size_t>(rows) * cols / 8);
+        scales.resize(static_cast<size_t>(rows) * cols / kQ4GroupSize);
+        for (auto& w : qweight) w = word(rng);
+        for (auto& s : scales) s = floatToHalf(scale(rng));
+        matrix.qweight = qweight.data();
+        matrix.scales = scales.data();
+        matrix.rows = rows;
+        matrix.cols = cols;
+    }
+};
+
+void testHalfRoundTrip() {
+    const float values[] = {0.0f, 1.0f, -2.5f, 0.0009765625f, 65504.0f, -0.333251953125f};
+    for (float v : values) {
+        EXPECT_EQ(halfToFloat(floatToHalf(v)), v);
+    }
+    EXPECT_NEAR(halfToFloat(floatToHalf(0.1f)), 0.1f, 1e-4);
+    // Subnormal
+    EXPECT_NEAR(halfToFloat(floatToHalf(3e-6f)), 3e-6f, 1e-7);
+}
+
+void testQ4GemvMatchesDequantized() {
+    std::mt19937 rng(7);
+    const int rows = 37;
+    const int cols = 128;
+    RandomQ4 w(rows, cols, rng);
+
+    std::vector<float> x(cols);
+    std::normal_distribution<float> normal;
+    for (auto& v : x) v = normal(rng);
+
+    std::vector<float> y(rows);
+    q4Gemv(w.matrix, x.data(), y.data(), 0, rows);
+
+    std::vector<float> row(cols);
+    for (int r = 0; r < rows; ++r) {
+        q4DequantRow(w.matrix, r, row.data());
+        double expected = 0.0;
+        for (int c = 0; c < cols; ++c) expected += static_cast<double>(row[c]) * x[c];
+        EXPECT_NEAR(y[r], expected, 1e-3);
+    }
+}
+
+void testQ4GemmMatchesGemv() {
+    std::mt19937 rng(11);
+    const int rows = 37;  // not a multiple of the 4-row block
+    const int cols = 96;
+    const int n = 19;     // spans two token tiles
+    RandomQ4 w(rows, cols, rng);
+
+    std::vector<float> x(static_cast<size_t>(n) * cols);
+    std::normal_distribution<float> normal;
+    for (auto& v : x) v = normal(rng);
+
+    std::vector<float> y(static_cast<size_t>(n) * rows);
+    q4Gemm(w.matrix, x.data(), n, y.data(), rows, 0, rows);
+
+    std::vector<float> expected(rows);
+    for (int t = 0; t < n; ++t) {
+        q4Gemv(w.matrix, x.data() + static_cast<size_t>(t) * cols, expected.data(), 0, rows);
+        for (int r = 0; r < rows; ++r) {
+            EXPECT_NEAR(y[static_cast<size_t>(t) * rows + r], expected[r], 1e-3);
+        }
+    }
+}
+
+void testPackedLayoutMatchesStorageLayout() {
+    std::mt19937 rng(13);
+    const int rows = 36;
+    const int cols = 96;
+    const int n = 5;
+    RandomQ4 w(rows, cols, rng);
+    EXPECT_TRUE(q4CanPack(rows, cols) && !q4CanPack(37, cols));
+
+    std::vector<uint8_t> packed(q4PackedBytes(rows, cols));
+    EXPECT_EQ(packed.size(), w.qweight.size() * 4 + w.scales.size() * 2);
+    // In two pieces, as RepackedWeights writes large matrices.
+    const int tiles = rows / kQ4PackRows;
+    q4RepackTiles(w.matrix, 0, 3, packed.data());
+    q4RepackTiles(w.matrix, 3, tiles, packed.data() + q4PackedBytes(3 * kQ4PackRows, cols));
+    Q4Matrix p = w.matrix;
+    p.packed = packed.data();
+
+    std::vector<float> a(cols);
+    std::vector<float> b(cols);
+    for (int r = 0; r < rows; ++r) {
+        q4DequantRow(w.matrix, r, a.data());
+        q4DequantRow(p, r, b.data());
+        EXPECT_TRUE(a == b);
+    }
+
+    std::vector<float> x(static_cast<size_t>(n) * cols);
+    std::normal_distribution<float> normal;
+    for (auto& v : x) v = normal(rng);
+    // A row range that starts and ends inside a tile.
+    std::vector<float> expected(rows, 0.0f);
+    std::vector<float> actual(rows, 0.0f);
+    q4Gemv(w.matrix, x.data(), expected.data(), 5, 30);
+    q4Gemv(p, x.data(), actual.data(), 5, 30);
+    for (int r = 0; r < rows; ++r) EXPECT_NEAR(actual[r], expected[r], 1e-3);
+
+    std::vector<float> gemmExpected(static_cast<size_t>(n) * rows);
+    std::vector<float> gemmActual(static_cast<size_t>(n) * rows);
+    q4Gemm(w.matrix, x.data(), n, gemmExpected.data(), rows, 0, rows);
+    q4Gemm(p, x.data(), n, gemmActual.data(), rows, 0, rows);
+    EXPECT_TRUE(gemmActual == gemmExpected);
+}
+
+void testQ4Q8KernelsMatchFloat() {
+    std::mt19937 rng(19);
+    const int rows = 36;
+    const int cols = 160;
+    const int n = 5;  // odd, so two-token kernels leave one over
+    RandomQ4 w(rows, cols, rng);
+    std::vector<uint8_t> packed(q4PackedBytes(rows, cols));
+    q4RepackTiles(w.matrix, 0, rows / kQ4PackRows, packed.data());
+    Q4Matrix p = w.matrix;
+    p.packed = packed.data();
+
+    std::vector<float> x(static_cast<size_t>(n) * cols);
+    std::normal_distribution<float> normal;
+    for (auto& v : x) v = normal(rng);
+    x[3] = 0.0f;
+    Q8Activations q8;
+    q8Quantize(x.data(), n, cols, &q8);
+    EXPECT_EQ(q8.n, n);
+
+    // The int8 kernels are exact on the quantized activations, up to float rounding.
+    std::vector<float> dequantized(x.size());
+    for (size_t i = 0; i < x.size(); ++i) {
+        const float scale = q8.scales[i / kQ4GroupSize];
+        dequantized[i] = q8.q[i] * scale;
+        EXPECT_NEAR(dequantized[i], x[i], scale / 2 + 1e-6);
+    }
+    for (size_t g = 0; g < q8.sums.size(); ++g) {
+        int32_t sum = 0;
+        for (int i = 0; i < kQ4GroupSize; ++i) sum += q8.q[g * kQ4GroupSize + i];
+        EXPECT_EQ(q8.sums[g], sum);
+    }
+
+    std::vector<float> y(static_cast<size_t>(n) * rows, 0.0f);
+    q4GemmQ8(p, q8, y.data(), rows, 5, 30);
+    Q8Activations single;
+    std::vector<float> expected(rows, 0.0f);
+    std::vector<float> actual(rows, 0.0f);
+    for (int t = 0; t < n; ++t) {
+        const float* xt = dequantized.data() + static_cast<size_t>(t) * cols;
+        q4Gemv(p, xt, expected.data(), 5, 30);
+        q8Quantize(x.data() + static_cast<size_t>(t) * cols, 1, cols, &single);
+        q4GemvQ8(p, single, actual.data(), 5, 30);
+        for (int r = 0; r < rows; ++r) {
+            EXPECT_NEAR(actual[r], expected[r], 1e-3);
+            EXPECT_NEAR(y[static_cast<size_t>(t) * rows + r], expected[r], 1e-3);
+        }
+    }
+}
+
+void testQ4KernelVariantsAgree() {
+    std::mt19937 rng(17);
+    const int rows = 40;
+    const int cols = 160;
+    RandomQ4 w(rows, cols, rng);
+    std::vector<uint8_t> packed(q4PackedBytes(rows, cols));
+    q4RepackTiles(w.matrix, 0, rows / kQ4PackRows, packed.data());
+    Q4Matrix p = w.matrix;
+    p.packed = packed.data();
+    std::vector<float> x(cols);
+    std::normal_distribution<float> normal;
+    for (auto& v : x) v = normal(rng);
+
+    const std::vector<std::string> variants = q4KernelVariants();
+    EXPECT_TRUE(!variants.empty());
+    EXPECT_TRUE(!useQ4Kernels("no-such-kernels"));
+    const std::string detected = q4KernelName();
+    EXPECT_EQ(detected, variants.front());
+
+    // The last variant is the baseline every other one must agree with.
+    EXPECT_TRUE(useQ4Kernels(variants.back()));
+    std::vector<float> expected(rows);
+    q4Gemv(w.matrix, x.data(), expected.data(), 0, rows);
+    for (const std::string& name : variants) {
+        EXPECT_TRUE(useQ4Kernels(name));
+        EXPECT_EQ(std::string(q4KernelName()), name);
+        std::vector<float> storage(rows);
+        std::vector<float> fromPacked(rows);
+        q4Gemv(w.matrix, x.data(), storage.data(), 0, rows);
+        q4Gemv(p, x.data(), fromPacked.data(), 0, rows);
+        for (int r = 0; r < rows; ++r) {
+            EXPECT_NEAR(storage[r], expected[r], 1e-3);
+            EXPECT_NEAR(fromPacked[r], expected[r], 1e-3);
+        }
+        // Each variant keys its own repacked weights.
+        if (name != variants.back()) {
+            const uint64_t layout = q4PackedLayoutId();
+            EXPECT_TRUE(useQ4Kernels(variants.back()));
+            EXPECT_TRUE(q4PackedLayoutId() != layout);
+        }
+    }
+    EXPECT_TRUE(useQ4Kernels(detected));
+    std::printf("cpu: %s, q4 kernels: %s\n", cpuFeatureList().c_str(), detected.c_str());
+}
+
+void testQuantizedKvKernelsMatchDequantized() {
+    std::mt19937 rng(5);
+    std::normal_distribution<float> normal;
+    const int n = 128;
+    std::vector<float> row(n);
+    std::vector<float> q(n);
+    for (auto& v : row) v = normal(rng);
+    for (auto& v : q) v = normal(rng);
+
+    std::vector<BlockQ8_0> q8(n / kKvQuantBlock);
+    std::vector<BlockQ4_0> q4(n / kKvQuantBlock);
+    quantizeRowQ8_0(row.data(), q8.data(), n);
+    quantizeRowQ4_0(row.data(), q4.data(), n);
+
+    // Plain dequantization as the reference for the fused kernels.
+    std::vector<float> d8(n);
+    std::vector<float> d4(n);
+    for (int i = 0; i < n; ++i) {
+        const int b = i / kKvQuantBlock;
+        const int j = i % kKvQuantBlock;
+        d8[i] = q8[b].q[j] * halfToFloat(q8[b].scale);
+        const uint8_t packed = q4[b].q[j % 16];
+        const int nibble = j < 16 ? (packed & 0x0F) : (packed >> 4);
+        d4[i] = (nibble - 8) * halfToFloat(q4[b].scale);
+        // Quantization error stays within half a step.
+        EXPECT_NEAR(d8[i], row[i], 0.5 * halfToFloat(q8[b].scale) + 1e-6);
+        EXPECT_NEAR(d4[i], row[i], 0.5 * std::fabs(halfToFloat(q4[b].scale)) + 1e-3);
+    }
+
+    EXPECT_NEAR(dotQ8_0(q.data(), q8.data(), n), dot(q.data(), d8.data(), n), 1e-3);
+    EXPECT_NEAR(dotQ4_0(q.data(), q4.data(), n), dot(q.data(), d4.data(), n), 1e-3);
+
+    std::vector<float> y8(n, 1.0f);
+    std::vector<float> y4(n, 1.0f);
+    axpyQ8_0(0.5f, q8.data(), y8.data(), n);
+    axpyQ4_0(0.5f, q4.data(), y4.data(), n);
+    for (int i = 0; i < n; ++i) {
+        EXPECT_NEAR(y8[i], 1.0 + 0.5 * d8[i], 1e-5);
+        EXPECT_NEAR(y4[i], 1.0 + 0.5 * d4[i], 1e-5);
+    }
+    std::printf("kv quant kernels: %s\n", kvQuantKernelName());
+}
+
+void testSoftmax() {
+    std::vector<float> x = {1.0f, 2.0f, 3.0f, -100.0f};
+    softmax(x.data(), static_cast<int>(x.size()));
+    float sum = 0.0f;
+    for (float v : x) sum += v;
+    EXPECT_NEAR(sum, 1.0, 1e-6);
+    EXPECT_TRUE(x[2] > x[1] && x[1] > x[0]);
+}
+
+void testRopePreservesNorm() {
+    const int headDim = 64;
+    std::vector<float> v(2 * headDim);
+    std::vector<float> cosSin(headDim);
+    for (int i = 0; i < 2 * headDim; ++i) v[i] = 0.01f * static_cast<float>(i - headDim);
+    double before = 0.0;
+    for (float f : v) before += f * f;
+
+    ropeCosSin(1234, headDim, 1000000.0f, cosSin.data());
+    applyRope(v.data(), 2, headDim, cosSin.data());
+
+    double after = 0.0;
+    for (float f : v) after += f * f;
+    EXPECT_NEAR(after, before, 1e-4);
+
+    // Position 0 is the identity.
+    std::vector<float> u(headDim, 0.5f);
+    ropeCosSin(0, headDim, 1000000.0f, cosSin.data());
+    applyRope(u.data(), 1, headDim, cosSin.data());
+    for (float f : u) EXPECT_NEAR(f, 0.5, 1e-7);
+}
+
+} // namespace
+
+int main() {
+    testHalfRoundTrip();
+    testQ4KernelVariantsAgree();
+    const std::vector<std::string> variants = q4KernelVariants();
+    for (const std::string& name : variants) {
+        useQ4Kernels(name);
+        testQ4GemvMatchesDequantized();
+        testQ4GemmMatchesGemv();
+        testPackedLayoutMatchesStorageLayout();
+        testQ4Q8KernelsMatchFloat();
+        testQuantizedKvKernelsMatchDequantized();
+    }
+    useQ4Kernels(variants.front());
+    testSoftmax();
+    testRopePreservesNorm();
+    return test::finish("kernels_test");
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Model files read from a directory inside a zip archive, as from an APK.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "model_source.h"
+#include "test_util.h"
+
+using namespace nimittam;
+
+namespace {
+
+struct ZipFile {
+    std::string name;
+    std::string data;
+    uint16_t method = 0;     // 0 stored; 8 is only labelled deflate, never read
+    size_t localPadding = 0; // extra field bytes in the local header only, as zipalign adds
+};
+
+void put16(std::string* out, uint16_t v) {
+    out->push_back(static_cast<char>(v & 0xff));
+    out->push_back(static_cast<char>(v >> 8));
+}
+
+void put32(std::string* out, uint32_t v) {
+    put16(out, static_cast<uint16_t>(v & 0xffff));
+    put16(out, static_cast<uint16_t>(v >> 16));
+}
+
+/** Minimal zip writer; CRCs are left zero because the reader never checks them. */
+bool writeZip(const std::string& path, const std::vector<ZipFile>& files) {
+    std::string zip;
+    std::string directory;
+    for (const ZipFile& file : files) {
+        const uint32_t localOffset = static_cast<uint32_t>(zip.size());
+        const uint32_t size = static_cast<uint32_t>(file.data.size());
+        put32(&zip, 0x04034b50);
+        put16(&zip, 10);
+        put16(&zip, 0);
+        put16(&zip, file.method);
+        put32(&zip, 0);  // time, date
+        put32(&zip, 0);  // crc
+        put32(&zip, size);
+        put32(&zip, size);
+        put16(&zip, static_cast<uint16_t>(file.name.size()));
+        put16(&zip, static_cast<uint16_t>(file.localPadding));
+        zip += file.name;
+        zip.append(file.localPadding, '\0');
+        zip += file.data;
+
+        put32(&directory, 0x02014b50);
+        put16(&directory, 20);
+        put16(&directory, 10);
+        put16(&directory, 0);
+        put16(&directory, file.method);
+        put32(&directory, 0);
+        put32(&directory, 0);
+        put32(&directory, size);
+        put32(&directory, size);
+        put16(&directory, static_cast<uint16_t>(file.name.size()));
+        put16(&directory, 0);  // extra
+        put16(&directory, 0);  // comment
+        put16(&directory, 0);  // disk
+        put16(&directory, 0);  // internal attributes
+        put32(&directory, 0);  // external attributes
+        put32(&directory, localOffset);
+        directory += file.name;
+    }
+    const uint32_t directoryOffset = static_cast<uint32_t>(zip.size());
+    zip += directory;
+    put32(&zip, 0x06054b50);
+    put16(&zip, 0);
+    put16(&zip, 0);
+    put16(&zip, static_cast<uint16_t>(files.size()));
+    put16(&zip, static_cast<uint16_t>(files.size()));
+    put32(&zip, static_cast<uint32_t>(directory.size()));
+    put32(&zip, directoryOffset);
+    put16(&zip, 0);
+
+    FILE* out = std::fopen(path.c_str(), "wb");
+    if (!out) return false;
+    const bool ok = std::fwrite(zip.data(), 1, zip.size(), out) == zip.size();
+    return std::fclose(out) == 0 && ok;
+}
+
+void testMapsStoredEntriesInsideArchive() {
+    std::string big(10000, '\0');
+    for (size_t i = 0; i < big.size(); ++i) big[i] = static_cast<char>(i * 7);
+    const std::string path = "model_source_test.zip";
+    EXPECT_TRUE(writeZip(path, {{"assets/filler.bin", std::string(5000, 'x'), 0, 0},
+                                {"assets/model/config.json", "{\"layers\": 24}", 0, 3},
+                                {"assets/model/shard.bin", big, 0, 1},
+                                {"assets/model/packed.bin", "not really deflated", 8, 0}}));
+
+    ModelSource source;
+    std::string error;
+    EXPECT_TRUE(source.open(path + "!/assets/model/", &error));
+    EXPECT_TRUE(source.inArchive());
+    const std::string& location = source.location();
+    EXPECT_EQ(location.substr(location.find('!')), std::string("!/assets/model"));
+
+    JsonValue config;
+    EXPECT_TRUE(source.parseJson("config.json", &config, &error));
+    EXPECT_EQ(config["layers"].asInt(), 24);
+
+    // Neither page aligned nor in the first page of the archive.
+    MappedFile shard;
+    EXPECT_TRUE(source.map("shard.bin", &shard, &error));
+    EXPECT_EQ(shard.size(), big.size());
+    EXPECT_TRUE(shard.data() && std::memcmp(shard.data(), big.data(), big.size()) == 0);
+
+    MappedFile packed;
+    EXPECT_TRUE(!source.map("packed.bin", &packed, &error));
+    EXPECT_TRUE(error.find("compressed") != std::string::npos);
+    EXPECT_TRUE(!source.map("missing.bin", &packed, &error));
+
+    ModelSource notAnArchive;
+    EXPECT_TRUE(!notAnArchive.open(std::string(MLC_LLM_TEST_MODEL_DIR) +
+                                           "/mlc-chat-config.json!/assets",
+                                   &error));
+    std::remove(path.c_str());
+}
+
+void testDirectorySource() {
+    ModelSource source;
+    std::string error;
+    EXPECT_TRUE(source.open(MLC_LLM_TEST_MODEL_DIR, &error));
+    EXPECT_TRUE(!source.inArchive());
+    JsonValue config;
+    EXPECT_TRUE(source.parseJson("mlc-chat-config.json", &config, &error));
+    EXPECT_TRUE(config["model_config"].isObject());
+}
+
+} // namespace
+
+int main() {
+    testMapsStoredEntriesInsideArchive();
+    testDirectorySource();
+    return test::finish("model_source_test");
+}
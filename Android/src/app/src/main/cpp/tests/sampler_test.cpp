@@ -0,0 +1,171 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "sampler.h"
+#include "test_util.h"
+
+using namespace nimittam;
+
+namespace {
+
+constexpr int kVocab = 5000;
+
+std::vector<float> randomLogits(uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> normal(0.0f, 2.5f);
+    std::vector<float> logits(kVocab);
+    for (float& x : logits) x = normal(rng);
+    return logits;
+}
+
+void testGreedy() {
+    std::vector<float> logits = randomLogits(1);
+    logits[1234] = 50.0f;
+    logits[4321] = 50.0f;
+    SamplingParams params;
+    params.temperature = 0.0f;
+    params.repeatPenalty = 1.0f;
+    Sampler sampler;
+    sampler.reset(0);
+    // Ties go to the lowest id.
+    EXPECT_EQ(sampler.sample(logits.data(), kVocab, params, {}), 1234);
+    params.temperature = 0.7f;
+    params.topK = 1;
+    EXPECT_EQ(sampler.sample(logits.data(), kVocab, params, {}), 1234);
+}
+
+void testSeededRunsRepeat() {
+    const std::vector<float> base = randomLogits(2);
+    const SamplingParams configs[] = {
+        {0.7f, 0.9f, 40, 1.1f, 7},
+        {1.0f, 0.95f, 0, 1.0f, 7},
+        {1.2f, 1.0f, 0, 1.0f, 7},
+    };
+    for (const SamplingParams& params : configs) {
+        std::vector<int32_t> runs[2];
+        for (std::vector<int32_t>& run : runs) {
+            Sampler sampler;
+            sampler.reset(params.seed);
+            std::vector<int32_t> history;
+            for (int i = 0; i < 50; ++i) {
+                std::vector<float> logits = base;
+                history.push_back(sampler.sample(logits.data(), kVocab, params, history));
+            }
+            run = history;
+        }
+        EXPECT_TRUE(runs[0] == runs[1]);
+    }
+}
+
+void testTopKAndTopP() {
+    const std::vector<float> base = randomLogits(3);
+    std::vector<int32_t> order(kVocab);
+    for (int i = 0; i < kVocab; ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](int32_t a, int32_t b) { return base[a] > base[b]; });
+    const std::vector<int32_t> top5(order.begin(), order.begin() + 5);
+
+    SamplingParams params{2.0f, 1.0f, 5, 1.0f, 11};
+    Sampler sampler;
+    sampler.reset(params.seed);
+    for (int i = 0; i < 500; ++i) {
+        std::vector<float> logits = base;
+        const int32_t token = sampler.sample(logits.data(), kVocab, params, {});
+        EXPECT_TRUE(std::find(top5.begin(), top5.end(), token) != top5.end());
+    }
+
+    // One token holding over 90% of the mass is all a 0.9 nucleus keeps.
+    std::vector<float> peaked = base;
+    peaked[order[0]] = base[order[1]] + 4.0f;
+    params = {1.0f, 0.9f, 0, 1.0f, 11};
+    for (int i = 0; i < 200; ++i) {
+        std::vector<float> logits(kVocab, -20.0f);
+        for (int j = 0; j < 4; ++j) logits[order[j]] = peaked[order[j]];
+        EXPECT_EQ(sampler.sample(logits.data(), kVocab, params, {}), order[0]);
+    }
+
+    // Four equal tokens are drawn evenly.
+    std::vector<int> hits(4, 0);
+    params = {1.0f, 1.0f, 0, 1.0f, 11};
+    for (int i = 0; i < 8000; ++i) {
+        std::vector<float> logits(kVocab, -30.0f);
+        for (int j = 0; j < 4; ++j) logits[order[j]] = 3.0f;
+        const int32_t token = sampler.sample(logits.data(), kVocab, params, {});
+        const auto at = std::find(order.begin(), order.begin() + 4, token);
+        EXPECT_TRUE(at != order.begin() + 4);
+        if (at != order.begin() + 4) ++hits[at - order.begin()];
+    }
+    for (int count : hits) EXPECT_NEAR(count / 8000.0, 0.25, 0.03);
+}
+
+/** Masked tokens are never drawn, even when top-k reaches past the open ones. */
+void testMaskedTokensAreNeverDrawn() {
+    const std::vector<float> base = randomLogits(6);
+    const SamplingParams configs[] = {
+        {0.7f, 1.0f, 40, 1.3f, 3},
+        {0.05f, 0.9f, 0, 1.3f, 3},
+        {1.5f, 1.0f, 0, 1.0f, 3},
+    };
+    for (const SamplingParams& params : configs) {
+        Sampler sampler;
+        sampler.reset(params.seed);
+        // The masked tokens are in the history, so the penalty scales them too.
+        const std::vector<int32_t> history = {0, 1, 2, 3, 10};
+        for (int i = 0; i < 200; ++i) {
+            std::vector<float> logits(kVocab, kMaskedLogit);
+            for (int id = 10; id < 20; ++id) logits[id] = base[id];
+            const int32_t token = sampler.sample(logits.data(), kVocab, params, history);
+            EXPECT_TRUE(token >= 10 && token < 20);
+        }
+    }
+}
+
+/** The counts kept across calls must match a sampler seeing the history fresh. */
+void testPenaltyFollowsHistoryRewrites() {
+    const std::vector<float> base = randomLogits(4);
+    SamplingParams params{0.0f, 1.0f, 0, 1.5f, 0};
+    std::mt19937 rng(5);
+    Sampler incremental;
+    incremental.reset(0);
+    std::vector<int32_t> history;
+    for (int round = 0; round < 300; ++round) {
+        // Grow, truncate or replace the tail, as prefix reuse does.
+        const uint32_t op = rng() % 3;
+        if (op == 0 || history.empty()) {
+            for (uint32_t i = rng() % 8; i > 0; --i) history.push_back(rng() % 40);
+        } else if (op == 1) {
+            history.resize(rng() % (history.size() + 1));
+        } else {
+            history.resize(rng() % (history.size() + 1));
+            for (uint32_t i = rng() % 4; i > 0; --i) history.push_back(rng() % 40);
+        }
+        // Penalties decide the winner among the 40 close leaders.
+        std::vector<float> logits = base;
+        for (int id = 0; id < 40; ++id) logits[id] = 20.0f - id * 0.1f;
+        std::vector<float> fresh = logits;
+        Sampler reference;
+        reference.reset(0);
+        EXPECT_EQ(incremental.sample(logits.data(), kVocab, params, history),
+                  reference.sample(fresh.data(), kVocab, params, history));
+        EXPECT_TRUE(logits == fresh);
+    }
+}
+
+} // namespace
+
+int main() {
+    testGreedy();
+    testSeededRunsRepeat();
+    testTopKAndTopP();
+    testMaskedTokensAreNeverDrawn();
+    testPenaltyFollowsHistoryRewrites();
+    return test::finish("sampler_test");
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "stop_matcher.h"
+#include "test_util.h"
+
+using namespace nimittam;
+
+namespace {
+
+const std::vector<std::string> kStops = {"<|end|>", "<|eot_id|>", "</s>"};
+
+void testHoldsBackPossibleStops() {
+    StopMatcher matcher;
+    matcher.build(kStops);
+    std::string out;
+    EXPECT_TRUE(!matcher.feed("Hello <", &out));
+    EXPECT_EQ(out, "Hello ");
+    EXPECT_EQ(matcher.heldBytes(), 1u);
+    EXPECT_TRUE(!matcher.feed("|e", &out));
+    EXPECT_EQ(out, "");
+    // "<|en" turns out not to be "<|end|>"; it is released with the rest.
+    EXPECT_TRUE(!matcher.feed("nd?", &out));
+    EXPECT_EQ(out, "<|end?");
+    EXPECT_EQ(matcher.heldBytes(), 0u);
+
+    // A stop split over three pieces ends the stream before its start.
+    EXPECT_TRUE(!matcher.feed("ok<|eo", &out));
+    EXPECT_EQ(out, "ok");
+    EXPECT_TRUE(!matcher.feed("t_i", &out));
+    EXPECT_EQ(out, "");
+    EXPECT_TRUE(matcher.feed("d|>tail", &out));
+    EXPECT_EQ(out, "");
+
+    // Held-back text that never completes comes out at the end.
+    matcher.build(kStops);
+    EXPECT_TRUE(!matcher.feed("done </", &out));
+    EXPECT_EQ(out, "done ");
+    out.clear();
+    matcher.finish(&out);
+    EXPECT_EQ(out, "</");
+}
+
+void testFailureLinks() {
+    StopMatcher matcher;
+    std::string out;
+    // The match can begin inside a failed attempt at another stop.
+    matcher.build({"abcd", "bc"});
+    EXPECT_TRUE(matcher.feed("xabc", &out));
+    EXPECT_EQ(out, "xa");
+    matcher.build({"aab"});
+    EXPECT_TRUE(matcher.feed("aaaab", &out));
+    EXPECT_EQ(out, "aa");
+
+    // No stops: text passes straight through.
+    matcher.build({"", ""});
+    EXPECT_TRUE(matcher.empty());
+    EXPECT_TRUE(!matcher.feed("</s>", &out));
+    EXPECT_EQ(out, "</s>");
+}
+
+/** The reply a stream should leave: cut before the first stop to end. */
+std::string naiveCut(const std::string& text, const std::vector<std::string>& stops) {
+    for (size_t end = 1; end <= text.size(); ++end) {
+        size_t longest = 0;
+        for (const std::string& stop : stops) {
+            if (stop.size() <= end && text.compare(end - stop.size(), stop.size(), stop) == 0) {
+                longest = std::max(longest, stop.size());
+            }
+        }
+        if (longest > 0) return text.substr(0, end - longest);
+    }
+    return text;
+}
+
+void testMatchesNaiveSearch() {
+    const std::vector<std::string> stops = {"</s>", "abab", "bab", "s>a"};
+    const char alphabet[] = "ab</s>";
+    std::mt19937 rng(3);
+    StopMatcher matcher;
+    for (int round = 0; round < 2000; ++round) {
+        std::string text;
+        const int length = static_cast<int>(rng() % 24);
+        for (int i = 0; i < length; ++i) text += alphabet[rng() % 6];
+
+        matcher.build(stops);
+        std::string reply;
+        std::string out;
+        bool stopped = false;
+        for (size_t i = 0; i < text.size() && !stopped;) {
+            const size_t piece = std::min<size_t>(1 + rng() % 3, text.size() - i);
+            stopped = matcher.feed(text.substr(i, piece), &out);
+            reply += out;
+            i += piece;
+        }
+        if (!stopped) matcher.finish(&reply);
+        EXPECT_EQ(reply, naiveCut(text, stops));
+    }
+}
+
+} // namespace
+
+int main() {
+    testHoldsBackPossibleStops();
+    testFailureLinks();
+    testMatchesNaiveSearch();
+    return test::finish("stop_matcher_test");
+}
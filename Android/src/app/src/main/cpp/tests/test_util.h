@@ -0,0 +1,55 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Minimal assertion helpers for the native test executables.
+ * Each test binary returns non-zero if any check failed.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+
+namespace test {
+
+inline int& failures() {
+    static int count = 0;
+    return count;
+}
+
+inline int finish(const char* name) {
+    if (failures() == 0) {
+        std::printf("[ PASSED ] %s\n", name);
+        return 0;
+    }
+    std::printf("[ FAILED ] %s: %d check(s) failed\n", name, failures());
+    return 1;
+}
+
+} // namespace test
+
+#define EXPECT_TRUE(cond)                                                  \
+    do {                                                                   \
+        if (!(cond)) {                                                     \
+            std::printf("%s:%d: expected %s\n", __FILE__, __LINE__, #cond); \
+            ++test::failures();                                            \
+        }                                                                  \
+    } while (0)
+
+#define EXPECT_EQ(a, b) EXPECT_TRUE((a) == (b))
+
+#define EXPECT_NEAR(a, b, tol)                                                       \
+    do {                                                                             \
+        double va_ = (a), vb_ = (b);                                                 \
+        if (std::fabs(va_ - vb_) > (tol)) {                                          \
+            std::printf("%s:%d: %s = %g, expected %g (tol %g)\n", __FILE__, __LINE__, \
+                        #a, va_, vb_, static_cast<double>(tol));                     \
+            ++test::failures();                                                      \
+        }                                                                            \
+    } while (0)
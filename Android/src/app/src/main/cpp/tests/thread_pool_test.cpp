@@ -0,0 +1,114 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "cpu_features.h"
+#include "test_util.h"
+#include "thread_pool.h"
+
+using namespace nimittam;
+
+namespace {
+
+// Every index is run exactly once, whatever the split.
+void testCoversRangeOnce(const ThreadPoolOptions& options) {
+    ThreadPool pool(4, options);
+    EXPECT_EQ(pool.size(), 4);
+    for (int n : {1, 3, 16, 17, 100, 1000, 4864}) {
+        for (int grain : {1, 4, 16, 5000}) {
+            std::vector<std::atomic<int>> hits(n);
+            pool.parallelFor(n, grain, [&](int begin, int end) {
+                EXPECT_TRUE(begin < end && end - begin >= std::min(grain, n - begin));
+                for (int i = begin; i < end; ++i) hits[i].fetch_add(1);
+            });
+            for (int i = 0; i < n; ++i) EXPECT_EQ(hits[i].load(), 1);
+        }
+    }
+}
+
+// Back-to-back small jobs, as in decode, must neither lose a wake-up nor
+// let one job's chunks leak into the next.
+void testManyShortJobs(const ThreadPoolOptions& options) {
+    ThreadPool pool(3, options);
+    std::atomic<long> total{0};
+    for (int job = 0; job < 2000; ++job) {
+        pool.parallelFor(64, 1, [&](int begin, int end) { total += end - begin; });
+    }
+    EXPECT_EQ(total.load(), 2000L * 64);
+}
+
+// A chunk stuck on a slow thread does not hold back the rest: the others
+// take over its run, so the call waits for that chunk alone.
+void testStealsFromSlowThread() {
+    ThreadPool pool(4);
+    std::vector<std::atomic<int>> hits(64);
+    std::atomic<int> slowThreadChunks{0};
+    std::atomic<std::thread::id> slowThread{};
+    pool.parallelFor(64, 1, [&](int begin, int end) {
+        if (begin == 0) {
+            slowThread = std::this_thread::get_id();
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        } else if (std::this_thread::get_id() == slowThread.load()) {
+            slowThreadChunks++;
+        }
+        for (int i = begin; i < end; ++i) hits[i].fetch_add(1);
+    });
+    for (auto& h : hits) EXPECT_EQ(h.load(), 1);
+    // Chunk 0 heads the caller's run; the workers are done with the rest,
+    // the caller's other chunks included, long before it wakes.
+    EXPECT_EQ(slowThreadChunks.load(), 0);
+}
+
+void testSingleThreadRunsInline() {
+    ThreadPool pool(1, ThreadPoolOptions{true, 100});
+    EXPECT_EQ(pool.size(), 1);
+    EXPECT_TRUE(pool.pinnedCpus().empty());
+    const std::thread::id caller = std::this_thread::get_id();
+    int calls = 0;
+    pool.parallelFor(100, 1, [&](int begin, int end) {
+        EXPECT_TRUE(std::this_thread::get_id() == caller);
+        EXPECT_TRUE(begin == 0 && end == 100);
+        ++calls;
+    });
+    EXPECT_EQ(calls, 1);
+}
+
+void testFastestCpus() {
+    const std::vector<int> capacities = cpuCapacities();
+    for (int count = 1; count <= static_cast<int>(capacities.size()); ++count) {
+        const std::vector<int> cpus = fastestCpus(count);
+        if (cpus.empty()) continue;
+        EXPECT_TRUE(static_cast<int>(cpus.size()) >= count);
+        EXPECT_TRUE(cpus.size() < capacities.size());
+        int slowestPicked = capacities[cpus[0]];
+        for (int cpu : cpus) slowestPicked = std::min(slowestPicked, capacities[cpu]);
+        for (size_t cpu = 0; cpu < capacities.size(); ++cpu) {
+            const bool picked = std::find(cpus.begin(), cpus.end(), cpu) != cpus.end();
+            if (!picked) EXPECT_TRUE(capacities[cpu] < slowestPicked);
+        }
+    }
+    EXPECT_TRUE(fastestCpus(0).empty());
+}
+
+} // namespace
+
+int main() {
+    testCoversRangeOnce(ThreadPoolOptions{false, 0});
+    testCoversRangeOnce(ThreadPoolOptions{true, 200});
+    testManyShortJobs(ThreadPoolOptions{false, 0});
+    testManyShortJobs(ThreadPoolOptions{false, 200});
+    testStealsFromSlowThread();
+    testSingleThreadRunsInline();
+    testFastestCpus();
+    return test::finish("thread_pool_test");
+}
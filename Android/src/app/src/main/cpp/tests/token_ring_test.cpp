@@ -0,0 +1,87 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <string>
+#include <thread>
+
+#include "token_ring.h"
+#include "test_util.h"
+
+using namespace nimittam;
+
+namespace {
+
+void testFullRingRejectsAndWraps() {
+    TokenRing ring(1024);
+    EXPECT_EQ(ring.capacity(), 1024u);
+
+    // 100-byte payloads take 112-byte records: 9 fit in 1024 bytes.
+    const std::string payload(100, 'x');
+    int pushed = 0;
+    while (ring.tryPush(pushed, payload.data(), static_cast<uint32_t>(payload.size()))) ++pushed;
+    EXPECT_EQ(pushed, 9);
+
+    int32_t id;
+    std::string bytes;
+    EXPECT_TRUE(ring.tryPop(&id, &bytes));
+    EXPECT_EQ(id, 0);
+    EXPECT_EQ(bytes, payload);
+    EXPECT_TRUE(ring.tryPop(&id, &bytes));
+
+    // 16 bytes remain before the end; a 24-byte record must wrap to 0.
+    EXPECT_TRUE(ring.tryPush(100, "abcdefghijk", 11));
+    EXPECT_EQ(ring.writeIndex(), 1008u + 16u + 24u);
+    for (int expected = 2; expected < 9; ++expected) {
+        EXPECT_TRUE(ring.tryPop(&id, &bytes));
+        EXPECT_EQ(id, expected);
+    }
+    EXPECT_TRUE(ring.tryPop(&id, &bytes));
+    EXPECT_EQ(id, 100);
+    EXPECT_EQ(bytes, std::string("abcdefghijk"));
+    EXPECT_TRUE(!ring.tryPop(&id, &bytes));
+    EXPECT_EQ(ring.readIndex(), ring.writeIndex());
+}
+
+void testConcurrentProducerConsumerKeepsOrder() {
+    TokenRing ring(1024);
+    const int count = 20000;
+
+    std::thread producer([&]() {
+        for (int i = 0; i < count;) {
+            const std::string text = std::to_string(i);
+            if (ring.tryPush(i, text.data(), static_cast<uint32_t>(text.size()))) {
+                ++i;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    int next = 0;
+    bool ordered = true;
+    int32_t id;
+    std::string bytes;
+    while (next < count) {
+        if (!ring.tryPop(&id, &bytes)) {
+            std::this_thread::yield();
+            continue;
+        }
+        ordered = ordered && id == next && bytes == std::to_string(next);
+        ++next;
+    }
+    producer.join();
+    EXPECT_TRUE(ordered);
+}
+
+} // namespace
+
+int main() {
+    testFullRingRejectsAndWraps();
+    testConcurrentProducerConsumerKeepsOrder();
+    return test::finish("token_ring_test");
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Pre-tokenizer splits and BPE encodings against the bundled Qwen2.5
+ * tokenizer.json.
+ */
+
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "model_source.h"
+#include "test_util.h"
+#include "tokenizer.h"
+
+using namespace nimittam;
+
+namespace {
+
+std::vector<std::string> split(const std::string& text) {
+    std::vector<TextSpan> spans;
+    preTokenize(text.data(), text.size(), &spans);
+    std::vector<std::string> pieces;
+    for (const TextSpan& span : spans) pieces.push_back(text.substr(span.offset, span.length));
+    return pieces;
+}
+
+void testPreTokenizerSplits() {
+    EXPECT_TRUE(split("I'll  go\r\n\n  x123") ==
+                (std::vector<std::string>{"I", "'ll", " ", " go", "\r\n\n", " ", " x", "1", "2",
+                                          "3"}));
+    // Ideographic spaces: the last one joins the word after it.
+    EXPECT_TRUE(split("a\xe3\x80\x80\xe3\x80\x80" "b") ==
+                (std::vector<std::string>{"a", "\xe3\x80\x80", "\xe3\x80\x80" "b"}));
+    EXPECT_TRUE(split("x  ?!\n\ny") == (std::vector<std::string>{"x", " ", " ?!\n\n", "y"}));
+    // Malformed UTF-8 counts as punctuation.
+    EXPECT_TRUE(split("a\xff\xe4\xb8 b") == (std::vector<std::string>{"a", "\xff\xe4\xb8", " b"}));
+
+    // Runs on either side of the 16-byte vector width.
+    for (int n = 2; n <= 40; ++n) {
+        const std::string letters(n, 'q');
+        EXPECT_TRUE(split(letters + " y") == (std::vector<std::string>{letters, " y"}));
+        const std::string spaces(n, ' ');
+        EXPECT_TRUE(split("x" + spaces + "\n" + spaces + "y") ==
+                    (std::vector<std::string>{"x", spaces + "\n", spaces.substr(1), " y"}));
+    }
+}
+
+void testKnownEncodings(const Tokenizer& tokenizer) {
+    EXPECT_TRUE(tokenizer.encode("Hello, world!") == (std::vector<int32_t>{9707, 11, 1879, 0}));
+    EXPECT_TRUE(tokenizer.encode("<|im_start|>user\nI'm here<|im_end|>\n") ==
+                (std::vector<int32_t>{151644, 872, 198, 40, 2776, 1588, 151645, 198}));
+    EXPECT_TRUE(tokenizer.encode("    if (x == 42) {\n        return y;\n    }\n") ==
+                (std::vector<int32_t>{262, 421, 320, 87, 621, 220, 19, 17, 8, 341, 286, 470, 379,
+                                      280, 262, 456}));
+    // Longer than a short word, so merged through the heap.
+    EXPECT_TRUE(tokenizer.encode(std::string(51, '=')) == (std::vector<int32_t>{18782, 8707}));
+}
+
+// Whatever goes in comes back out, malformed UTF-8 included.
+void testRoundTrip(const Tokenizer& tokenizer) {
+    const char* alphabet[] = {"a",  "Z",  " ",  "\n", "\r\n", "\t", "'s", "1",
+                              "é",  "中", "😀", "!",  "\xff", "\xe4\xb8", "<|im_end|>",
+                              "\xe2\x80\x83", "==", "    "};
+    const size_t letters = sizeof(alphabet) / sizeof(*alphabet);
+    std::mt19937 rng(42);
+    for (int round = 0; round < 500; ++round) {
+        std::string text;
+        const int parts = static_cast<int>(rng() % 80);
+        for (int i = 0; i < parts; ++i) text += alphabet[rng() % letters];
+        std::string decoded;
+        for (int32_t id : tokenizer.encode(text)) {
+            EXPECT_TRUE(id >= 0 && id < tokenizer.vocabSize());
+            decoded += tokenizer.tokenBytes(id);
+        }
+        EXPECT_EQ(decoded, text);
+    }
+}
+
+} // namespace
+
+int main() {
+    testPreTokenizerSplits();
+
+    ModelSource source;
+    Tokenizer tokenizer;
+    std::string error;
+    if (!source.open(MLC_LLM_TEST_MODEL_DIR, &error) || !tokenizer.load(source, &error)) {
+        std::printf("load failed: %s\n", error.c_str());
+        return 1;
+    }
+    testKnownEncodings(tokenizer);
+    testRoundTrip(tokenizer);
+    return test::finish("tokenizer_test");
+}
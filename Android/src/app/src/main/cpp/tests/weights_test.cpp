@@ -0,0 +1,173 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Shard verification, the load timeline and background warm-up, on tiny
+ * generated models.
+ */
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "md5.h"
+#include "model_source.h"
+#include "test_util.h"
+#include "weight_prefetcher.h"
+#include "weights.h"
+
+using namespace nimittam;
+
+namespace {
+
+std::string md5Of(const std::vector<uint8_t>& data) {
+    Md5 md5;
+    md5.update(data.data(), data.size());
+    return md5.hexDigest();
+}
+
+bool writeFile(const std::string& path, const void* data, size_t size) {
+    FILE* out = std::fopen(path.c_str(), "wb");
+    if (!out) return false;
+    const bool ok = std::fwrite(data, 1, size, out) == size;
+    return std::fclose(out) == 0 && ok;
+}
+
+void testMd5KnownDigests() {
+    EXPECT_EQ(md5Of({}), std::string("d41d8cd98f00b204e9800998ecf8427e"));
+    EXPECT_EQ(md5Of({'a', 'b', 'c'}), std::string("900150983cd24fb0d6963f7d28e17f72"));
+
+    // Fed in uneven pieces so partial blocks are carried between updates.
+    std::vector<uint8_t> data(1000);
+    for (size_t i = 0; i < data.size(); ++i) data[i] = static_cast<uint8_t>(i * 31 + 7);
+    Md5 pieces;
+    for (size_t at = 0, step = 1; at < data.size(); at += step, step = step * 2 + 3) {
+        pieces.update(data.data() + at, std::min(step, data.size() - at));
+    }
+    EXPECT_EQ(pieces.hexDigest(), std::string("2b1e78d5765de9e10495a01412a1cf22"));
+}
+
+/**
+ * One-shard model in [dir] whose manifest records [md5], with a 256-byte
+ * tensor per name in [names] laid out back to back.
+ */
+bool writeModel(const std::string& dir, const std::vector<uint8_t>& shard, const std::string& md5,
+                const std::vector<std::string>& names = {"w"}) {
+    mkdir(dir.c_str(), 0755);
+    std::string records;
+    for (size_t i = 0; i < names.size(); ++i) {
+        records += std::string(i ? ", " : "") + "{\"name\": \"" + names[i] +
+                   "\", \"shape\": [64], \"dtype\": \"uint32\", \"nbytes\": 256, "
+                   "\"byteOffset\": " + std::to_string(i * 256) + "}";
+    }
+    const std::string manifest =
+            "{\"records\": [{\"dataPath\": \"params_shard_0.bin\", \"format\": \"raw-shard\", "
+            "\"nbytes\": " + std::to_string(shard.size()) + ", \"records\": [" + records +
+            "], \"md5sum\": \"" + md5 + "\"}]}";
+    return writeFile(dir + "/ndarray-cache.json", manifest.data(), manifest.size()) &&
+           writeFile(dir + "/params_shard_0.bin", shard.data(), shard.size());
+}
+
+void testShardsAreVerifiedAndTimed() {
+    std::vector<uint8_t> shard(256);
+    for (size_t i = 0; i < shard.size(); ++i) shard[i] = static_cast<uint8_t>(i * 13);
+    const std::string dir = "weights_test_model";
+    EXPECT_TRUE(writeModel(dir, shard, md5Of(shard)));
+
+    ModelSource source;
+    std::string error;
+    EXPECT_TRUE(source.open(dir, &error));
+    WeightStore good;
+    EXPECT_TRUE(good.load(source, WeightLoadOptions(), &error));
+    EXPECT_TRUE(good.find("w") != nullptr);
+    EXPECT_EQ(good.loadTimeline().size(), 1u);
+    if (!good.loadTimeline().empty()) {
+        const ShardLoadTiming& timing = good.loadTimeline()[0];
+        EXPECT_EQ(timing.name, std::string("params_shard_0.bin"));
+        EXPECT_EQ(timing.bytes, shard.size());
+        EXPECT_TRUE(timing.verified);
+        EXPECT_TRUE(timing.startMs <= timing.endMs);
+    }
+
+    // One flipped bit, as from a partial or corrupted copy.
+    shard[100] ^= 0x10;
+    EXPECT_TRUE(writeFile(dir + "/params_shard_0.bin", shard.data(), shard.size()));
+    WeightStore corrupt;
+    EXPECT_TRUE(!corrupt.load(source, WeightLoadOptions(), &error));
+    EXPECT_TRUE(error.find("checksum") != std::string::npos);
+
+    WeightLoadOptions unverified;
+    unverified.verifyChecksums = false;
+    WeightStore trusting;
+    EXPECT_TRUE(trusting.load(source, unverified, &error));
+    EXPECT_TRUE(!trusting.loadTimeline().empty() && !trusting.loadTimeline()[0].verified);
+
+    std::remove((dir + "/ndarray-cache.json").c_str());
+    std::remove((dir + "/params_shard_0.bin").c_str());
+    rmdir(dir.c_str());
+}
+
+void testPrefetcherWarmsLayersAndVerifiesInBackground() {
+    const std::vector<std::string> names = {"model.embed_tokens.q_weight",
+                                            "model.layers.0.mlp.down_proj.q_weight",
+                                            "model.layers.1.mlp.down_proj.q_weight",
+                                            "model.norm.weight"};
+    std::vector<uint8_t> shard(names.size() * 256);
+    for (size_t i = 0; i < shard.size(); ++i) shard[i] = static_cast<uint8_t>(i * 5);
+    const std::string dir = "prefetcher_test_model";
+    EXPECT_TRUE(writeModel(dir, shard, md5Of(shard), names));
+
+    ModelSource source;
+    std::string error;
+    EXPECT_TRUE(source.open(dir, &error));
+    WeightLoadOptions deferred;
+    deferred.verifyChecksums = false;
+    WeightStore weights;
+    EXPECT_TRUE(weights.load(source, deferred, &error));
+    {
+        WeightPrefetcher prefetcher(weights, nullptr, 2);
+        prefetcher.didRun(0);  // as if the model ran layer 0 before the prefetcher got to it
+        prefetcher.start(true);
+        EXPECT_TRUE(prefetcher.waitForLayers(1));
+        EXPECT_TRUE(prefetcher.finish());
+        EXPECT_TRUE(prefetcher.progress() == 1.0f);
+        EXPECT_TRUE(!prefetcher.failed());
+    }
+
+    // Corruption only shows up in the background check.
+    shard[300] ^= 0x01;
+    EXPECT_TRUE(writeFile(dir + "/params_shard_0.bin", shard.data(), shard.size()));
+    WeightStore corrupt;
+    EXPECT_TRUE(corrupt.load(source, deferred, &error));
+    {
+        WeightPrefetcher prefetcher(corrupt, nullptr, 2);
+        prefetcher.start(true);
+        EXPECT_TRUE(!prefetcher.finish());
+        EXPECT_TRUE(prefetcher.failed());
+        EXPECT_TRUE(prefetcher.error().find("checksum") != std::string::npos);
+        EXPECT_TRUE(!prefetcher.waitForLayers(2));
+    }
+
+    std::remove((dir + "/ndarray-cache.json").c_str());
+    std::remove((dir + "/params_shard_0.bin").c_str());
+    rmdir(dir.c_str());
+}
+
+} // namespace
+
+int main() {
+    testMd5KnownDigests();
+    testShardsAreVerifiedAndTimed();
+    testPrefetcherWarmsLayersAndVerifiesInBackground();
+    return test::finish("weights_test");
+}
@@ -62,16 +62,19 @@ class GalleryApplication : Application() {
         Log.d(TAG, "[$operationId] Starting model extraction on thread: $threadName")
         
         try {
-            // Step 1: Extract model weights from APK assets to filesystem
-            val modelPath = ModelAssetExtractor.extractModelIfNeeded(
-                context = this@GalleryApplication,
-                onProgress = { progress, message ->
-                    Log.d(TAG, "[$operationId] Extraction progress: $progress% - $message")
-                }
-            )
-            Log.i(TAG, "[$operationId] Model extracted to: $modelPath")
+            // Step 1: Locate the model. The native CPU engine maps the weights
+            // straight from the APK; MlcLlmEngine extracts them only if the MLC
+            // runtime ends up being used.
+            val modelPath = ModelAssetExtractor.getApkModelLocation(this@GalleryApplication)
+                ?: ModelAssetExtractor.extractModelIfNeeded(
+                    context = this@GalleryApplication,
+                    onProgress = { progress, message ->
+                        Log.d(TAG, "[$operationId] Extraction progress: $progress% - $message")
+                    }
+                )
+            Log.i(TAG, "[$operationId] Model located at: $modelPath")
             
-            // Step 2: Initialize the LLM engine with extracted model
+            // Step 2: Initialize the LLM engine with the model
             Log.i(TAG, "[$operationId] Initializing LLM engine...")
             val initResult = engineLifecycleManager.initialize(modelPath)
             
@@ -46,6 +46,7 @@ class EngineLifecycleManager @Inject constructor(
         private const val TAG = "EngineLifecycleManager"
         private const val DEFAULT_INIT_TIMEOUT_MS = 30000L
         private const val QUEUE_PROCESSING_DELAY_MS = 100L
+        private const val WARM_UP_POLL_MS = 250L
     }
     
     // Initialization coroutine scope
@@ -66,6 +67,9 @@ class EngineLifecycleManager @Inject constructor(
     // Queue processing job
     private var queueProcessingJob: Job? = null
     
+    // Weight warm-up tracking job
+    private var warmUpJob: Job? = null
+    
     // Current engine configuration
     private var currentConfig: LlmEngineConfig = LlmEngineConfig()
     
@@ -81,6 +85,10 @@ class EngineLifecycleManager @Inject constructor(
     val progressFlow: StateFlow<InitializationProgress> = stateManager.progressFlow
     val currentState: EngineState get() = stateManager.getCurrentState()
     
+    // Fraction of model weights resident; READY is reached before this hits 1
+    private val _warmUpFlow = MutableStateFlow(0f)
+    val warmUpFlow: StateFlow<Float> = _warmUpFlow.asStateFlow()
+    
     /**
      * Initialize the engine with the specified model and configuration.
      * 
@@ -131,6 +139,7 @@ class EngineLifecycleManager @Inject constructor(
             when (initResult) {
                 is InitializationResult.Success -> {
                     Log.i(TAG, "Engine initialized successfully: ${initResult.metrics}")
+                    startWarmUpTracking()
                     notifyInitialized(initResult.metrics)
                     Result.success(Unit)
                 }
@@ -271,6 +280,7 @@ class EngineLifecycleManager @Inject constructor(
             // Cancel observation jobs
             stateObservationJob?.cancel()
             queueProcessingJob?.cancel()
+            warmUpJob?.cancel()
             
             // Cancel the scope
             scope.cancel()
@@ -305,6 +315,7 @@ class EngineLifecycleManager @Inject constructor(
         // Cancel jobs
         stateObservationJob?.cancel()
         queueProcessingJob?.cancel()
+        warmUpJob?.cancel()
         
         // Cancel scope
         scope.cancel()
@@ -378,6 +389,37 @@ class EngineLifecycleManager @Inject constructor(
         }
     }
     
+    /**
+     * The native engine turns READY once the embedding and first layers are
+     * resident; follow the rest of the warm-up until it completes or fails.
+     */
+    private fun startWarmUpTracking() {
+        warmUpJob?.cancel()
+        val engineInstance = engine ?: return
+        
+        warmUpJob = scope.launch {
+            val start = System.currentTimeMillis()
+            while (isActive) {
+                val progress = engineInstance.getWarmUpProgress()
+                if (progress < 0f) {
+                    Log.e(TAG, "Model weights failed background verification")
+                    stateManager.transitionTo(
+                        EngineState.ERROR,
+                        reason = "Model weights failed verification",
+                        error = IllegalStateException("Corrupt model weights")
+                    )
+                    break
+                }
+                _warmUpFlow.value = progress
+                if (progress >= 1f) {
+                    Log.i(TAG, "Model weights warm ${System.currentTimeMillis() - start}ms after ready")
+                    break
+                }
+                delay(WARM_UP_POLL_MS)
+            }
+        }
+    }
+    
     private fun startQueueProcessing() {
         if (queueProcessingJob?.isActive == true) {
             return
@@ -12,6 +12,7 @@ import android.content.Context
 import android.os.Build
 import android.util.Log
 import dagger.hilt.android.qualifiers.ApplicationContext
+import java.io.File
 import javax.inject.Inject
 import javax.inject.Singleton
 
@@ -79,8 +80,9 @@ class HardwareDetector @Inject constructor(
             else -> 2048
         }
         
-        // Thread count based on CPU cores
-        val threads = minOf(caps.cpuCores, 8)
+        // One thread per big or mid core: work landing on a little core
+        // only holds the others up. The native pool pins to the same cores.
+        val threads = minOf(caps.performanceCores, 8)
         
         Log.i(TAG, "Optimal config: backend=$backend, gpuLayers=$gpuLayers, context=$contextSize, threads=$threads")
         
@@ -90,7 +92,8 @@ class HardwareDetector @Inject constructor(
             contextSize = contextSize,
             batchSize = if (backend == HardwareBackend.CPU) 256 else 512,
             threads = threads,
-            useFlashAttention = caps.hasVulkan || caps.hasOpenCL,
+            // The native CPU engine has a fused attention kernel too.
+            useFlashAttention = true,
             kvCacheType = if (caps.totalRamMb >= 8000) KvCacheType.F16 else KvCacheType.Q8_0
         )
     }
@@ -104,6 +107,7 @@ class HardwareDetector @Inject constructor(
         val availableRam = memInfo.availMem / (1024 * 1024)
         
         val cpuCores = Runtime.getRuntime().availableProcessors()
+        val performanceCores = detectPerformanceCores(cpuCores)
         
         val hasVulkan = checkVulkanSupport()
         val hasOpenCL = checkOpenCLSupport()
@@ -115,6 +119,7 @@ class HardwareDetector @Inject constructor(
             deviceModel = "${Build.MANUFACTURER} ${Build.MODEL}",
             androidVersion = Build.VERSION.SDK_INT,
             cpuCores = cpuCores,
+            performanceCores = performanceCores,
             cpuArch = Build.SUPPORTED_ABIS.firstOrNull() ?: "unknown",
             totalRamMb = totalRam,
             availableRamMb = availableRam,
@@ -133,6 +138,23 @@ class HardwareDetector @Inject constructor(
         return caps
     }
 
+    /**
+     * Cores at least half as fast as the fastest, going by the kernel's
+     * cpu_capacity; every core where that is not reported.
+     */
+    private fun detectPerformanceCores(cpuCores: Int): Int {
+        val capacities = (0 until cpuCores).mapNotNull { cpu ->
+            try {
+                File("/sys/devices/system/cpu/cpu$cpu/cpu_capacity").readText().trim().toIntOrNull()
+            } catch (e: Exception) {
+                null
+            }
+        }
+        val fastest = capacities.maxOrNull() ?: return cpuCores
+        if (capacities.size != cpuCores || fastest <= 0) return cpuCores
+        return capacities.count { it * 2 >= fastest }
+    }
+
     private fun checkVulkanSupport(): Boolean {
         if (Build.VERSION.SDK_INT < Build.VERSION_CODES.N) return false
         
@@ -228,6 +250,8 @@ data class DeviceCapabilities(
     val deviceModel: String,
     val androidVersion: Int,
     val cpuCores: Int,
+    // Big and mid cores of a big.LITTLE CPU; cpuCores when they are all alike
+    val performanceCores: Int,
     val cpuArch: String,
     val totalRamMb: Long,
     val availableRamMb: Long,
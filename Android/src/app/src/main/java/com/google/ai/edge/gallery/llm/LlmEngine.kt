@@ -59,6 +59,28 @@ interface LlmEngine {
      */
     suspend fun resetContext()
     
+    /**
+     * Save the conversation's KV cache to [path] so it can be resumed
+     * without re-prefilling. Returns false if nothing was written.
+     */
+    suspend fun saveContext(path: String): Boolean
+    
+    /**
+     * Restore a KV cache saved by [saveContext] for the same model.
+     * Continue with [chat] and the conversation's messages: the restored
+     * prefix is reused and only the new turn is prefilled.
+     */
+    suspend fun loadContext(path: String): Boolean
+    
+    /**
+     * Fraction of the model weights resident in memory, 0 to 1. An engine
+     * may report ready before this reaches 1; later layers then load
+     * behind the first prompts. Reaches 1 only after background
+     * verification has passed; negative if it found the weights corrupt
+     * after the engine became ready.
+     */
+    fun getWarmUpProgress(): Float
+    
     /**
      * Release all resources.
      */
@@ -128,7 +150,9 @@ data class GenerationParams(
     val topK: Int = 40,
     val repeatPenalty: Float = 1.1f,
     val stopSequences: List<String> = listOf("<|end|>", "<|eot_id|>", "</s>"),
-    val seed: Long = -1L  // -1 = random
+    val seed: Long = -1L,  // -1 = random
+    val grammar: String? = null,  // GBNF the reply must match
+    val jsonSchema: String? = null  // JSON schema the reply must match; ignored with grammar
 )
 
 /**
@@ -167,7 +191,9 @@ data class InferenceMetrics(
     val tokensPerSecond: Float,
     val promptTokensPerSecond: Float,
     val memoryUsedMb: Long,
-    val backend: HardwareBackend
+    val backend: HardwareBackend,
+    // Time from a stop request until the engine went idle (native CPU engine only)
+    val stopLatencyMs: Double = 0.0
 ) {
     companion object {
         fun empty() = InferenceMetrics(
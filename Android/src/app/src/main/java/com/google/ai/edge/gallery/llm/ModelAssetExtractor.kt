@@ -16,10 +16,13 @@ import java.io.File
 import java.io.FileOutputStream
 
 /**
- * Extracts bundled model weights from APK assets to the app's files directory.
+ * Locates the bundled model weights in the APK, extracting them to the
+ * app's files directory when a runtime needs them on the filesystem.
  * 
- * MLC-LLM requires model weights to be on the filesystem (not in compressed APK assets),
- * so we extract them on first launch.
+ * The native CPU engine reads the stored (noCompress) assets straight out
+ * of the installed APK via [getApkModelLocation], so nothing is copied.
+ * The MLC-LLM runtime needs a real directory, so it still goes through
+ * [extractModelIfNeeded].
  */
 object ModelAssetExtractor {
     private const val TAG = "ModelAssetExtractor"
@@ -30,6 +33,23 @@ object ModelAssetExtractor {
     
     // Config file that indicates a valid extraction
     private const val CONFIG_FILE = "mlc-chat-config.json"
+
+    // Separates the APK path from the asset directory in a model location
+    private const val APK_SEPARATOR = "!/"
+
+    /**
+     * Location of the bundled model inside the installed APK, in the
+     * "<apk>!/assets/<model>" form the native engine maps directly.
+     * Returns null if the model is not bundled.
+     */
+    fun getApkModelLocation(context: Context): String? {
+        val bundled = context.assets.list(MODEL_ID)?.contains(CONFIG_FILE) == true
+        if (!bundled) return null
+        return "${context.applicationInfo.sourceDir}${APK_SEPARATOR}assets/$MODEL_ID"
+    }
+
+    /** Whether [path] points inside the APK rather than at a directory. */
+    fun isApkLocation(path: String): Boolean = path.contains(APK_SEPARATOR)
     
     /**
      * Extract model from assets if not already extracted.
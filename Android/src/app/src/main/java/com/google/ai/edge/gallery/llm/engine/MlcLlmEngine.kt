@@ -13,10 +13,19 @@ import android.util.Log
 import ai.mlc.mlcllm.MLCEngine
 import ai.mlc.mlcllm.OpenAIProtocol.*
 import com.google.ai.edge.gallery.llm.*
+import com.google.ai.edge.gallery.performance.CpuKernelInfo
+import com.google.ai.edge.gallery.performance.ShardLoadTiming
+import com.google.ai.edge.gallery.performance.StartupTracer
+import com.google.ai.edge.gallery.util.memory.AdaptiveMemoryManager
 import dagger.hilt.android.qualifiers.ApplicationContext
 import kotlinx.coroutines.*
+import kotlinx.coroutines.channels.Channel
+import kotlinx.coroutines.channels.ProducerScope
 import kotlinx.coroutines.channels.awaitClose
+import kotlinx.coroutines.channels.consumeEach
 import kotlinx.coroutines.flow.*
+import org.json.JSONArray
+import org.json.JSONObject
 import java.io.File
 import java.util.concurrent.atomic.AtomicBoolean
 import javax.inject.Inject
@@ -33,11 +42,18 @@ import javax.inject.Singleton
  * - Streaming token generation
  * - Conversation context management
  * - Automatic model library loading
+ *
+ * When the CPU backend is selected, inference runs on the in-tree native
+ * engine (libmlc_llm_jni) instead: tokens are decoded on a native thread
+ * and streamed through a shared [NativeTokenRing], with [NativeTokenCallback]
+ * signalling when there is something to drain.
  */
 @Singleton
 class MlcLlmEngine @Inject constructor(
     @param:ApplicationContext private val context: Context,
-    private val lifecycleManager: dagger.Lazy<EngineLifecycleManager>
+    private val lifecycleManager: dagger.Lazy<EngineLifecycleManager>,
+    private val startupTracer: StartupTracer,
+    private val memoryManager: AdaptiveMemoryManager
 ) : LlmEngine {
 
     companion object {
@@ -46,10 +62,41 @@ class MlcLlmEngine @Inject constructor(
         // Model configuration from mlc-app-config.json
         private const val MODEL_ID = "Qwen2.5-0.5B-Instruct-q4f16_1-MLC"
         private const val MODEL_LIB = "qwen2_q4f16_1_dbc9845947d563a3c13bf93ebf315c83"
+
+        // Native CPU engine library built from src/main/cpp
+        private const val NATIVE_LIBRARY = "mlc_llm_jni"
+
+        // nativePrompt(Transcript) result when the request was stopped during prefill
+        private const val PROMPT_CANCELLED = -2
+
+        // Repacked weights, under Context.codeCacheDir
+        private const val REPACK_DIR = "repacked_weights"
+
+        // Smallest context the native engine is shrunk to when memory is short
+        private const val MIN_NATIVE_CONTEXT = 1024
+
+        private const val DEFAULT_SYSTEM_PROMPT = "You are a helpful assistant."
+
+        private val nativeLibraryLoaded: Boolean by lazy {
+            try {
+                System.loadLibrary(NATIVE_LIBRARY)
+                true
+            } catch (e: UnsatisfiedLinkError) {
+                Log.w(TAG, "Native CPU engine unavailable", e)
+                false
+            }
+        }
     }
     
     // MLC-LLM Engine instance
     private var mlcEngine: MLCEngine? = null
+
+    // Native CPU engine handle (0 when the MLC-LLM runtime is in use)
+    @Volatile
+    private var nativeHandle: Long = 0L
+
+    // Token ring shared with the native decode thread; valid while nativeHandle is
+    private var nativeTokenRing: NativeTokenRing? = null
     
     // Engine state management
     private val _state = MutableStateFlow(LlmEngineState.UNINITIALIZED)
@@ -95,9 +142,22 @@ class MlcLlmEngine @Inject constructor(
                 _state.value = LlmEngineState.LOADING
                 
                 Log.i(TAG, "Initializing MLC-LLM engine with model: $modelPath")
+
+                val nativeCpu = config.backend == HardwareBackend.CPU && nativeLibraryLoaded
+                if (nativeCpu && ModelAssetExtractor.isApkLocation(modelPath)) {
+                    // Weights are mapped straight out of the APK
+                    currentModelPath = modelPath
+                    return@withContext initializeNative(modelPath, config)
+                }
+                // The MLC runtime needs the model extracted to a directory
+                val modelDirPath = if (ModelAssetExtractor.isApkLocation(modelPath)) {
+                    ModelAssetExtractor.extractModelIfNeeded(context)
+                } else {
+                    modelPath
+                }
                 
                 // Validate model path - must be a directory containing mlc-chat-config.json
-                val modelDir = File(modelPath)
+                val modelDir = File(modelDirPath)
                 val configFile = File(modelDir, "mlc-chat-config.json")
                 
                 if (!modelDir.exists() || !modelDir.isDirectory) {
@@ -119,6 +179,10 @@ class MlcLlmEngine @Inject constructor(
                 
                 currentModelPath = modelPath
                 
+                if (nativeCpu) {
+                    return@withContext initializeNative(modelDir.absolutePath, config)
+                }
+                
                 // Create MLC Engine
                 mlcEngine = MLCEngine()
                 
@@ -145,7 +209,106 @@ class MlcLlmEngine @Inject constructor(
         }
     }
 
+    /**
+     * Start the in-tree CPU engine on [location]: a model directory or an
+     * "<apk>!/assets/<model>" location whose stored entries are mapped in place.
+     * Kernel-layout weights are cached in the code cache, which Android clears
+     * on app updates along with the kernels that wrote them.
+     */
+    private fun initializeNative(location: String, requested: LlmEngineConfig): Result<Unit> {
+        val config = fitNativeConfig(location, requested)
+        _config = config
+        val repackDir = File(context.codeCacheDir, REPACK_DIR).apply { mkdirs() }
+        val handle = nativeInit(
+            location,
+            config.backend.ordinal,
+            config.gpuLayers,
+            config.contextSize,
+            config.batchSize,
+            config.threads,
+            config.useFlashAttention,
+            config.kvCacheType.ordinal,
+            repackDir.absolutePath
+        )
+        if (handle == 0L) {
+            val error = "Native engine failed to load model: $location"
+            Log.e(TAG, error)
+            _state.value = LlmEngineState.ERROR
+            return Result.failure(IllegalStateException(error))
+        }
+        nativeHandle = handle
+        nativeTokenRing = nativeGetTokenRing(handle)?.let { NativeTokenRing(it) }
+        nativeGetLoadTimeline(handle)?.let { startupTracer.recordModelLoad(parseLoadTimeline(it)) }
+        startupTracer.recordCpuKernels(parseCpuKernels(nativeGetCpuKernels()))
+        isInitialized.set(true)
+        _state.value = LlmEngineState.READY
+        Log.i(TAG, "Native CPU engine initialized")
+        return Result.success(Unit)
+    }
+
+    /**
+     * Halve the context until the native engine's estimated peak working set
+     * fits the memory available now, down to [MIN_NATIVE_CONTEXT]. The KV cache
+     * is the only part that scales with it; weights and the activation arena
+     * are fixed by the model and batch size.
+     */
+    private fun fitNativeConfig(location: String, config: LlmEngineConfig): LlmEngineConfig {
+        var fitted = config
+        while (true) {
+            val json = nativeEstimateMemory(
+                location,
+                fitted.contextSize,
+                fitted.batchSize,
+                fitted.useFlashAttention,
+                fitted.kvCacheType.ordinal
+            ) ?: return fitted
+            val estimate = JSONObject(json)
+            val peakBytes = estimate.getLong("weightBytes") +
+                estimate.getLong("kvCacheBytes") +
+                estimate.getLong("activationBytes")
+            Log.i(TAG, "Native engine peak estimate: ${peakBytes / (1024 * 1024)} MB " +
+                "(context ${estimate.getInt("contextSize")}, " +
+                "${estimate.getLong("activationBytes") / 1024} KB activations)")
+            if (memoryManager.canFitEngine(peakBytes) || fitted.contextSize <= MIN_NATIVE_CONTEXT) {
+                if (fitted.contextSize != config.contextSize) {
+                    Log.w(TAG, "Context reduced from ${config.contextSize} to ${fitted.contextSize} to fit memory")
+                }
+                return fitted
+            }
+            fitted = fitted.copy(contextSize = maxOf(fitted.contextSize / 2, MIN_NATIVE_CONTEXT))
+        }
+    }
+
+    private fun parseLoadTimeline(json: String): List<ShardLoadTiming> {
+        val shards = JSONArray(json)
+        return (0 until shards.length()).map { i ->
+            val shard = shards.getJSONObject(i)
+            ShardLoadTiming(
+                name = shard.getString("name"),
+                bytes = shard.getLong("bytes"),
+                startMs = shard.getDouble("startMs"),
+                mapMs = shard.getDouble("mapMs"),
+                firstTouchMs = shard.getDouble("firstTouchMs"),
+                verifyMs = shard.getDouble("verifyMs"),
+                endMs = shard.getDouble("endMs"),
+                verified = shard.getBoolean("verified")
+            )
+        }
+    }
+
+    private fun parseCpuKernels(json: String): CpuKernelInfo {
+        val kernels = JSONObject(json)
+        return CpuKernelInfo(
+            cpuFeatures = kernels.getString("cpuFeatures").split(',').filter { it.isNotEmpty() },
+            q4Kernels = kernels.getString("q4Kernels"),
+            kvQuantKernels = kernels.getString("kvQuantKernels")
+        )
+    }
+
     override fun generate(prompt: String, params: GenerationParams): Flow<GenerationResult> {
+        if (nativeHandle != 0L) {
+            return generateNative(prompt, params)
+        }
         return callbackFlow {
             // Check if engine is ready
             if (!isInitialized.get() || mlcEngine == null) {
@@ -270,6 +433,177 @@ class MlcLlmEngine @Inject constructor(
         }
     }
 
+    /**
+     * Generation on the native CPU engine. The transcript is rendered with
+     * the qwen2 chat template and prefilled, then a native decode thread
+     * publishes tokens into the token ring. This coroutine drains the ring
+     * whenever the decoder signals, so a slow collector suspends here
+     * instead of stalling the decoder.
+     */
+    private fun generateNative(prompt: String, params: GenerationParams): Flow<GenerationResult> {
+        return callbackFlow {
+            val handle = nativeHandle
+            val ring = nativeTokenRing
+            val startTime = System.currentTimeMillis()
+            val responseBuilder = StringBuilder()
+            val userMessage = ChatCompletionMessage(
+                role = ChatCompletionRole.user,
+                content = prompt
+            )
+            if (ring == null) {
+                send(GenerationResult.Error("Native token ring unavailable"))
+                close()
+                return@callbackFlow
+            }
+
+            val doorbell = Channel<Unit>(Channel.CONFLATED)
+            var completion: InferenceMetrics? = null
+
+            val callback = object : NativeTokenCallback {
+                override fun onTokensAvailable() {
+                    doorbell.trySend(Unit)
+                }
+
+                override fun onComplete(
+                    promptTokens: Int,
+                    generatedTokens: Int,
+                    prefillMs: Double,
+                    decodeMs: Double,
+                    finishReason: Int,
+                    stopLatencyMs: Double
+                ) {
+                    completion = InferenceMetrics(
+                        promptTokens = promptTokens,
+                        generatedTokens = generatedTokens,
+                        promptTimeMs = prefillMs.toLong(),
+                        generationTimeMs = decodeMs.toLong(),
+                        totalTimeMs = System.currentTimeMillis() - startTime,
+                        tokensPerSecond = if (decodeMs > 0) (generatedTokens * 1000.0 / decodeMs).toFloat() else 0f,
+                        promptTokensPerSecond = if (prefillMs > 0) (promptTokens * 1000.0 / prefillMs).toFloat() else 0f,
+                        memoryUsedMb = getMemoryUsage(),
+                        backend = _config.backend,
+                        stopLatencyMs = stopLatencyMs
+                    )
+                    if (finishReason == NativeTokenCallback.FINISH_CANCELLED) {
+                        Log.d(TAG, "Native generation stopped in $stopLatencyMs ms")
+                    } else {
+                        Log.d(TAG, "Native generation finished ($finishReason)")
+                    }
+                    // Closing publishes [completion] to the drain loop below
+                    doorbell.close()
+                }
+            }
+
+            currentGenerationJob = generationScope.launch {
+                val messages = conversationHistory.toMutableList()
+                messages.add(userMessage)
+
+                // The whole transcript every turn: native keeps the KV cache for
+                // the prefix it has already seen and prefills only the new turn
+                val promptTokens = nativePromptTranscript(handle, buildChatTranscript(messages))
+                if (promptTokens == PROMPT_CANCELLED) {
+                    close()
+                    return@launch
+                }
+                if (promptTokens < 0) {
+                    val reason = if (nativeGetWarmUpProgress(handle) < 0f) {
+                        "Model weights failed verification; reinstall the model"
+                    } else {
+                        "Conversation exceeds the context window"
+                    }
+                    send(GenerationResult.Error(reason))
+                    close()
+                    return@launch
+                }
+                // Skip anything a cancelled run left behind
+                ring.skipTo(nativeRingPoll(handle, ring.readIndex))
+                val droppedBefore = ring.droppedTokens
+
+                val started = nativeStartGeneration(
+                    handle,
+                    params.maxTokens,
+                    params.temperature,
+                    params.topP,
+                    params.topK,
+                    params.repeatPenalty,
+                    params.seed,
+                    params.stopSequences.toTypedArray(),
+                    params.grammar,
+                    params.jsonSchema,
+                    callback
+                )
+                if (!started) {
+                    val reason = if (params.grammar != null || params.jsonSchema != null) {
+                        "Native generation failed to start; check the grammar or JSON schema"
+                    } else {
+                        "Native generation failed to start"
+                    }
+                    send(GenerationResult.Error(reason))
+                    close()
+                    return@launch
+                }
+
+                doorbell.consumeEach {
+                    drainTokenRing(handle, ring, responseBuilder)
+                }
+                drainTokenRing(handle, ring, responseBuilder)
+                nativeRingPoll(handle, ring.readIndex)
+
+                val dropped = ring.droppedTokens - droppedBefore
+                if (dropped > 0) {
+                    Log.w(TAG, "Token ring overflow: $dropped tokens dropped")
+                }
+                if (responseBuilder.isNotEmpty()) {
+                    conversationHistory.add(userMessage)
+                    conversationHistory.add(ChatCompletionMessage(
+                        role = ChatCompletionRole.assistant,
+                        content = responseBuilder.toString()
+                    ))
+                }
+                completion?.let { metrics ->
+                    _lastMetrics = metrics
+                    Log.d(TAG, "Native generation: ${metrics.tokensPerSecond} tok/s")
+                    send(GenerationResult.Complete(metrics))
+                }
+                close()
+            }
+
+            awaitClose {
+                currentGenerationJob?.cancel()
+                nativeStopGeneration(handle)
+            }
+        }
+    }
+
+    private suspend fun ProducerScope<GenerationResult>.drainTokenRing(
+        handle: Long,
+        ring: NativeTokenRing,
+        responseBuilder: StringBuilder
+    ) {
+        // Null while the new tokens end partway through a character
+        val batch = ring.read(nativeRingPoll(handle, ring.readIndex)) ?: return
+        responseBuilder.append(batch.text)
+        send(GenerationResult.Token(batch.text))
+    }
+
+    /**
+     * Render messages with the qwen2 chat template, ending with the
+     * assistant header so the model continues as the assistant.
+     */
+    private fun buildChatTranscript(messages: List<ChatCompletionMessage>): String {
+        val builder = StringBuilder()
+        if (messages.none { it.role == ChatCompletionRole.system }) {
+            builder.append("<|im_start|>system\n").append(DEFAULT_SYSTEM_PROMPT).append("<|im_end|>\n")
+        }
+        messages.forEach { message ->
+            builder.append("<|im_start|>").append(message.role.name).append('\n')
+                .append(message.content ?: "")
+                .append("<|im_end|>\n")
+        }
+        builder.append("<|im_start|>assistant\n")
+        return builder.toString()
+    }
+
     override fun chat(messages: List<ChatMessage>, params: GenerationParams): Flow<GenerationResult> {
         // Convert ChatMessage to OpenAI format and generate
         val prompt = messages.lastOrNull { it.role == ChatRole.USER }?.content ?: ""
@@ -291,6 +625,8 @@ class MlcLlmEngine @Inject constructor(
     }
 
     override suspend fun stopGeneration() {
+        // Native first: it interrupts a blocking prefill the job cannot
+        nativeHandle.takeIf { it != 0L }?.let { nativeStopGeneration(it) }
         currentGenerationJob?.cancel()
         // MLC-LLM handles stop internally when channel is closed
     }
@@ -298,11 +634,35 @@ class MlcLlmEngine @Inject constructor(
     override suspend fun resetContext() {
         withContext(Dispatchers.IO) {
             mlcEngine?.reset()
+            nativeHandle.takeIf { it != 0L }?.let { nativeResetContext(it) }
             conversationHistory.clear()
             Log.d(TAG, "Context reset")
         }
     }
 
+    override suspend fun saveContext(path: String): Boolean = withContext(Dispatchers.IO) {
+        val handle = nativeHandle.takeIf { it != 0L } ?: return@withContext false
+        nativeSaveContext(handle, path)
+    }
+
+    override suspend fun loadContext(path: String): Boolean = withContext(Dispatchers.IO) {
+        val handle = nativeHandle.takeIf { it != 0L } ?: return@withContext false
+        if (!File(path).exists()) return@withContext false
+        nativeLoadContext(handle, path).also { loaded ->
+            if (loaded) {
+                // chat() supplies the messages; the transcript then matches the cache
+                conversationHistory.clear()
+                Log.d(TAG, "Context restored from $path")
+            }
+        }
+    }
+
+    override fun getWarmUpProgress(): Float {
+        // The MLC runtime loads everything up front
+        val handle = nativeHandle.takeIf { it != 0L } ?: return if (isInitialized.get()) 1f else 0f
+        return nativeGetWarmUpProgress(handle)
+    }
+
     override suspend fun release() {
         generationScope.cancel()
         
@@ -311,6 +671,9 @@ class MlcLlmEngine @Inject constructor(
                 currentGenerationJob?.cancelAndJoin()
                 mlcEngine?.unload()
                 mlcEngine = null
+                nativeTokenRing = null
+                nativeHandle.takeIf { it != 0L }?.let { nativeRelease(it) }
+                nativeHandle = 0L
                 isInitialized.set(false)
                 _state.value = LlmEngineState.RELEASED
                 Log.i(TAG, "MLC-LLM engine released")
@@ -376,10 +739,70 @@ class MlcLlmEngine @Inject constructor(
     /**
      * Check if the engine can accept prompts.
      */
-    fun isReady(): Boolean = isInitialized.get() && mlcEngine != null
+    fun isReady(): Boolean = isInitialized.get() && (mlcEngine != null || nativeHandle != 0L)
 
     private fun getMemoryUsage(): Long {
         val runtime = Runtime.getRuntime()
         return (runtime.totalMemory() - runtime.freeMemory()) / (1024 * 1024)
     }
+
+    // Native CPU engine (src/main/cpp/mlc_llm_jni.cpp)
+
+    private external fun nativeInit(
+        modelPath: String,
+        backend: Int,
+        gpuLayers: Int,
+        contextSize: Int,
+        batchSize: Int,
+        threads: Int,
+        useFlashAttention: Boolean,
+        kvCacheType: Int,
+        repackDir: String
+    ): Long
+
+    private external fun nativeEstimateMemory(
+        modelPath: String,
+        contextSize: Int,
+        batchSize: Int,
+        useFlashAttention: Boolean,
+        kvCacheType: Int
+    ): String?
+
+    private external fun nativePrompt(handle: Long, prompt: String): Int
+
+    private external fun nativePromptTranscript(handle: Long, transcript: String): Int
+
+    private external fun nativeStartGeneration(
+        handle: Long,
+        maxTokens: Int,
+        temperature: Float,
+        topP: Float,
+        topK: Int,
+        repeatPenalty: Float,
+        seed: Long,
+        stopSequences: Array<String>,
+        grammar: String?,
+        jsonSchema: String?,
+        callback: NativeTokenCallback
+    ): Boolean
+
+    private external fun nativeGetTokenRing(handle: Long): java.nio.ByteBuffer?
+
+    private external fun nativeRingPoll(handle: Long, readIndex: Long): Long
+
+    private external fun nativeGetLoadTimeline(handle: Long): String?
+
+    private external fun nativeGetWarmUpProgress(handle: Long): Float
+
+    private external fun nativeGetCpuKernels(): String
+
+    private external fun nativeStopGeneration(handle: Long)
+
+    private external fun nativeResetContext(handle: Long)
+
+    private external fun nativeSaveContext(handle: Long, path: String): Boolean
+
+    private external fun nativeLoadContext(handle: Long, path: String): Boolean
+
+    private external fun nativeRelease(handle: Long)
 }
@@ -0,0 +1,51 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+package com.google.ai.edge.gallery.llm.engine
+
+/**
+ * Receiver for the native streaming decode loop (nativeStartGeneration).
+ *
+ * Token text does not pass through this interface: the decoder writes
+ * it into the engine's [NativeTokenRing] and only signals here. Both
+ * methods are invoked on the native decode thread, never on the
+ * caller's thread. Implementations must return quickly (e.g. post to a
+ * conflated channel) and drain the ring elsewhere.
+ */
+interface NativeTokenCallback {
+
+    /**
+     * New tokens were published to the ring. Signals are coalesced to
+     * at most one per batch; at low decode rates that is one per token.
+     */
+    fun onTokensAvailable()
+
+    /**
+     * Called exactly once when generation ends, after the last token
+     * has been published to the ring.
+     * [finishReason] is one of the FINISH_* constants. For
+     * FINISH_CANCELLED, [stopLatencyMs] is the time from the stop
+     * request until the decoder went idle; otherwise it is 0.
+     */
+    fun onComplete(
+        promptTokens: Int,
+        generatedTokens: Int,
+        prefillMs: Double,
+        decodeMs: Double,
+        finishReason: Int,
+        stopLatencyMs: Double
+    )
+
+    companion object {
+        const val FINISH_STOP = 1
+        const val FINISH_LENGTH = 2
+        const val FINISH_CONTEXT_FULL = 3
+        const val FINISH_CANCELLED = 4
+        const val FINISH_STOP_SEQUENCE = 5
+    }
+}
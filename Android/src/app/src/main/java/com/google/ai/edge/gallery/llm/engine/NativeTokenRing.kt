@@ -0,0 +1,97 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+package com.google.ai.edge.gallery.llm.engine
+
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+
+/**
+ * Consumer side of the native token ring (src/main/cpp/engine/token_ring.h).
+ *
+ * The ring is a direct ByteBuffer owned by the native engine; records
+ * are read in place. Index synchronization goes through the engine's
+ * nativeRingPoll, which release-stores [readIndex] and acquire-loads the
+ * producer's write index, so only one thread may drain a ring at a time.
+ * The buffer must not be touched after the engine handle is released.
+ * Records hold whole characters (the producer holds back a partial
+ * one), so each batch decodes as UTF-8 on its own.
+ */
+internal class NativeTokenRing(buffer: ByteBuffer) {
+
+    /**
+     * Text read by one [read] call and the tokens it came from; the
+     * final flush of a run carries text without a token.
+     */
+    class Batch(val text: String, val tokenCount: Int)
+
+    private val buffer: ByteBuffer = buffer.order(ByteOrder.nativeOrder())
+    private val bytes: ByteBuffer = buffer.duplicate()
+    private val capacity: Int = this.buffer.getInt(CAPACITY_OFFSET)
+    private var scratch = ByteArray(4096)
+
+    /** Everything before this index has been consumed. */
+    var readIndex: Long = 0L
+        private set
+
+    /** Tokens the decoder discarded because the ring stayed full. */
+    val droppedTokens: Long get() = buffer.getLong(DROPPED_OFFSET)
+
+    /** Times the decoder found the ring full and parked a token. */
+    val backpressureEvents: Long get() = buffer.getLong(BACKPRESSURE_OFFSET)
+
+    init {
+        require(this.buffer.getInt(0) == MAGIC) { "Not a native token ring" }
+    }
+
+    /** Discard everything up to [writeIndex], e.g. leftovers of a cancelled run. */
+    fun skipTo(writeIndex: Long) {
+        readIndex = maxOf(readIndex, writeIndex)
+    }
+
+    /**
+     * Read all records up to [writeIndex] (from nativeRingPoll). Returns
+     * null when they hold no text, as for tokens ending partway through a
+     * character; they are consumed all the same.
+     */
+    fun read(writeIndex: Long): Batch? {
+        var length = 0
+        var tokens = 0
+        val mask = capacity - 1L
+        while (readIndex < writeIndex) {
+            val offset = HEADER_BYTES + (readIndex and mask).toInt()
+            val tokenId = buffer.getInt(offset)
+            if (tokenId == WRAP_MARKER) {
+                readIndex += capacity - (readIndex and mask)
+                continue
+            }
+            val size = buffer.getInt(offset + 4)
+            if (length + size > scratch.size) {
+                scratch = scratch.copyOf(maxOf(scratch.size * 2, length + size))
+            }
+            bytes.position(offset + RECORD_HEADER_BYTES)
+            bytes.get(scratch, length, size)
+            length += size
+            if (tokenId != NO_TOKEN) tokens++
+            readIndex += (RECORD_HEADER_BYTES + size + 7) and 7.inv()
+        }
+        if (length == 0) return null
+        return Batch(String(scratch, 0, length, Charsets.UTF_8), tokens)
+    }
+
+    private companion object {
+        const val MAGIC = 0x47524B54
+        const val WRAP_MARKER = Int.MIN_VALUE
+        const val NO_TOKEN = -1
+        const val HEADER_BYTES = 256
+        const val CAPACITY_OFFSET = 4
+        const val DROPPED_OFFSET = 192
+        const val BACKPRESSURE_OFFSET = 200
+        const val RECORD_HEADER_BYTES = 8
+    }
+}
@@ -40,6 +40,40 @@ data class StartupPhaseData(
     val durationMs: Long
 )
 
+/**
+ * How one model weight shard was loaded by the native engine.
+ * Times are ms from the start of the weight load.
+ * @property name Shard file name from the model manifest
+ * @property bytes Shard size
+ * @property startMs When loading of this shard began
+ * @property mapMs Opening and mapping the shard
+ * @property firstTouchMs Faulting in its first page
+ * @property verifyMs Checking it against the manifest checksum (0 if not verified)
+ * @property endMs When the shard was ready
+ */
+data class ShardLoadTiming(
+    val name: String,
+    val bytes: Long,
+    val startMs: Double,
+    val mapMs: Double,
+    val firstTouchMs: Double,
+    val verifyMs: Double,
+    val endMs: Double,
+    val verified: Boolean
+)
+
+/**
+ * Kernel variants the native engine picked for this device's CPU.
+ * @property cpuFeatures Instruction set extensions detected at runtime, e.g. "asimd,asimddp"
+ * @property q4Kernels Variant running the q4 weight matrix kernels, e.g. "armv8.2-a"
+ * @property kvQuantKernels Variant running the quantized KV cache kernels, e.g. "neon"
+ */
+data class CpuKernelInfo(
+    val cpuFeatures: List<String>,
+    val q4Kernels: String,
+    val kvQuantKernels: String
+)
+
 /**
  * Complete startup trace report.
  * @property totalStartupTimeMs Total time from app start to content ready
@@ -63,6 +97,8 @@ class StartupTracer @Inject constructor() {
     private val phases = mutableListOf<StartupPhaseData>()
     private var lastPhaseTime = appStartTime
     private var isComplete = false
+    @Volatile private var modelLoad: List<ShardLoadTiming> = emptyList()
+    @Volatile private var cpuKernels: CpuKernelInfo? = null
 
     /**
      * Record a startup phase completion.
@@ -114,6 +150,46 @@ class StartupTracer @Inject constructor() {
         return SystemClock.elapsedRealtime() - appStartTime
     }
 
+    /**
+     * Record the per-shard weight load timeline of the model engine.
+     * Unlike phases, this is accepted after startup completes, since the
+     * model loads in the background.
+     */
+    fun recordModelLoad(shards: List<ShardLoadTiming>) {
+        modelLoad = shards
+        val wallMs = shards.maxOfOrNull { it.endMs } ?: 0.0
+        Log.d(TAG, "Model weights: ${shards.size} shards in ${"%.0f".format(wallMs)}ms")
+        shards.forEach {
+            Log.d(
+                TAG, "  ${it.name}: ${it.bytes / 1024}KB start ${"%.1f".format(it.startMs)} " +
+                    "map ${"%.2f".format(it.mapMs)} touch ${"%.2f".format(it.firstTouchMs)} " +
+                    "verify ${"%.1f".format(it.verifyMs)} end ${"%.1f".format(it.endMs)}ms"
+            )
+        }
+    }
+
+    /**
+     * Weight load timeline recorded by [recordModelLoad], empty if none.
+     */
+    fun getModelLoadTimeline(): List<ShardLoadTiming> = modelLoad
+
+    /**
+     * Record which kernel variants the native engine selected, so slow
+     * devices can be told apart from slow kernel paths.
+     */
+    fun recordCpuKernels(info: CpuKernelInfo) {
+        cpuKernels = info
+        Log.i(
+            TAG, "CPU kernels: q4 ${info.q4Kernels}, kv ${info.kvQuantKernels} " +
+                "(features: ${info.cpuFeatures.joinToString(",")})"
+        )
+    }
+
+    /**
+     * Kernel variants recorded by [recordCpuKernels], null if none.
+     */
+    fun getCpuKernels(): CpuKernelInfo? = cpuKernels
+
     /**
      * Check if startup is complete.
      */
@@ -289,6 +289,19 @@ class AdaptiveMemoryManager @Inject constructor(
                stats.memoryPressure != MemoryPressure.CRITICAL
     }
 
+    /**
+     * Check if a native LLM engine fits in memory, given the peak working set
+     * it reports before loading (weights, KV cache for the full context and
+     * activation arena).
+     *
+     * @param peakBytes Estimated peak working set in bytes
+     * @return true if the engine can be loaded
+     */
+    fun canFitEngine(peakBytes: Long): Boolean {
+        val requiredMB = (peakBytes + 1024 * 1024 - 1) / (1024 * 1024)
+        return canPerformOperation(requiredMB.coerceAtMost(Int.MAX_VALUE.toLong()).toInt())
+    }
+
     /**
      * Get recommended image decode size based on current profile.
      */
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2025 Tanmay Patil
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+package com.google.ai.edge.gallery.llm.engine
+
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+import org.junit.Assert.*
+import org.junit.Test
+
+class NativeTokenRingTest {
+
+    /** Producer side of the layout in token_ring.h, enough to feed a reader. */
+    private class Producer(capacity: Int = 1024) {
+        val buffer: ByteBuffer = ByteBuffer.allocateDirect(HEADER_BYTES + capacity)
+            .order(ByteOrder.nativeOrder())
+        var writeIndex = 0L
+            private set
+
+        init {
+            buffer.putInt(0, MAGIC)
+            buffer.putInt(4, capacity)
+        }
+
+        fun push(tokenId: Int, text: String) {
+            val bytes = text.toByteArray(Charsets.UTF_8)
+            val offset = HEADER_BYTES + writeIndex.toInt()
+            buffer.putInt(offset, tokenId)
+            buffer.putInt(offset + 4, bytes.size)
+            bytes.forEachIndexed { i, b -> buffer.put(offset + 8 + i, b) }
+            writeIndex += (8 + bytes.size + 7) and 7.inv()
+        }
+    }
+
+    @Test
+    fun `tokens without text are consumed but yield no batch`() {
+        val producer = Producer()
+        val ring = NativeTokenRing(producer.buffer)
+        producer.push(7, "")
+
+        assertNull(ring.read(producer.writeIndex))
+        assertEquals(producer.writeIndex, ring.readIndex)
+    }
+
+    @Test
+    fun `stream ending on a held-back tail delivers the tail`() {
+        val producer = Producer()
+        val ring = NativeTokenRing(producer.buffer)
+        producer.push(5, "Hello")
+        producer.push(6, "")
+
+        val first = ring.read(producer.writeIndex)
+        assertEquals("Hello", first?.text)
+        assertEquals(2, first?.tokenCount)
+
+        // The final flush after the last token: text belonging to no token
+        producer.push(NO_TOKEN, ", wor�")
+        val tail = ring.read(producer.writeIndex)
+        assertNotNull(tail)
+        assertEquals(", wor�", tail?.text)
+        assertEquals(0, tail?.tokenCount)
+        assertNull(ring.read(producer.writeIndex))
+    }
+
+    private companion object {
+        const val MAGIC = 0x47524B54
+        const val NO_TOKEN = -1
+        const val HEADER_BYTES = 256
+    }
+}